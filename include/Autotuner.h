@@ -0,0 +1,448 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "PragmaticMinis.h"
+#include "Profiler.h"
+
+/// Operators whose parameters are tuned, each keyed separately.
+enum AutotunerOperator{
+  AUTOTUNE_COARSEN,
+  AUTOTUNE_REFINE,
+  AUTOTUNE_SWAP,
+  AUTOTUNE_SMART_LAPLACIAN,
+  AUTOTUNE_OPTIMISATION_LINF,
+  AUTOTUNE_LAPLACIAN,
+  AUTOTUNE_NOPERATORS
+};
+
+/// Loop schedules, numbered as omp_sched_t.
+enum AutotunerSchedule{
+  AUTOTUNE_STATIC=1,
+  AUTOTUNE_DYNAMIC=2,
+  AUTOTUNE_GUIDED=3
+};
+
+/// Parameters of an operator. Each operator ignores those it does not have.
+struct TuningParameters{
+  int defop_scaling_factor; ///< deferred operation queues per thread
+  int schedule;             ///< AutotunerSchedule of the worksharing loops
+  int chunk;                ///< chunk size of the schedule, 0 for the default
+  int max_colour;           ///< independent sets, raised to the largest vertex degree plus one
+  int initial_colours;      ///< initial guess of the chromatic number in Colour::GebremedhinManne
+
+  bool operator==(const TuningParameters &p) const{
+    return defop_scaling_factor==p.defop_scaling_factor && schedule==p.schedule && chunk==p.chunk &&
+      max_colour==p.max_colour && initial_colours==p.initial_colours;
+  }
+};
+
+/*! \brief Tunes the scheduling parameters of the operators at run time.
+ *
+ * Until enable() is called every operator runs with defaults(). Once
+ * enabled, the parameters of each operator, dimension and number of
+ * threads are searched one at a time: every candidate value of a
+ * parameter is used for the next calls of the operator, the value
+ * with the least time per unit of work is kept, and the search moves
+ * on to the next parameter. When all have been searched the result is added
+ * to the cache file, and later runs which enable the same file start
+ * from it without searching again.
+ *
+ * The work of a call is the number of operations it did: collapses,
+ * splits or flips. Successive calls of these operators do less and
+ * less work on a mesh that is converging, so the time per vertex would
+ * favour whichever candidates are timed last. Calls which do no work
+ * are not timed. The time per operation still includes the colouring
+ * and the scans over the mesh, which do not shrink with the work, so
+ * it is only comparable between calls on meshes of similar size, such
+ * as the first timesteps of a simulation. Smoothing moves every vertex
+ * each call, so its work stays the number of vertices.
+ *
+ * The times are those of the local process, so each MPI process tunes
+ * on its own and rank 0 writes the cache. Use samples>1 to time each
+ * candidate over several calls and keep the fastest.
+ */
+class Autotuner{
+ public:
+  /// The process wide autotuner.
+  static Autotuner &instance(){
+    static Autotuner autotuner;
+    return autotuner;
+  }
+
+  /// The parameters fixed in the code before autotuning was added.
+  static TuningParameters defaults(AutotunerOperator op, int dim){
+    TuningParameters parameters;
+    parameters.defop_scaling_factor = (op==AUTOTUNE_COARSEN)?4:32;
+    parameters.schedule = AUTOTUNE_GUIDED;
+    parameters.chunk = 0;
+    parameters.max_colour = (dim==2)?16:64;
+    parameters.initial_colours = 15;
+    return parameters;
+  }
+
+  static const char *get_operator_name(int op){
+    static const char *names[] = {"coarsen", "refine", "swap", "smart_laplacian", "optimisation_linf", "laplacian"};
+    return (op>=0 && op<AUTOTUNE_NOPERATORS)?names[op]:NULL;
+  }
+
+  static const char *get_schedule_name(int schedule){
+    static const char *names[] = {"static", "dynamic", "guided"};
+    return (schedule>=AUTOTUNE_STATIC && schedule<=AUTOTUNE_GUIDED)?names[schedule-1]:NULL;
+  }
+
+  /*! Start tuning, reading any results already in cache_file.
+   * @param samples number of calls each candidate is timed over.
+   * @return false if cache_file exists but cannot be parsed.
+   */
+  bool enable(const std::string &cache_file, int samples=1){
+    // Parse the whole cache before changing any state, so a rejected
+    // cache leaves tuning as it was and is never overwritten.
+    std::map<Key, TuningParameters> cached;
+    std::ifstream in(cache_file.c_str());
+    std::string line;
+    for(int lineno=1;in.is_open() && std::getline(in, line);lineno++){
+      if(line.empty() || line[0]=='#')
+        continue;
+
+      std::istringstream fields(line);
+      std::string op_name, schedule_name;
+      int op, dim, nthreads;
+      TuningParameters parameters;
+      if(!(fields>>op_name>>dim>>nthreads>>parameters.defop_scaling_factor>>schedule_name>>parameters.chunk
+           >>parameters.max_colour>>parameters.initial_colours) ||
+         (op=lookup(op_name, &get_operator_name, 0, AUTOTUNE_NOPERATORS))<0 ||
+         (parameters.schedule=lookup(schedule_name, &get_schedule_name, AUTOTUNE_STATIC, AUTOTUNE_GUIDED+1))<0 ||
+         parameters.defop_scaling_factor<1 || parameters.max_colour<1 ||
+         parameters.initial_colours<1 || parameters.initial_colours>63){
+        std::cerr<<"ERROR: cannot parse line "<<lineno<<" of autotuning cache "<<cache_file<<std::endl;
+        return false;
+      }
+      cached[Key(op, dim, nthreads)] = parameters;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    filename = cache_file;
+    nsamples = std::max(samples, 1);
+    searches.clear();
+    tuned.swap(cached);
+    enabled = true;
+
+    return true;
+  }
+
+  /// Stop tuning; the operators return to the defaults.
+  void disable(){
+    std::lock_guard<std::mutex> lock(mutex);
+    enabled = false;
+    searches.clear();
+    tuned.clear();
+  }
+
+  bool is_enabled() const{
+    return enabled;
+  }
+
+  /// Get the tuned parameters of an operator, returning false if it has not been tuned.
+  bool get_tuned(AutotunerOperator op, int dim, int nthreads, TuningParameters &parameters){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<Key, TuningParameters>::const_iterator it=tuned.find(Key(op, dim, nthreads));
+    if(it==tuned.end())
+      return false;
+    parameters = it->second;
+    return true;
+  }
+
+  /*! Parameters for the next call of an operator.
+   * @param timed set if the call is to be timed and passed to end().
+   */
+  TuningParameters begin(AutotunerOperator op, int dim, int nthreads, bool &timed){
+    timed = false;
+    if(!enabled)
+      return defaults(op, dim);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!enabled)
+      return defaults(op, dim);
+
+    Key key(op, dim, nthreads);
+    std::map<Key, TuningParameters>::const_iterator it=tuned.find(key);
+    if(it!=tuned.end())
+      return it->second;
+
+    std::map<Key, Search>::iterator search=searches.find(key);
+    if(search==searches.end())
+      search = searches.insert(std::make_pair(key, Search(op, dim))).first;
+
+    timed = true;
+    return search->second.candidate();
+  }
+
+  /// Record the time taken by a call for which begin() set timed, unless it did no work.
+  void end(AutotunerOperator op, int dim, int nthreads, const TuningParameters &parameters, double seconds, size_t work){
+    if(work==0)
+      return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Key key(op, dim, nthreads);
+    std::map<Key, Search>::iterator search=searches.find(key);
+    if(!enabled || search==searches.end() || !(search->second.candidate()==parameters))
+      return;
+
+    if(search->second.record(seconds/work, nsamples)){
+      tuned[key] = search->second.best;
+      searches.erase(search);
+      write();
+    }
+  }
+
+ private:
+  typedef std::tuple<int, int, int> Key;
+
+  /// Search over one parameter at a time, starting from the defaults.
+  struct Search{
+    Search(AutotunerOperator op, int dim) : best(defaults(op, dim)), axis(0), candidate_no(0), sample(0){
+      int schedules[][2] = {{AUTOTUNE_GUIDED, 0}, {AUTOTUNE_STATIC, 0}, {AUTOTUNE_DYNAMIC, 64}};
+      for(int i=0;i<3;i++){
+        TuningParameters p = best;
+        p.schedule = schedules[i][0];
+        p.chunk = schedules[i][1];
+        add(0, p);
+      }
+
+      if(op==AUTOTUNE_COARSEN || op==AUTOTUNE_REFINE || op==AUTOTUNE_SWAP){
+        for(int factor=2;factor<=64;factor*=2){
+          TuningParameters p = best;
+          p.defop_scaling_factor = factor;
+          add(1, p);
+        }
+      }
+
+      if(op==AUTOTUNE_COARSEN || op==AUTOTUNE_SWAP){
+        for(int scale=1;scale<=4;scale*=2){
+          TuningParameters p = best;
+          p.max_colour = (dim==2?8:32)*scale;
+          add(2, p);
+        }
+      }
+
+      if(op==AUTOTUNE_SMART_LAPLACIAN || op==AUTOTUNE_OPTIMISATION_LINF || op==AUTOTUNE_LAPLACIAN){
+        int colours[] = {7, 11, 15, 23, 31};
+        for(int i=0;i<5;i++){
+          TuningParameters p = best;
+          p.initial_colours = colours[i];
+          add(2, p);
+        }
+      }
+      cost.resize(candidates[0].size(), std::numeric_limits<double>::max());
+    }
+
+    void add(int a, const TuningParameters &p){
+      if((int)candidates.size()<=a)
+        candidates.resize(a+1);
+      candidates[a].push_back(p);
+    }
+
+    /// The parameters to time next: the best so far, with the current parameter varied.
+    TuningParameters candidate() const{
+      TuningParameters p = best;
+      const TuningParameters &c = candidates[axis][candidate_no];
+      switch(axis){
+      case 0: p.schedule = c.schedule; p.chunk = c.chunk; break;
+      case 1: p.defop_scaling_factor = c.defop_scaling_factor; break;
+      default: p.max_colour = c.max_colour; p.initial_colours = c.initial_colours;
+      }
+      return p;
+    }
+
+    /// Record the cost of the candidate, returning true when the search is over.
+    bool record(double c, int nsamples){
+      cost[candidate_no] = std::min(cost[candidate_no], c);
+      if(++sample<nsamples)
+        return false;
+
+      sample = 0;
+      if(++candidate_no<(int)candidates[axis].size())
+        return false;
+
+      candidate_no = std::min_element(cost.begin(), cost.end())-cost.begin();
+      best = candidate();
+      candidate_no = 0;
+      while(++axis<(int)candidates.size() && candidates[axis].empty());
+      if(axis==(int)candidates.size())
+        return true;
+      cost.assign(candidates[axis].size(), std::numeric_limits<double>::max());
+      return false;
+    }
+
+    TuningParameters best;
+    std::vector< std::vector<TuningParameters> > candidates;
+    std::vector<double> cost;
+    int axis, candidate_no, sample;
+  };
+
+  Autotuner() : enabled(false), nsamples(1){}
+
+  static int lookup(const std::string &name, const char *(*get_name)(int), int begin, int end){
+    for(int i=begin;i<end;i++)
+      if(name==get_name(i))
+        return i;
+    return -1;
+  }
+
+  /// Write every tuned result to the cache file on rank 0.
+  void write() const{
+    int rank=0;
+#ifdef HAVE_MPI
+    int initialized;
+    MPI_Initialized(&initialized);
+    if(initialized)
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+    if(rank!=0)
+      return;
+
+    std::ofstream out(filename.c_str());
+    if(!out.is_open()){
+      std::cerr<<"ERROR: cannot write autotuning cache "<<filename<<std::endl;
+      return;
+    }
+    out<<"# operator dim threads defop_scaling_factor schedule chunk max_colour initial_colours"<<std::endl;
+    for(std::map<Key, TuningParameters>::const_iterator it=tuned.begin();it!=tuned.end();++it){
+      const TuningParameters &p = it->second;
+      out<<get_operator_name(std::get<0>(it->first))<<" "<<std::get<1>(it->first)<<" "<<std::get<2>(it->first)<<" "
+         <<p.defop_scaling_factor<<" "<<get_schedule_name(p.schedule)<<" "<<p.chunk<<" "
+         <<p.max_colour<<" "<<p.initial_colours<<std::endl;
+    }
+  }
+
+  // Read without the mutex on the fast path of begin().
+  std::atomic<bool> enabled;
+  int nsamples;
+  std::string filename;
+  std::map<Key, Search> searches;
+  std::map<Key, TuningParameters> tuned;
+  std::mutex mutex;
+};
+
+/*! Tuning of one call of an operator over the enclosing scope. It
+ * sets the OpenMP runtime schedule used by the operator's
+ * schedule(runtime) loops, restoring the previous one at the end.
+ */
+class AutotunerScope{
+ public:
+  /// @param work the work of the call if it is known in advance, otherwise set by set_work().
+  AutotunerScope(AutotunerOperator op, int dim, size_t work) : op(op), dim(dim), work(work){
+    nthreads = pragmatic_nthreads();
+    tuning = Autotuner::instance().begin(op, dim, nthreads, timed);
+#ifdef _OPENMP
+    omp_get_schedule(&saved_schedule, &saved_chunk);
+    omp_set_schedule((omp_sched_t)tuning.schedule, tuning.chunk);
+#endif
+    start = timed?Profiler::wtime():0.0;
+  }
+
+  ~AutotunerScope(){
+    if(timed)
+      Autotuner::instance().end(op, dim, nthreads, tuning, Profiler::wtime()-start, work);
+#ifdef _OPENMP
+    omp_set_schedule(saved_schedule, saved_chunk);
+#endif
+  }
+
+  const TuningParameters &parameters() const{
+    return tuning;
+  }
+
+  /// Set the work done by the call, which its time is divided by.
+  void set_work(size_t n){
+    work = n;
+  }
+
+ private:
+  AutotunerOperator op;
+  int dim, nthreads;
+  size_t work;
+  TuningParameters tuning;
+  bool timed;
+  double start;
+#ifdef _OPENMP
+  omp_sched_t saved_schedule;
+  int saved_chunk;
+#endif
+};
+
+/*! Size the independent sets of Coarsen and Swapping for the tuned
+ * max_colour. The defaults have always covered the vertex degrees of
+ * adapted meshes; a lower candidate is raised to the largest degree
+ * plus one, so that every vertex has a colour left by its neighbours.
+ */
+template<class mesh_t, typename index_t>
+void tune_independent_sets(const TuningParameters &tuning, const mesh_t *mesh, int nthreads, int &max_colour,
+                           std::vector<size_t> *ind_set_size,
+                           std::vector< std::vector< std::vector<index_t> > > &ind_sets,
+                           std::vector< std::vector< std::pair<size_t,size_t> > > &range_indexer){
+  int colours = tuning.max_colour;
+  if(colours<Autotuner::defaults(AUTOTUNE_COARSEN, mesh->get_number_dimensions()).max_colour)
+    colours = std::max(colours, mesh->get_max_degree()+1);
+
+  if(colours==max_colour)
+    return;
+
+  max_colour = colours;
+  for(int i=0; i<3; ++i)
+    ind_set_size[i].assign(max_colour, 0);
+  ind_sets.assign(nthreads, std::vector< std::vector<index_t> >(max_colour));
+  range_indexer.assign(nthreads, std::vector< std::pair<size_t,size_t> >(max_colour, std::pair<size_t,size_t>(0,0)));
+}
+
+#endif
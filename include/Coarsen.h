@@ -48,6 +48,7 @@
 #include <boost/unordered_map.hpp>
 #endif
 
+#include "Autotuner.h"
 #include "DeferredOperations.h"
 #include "ElementProperty.h"
 #include "Mesh.h"
@@ -93,6 +94,10 @@ template<typename real_t, int dim> class Coarsen{
 
     node_colour = NULL;
 
+    TuningParameters tuning = Autotuner::defaults(AUTOTUNE_COARSEN, dim);
+    max_colour = tuning.max_colour;
+    defOp_scaling_factor = tuning.defop_scaling_factor;
+
     for(int i=0; i<3; ++i)
       ind_set_size[i].resize(max_colour, 0);
     ind_sets.resize(nthreads, std::vector< std::vector<index_t> >(max_colour));
@@ -124,8 +129,15 @@ template<typename real_t, int dim> class Coarsen{
    * See Figure 15; X Li et al, Comp Methods Appl Mech Engrg 194 (2005) 4915-4950
    */
   void coarsen(real_t L_low, real_t L_max, bool enable_sliver_deletion=false){
+    PRAGMATIC_MEMORY("coarsen", this);
+    PRAGMATIC_TIMER("coarsen");
     size_t NNodes = _mesh->get_number_nodes();
 
+    AutotunerScope tuning(AUTOTUNE_COARSEN, dim, 0);
+    defOp_scaling_factor = tuning.parameters().defop_scaling_factor;
+    def_ops->set_scaling_factor(defOp_scaling_factor);
+    tune_independent_sets(tuning.parameters(), _mesh, nthreads, max_colour, ind_set_size, ind_sets, range_indexer);
+
     _L_low = L_low;
     _L_max = L_max;
     delete_slivers = enable_sliver_deletion;
@@ -152,12 +164,15 @@ template<typename real_t, int dim> class Coarsen{
       node_colour = new int[NNodes];
     }
 
+    size_t ncollapses=0;
 #pragma omp parallel
     {
       const int tid = pragmatic_thread_id();
+      PRAGMATIC_PHASE_BEGIN(phase, "coarsen/identify");
 
       // Thread-private array of forbidden colours
       std::vector<index_t> forbiddenColours(max_colour, std::numeric_limits<index_t>::max());
+      size_t collapses=0;
 
       /* dynamic_vertex[i] >= 0 :: target to collapse node i
        * dynamic_vertex[i] = -1 :: node inactive (deleted/locked)
@@ -175,7 +190,7 @@ template<typename real_t, int dim> class Coarsen{
       }
 
       // Mark all vertices for evaluation.
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
       for(size_t i=0; i<NNodes; ++i){
         dynamic_vertex[i] = coarsen_identify_kernel(i, L_low, L_max);
       }
@@ -199,10 +214,13 @@ template<typename real_t, int dim> class Coarsen{
           for(int i=0; i<max_colour; ++i)
             ind_set_size[next_rnd][i] = 0;
           GlobalActiveSet_size[next_rnd] = 0;
+
+          PRAGMATIC_COUNT(PROFILE_COLOUR_ROUNDS, 1);
         }
 
         if(!first_time){
-#pragma omp for schedule(guided)
+          PRAGMATIC_PHASE(phase, "coarsen/identify");
+#pragma omp for schedule(runtime)
           for(size_t i=0; i<NNodes; ++i){
             if(dynamic_vertex[i] == -2){
               dynamic_vertex[i] = coarsen_identify_kernel(i, L_low, L_max);
@@ -212,10 +230,11 @@ template<typename real_t, int dim> class Coarsen{
         }else
           first_time = false;
 
-#pragma omp barrier
+        PRAGMATIC_BARRIER();
         // Colour the active sub-mesh
+        PRAGMATIC_PHASE(phase, "coarsen/colour");
         std::vector<index_t> local_coloured;
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
         for(size_t i=0; i<NNodes; ++i){
           if(dynamic_vertex[i]>=0){
             /*
@@ -247,7 +266,7 @@ template<typename real_t, int dim> class Coarsen{
           memcpy(&GlobalActiveSet[pos], &local_coloured[0], local_coloured.size() * sizeof(index_t));
         }
 
-#pragma omp barrier
+        PRAGMATIC_BARRIER();
         if(GlobalActiveSet_size[rnd]>0){
           for(int set_no=0; set_no<max_colour; ++set_no){
             ind_sets[tid][set_no].clear();
@@ -258,7 +277,7 @@ template<typename real_t, int dim> class Coarsen{
           // Continue colouring and coarsening
           std::vector<index_t> conflicts;
 
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
           for(size_t i=0; i<GlobalActiveSet_size[rnd]; ++i){
             bool defective = false;
             index_t n = GlobalActiveSet[i];
@@ -296,18 +315,19 @@ template<typename real_t, int dim> class Coarsen{
             }
           }
 
+          PRAGMATIC_COUNT(PROFILE_COLOUR_CONFLICTS, conflicts.size());
           size_t pos;
           pos = pragmatic_omp_atomic_capture(&worklist_size[0], conflicts.size());
 
           memcpy(&worklist[0][pos], &conflicts[0], conflicts.size() * sizeof(index_t));
 
           conflicts.clear();
-#pragma omp barrier
+          PRAGMATIC_BARRIER();
 
           int wl = 0;
 
           while(worklist_size[wl]){
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
             for(size_t item=0; item<worklist_size[wl]; ++item){
               index_t n = worklist[wl][item];
               bool defective = false;
@@ -348,6 +368,7 @@ template<typename real_t, int dim> class Coarsen{
             // Switch worklist
             wl = (wl+1)%3;
 
+            PRAGMATIC_COUNT(PROFILE_COLOUR_CONFLICTS, conflicts.size());
             size_t pos = pragmatic_omp_atomic_capture(&worklist_size[wl], conflicts.size());
 
             memcpy(&worklist[wl][pos], &conflicts[0], conflicts.size() * sizeof(index_t));
@@ -368,7 +389,7 @@ template<typename real_t, int dim> class Coarsen{
             }
           }
 
-#pragma omp barrier
+          PRAGMATIC_BARRIER();
           /* Start processing independent sets. After processing each set, colouring
            * might be invalid. More precisely, it's the target vertices whose colours
            * might clash with their neighbours' colours. To avoid hazards, we just
@@ -395,7 +416,8 @@ template<typename real_t, int dim> class Coarsen{
             }
             std::sort(range.begin(), range.end(), pragmatic_range_element_comparator);
 
-#pragma omp for schedule(guided)
+            PRAGMATIC_PHASE(phase, "coarsen/collapse");
+#pragma omp for schedule(runtime) nowait
             for(size_t idx=0; idx<ind_set_size[rnd][set_no]; ++idx){
               // Find which vertex corresponds to idx.
               index_t rm_vertex = -1;
@@ -445,9 +467,12 @@ template<typename real_t, int dim> class Coarsen{
 
               // Coarsen the edge.
               coarsen_kernel(rm_vertex, target_vertex, tid);
+              collapses++;
             }
+            PRAGMATIC_BARRIER();
 
-#pragma omp for schedule(guided)
+            PRAGMATIC_PHASE(phase, "coarsen/commit");
+#pragma omp for schedule(runtime) nowait
             for(size_t vtid=0; vtid<defOp_scaling_factor*nthreads; ++vtid){
               for(int i=0; i<nthreads; ++i){
                 def_ops->commit_remNN(i, vtid);
@@ -459,13 +484,40 @@ template<typename real_t, int dim> class Coarsen{
                 def_ops->commit_colour_reset(node_colour, i, vtid);
               }
             }
+            PRAGMATIC_BARRIER();
           }
         }
       }while(GlobalActiveSet_size[rnd]>0);
+
+      PRAGMATIC_COUNT(PROFILE_COLLAPSES, collapses);
+#pragma omp atomic
+      ncollapses += collapses;
+    }
+
+    tuning.set_work(ncollapses);
+  }
+
+  /// Add the memory held by the mesh and the coarsening workspace to report.
+  void memory_report(MemoryReport &report) const{
+    _mesh->memory_report(report);
+
+    MemoryReport workspace;
+    workspace.add("dynamic_vertex", dynamic_vertex, nnodes_reserve, nnodes_reserve);
+    workspace.add("node_colour", node_colour, nnodes_reserve, nnodes_reserve);
+    for(int i=0;i<3;i++){
+      workspace.add("worklist", worklist[i], nnodes_reserve, nnodes_reserve);
+      workspace.add("ind_set_size", ind_set_size[i], ind_set_size[i].size());
     }
+    workspace.add("GlobalActiveSet", GlobalActiveSet, GlobalActiveSet.size());
+    for(size_t t=0;t<ind_sets.size();t++)
+      workspace.add("ind_sets", ind_sets[t], ind_sets[t].size());
+    workspace.add("range_indexer", range_indexer, range_indexer.size());
+    def_ops->memory_report(workspace);
+    report.add("coarsen/", workspace);
   }
 
  private:
+  template<typename _real_t, int _dim> friend class KernelBenchmark;
 
   /*! Kernel for identifying what vertex (if any) rm_vertex should collapse onto.
    * See Figure 15; X Li et al, Comp Methods Appl Mech Engrg 194 (2005) 4915-4950
@@ -761,7 +813,7 @@ template<typename real_t, int dim> class Coarsen{
 
   // Colouring
   int *node_colour;
-  static const int max_colour = (dim==2?16:64);
+  int max_colour;
   std::vector<index_t> GlobalActiveSet;
   size_t GlobalActiveSet_size[3];
   std::vector<size_t> ind_set_size[3];
@@ -773,7 +825,7 @@ template<typename real_t, int dim> class Coarsen{
   size_t worklist_size[3];
 
   DeferredOperations<real_t>* def_ops;
-  static const int defOp_scaling_factor = 4;
+  int defOp_scaling_factor;
 
   real_t _L_low, _L_max;
   bool delete_slivers;
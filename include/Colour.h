@@ -164,7 +164,7 @@ class Colour{
 			       const std::vector< std::vector<index_t> > &send,
 			       const std::vector< std::vector<index_t> > &recv,
 			       const std::vector<int> &node_owner,
-			       std::vector<char> &colour){
+			       std::vector<char> &colour, int initial_colours=15){
     int max_iterations = 4096;
     std::vector<int> conflicts_exist(max_iterations, 0);
     std::vector<bool> conflict(NNodes);
@@ -172,7 +172,7 @@ class Colour{
     int rank;
     MPI_Comm_rank(comm, &rank);
     
-    char K=15; // Initialise guess at number
+    char K=initial_colours; // Initialise guess at number
     
     assert(NNodes==colour.size());
     
@@ -265,7 +265,7 @@ class Colour{
 	
 #pragma omp single
 	{	  
-	  MPI_Allreduce(MPI_IN_PLACE, &(conflicts_exist[k]), 1, MPI_INT, MPI_SUM, comm);
+	  PRAGMATIC_TRACE_CALL("MPI_Allreduce", MPI_Allreduce(MPI_IN_PLACE, &(conflicts_exist[k]), 1, MPI_INT, MPI_SUM, comm));
 
 	  // If progress has stagnated then lift the limit on chromatic number.
 	  if(k>=K && conflicts_exist[k-K]==conflicts_exist[k]){
@@ -54,6 +54,49 @@ public:
 
   ~DeferredOperations(){}
 
+  /// Change the number of queues per thread, discarding any queued operations.
+  void set_scaling_factor(const int scaling_factor){
+    if(scaling_factor==defOp_scaling_factor)
+      return;
+
+    defOp_scaling_factor = scaling_factor;
+    for(int i=0; i<nthreads; ++i){
+      deferred_operations[i].clear();
+      deferred_operations[i].resize(nthreads*defOp_scaling_factor);
+    }
+  }
+
+  /// Discard all queued operations, keeping the queues' capacity.
+  void clear(){
+    for(size_t t=0;t<deferred_operations.size();t++){
+      for(size_t v=0;v<deferred_operations[t].size();v++){
+        def_op_t &op = deferred_operations[t][v];
+        op.addNN.clear(); op.remNN.clear(); op.addNE.clear(); op.remNE.clear(); op.addNE_fix.clear();
+        op.repEN.clear(); op.coarsening_propagation.clear(); op.refinement_propagation.clear();
+        op.swapping_propagation.clear(); op.reset_colour.clear();
+      }
+    }
+  }
+
+  /// Add the memory held by the queues to report.
+  void memory_report(MemoryReport &report) const{
+    size_t used=0, reserved=MemoryReport::heap_block(deferred_operations.capacity()*sizeof(std::vector<def_op_t>));
+    for(size_t t=0;t<deferred_operations.size();t++){
+      reserved += MemoryReport::heap_block(deferred_operations[t].capacity()*sizeof(def_op_t));
+      for(size_t v=0;v<deferred_operations[t].size();v++){
+        const def_op_t &op = deferred_operations[t][v];
+        const std::vector<index_t> *queues[] = {&op.addNN, &op.remNN, &op.addNE, &op.remNE, &op.addNE_fix, &op.repEN,
+                                                &op.coarsening_propagation, &op.refinement_propagation,
+                                                &op.swapping_propagation, &op.reset_colour};
+        for(int q=0;q<10;q++){
+          used += queues[q]->size()*sizeof(index_t);
+          reserved += MemoryReport::heap_block(queues[q]->capacity()*sizeof(index_t));
+        }
+      }
+    }
+    report.add("deferred_operations", used, reserved);
+  }
+
   inline void addNN(const index_t i, const index_t n, const int tid){
     deferred_operations[tid][hash(i) % (defOp_scaling_factor*nthreads)].addNN.push_back(i);
     deferred_operations[tid][hash(i) % (defOp_scaling_factor*nthreads)].addNN.push_back(n);
@@ -226,7 +269,7 @@ private:
   //Deferred operations main structure
   std::vector< std::vector<def_op_t> > deferred_operations;
   const int nthreads;
-  const int defOp_scaling_factor;
+  int defOp_scaling_factor;
 
   Mesh<real_t>* _mesh;
 };
@@ -174,6 +174,7 @@ template<typename index_t> class DirectedEdge{
   template<typename _real_t, int _dim> friend class Coarsen;
   template<typename _real_t, int _dim> friend class Swapping;
   template<typename _real_t, int _dim> friend class Refine;
+  template<typename _real_t, int _dim> friend class KernelBenchmark;
 
  private:
   index_t id;
@@ -0,0 +1,502 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef ELEMENTINDEX_H
+#define ELEMENTINDEX_H
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "ElementProperty.h"
+#include "Mesh.h"
+
+/*! \brief Bounding volume hierarchy over the elements of a mesh, for
+ * locating points.
+ *
+ * The hierarchy is a binary tree of axis aligned bounding boxes. It is
+ * built by recursively splitting the elements at the median of their
+ * centroids along the longest axis, until at most leaf_size elements
+ * are left. The tree is stored depth first in a flat array, so the
+ * left child of a node follows it.
+ *
+ * The index refers to the mesh, or to the element and coordinate
+ * arrays it was built over, and does not copy it:
+ * \li after the vertices have been moved, e.g. by Smooth, refit()
+ * updates the bounding boxes while keeping the tree;
+ * \li after the elements have changed, e.g. by Coarsen, Refine,
+ * Swapping or Mesh::defragment(), rebuild() must be called.
+ *
+ * Building and refitting are parallelised with OpenMP, and queries are
+ * thread safe. In parallel, only the local part of the mesh (including
+ * the halo) is indexed.
+ */
+template<typename real_t> class ElementIndex{
+ public:
+  /// Build the index over the elements of mesh.
+  ElementIndex(const Mesh<real_t> &mesh){
+    _mesh = &mesh;
+    ndims = mesh.get_number_dimensions();
+    nloc = ndims+1;
+
+    rebuild();
+  }
+
+  /*! Build the index over elements stored as arrays, e.g. a snapshot
+   * of a mesh (see FieldTransfer). The arrays are not copied.
+   *
+   * @param ndims number of dimensions.
+   * @param NElements number of elements. Elements whose first vertex
+   * is negative are skipped.
+   * @param ENList element-node list, ndims+1 vertices per element.
+   * @param coords coordinates, ndims per vertex.
+   */
+  ElementIndex(size_t ndims, size_t NElements, const index_t *ENList, const real_t *coords){
+    _mesh = NULL;
+    this->ndims = ndims;
+    nloc = ndims+1;
+    this->NElements = NElements;
+    _ENList = ENList;
+    _coords = coords;
+
+    rebuild();
+  }
+
+  /// Rebuild the index after the elements of the mesh have changed.
+  void rebuild(){
+    map_mesh();
+
+    elements.clear();
+    for(int i=0;i<(int)NElements;i++){
+      if(get_element(i)[0]>=0)
+        elements.push_back(i);
+    }
+
+    int nelements = elements.size();
+    nodes.resize(count_nodes(nelements));
+    if(nelements==0)
+      return;
+
+    // The centroids are permuted along with the elements while building,
+    // so that each split scans contiguous memory.
+    std::vector<Centroid> centroids(nelements);
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<nelements;i++){
+      Centroid &c = centroids[i];
+      c.eid = elements[i];
+      const index_t *n = get_element(c.eid);
+      for(size_t d=0;d<3;d++)
+        c.x[d] = 0.0;
+      for(size_t m=0;m<nloc;m++){
+        const real_t *x = get_coords(n[m]);
+        for(size_t d=0;d<ndims;d++)
+          c.x[d] += x[d]/nloc;
+      }
+    }
+
+#pragma omp parallel
+    {
+#pragma omp single
+      build(0, 0, nelements, centroids);
+    }
+
+    set_tolerance();
+  }
+
+  /// Update the bounding boxes after the vertices of the mesh have
+  /// moved. The elements must not have changed since the last build.
+  void refit(){
+    map_mesh();
+
+    int nnodes = nodes.size();
+    if(elements.empty())
+      return;
+
+#pragma omp parallel for schedule(guided)
+    for(int i=0;i<nnodes;i++){
+      if(nodes[i].count>0)
+        fit_leaf(nodes[i]);
+    }
+
+    // Children follow their parent, so a reverse sweep visits them first.
+    for(int i=nnodes-1;i>=0;i--){
+      if(nodes[i].count==0)
+        fit_internal(nodes[i], nodes[i+1], nodes[nodes[i].right]);
+    }
+
+    set_tolerance();
+  }
+
+  /// Number of elements in the index.
+  size_t get_number_elements() const{
+    return elements.size();
+  }
+
+  /*! Locate a point in the mesh.
+   *
+   * @param x coordinates of the point.
+   * @param bary returns the barycentric coordinates of the point in the
+   * element.
+   * @param seed optional element to be tried first, e.g. the result of
+   * a previous query for a nearby point.
+   * @return the element containing the point, or -1 if the point is
+   * outside the mesh.
+   */
+  int locate(const real_t *x, real_t *bary, int seed=-1) const{
+    if(seed>=0 && seed<(int)NElements && get_element(seed)[0]>=0){
+      if(barycentric(seed, x, bary)>=-tol)
+        return seed;
+    }
+
+    if(elements.empty())
+      return -1;
+
+    int stack[64];
+    int top=0;
+    stack[top++] = 0;
+    while(top>0){
+      int id = stack[--top];
+      const Node &node = nodes[id];
+      if(!inside(node, x))
+        continue;
+
+      if(node.count>0){
+        for(int i=node.first;i<node.first+node.count;i++){
+          if(barycentric(elements[i], x, bary)>=-tol)
+            return elements[i];
+        }
+      }else{
+        stack[top++] = node.right;
+        stack[top++] = id+1;
+      }
+    }
+
+    return -1;
+  }
+
+  /*! Find the element closest to a point, for points which locate()
+   * does not find, e.g. because round-off puts them just outside the
+   * mesh. The distance to an element is measured to the point given by
+   * the clamped barycentric coordinates. Leaves are visited in order of
+   * the distance to their box, until the boxes are further away than
+   * the closest element found so far.
+   *
+   * @param x coordinates of the point.
+   * @param bary returns the barycentric coordinates of the point in
+   * the element, clamped to the element.
+   * @param lmin returns the smallest barycentric coordinate before
+   * clamping, i.e. the point is outside the element if it is negative.
+   * @return the element, or -1 if the index is empty.
+   */
+  int closest(const real_t *x, real_t *bary, real_t &lmin) const{
+    lmin = -DBL_MAX;
+    if(elements.empty())
+      return -1;
+
+    int best=-1;
+    real_t best_d2=DBL_MAX;
+    real_t l[4];
+
+    typedef std::pair<real_t, int> Entry;
+    std::priority_queue< Entry, std::vector<Entry>, std::greater<Entry> > queue;
+    queue.push(Entry(distance2(nodes[0], x), 0));
+    while(!queue.empty() && queue.top().first<best_d2){
+      int id = queue.top().second;
+      queue.pop();
+
+      const Node &node = nodes[id];
+      if(node.count==0){
+        queue.push(Entry(distance2(nodes[id+1], x), id+1));
+        queue.push(Entry(distance2(nodes[node.right], x), node.right));
+        continue;
+      }
+
+      for(int i=node.first;i<node.first+node.count;i++){
+        real_t l_min = barycentric(elements[i], x, l);
+        clamp(l);
+
+        const index_t *n = get_element(elements[i]);
+        real_t d2=0;
+        for(size_t d=0;d<ndims;d++){
+          real_t y=0;
+          for(size_t m=0;m<nloc;m++)
+            y += l[m]*get_coords(n[m])[d];
+          d2 += (y-x[d])*(y-x[d]);
+        }
+
+        if(d2<best_d2){
+          best = elements[i];
+          best_d2 = d2;
+          lmin = l_min;
+          for(size_t m=0;m<nloc;m++)
+            bary[m] = l[m];
+        }
+      }
+    }
+
+    return best;
+  }
+
+  /*! Locate a batch of points in the mesh, in parallel.
+   *
+   * @param npoints number of points.
+   * @param x coordinates of the points, point by point.
+   * @param eid returns the element containing each point, or -1.
+   * @param bary returns the barycentric coordinates of each point in
+   * its element, nloc values per point.
+   * @return number of points which were located.
+   */
+  size_t locate(int npoints, const real_t *x, int *eid, real_t *bary) const{
+    size_t found=0;
+
+#pragma omp parallel reduction(+:found)
+    {
+      // Consecutive points are often close, so start from the element
+      // of the previous one.
+      int seed=-1;
+#pragma omp for schedule(guided)
+      for(int i=0;i<npoints;i++){
+        eid[i] = locate(x+i*ndims, bary+i*nloc, seed);
+        if(eid[i]>=0){
+          seed = eid[i];
+          found++;
+        }
+      }
+    }
+
+    return found;
+  }
+
+ private:
+  // Node of the tree. A leaf holds count>0 elements starting at first.
+  // The children of an internal node are the next node and right.
+  struct Node{
+    real_t lo[3], hi[3];
+    int first, count, right;
+  };
+
+  struct Centroid{
+    real_t x[3];
+    int eid;
+  };
+
+  // Number of nodes of a tree over n elements.
+  static int count_nodes(int n){
+    if(n<=leaf_size)
+      return 1;
+    return 1+count_nodes(n/2)+count_nodes(n-n/2);
+  }
+
+  // Build the subtree of elements[begin, end) at node id.
+  void build(int id, int begin, int end, std::vector<Centroid> &centroids){
+    Node &node = nodes[id];
+    int n = end-begin;
+    if(n<=leaf_size){
+      node.first = begin;
+      node.count = n;
+      node.right = -1;
+      for(int i=begin;i<end;i++)
+        elements[i] = centroids[i].eid;
+      fit_leaf(node);
+      return;
+    }
+
+    // Split along the longest axis of the centroids.
+    real_t lo[3], hi[3];
+    for(size_t d=0;d<ndims;d++){
+      lo[d] = DBL_MAX;
+      hi[d] = -DBL_MAX;
+    }
+    for(int i=begin;i<end;i++){
+      for(size_t d=0;d<ndims;d++){
+        lo[d] = std::min(lo[d], centroids[i].x[d]);
+        hi[d] = std::max(hi[d], centroids[i].x[d]);
+      }
+    }
+    size_t axis=0;
+    for(size_t d=1;d<ndims;d++){
+      if(hi[d]-lo[d]>hi[axis]-lo[axis])
+        axis = d;
+    }
+
+    int mid = begin+n/2;
+    std::nth_element(centroids.begin()+begin, centroids.begin()+mid, centroids.begin()+end,
+                     CentroidLess(axis));
+
+    node.first = begin;
+    node.count = 0;
+    node.right = id+1+count_nodes(n/2);
+
+    if(n>task_size){
+#pragma omp task shared(centroids)
+      build(id+1, begin, mid, centroids);
+      build(node.right, mid, end, centroids);
+#pragma omp taskwait
+    }else{
+      build(id+1, begin, mid, centroids);
+      build(node.right, mid, end, centroids);
+    }
+
+    fit_internal(node, nodes[id+1], nodes[node.right]);
+  }
+
+  struct CentroidLess{
+    CentroidLess(size_t axis) : axis(axis){}
+
+    bool operator()(const Centroid &a, const Centroid &b) const{
+      return a.x[axis]<b.x[axis];
+    }
+
+    size_t axis;
+  };
+
+  void fit_leaf(Node &node) const{
+    for(size_t d=0;d<3;d++){
+      node.lo[d] = DBL_MAX;
+      node.hi[d] = -DBL_MAX;
+    }
+    for(int i=node.first;i<node.first+node.count;i++){
+      const index_t *n = get_element(elements[i]);
+      for(size_t m=0;m<nloc;m++){
+        const real_t *x = get_coords(n[m]);
+        for(size_t d=0;d<ndims;d++){
+          node.lo[d] = std::min(node.lo[d], x[d]);
+          node.hi[d] = std::max(node.hi[d], x[d]);
+        }
+      }
+    }
+  }
+
+  static void fit_internal(Node &node, const Node &left, const Node &right){
+    for(size_t d=0;d<3;d++){
+      node.lo[d] = std::min(left.lo[d], right.lo[d]);
+      node.hi[d] = std::max(left.hi[d], right.hi[d]);
+    }
+  }
+
+  // Boxes are tested with a tolerance relative to the size of the mesh,
+  // so that points on faces are found in the elements on either side.
+  void set_tolerance(){
+    real_t extent=0;
+    for(size_t d=0;d<ndims;d++)
+      extent = std::max(extent, nodes[0].hi[d]-nodes[0].lo[d]);
+    box_tol = tol*extent;
+  }
+
+  bool inside(const Node &node, const real_t *x) const{
+    for(size_t d=0;d<ndims;d++){
+      if(x[d]<node.lo[d]-box_tol || x[d]>node.hi[d]+box_tol)
+        return false;
+    }
+    return true;
+  }
+
+  // Barycentric coordinates of x in element eid. Returns the smallest.
+  real_t barycentric(int eid, const real_t *x, real_t *l) const{
+    const index_t *n = get_element(eid);
+    const real_t *v[4];
+    for(size_t m=0;m<nloc;m++)
+      v[m] = get_coords(n[m]);
+
+    return ElementProperty<real_t>::barycentric(ndims, v, x, l);
+  }
+
+  // Clamp barycentric coordinates to the element.
+  void clamp(real_t *l) const{
+    real_t sum=0;
+    for(size_t m=0;m<nloc;m++){
+      l[m] = std::max(l[m], (real_t)0.0);
+      sum += l[m];
+    }
+    for(size_t m=0;m<nloc;m++)
+      l[m] /= sum;
+  }
+
+  // Squared distance from x to the box of node, 0 if x is inside.
+  real_t distance2(const Node &node, const real_t *x) const{
+    real_t d2=0;
+    for(size_t d=0;d<ndims;d++){
+      real_t dx = std::max(node.lo[d]-x[d], x[d]-node.hi[d]);
+      if(dx>0)
+        d2 += dx*dx;
+    }
+    return d2;
+  }
+
+  // Point at the arrays of the mesh, which move as the mesh grows.
+  void map_mesh(){
+    if(_mesh==NULL)
+      return;
+
+    NElements = _mesh->get_number_elements();
+    _ENList = NElements>0?_mesh->get_element(0):NULL;
+    _coords = _mesh->get_number_nodes()>0?_mesh->get_coords(0):NULL;
+  }
+
+  const index_t *get_element(int eid) const{
+    return _ENList+eid*nloc;
+  }
+
+  const real_t *get_coords(index_t nid) const{
+    return _coords+nid*ndims;
+  }
+
+  const Mesh<real_t> *_mesh;
+  size_t ndims, nloc;
+
+  size_t NElements;
+  const index_t *_ENList;
+  const real_t *_coords;
+
+  std::vector<int> elements;
+  std::vector<Node> nodes;
+  real_t box_tol;
+
+  static const int leaf_size=4;
+  // Subtrees with more elements than this are built by separate tasks.
+  static const int task_size=4096;
+  static const real_t tol;
+};
+
+template<typename real_t> const real_t ElementIndex<real_t>::tol = 1.0e-10;
+
+#endif
@@ -179,6 +179,49 @@ class ElementProperty{
                 x*(z*m[2] + y*m[1] + x*m[0]));
   }
 
+  /*! Signed area (2D) or volume (3D) of a simplex, scaled by 2 or 6
+   * and independent of the orientation of the reference element.
+   * @param ndims number of spatial dimensions.
+   * @param x pointers to the ndims+1 vertex positions.
+   */
+  static real_t simplex_measure(size_t ndims, const real_t * const *x){
+    if(ndims==2){
+      return ((x[1][0]-x[0][0])*(x[2][1]-x[0][1])-(x[1][1]-x[0][1])*(x[2][0]-x[0][0]));
+    }else{
+      real_t a[3], b[3], c[3];
+      for(int d=0;d<3;d++){
+        a[d] = x[1][d]-x[0][d];
+        b[d] = x[2][d]-x[0][d];
+        c[d] = x[3][d]-x[0][d];
+      }
+      return (a[0]*(b[1]*c[2]-b[2]*c[1])-a[1]*(b[0]*c[2]-b[2]*c[0])+a[2]*(b[0]*c[1]-b[1]*c[0]));
+    }
+  }
+
+  /*! Barycentric coordinates of a point in a simplex.
+   * @param ndims number of spatial dimensions.
+   * @param v pointers to the ndims+1 vertex positions.
+   * @param x the point.
+   * @param l returns the ndims+1 coordinates.
+   * @return the smallest coordinate, negative if x is outside.
+   */
+  static real_t barycentric(size_t ndims, const real_t * const *v, const real_t *x, real_t *l){
+    const real_t *w[4];
+    for(size_t m=0;m<=ndims;m++)
+      w[m] = v[m];
+
+    real_t vol = simplex_measure(ndims, w);
+    real_t lmin = DBL_MAX;
+    for(size_t m=0;m<=ndims;m++){
+      w[m] = x;
+      l[m] = simplex_measure(ndims, w)/vol;
+      w[m] = v[m];
+      lmin = std::min(lmin, l[m]);
+    }
+
+    return lmin;
+  }
+
   /*! Evaluates the 2D Lipnikov functional. The description for the
    * functional is taken from: Yu. V. Vasileskii and K. N. Lipnikov,
    * An Adaptive Algorithm for Quasioptimal Mesh Generation,
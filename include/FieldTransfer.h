@@ -0,0 +1,410 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef FIELDTRANSFER_H
+#define FIELDTRANSFER_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "ElementIndex.h"
+#include "ElementProperty.h"
+#include "Mesh.h"
+#include "Provenance.h"
+
+/*! \brief Transfers node-centred fields from a mesh to its adapted
+ * version by linear interpolation.
+ *
+ * The adaptivity operators modify the mesh in place, so a snapshot of
+ * the mesh (coordinates and elements) must be taken before adapting:
+ * \code
+ * FieldTransfer<double> transfer(*mesh);
+ * ... adapt mesh ...
+ * transfer.transfer(*mesh, nfields, old_fields, new_fields);
+ * \endcode
+ * Taking the snapshot starts a Provenance log on the mesh (see
+ * Mesh::record_provenance()), which traces each vertex of the new mesh
+ * back to a vertex of the snapshot. The vertex is located by walking
+ * from an element around that vertex towards it, and otherwise with an
+ * ElementIndex over the snapshot. The fields are interpolated with the barycentric
+ * coordinates of the vertex in the containing element. Vertices which
+ * fall outside the snapshot, e.g. by round-off on the boundary, are
+ * given the value at the closest point of the closest element.
+ *
+ * The search is parallelised with OpenMP across the vertices. In
+ * parallel, each process locates its owned vertices in its own part of
+ * the snapshot, which contains almost all of them as adaptivity does
+ * not change the partitioning. The few vertices which have moved out
+ * of it are located by all processes, and the values of halo vertices
+ * are then obtained by a halo update.
+ */
+template<typename real_t> class FieldTransfer{
+ public:
+  /// Take a snapshot of mesh, and start recording its provenance.
+  FieldTransfer(Mesh<real_t> &mesh){
+    ndims = mesh.get_number_dimensions();
+    nloc = ndims+1;
+
+    NNodes = mesh.get_number_nodes();
+    coords.resize(NNodes*ndims);
+    if(NNodes>0)
+      std::copy(mesh.get_coords(0), mesh.get_coords(0)+NNodes*ndims, coords.begin());
+
+    size_t NElements = mesh.get_number_elements();
+    ENList.reserve(NElements*nloc);
+    for(size_t i=0;i<NElements;i++){
+      const index_t *n = mesh.get_element(i);
+      if(n[0]<0)
+        continue;
+      ENList.insert(ENList.end(), n, n+nloc);
+    }
+
+    create_node_elements();
+    index = new ElementIndex<real_t>(ndims, ENList.size()/nloc, ENList.data(), coords.data());
+
+    mesh.record_provenance();
+  }
+
+  ~FieldTransfer(){
+    delete index;
+  }
+
+  /// Number of nodes in the snapshot, i.e. the length of the old fields.
+  size_t get_number_nodes() const{
+    return NNodes;
+  }
+
+  /*! Locate a point in the snapshot.
+   *
+   * @param x coordinates of the point.
+   * @param bary returns the barycentric coordinates of the point in
+   * the element. If the point is outside the snapshot these are
+   * clamped to the element, i.e. all are non-negative.
+   * @param seed optional element to be tried first.
+   * @return the index of the element in the snapshot, or -1 if the
+   * snapshot is empty. Element indices ignore deleted elements.
+   */
+  int locate(const real_t *x, real_t *bary, int seed=-1) const{
+    real_t lmin;
+    return find(x, bary, seed, lmin);
+  }
+
+
+  /*! Interpolate node-centred fields from the snapshot onto mesh.
+   *
+   * Fields are stored node by node, i.e. value k of node n is at
+   * n*nfields+k.
+   *
+   * @param mesh the adapted mesh.
+   * @param nfields number of fields.
+   * @param old_fields fields on the nodes of the snapshot.
+   * @param new_fields returns the fields on the nodes of mesh.
+   * @return number of local vertices which were outside the snapshot.
+   */
+  size_t transfer(Mesh<real_t> &mesh, int nfields, const real_t *old_fields, real_t *new_fields) const{
+    int NNodes_new = mesh.get_number_nodes();
+    std::vector<index_t> missing;
+
+    // The vertex of the snapshot each vertex derives from.
+    std::vector<index_t> origin(NNodes);
+    for(size_t i=0;i<NNodes;i++)
+      origin[i] = i;
+    if(mesh.get_provenance()!=NULL)
+      mesh.get_provenance()->trace(origin);
+    origin.resize(NNodes_new, -1);
+
+#pragma omp parallel
+    {
+      int seed=-1;
+      real_t l[4], lmin;
+      std::vector<index_t> local_missing;
+
+#pragma omp for schedule(guided)
+      for(int i=0;i<NNodes_new;i++){
+#ifdef HAVE_MPI
+        if(!mesh.is_owned_node(i))
+          continue;
+#endif
+        // Walk from the origin of the vertex, or failing that from the
+        // element of the previous vertex.
+        int start = seed;
+        if(origin[i]>=0 && origin[i]<(index_t)NNodes && node_offset[origin[i]]<node_offset[origin[i]+1])
+          start = node_elements[node_offset[origin[i]]];
+        int eid = walk(mesh.get_coords(i), l, start, lmin);
+        if(eid<0)
+          eid = find(mesh.get_coords(i), l, -1, lmin);
+        if(lmin<-tol)
+          local_missing.push_back(i);
+        if(eid<0)
+          continue;
+        seed = eid;
+
+        interpolate(eid, l, nfields, old_fields, new_fields+i*nfields);
+      }
+
+      if(!local_missing.empty()){
+#pragma omp critical
+        missing.insert(missing.end(), local_missing.begin(), local_missing.end());
+      }
+    }
+
+    size_t outside = missing.size();
+
+#ifdef HAVE_MPI
+    int nprocs;
+    MPI_Comm_size(mesh.get_mpi_comm(), &nprocs);
+    if(nprocs>1){
+      outside = transfer_missing(mesh, missing, nfields, old_fields, new_fields);
+
+      std::vector<real_t> field(NNodes_new);
+      for(int k=0;k<nfields;k++){
+        for(int i=0;i<NNodes_new;i++)
+          field[i] = new_fields[i*nfields+k];
+        mesh.template update_halo<real_t, 1>(field);
+        for(int i=0;i<NNodes_new;i++)
+          new_fields[i*nfields+k] = field[i];
+      }
+    }
+#endif
+
+    return outside;
+  }
+
+  /// As above, for a single field.
+  size_t transfer(Mesh<real_t> &mesh, const std::vector<real_t> &old_field, std::vector<real_t> &new_field) const{
+    assert(old_field.size()==NNodes);
+    new_field.resize(mesh.get_number_nodes());
+    return transfer(mesh, 1, old_field.data(), new_field.data());
+  }
+
+ private:
+  // Not copyable: an object owns its index.
+  FieldTransfer(const FieldTransfer&);
+  FieldTransfer& operator=(const FieldTransfer&);
+
+  void interpolate(int eid, const real_t *l, int nfields, const real_t *old_fields, real_t *value) const{
+    const index_t *n = &(ENList[eid*nloc]);
+    for(int k=0;k<nfields;k++){
+      real_t v=0;
+      for(size_t m=0;m<nloc;m++)
+        v += l[m]*old_fields[n[m]*nfields+k];
+      value[k] = v;
+    }
+  }
+
+#ifdef HAVE_MPI
+  // Layout of MPI_DOUBLE_INT.
+  struct double_int{
+    double value;
+    int rank;
+  };
+
+  /* Vertices which are outside the local snapshot are located by every
+   * process, and take their values from the process in whose snapshot
+   * they are furthest inside. Returns the number of local vertices
+   * which are outside every snapshot.
+   */
+  size_t transfer_missing(const Mesh<real_t> &mesh, const std::vector<index_t> &missing,
+                          int nfields, const real_t *old_fields, real_t *new_fields) const{
+    MPI_Comm comm = mesh.get_mpi_comm();
+    MPI_Datatype MPI_REAL_T = mpi_type_wrapper<real_t>().mpi_type;
+
+    int nprocs, rank;
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Comm_rank(comm, &rank);
+
+    int nmissing = missing.size()*ndims;
+    std::vector<int> counts(nprocs), displs(nprocs+1, 0);
+    MPI_Allgather(&nmissing, 1, MPI_INT, counts.data(), 1, MPI_INT, comm);
+    for(int p=0;p<nprocs;p++)
+      displs[p+1] = displs[p]+counts[p];
+    if(displs[nprocs]==0)
+      return 0;
+
+    std::vector<real_t> x(nmissing+1);
+    for(size_t i=0;i<missing.size();i++)
+      mesh.get_coords(missing[i], &(x[i*ndims]));
+
+    std::vector<real_t> all_x(displs[nprocs]);
+    MPI_Allgatherv(x.data(), nmissing, MPI_REAL_T, all_x.data(), counts.data(), displs.data(), MPI_REAL_T, comm);
+
+    int npoints = displs[nprocs]/ndims;
+    std::vector<double_int> score(npoints);
+    std::vector<real_t> values(npoints*nfields);
+
+#pragma omp parallel for schedule(guided)
+    for(int i=0;i<npoints;i++){
+      real_t l[4], lmin;
+      int eid = find(&(all_x[i*ndims]), l, -1, lmin);
+      score[i].value = lmin;
+      score[i].rank = rank;
+      if(eid>=0)
+        interpolate(eid, l, nfields, old_fields, &(values[i*nfields]));
+    }
+
+    std::vector<double_int> best(score);
+    MPI_Allreduce(score.data(), best.data(), npoints, MPI_DOUBLE_INT, MPI_MAXLOC, comm);
+
+    for(int i=0;i<npoints;i++){
+      if(best[i].rank!=rank){
+        for(int k=0;k<nfields;k++)
+          values[i*nfields+k] = 0;
+      }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, values.data(), npoints*nfields, MPI_REAL_T, MPI_SUM, comm);
+
+    size_t outside=0;
+    int offset = displs[rank]/ndims;
+    for(size_t i=0;i<missing.size();i++){
+      for(int k=0;k<nfields;k++)
+        new_fields[missing[i]*nfields+k] = values[(offset+i)*nfields+k];
+      if(best[offset+i].value<-tol)
+        outside++;
+    }
+
+    return outside;
+  }
+
+#endif
+
+  // Walk from element eid towards x, each step crossing the face
+  // opposite the most negative barycentric coordinate. Returns -1 if
+  // the walk leaves the snapshot or takes too long.
+  int walk(const real_t *x, real_t *bary, int eid, real_t &lmin) const{
+    if(eid<0)
+      return -1;
+
+    for(int step=0;step<max_walk;step++){
+      lmin = barycentric(eid, x, bary);
+      if(lmin>=-tol)
+        return eid;
+
+      size_t m = std::min_element(bary, bary+nloc)-bary;
+      eid = neighbour(eid, m);
+      if(eid<0)
+        return -1;
+    }
+
+    return -1;
+  }
+
+  // The element across the face of eid opposite its vertex m, or -1.
+  int neighbour(int eid, size_t m) const{
+    const index_t *n = &(ENList[eid*nloc]);
+    index_t v0 = n[(m+1)%nloc];
+    for(int p=node_offset[v0];p<node_offset[v0+1];p++){
+      int e = node_elements[p];
+      if(e==eid)
+        continue;
+
+      const index_t *ne = &(ENList[e*nloc]);
+      size_t shared=0;
+      for(size_t k=0;k<nloc;k++){
+        if(k==m)
+          continue;
+        if(std::find(ne, ne+nloc, n[k])!=ne+nloc)
+          shared++;
+      }
+      if(shared==nloc-1)
+        return e;
+    }
+
+    return -1;
+  }
+
+  // Locate x, see locate(). lmin returns the smallest barycentric
+  // coordinate before clamping, i.e. x is outside the snapshot if it
+  // is negative.
+  int find(const real_t *x, real_t *bary, int seed, real_t &lmin) const{
+    if(seed>=0 && seed<(int)(ENList.size()/nloc)){
+      lmin = barycentric(seed, x, bary);
+      if(lmin>=-tol)
+        return seed;
+    }
+
+    int eid = index->locate(x, bary);
+    if(eid>=0){
+      lmin = *std::min_element(bary, bary+nloc);
+      return eid;
+    }
+
+    return index->closest(x, bary, lmin);
+  }
+
+  // Barycentric coordinates of x in element eid. Returns the smallest.
+  real_t barycentric(int eid, const real_t *x, real_t *l) const{
+    const index_t *n = &(ENList[eid*nloc]);
+    const real_t *v[4];
+    for(size_t m=0;m<nloc;m++)
+      v[m] = &(coords[n[m]*ndims]);
+
+    return ElementProperty<real_t>::barycentric(ndims, v, x, l);
+  }
+
+  // The elements around each vertex of the snapshot, in compressed row
+  // format.
+  void create_node_elements(){
+    int NElements = ENList.size()/nloc;
+
+    node_offset.assign(NNodes+1, 0);
+    for(size_t i=0;i<ENList.size();i++)
+      node_offset[ENList[i]+1]++;
+    for(size_t i=0;i<NNodes;i++)
+      node_offset[i+1] += node_offset[i];
+
+    node_elements.resize(node_offset[NNodes]);
+    std::vector<int> fill(node_offset.begin(), node_offset.end()-1);
+    for(int e=0;e<NElements;e++)
+      for(size_t m=0;m<nloc;m++)
+        node_elements[fill[ENList[e*nloc+m]]++] = e;
+  }
+
+  size_t ndims, nloc, NNodes;
+  std::vector<real_t> coords;
+  std::vector<index_t> ENList;
+
+  std::vector<int> node_offset, node_elements;
+  ElementIndex<real_t> *index;
+
+  static const real_t tol;
+  static const int max_walk=64;
+};
+
+template<typename real_t> const real_t FieldTransfer<real_t>::tol = 1.0e-10;
+
+#endif
@@ -0,0 +1,815 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef GMSHTOOLS_H
+#define GMSHTOOLS_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+
+extern "C" {
+#include "metis.h"
+}
+
+#ifdef HAVE_MPI
+#include "mpi_tools.h"
+#endif
+
+/*! \brief Reads and writes Gmsh MSH 4.1 binary files without going
+ * through VTK.
+ *
+ * Node and element blocks are read and written with one fread/fwrite
+ * per block, so there is no per-entity overhead. Line (2D) or
+ * triangle (3D) elements are boundary facets. Their physical tag
+ * becomes the boundary ID, or their entity tag if they have no
+ * physical tag. If the file has boundary facets, import_gmsh() calls
+ * Mesh::set_boundary(), so the facets must cover the whole boundary.
+ * Otherwise call create_boundary() after import, as for import_vtu.
+ *
+ * Partitioned files, which have a $PartitionedEntities section, keep
+ * their partitioning when the number of partitions equals the number
+ * of MPI processes. Otherwise the mesh is partitioned with METIS, as
+ * in VTKTools::import_vtu. Ghost cells are skipped. Every process
+ * parses the whole file.
+ *
+ * In parallel, export_gmsh() writes one file per process,
+ * basename_<rank>.msh. It holds the elements that process owns and
+ * uses global node numbers as node tags. Gmsh can therefore merge
+ * the pieces into a single mesh.
+ */
+template<typename real_t> class GmshTools{
+ public:
+  /*! Read a Gmsh MSH 4.1 binary file.
+   *
+   * @param filename name of the .msh file.
+   * @return the new mesh, or NULL if the file could not be read.
+   */
+  static Mesh<real_t>* import_gmsh(std::string filename){
+    Model model;
+    if(!parse(filename, model))
+      return NULL;
+
+    int ndims = model.conn[3].empty()?2:3;
+    int nloc = ndims+1;
+    if(model.conn[ndims].empty()){
+      std::cerr<<"ERROR: "<<filename<<" has no triangles or tetrahedra.\n";
+      return NULL;
+    }
+
+    NodeIndex index(model);
+
+    int nparts=1, rank=0;
+    MPI_Comm_size(MPI_COMM_WORLD, &nparts);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    // Compact numbering of the vertices used by the cells. Gmsh
+    // files usually also have geometry points and other unused nodes.
+    std::vector<index_t> gid(model.node_tags.size(), -1);
+    std::vector<real_t> x, y, z;
+    std::vector<index_t> ENList;
+    std::vector<int> epart;
+    bool keep_partitions = nparts>1 && model.npartitions==(size_t)nparts;
+    size_t NNodes=0;
+    for(typename std::vector<Block>::const_iterator blk=model.blocks[ndims].begin();blk!=model.blocks[ndims].end();++blk){
+      if(model.ghosts.count(blk->tag))
+        continue;
+
+      int part=-1;
+      if(keep_partitions){
+        std::map<std::pair<int, int>, int>::const_iterator it=model.partition.find(std::pair<int, int>(ndims, blk->tag));
+        if(it==model.partition.end() || it->second<1 || it->second>nparts)
+          keep_partitions = false;
+        else
+          part = it->second-1;
+      }
+
+      const size_t *tags = &(model.conn[ndims][blk->first*nloc]);
+      for(size_t i=0;i<blk->count*nloc;i++){
+        index_t p = index.find(tags[i]);
+        if(p<0){
+          std::cerr<<"ERROR: "<<filename<<" refers to undefined node "<<tags[i]<<".\n";
+          return NULL;
+        }
+        if(gid[p]<0){
+          gid[p] = NNodes++;
+          x.push_back(model.node_xyz[p*3]);
+          y.push_back(model.node_xyz[p*3+1]);
+          z.push_back(model.node_xyz[p*3+2]);
+        }
+        ENList.push_back(gid[p]);
+      }
+      epart.insert(epart.end(), blk->count, part);
+    }
+    size_t NElements = ENList.size()/nloc;
+
+    // Boundary facets with their IDs.
+    std::vector<index_t> facets;
+    std::vector<int> ids;
+    for(typename std::vector<Block>::const_iterator blk=model.blocks[ndims-1].begin();blk!=model.blocks[ndims-1].end();++blk){
+      int id = blk->tag;
+      std::map<std::pair<int, int>, int>::const_iterator it=model.physical.find(std::pair<int, int>(ndims-1, blk->tag));
+      if(it!=model.physical.end())
+        id = it->second;
+      else if(model.npartitions>0)
+        continue; // Partition interfaces are not boundaries.
+
+      const size_t *tags = &(model.conn[ndims-1][blk->first*ndims]);
+      for(size_t i=0;i<blk->count;i++){
+        bool used=true;
+        for(int j=0;j<ndims;j++){
+          index_t p = index.find(tags[i*ndims+j]);
+          if(p<0 || gid[p]<0){
+            used = false;
+            break;
+          }
+        }
+        if(!used)
+          continue;
+
+        for(int j=0;j<ndims;j++)
+          facets.push_back(gid[index.find(tags[i*ndims+j])]);
+        ids.push_back(id);
+      }
+    }
+    bool has_boundary = !ids.empty();
+
+    Mesh<real_t> *mesh=NULL;
+    if(nparts>1){
+      std::vector<index_t> owner_range;
+      std::vector<index_t> lnn2gnn;
+      std::vector<int> npart(NNodes, nparts);
+
+      if(keep_partitions){
+        // A vertex belongs to the lowest partition of the cells around it.
+        for(size_t i=0;i<NElements;i++)
+          for(int j=0;j<nloc;j++)
+            npart[ENList[i*nloc+j]] = std::min(npart[ENList[i*nloc+j]], epart[i]);
+      }else{
+        partition(NNodes, NElements, ndims, ENList, nparts, rank, epart, npart);
+      }
+
+      // Separate out owned nodes.
+      std::vector< std::vector<index_t> > node_partition(nparts);
+      for(size_t i=0;i<NNodes;i++)
+        node_partition[npart[i]].push_back(i);
+
+      std::vector<index_t> renumber(NNodes);
+      owner_range.push_back(0);
+      for(int i=0;i<nparts;i++){
+        int pNNodes = node_partition[i].size();
+        owner_range.push_back(owner_range[i]+pNNodes);
+        for(int j=0;j<pNNodes;j++)
+          renumber[node_partition[i][j]] = owner_range[i]+j;
+      }
+
+      std::vector<index_t> element_partition;
+      std::set<index_t> halo_nodes;
+      for(size_t i=0;i<NElements;i++){
+        bool resident=false;
+        for(int j=0;j<nloc;j++)
+          resident = resident || npart[ENList[i*nloc+j]]==rank;
+
+        if(resident){
+          element_partition.push_back(i);
+
+          for(int j=0;j<nloc;j++){
+            index_t nid = ENList[i*nloc+j];
+            if(npart[nid]!=rank)
+              halo_nodes.insert(nid);
+          }
+        }
+      }
+
+      // Append halo nodes to local node partition.
+      node_partition[rank].insert(node_partition[rank].end(), halo_nodes.begin(), halo_nodes.end());
+
+      std::vector<index_t> g2l(NNodes, -1);
+      size_t lNNodes = node_partition[rank].size();
+      lnn2gnn.resize(lNNodes);
+      std::vector<real_t> lx(lNNodes), ly(lNNodes), lz(lNNodes);
+      for(size_t i=0;i<lNNodes;i++){
+        index_t nid = node_partition[rank][i];
+        g2l[nid] = i;
+        lnn2gnn[i] = renumber[nid];
+        lx[i] = x[nid];
+        ly[i] = y[nid];
+        lz[i] = z[nid];
+      }
+
+      size_t lNElements = element_partition.size();
+      std::vector<index_t> lENList(lNElements*nloc);
+      for(size_t i=0;i<lNElements;i++)
+        for(int j=0;j<nloc;j++)
+          lENList[i*nloc+j] = renumber[ENList[element_partition[i]*nloc+j]];
+
+      // Keep the facets which are local to this process.
+      std::vector<index_t> lfacets;
+      std::vector<int> lids;
+      for(size_t i=0;i<ids.size();i++){
+        bool local=true;
+        for(int j=0;j<ndims;j++)
+          local = local && g2l[facets[i*ndims+j]]>=0;
+        if(local){
+          for(int j=0;j<ndims;j++)
+            lfacets.push_back(g2l[facets[i*ndims+j]]);
+          lids.push_back(ids[i]);
+        }
+      }
+
+      x.swap(lx);
+      y.swap(ly);
+      z.swap(lz);
+      ENList.swap(lENList);
+      facets.swap(lfacets);
+      ids.swap(lids);
+
+      MPI_Comm comm = MPI_COMM_WORLD;
+      if(ndims==2)
+        mesh = new Mesh<real_t>(lNNodes, lNElements, &(ENList[0]), &(x[0]), &(y[0]), &(lnn2gnn[0]), &(owner_range[0]), comm);
+      else
+        mesh = new Mesh<real_t>(lNNodes, lNElements, &(ENList[0]), &(x[0]), &(y[0]), &(z[0]), &(lnn2gnn[0]), &(owner_range[0]), comm);
+    }else{
+      if(ndims==2)
+        mesh = new Mesh<real_t>(NNodes, NElements, &(ENList[0]), &(x[0]), &(y[0]));
+      else
+        mesh = new Mesh<real_t>(NNodes, NElements, &(ENList[0]), &(x[0]), &(y[0]), &(z[0]));
+    }
+
+    if(has_boundary)
+      mesh->set_boundary(ids.size(), ids.empty()?NULL:&(facets[0]), ids.empty()?NULL:&(ids[0]));
+
+    return mesh;
+  }
+
+  /*! Write a mesh as a Gmsh MSH 4.1 binary file. Boundary facets are
+   * written with their boundary ID as entity and physical tag. There
+   * are no boundary facets unless create_boundary() or set_boundary()
+   * has been called.
+   *
+   * @param basename file name without the .msh extension.
+   * @param mesh the mesh to write.
+   * @return false if the file could not be written.
+   */
+  static bool export_gmsh(const char *basename, const Mesh<real_t> *mesh){
+    int rank = mesh->rank;
+    int nparts = mesh->num_processes;
+    int ndims = mesh->ndims;
+    int nloc = mesh->nloc;
+    size_t NElements = mesh->get_number_elements();
+    size_t NNodes = mesh->get_number_nodes();
+
+    std::string filename(basename);
+    if(nparts>1){
+      std::ostringstream suffix;
+      suffix<<"_"<<rank;
+      filename += suffix.str();
+    }
+    filename += ".msh";
+
+    // Select the elements owned by this process, their vertices and
+    // their boundary facets.
+    std::vector<size_t> cells;
+    std::map<int, std::vector<size_t> > facets;
+    std::vector<bool> used(NNodes, false);
+    bool has_boundary = mesh->boundary.size()==NElements*nloc;
+    for(size_t i=0;i<NElements;i++){
+      const index_t *n = mesh->get_element(i);
+      if(n[0]<0)
+        continue;
+
+      int owner = mesh->node_owner[n[0]];
+      for(int j=1;j<nloc;j++)
+        owner = std::min(owner, mesh->node_owner[n[j]]);
+      if(owner!=rank)
+        continue;
+
+      for(int j=0;j<nloc;j++){
+        used[n[j]] = true;
+        cells.push_back(tag(mesh, n[j]));
+      }
+
+      if(has_boundary){
+        for(int j=0;j<nloc;j++){
+          int id = mesh->boundary[i*nloc+j];
+          if(id>0){
+            std::vector<size_t> &facet = facets[id];
+            for(int k=1;k<nloc;k++)
+              facet.push_back(tag(mesh, n[(j+k)%nloc]));
+          }
+        }
+      }
+    }
+
+    std::vector<size_t> node_tags;
+    std::vector<double> xyz;
+    double bbox[6] = {0, 0, 0, 0, 0, 0};
+    for(size_t i=0;i<NNodes;i++){
+      if(!used[i])
+        continue;
+
+      const real_t *r = mesh->get_coords(i);
+      node_tags.push_back(tag(mesh, i));
+      for(int d=0;d<3;d++){
+        double v = d<ndims?r[d]:0.0;
+        if(xyz.size()<3){
+          bbox[d] = v;
+          bbox[d+3] = v;
+        }else{
+          bbox[d] = std::min(bbox[d], v);
+          bbox[d+3] = std::max(bbox[d+3], v);
+        }
+        xyz.push_back(v);
+      }
+    }
+
+    // Element tags are numbered consecutively across processes.
+    size_t ncells = cells.size()/nloc;
+    size_t nelements = ncells;
+    for(std::map<int, std::vector<size_t> >::const_iterator it=facets.begin();it!=facets.end();++it)
+      nelements += it->second.size()/ndims;
+    size_t offset = 0;
+#ifdef HAVE_MPI
+    if(nparts>1){
+      unsigned long long local = nelements, scan = 0;
+      MPI_Exscan(&local, &scan, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, mesh->get_mpi_comm());
+      if(rank>0)
+        offset = scan;
+    }
+#endif
+
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if(fp==NULL){
+      std::cerr<<"ERROR: Cannot open "<<filename<<" for writing.\n";
+      return false;
+    }
+
+    int one = 1;
+    fprintf(fp, "$MeshFormat\n4.1 1 %d\n", (int)sizeof(size_t));
+    fwrite(&one, sizeof(int), 1, fp);
+    fprintf(fp, "\n$EndMeshFormat\n");
+
+    // One entity for the cells and one per boundary ID.
+    fprintf(fp, "$Entities\n");
+    size_t nentities[] = {0, 0, 0, 0};
+    nentities[ndims-1] = facets.size();
+    nentities[ndims] = 1;
+    fwrite(nentities, sizeof(size_t), 4, fp);
+    for(std::map<int, std::vector<size_t> >::const_iterator it=facets.begin();it!=facets.end();++it)
+      write_entity(fp, it->first, bbox);
+    write_entity(fp, 1, bbox);
+    fprintf(fp, "\n$EndEntities\n");
+
+    fprintf(fp, "$Nodes\n");
+    size_t nnodes = node_tags.size();
+    size_t node_header[] = {1, nnodes, 0, 0};
+    if(nnodes>0){
+      node_header[2] = *std::min_element(node_tags.begin(), node_tags.end());
+      node_header[3] = *std::max_element(node_tags.begin(), node_tags.end());
+    }
+    fwrite(node_header, sizeof(size_t), 4, fp);
+    int node_block[] = {ndims, 1, 0};
+    fwrite(node_block, sizeof(int), 3, fp);
+    fwrite(&nnodes, sizeof(size_t), 1, fp);
+    if(nnodes>0){
+      fwrite(&(node_tags[0]), sizeof(size_t), nnodes, fp);
+      fwrite(&(xyz[0]), sizeof(double), xyz.size(), fp);
+    }
+    fprintf(fp, "\n$EndNodes\n");
+
+    fprintf(fp, "$Elements\n");
+    size_t element_header[] = {1+facets.size(), nelements, offset+1, offset+nelements};
+    fwrite(element_header, sizeof(size_t), 4, fp);
+    write_block(fp, ndims, 1, ndims==2?TRIANGLE:TETRAHEDRON, nloc, cells, offset);
+    for(std::map<int, std::vector<size_t> >::const_iterator it=facets.begin();it!=facets.end();++it)
+      write_block(fp, ndims-1, it->first, ndims==2?LINE:TRIANGLE, ndims, it->second, offset);
+    fprintf(fp, "\n$EndElements\n");
+
+    bool ok = !ferror(fp);
+    if(fclose(fp)!=0 || !ok){
+      std::cerr<<"ERROR: Failed to write "<<filename<<".\n";
+      return false;
+    }
+
+    return true;
+  }
+
+ private:
+  enum ElementType{LINE=1, TRIANGLE=2, TETRAHEDRON=4};
+
+  /// A block of elements of the same type on one entity.
+  struct Block{
+    int tag;
+    size_t first, count;
+  };
+
+  /// Everything import_gmsh() needs from the file.
+  struct Model{
+    Model() : npartitions(0){}
+
+    std::map<std::pair<int, int>, int> physical;  // (dim, tag) -> first physical tag
+    std::map<std::pair<int, int>, int> partition; // (dim, tag) -> first partition
+    std::set<int> ghosts;
+    size_t npartitions;
+
+    std::vector<size_t> node_tags;
+    std::vector<double> node_xyz;
+    size_t min_node_tag, max_node_tag;
+
+    // Node tags and blocks of the lines, triangles and tetrahedra,
+    // indexed by dimension.
+    std::vector<size_t> conn[4];
+    std::vector<Block> blocks[4];
+  };
+
+  /// Maps node tags to their position in the $Nodes section.
+  class NodeIndex{
+   public:
+    NodeIndex(const Model &model) : min_tag(model.min_node_tag){
+      size_t nnodes = model.node_tags.size();
+      dense = nnodes>0 && model.max_node_tag-model.min_node_tag<2*nnodes+1024;
+      if(dense){
+        lut.resize(model.max_node_tag-model.min_node_tag+1, -1);
+        for(size_t i=0;i<nnodes;i++)
+          lut[model.node_tags[i]-min_tag] = i;
+      }else{
+        sorted.resize(nnodes);
+        for(size_t i=0;i<nnodes;i++)
+          sorted[i] = std::pair<size_t, index_t>(model.node_tags[i], i);
+        std::sort(sorted.begin(), sorted.end());
+      }
+    }
+
+    index_t find(size_t tag) const{
+      if(dense)
+        return (tag<min_tag || tag-min_tag>=lut.size())?-1:lut[tag-min_tag];
+
+      typename std::vector< std::pair<size_t, index_t> >::const_iterator it =
+        std::lower_bound(sorted.begin(), sorted.end(), std::pair<size_t, index_t>(tag, -1));
+      return (it==sorted.end() || it->first!=tag)?-1:it->second;
+    }
+
+   private:
+    bool dense;
+    size_t min_tag;
+    std::vector<index_t> lut;
+    std::vector< std::pair<size_t, index_t> > sorted;
+  };
+
+  static size_t tag(const Mesh<real_t> *mesh, index_t nid){
+    return (mesh->num_processes>1?mesh->lnn2gnn[nid]:nid)+1;
+  }
+
+  static void write_entity(FILE *fp, int tag, const double *bbox){
+    size_t nphysical=1, nbounding=0;
+    fwrite(&tag, sizeof(int), 1, fp);
+    fwrite(bbox, sizeof(double), 6, fp);
+    fwrite(&nphysical, sizeof(size_t), 1, fp);
+    fwrite(&tag, sizeof(int), 1, fp);
+    fwrite(&nbounding, sizeof(size_t), 1, fp);
+  }
+
+  static void write_block(FILE *fp, int dim, int tag, int type, int nnodes, const std::vector<size_t> &conn, size_t &offset){
+    size_t n = conn.size()/nnodes;
+    std::vector<size_t> data(n*(nnodes+1));
+    for(size_t i=0;i<n;i++){
+      data[i*(nnodes+1)] = ++offset;
+      for(int j=0;j<nnodes;j++)
+        data[i*(nnodes+1)+1+j] = conn[i*nnodes+j];
+    }
+
+    int block[] = {dim, tag, type};
+    fwrite(block, sizeof(int), 3, fp);
+    fwrite(&n, sizeof(size_t), 1, fp);
+    if(n>0)
+      fwrite(&(data[0]), sizeof(size_t), data.size(), fp);
+  }
+
+  /// Number of nodes of a Gmsh element type, or -1 if unknown.
+  static int nodes_per_element(int type){
+    static const int nnodes[] = {-1, 2, 3, 4, 4, 8, 6, 5, 3, 6, 9, 10, 27, 18, 14, 1, 8, 20, 15, 13};
+    return (type>0 && type<(int)(sizeof(nnodes)/sizeof(int)))?nnodes[type]:-1;
+  }
+
+  template<typename T>
+    static bool read(FILE *fp, T *buffer, size_t n){
+    return n==0 || fread(buffer, sizeof(T), n, fp)==n;
+  }
+
+  /// Skip the rest of a section, up to and including "$End<name>".
+  static bool end_section(FILE *fp, const std::string &name){
+    std::string end = "$End"+name;
+    char line[1024];
+    while(fgets(line, sizeof(line), fp)!=NULL){
+      if(strncmp(line, end.c_str(), end.size())==0)
+        return true;
+    }
+    return false;
+  }
+
+  static bool parse(const std::string &filename, Model &model){
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if(fp==NULL){
+      std::cerr<<"ERROR: Cannot open "<<filename<<" for reading.\n";
+      return false;
+    }
+
+    bool ok=true, have_format=false, have_nodes=false;
+    char line[1024];
+    while(ok && fgets(line, sizeof(line), fp)!=NULL){
+      if(line[0]!='$')
+        continue;
+
+      std::string section(line+1);
+      section = section.substr(0, section.find_first_of(" \r\n"));
+
+      if(section=="MeshFormat"){
+        ok = read_format(fp, filename);
+        have_format = ok;
+      }else if(!have_format){
+        break;
+      }else if(section=="Entities"){
+        ok = read_entities(fp, model, false);
+      }else if(section=="PartitionedEntities"){
+        ok = read_entities(fp, model, true);
+      }else if(section=="Nodes"){
+        ok = read_nodes(fp, model);
+        have_nodes = ok;
+      }else if(section=="Elements"){
+        ok = read_elements(fp, model);
+      }
+
+      if(ok)
+        ok = end_section(fp, section);
+    }
+    fclose(fp);
+
+    if(!have_format){
+      std::cerr<<"ERROR: "<<filename<<" is not a Gmsh MSH file.\n";
+      return false;
+    }
+    if(!ok || !have_nodes){
+      std::cerr<<"ERROR: "<<filename<<" is truncated or corrupt.\n";
+      return false;
+    }
+
+    return true;
+  }
+
+  static bool read_format(FILE *fp, const std::string &filename){
+    double version;
+    int binary, data_size;
+    if(fscanf(fp, "%lf %d %d", &version, &binary, &data_size)!=3)
+      return false;
+
+    if(version<4.1 || version>=5.0 || binary!=1 || data_size!=(int)sizeof(size_t)){
+      std::cerr<<"ERROR: "<<filename<<" must be a binary MSH 4.1 file with "<<sizeof(size_t)<<" byte size_t.\n";
+      return false;
+    }
+
+    fgetc(fp); // '\n'
+    int one;
+    if(!read(fp, &one, 1))
+      return false;
+    if(one!=1){
+      std::cerr<<"ERROR: "<<filename<<" was written with a different byte order.\n";
+      return false;
+    }
+
+    return true;
+  }
+
+  static bool read_entities(FILE *fp, Model &model, bool partitioned){
+    if(partitioned){
+      size_t nghosts;
+      if(!read(fp, &(model.npartitions), 1) || !read(fp, &nghosts, 1))
+        return false;
+      std::vector<int> ghosts(2*nghosts);
+      if(!read(fp, ghosts.empty()?NULL:&(ghosts[0]), ghosts.size()))
+        return false;
+      for(size_t i=0;i<nghosts;i++)
+        model.ghosts.insert(ghosts[2*i]);
+    }
+
+    size_t nentities[4];
+    if(!read(fp, nentities, 4))
+      return false;
+
+    std::vector<int> ints;
+    for(int dim=0;dim<4;dim++){
+      for(size_t i=0;i<nentities[dim];i++){
+        int tag;
+        if(!read(fp, &tag, 1))
+          return false;
+        std::pair<int, int> key(dim, tag);
+
+        if(partitioned){
+          int parent[2];
+          size_t nparts;
+          if(!read(fp, parent, 2) || !read(fp, &nparts, 1))
+            return false;
+          ints.resize(nparts);
+          if(!read(fp, ints.empty()?NULL:&(ints[0]), nparts))
+            return false;
+          if(nparts>0)
+            model.partition[key] = ints[0];
+        }
+
+        double bbox[6];
+        size_t nphysical;
+        if(!read(fp, bbox, dim==0?3:6) || !read(fp, &nphysical, 1))
+          return false;
+        ints.resize(nphysical);
+        if(!read(fp, ints.empty()?NULL:&(ints[0]), nphysical))
+          return false;
+        if(nphysical>0)
+          model.physical[key] = ints[0];
+
+        if(dim>0){
+          size_t nbounding;
+          if(!read(fp, &nbounding, 1))
+            return false;
+          ints.resize(nbounding);
+          if(!read(fp, ints.empty()?NULL:&(ints[0]), nbounding))
+            return false;
+        }
+      }
+    }
+
+    return true;
+  }
+
+  static bool read_nodes(FILE *fp, Model &model){
+    size_t header[4];
+    if(!read(fp, header, 4))
+      return false;
+
+    size_t nblocks = header[0], nnodes = header[1];
+    model.min_node_tag = header[2];
+    model.max_node_tag = header[3];
+    model.node_tags.resize(nnodes);
+    model.node_xyz.resize(nnodes*3);
+
+    std::vector<double> buffer;
+    size_t pos=0;
+    for(size_t b=0;b<nblocks;b++){
+      int block[3]; // dim, tag, parametric
+      size_t n;
+      if(!read(fp, block, 3) || !read(fp, &n, 1) || pos+n>nnodes)
+        return false;
+      if(n==0)
+        continue;
+
+      if(!read(fp, &(model.node_tags[pos]), n))
+        return false;
+
+      // NodeIndex looks tags up within the range given in the header.
+      for(size_t i=pos;i<pos+n;i++){
+        if(model.node_tags[i]<model.min_node_tag || model.node_tags[i]>model.max_node_tag){
+          std::cerr<<"ERROR: Gmsh node tag "<<model.node_tags[i]<<" is outside the range "
+                   <<model.min_node_tag<<" to "<<model.max_node_tag<<" of the $Nodes section.\n";
+          return false;
+        }
+      }
+
+      if(block[2]==0){
+        if(!read(fp, &(model.node_xyz[pos*3]), n*3))
+          return false;
+      }else{
+        // Parametric coordinates follow x, y, z for each node.
+        size_t stride = 3+block[0];
+        buffer.resize(n*stride);
+        if(!read(fp, &(buffer[0]), buffer.size()))
+          return false;
+        for(size_t i=0;i<n;i++)
+          for(int d=0;d<3;d++)
+            model.node_xyz[(pos+i)*3+d] = buffer[i*stride+d];
+      }
+      pos += n;
+    }
+
+    return pos==nnodes;
+  }
+
+  static bool read_elements(FILE *fp, Model &model){
+    size_t header[4];
+    if(!read(fp, header, 4))
+      return false;
+
+    std::vector<size_t> buffer;
+    for(size_t b=0;b<header[0];b++){
+      int block[3]; // dim, tag, type
+      size_t n;
+      if(!read(fp, block, 3) || !read(fp, &n, 1))
+        return false;
+
+      int nnodes = nodes_per_element(block[2]);
+      if(nnodes<0){
+        std::cerr<<"ERROR: Unsupported Gmsh element type "<<block[2]<<".\n";
+        return false;
+      }
+
+      buffer.resize(n*(nnodes+1));
+      if(!read(fp, buffer.empty()?NULL:&(buffer[0]), buffer.size()))
+        return false;
+
+      int dim;
+      switch(block[2]){
+      case LINE: dim=1; break;
+      case TRIANGLE: dim=2; break;
+      case TETRAHEDRON: dim=3; break;
+      default: continue;
+      }
+
+      Block blk;
+      blk.tag = block[1];
+      blk.first = model.conn[dim].size()/nnodes;
+      blk.count = n;
+      model.blocks[dim].push_back(blk);
+
+      std::vector<size_t> &conn = model.conn[dim];
+      size_t first = conn.size();
+      conn.resize(first+n*nnodes);
+      for(size_t i=0;i<n;i++)
+        for(int j=0;j<nnodes;j++)
+          conn[first+i*nnodes+j] = buffer[i*(nnodes+1)+1+j];
+    }
+
+    return true;
+  }
+
+  /// Partition the vertices with METIS, as in VTKTools::import_vtu.
+  static void partition(size_t NNodes, size_t NElements, int ndims, const std::vector<index_t> &ENList,
+                        int nparts, int rank, std::vector<int> &epart, std::vector<int> &npart){
+    int nloc = ndims+1;
+    epart.assign(NElements, 0);
+    npart.assign(NNodes, 0);
+
+    if(rank==0){
+      int edgecut;
+      std::vector<int> eind(ENList.begin(), ENList.end());
+      int intNElements = NElements;
+      int intNNodes = NNodes;
+
+#ifdef METIS_VER_MAJOR
+      int vsize = nloc - 1;
+      std::vector<int> eptr(NElements+1, 0);
+      for(size_t i=0;i<NElements;i++)
+        eptr[i+1] = eptr[i]+nloc;
+      METIS_PartMeshNodal(&intNElements, &intNNodes, &(eptr[0]), &(eind[0]), NULL, &vsize,
+                          &nparts, NULL, NULL, &edgecut, &(epart[0]), &(npart[0]));
+#else
+      std::vector<int> etype(NElements, ndims-1);
+      int numflag = 0;
+      METIS_PartMeshNodal(&intNElements, &intNNodes, &(eind[0]), &(etype[0]), &numflag,
+                          &nparts, &edgecut, &(epart[0]), &(npart[0]));
+#endif
+    }
+
+    MPI_Bcast(&(npart[0]), NNodes, MPI_INT, 0, MPI_COMM_WORLD);
+  }
+};
+
+#endif
@@ -37,12 +37,206 @@
 #ifndef HALOEXCHANGE_H
 #define HALOEXCHANGE_H
 
+#include <algorithm>
 #include <vector>
 #include <cassert>
 
 #include "PragmaticTypes.h"
+#include "Profiler.h"
 #include "mpi_tools.h"
 
+/*! Query the neighbourhood of a distributed graph communicator, such
+ * as the one returned by Mesh::get_halo_comm(). The mesh caches its own
+ * neighbourhood, so this is only needed for communicators of unknown
+ * topology.
+ *
+ * @param comm the mpi communicator.
+ * @param sources ranks that halo data is received from.
+ * @param destinations ranks that halo data is sent to.
+ * @return false if comm does not carry a MPI_DIST_GRAPH topology.
+ */
+inline bool halo_neighbours(MPI_Comm comm, std::vector<int> &sources, std::vector<int> &destinations){
+  int topology;
+  MPI_Topo_test(comm, &topology);
+  if(topology!=MPI_DIST_GRAPH)
+    return false;
+
+  int indegree, outdegree, weighted;
+  MPI_Dist_graph_neighbors_count(comm, &indegree, &outdegree, &weighted);
+
+  sources.resize(indegree);
+  destinations.resize(outdegree);
+  MPI_Dist_graph_neighbors(comm, indegree, sources.data(), MPI_UNWEIGHTED,
+                           outdegree, destinations.data(), MPI_UNWEIGHTED);
+
+#ifndef NDEBUG
+  // Every rank we share halo vertices with has to be both a source and
+  // a destination, otherwise the neighbourhood collectives silently
+  // drop data.
+  std::vector<int> sorted_sources(sources), sorted_destinations(destinations);
+  std::sort(sorted_sources.begin(), sorted_sources.end());
+  std::sort(sorted_destinations.begin(), sorted_destinations.end());
+  assert(sorted_sources==sorted_destinations);
+#endif
+
+  return true;
+}
+
+/*! Exchange variable length blocks with the halo neighbours of a
+ * graph communicator using a single MPI_Neighbor_alltoallv.
+ *
+ * @param comm distributed graph communicator.
+ * @param sources ranks that data is received from.
+ * @param destinations ranks that data is sent to.
+ * @param send_buff packed data for each rank in destinations.
+ * @param send_cnt number of items sent to each rank in destinations.
+ * @param recv_buff resized to hold the data received.
+ * @param recv_cnt number of items received from each rank in sources.
+ */
+template <typename DATATYPE>
+  void neighbour_alltoallv(MPI_Comm comm,
+                           const std::vector<int> &sources,
+                           const std::vector<int> &destinations,
+                           const std::vector<DATATYPE> &send_buff, const std::vector<int> &send_cnt,
+                           std::vector<DATATYPE> &recv_buff, const std::vector<int> &recv_cnt){
+  mpi_type_wrapper<DATATYPE> wrap;
+
+  std::vector<int> send_displ(destinations.size()+1, 0);
+  for(size_t i=0;i<destinations.size();i++)
+    send_displ[i+1] = send_displ[i]+send_cnt[i];
+  assert(send_displ.back()==(int)send_buff.size());
+
+  std::vector<int> recv_displ(sources.size()+1, 0);
+  for(size_t i=0;i<sources.size();i++)
+    recv_displ[i+1] = recv_displ[i]+recv_cnt[i];
+  recv_buff.resize(recv_displ.back());
+
+  MPI_Neighbor_alltoallv(send_buff.data(), send_cnt.data(), send_displ.data(), wrap.mpi_type,
+                         recv_buff.data(), recv_cnt.data(), recv_displ.data(), wrap.mpi_type, comm);
+}
+
+/*! As neighbour_alltoallv() but nonblocking: the exchange is started
+ * with MPI_Ineighbor_alltoallv and completes when request does. The
+ * buffers, counts and displacements must not be touched until then.
+ *
+ * @param send_displ set to the offset of each destination in send_buff.
+ * @param recv_displ set to the offset of each source in recv_buff.
+ * @param request completed by MPI_Wait.
+ */
+template <typename DATATYPE>
+  void neighbour_ialltoallv(MPI_Comm comm,
+                            const std::vector<int> &sources,
+                            const std::vector<int> &destinations,
+                            const std::vector<DATATYPE> &send_buff, const std::vector<int> &send_cnt,
+                            std::vector<int> &send_displ,
+                            std::vector<DATATYPE> &recv_buff, const std::vector<int> &recv_cnt,
+                            std::vector<int> &recv_displ,
+                            MPI_Request *request){
+  mpi_type_wrapper<DATATYPE> wrap;
+
+  send_displ.assign(destinations.size()+1, 0);
+  for(size_t i=0;i<destinations.size();i++)
+    send_displ[i+1] = send_displ[i]+send_cnt[i];
+  assert(send_displ.back()==(int)send_buff.size());
+
+  recv_displ.assign(sources.size()+1, 0);
+  for(size_t i=0;i<sources.size();i++)
+    recv_displ[i+1] = recv_displ[i]+recv_cnt[i];
+  recv_buff.resize(recv_displ.back());
+
+  MPI_Ineighbor_alltoallv(send_buff.data(), send_cnt.data(), send_displ.data(), wrap.mpi_type,
+                          recv_buff.data(), recv_cnt.data(), recv_displ.data(), wrap.mpi_type, comm, request);
+}
+
+/*! Update the halo values of vec over a graph communicator whose
+ * neighbourhood is already known, see Mesh::update_halo_comm().
+ *
+ * @param comm distributed graph communicator.
+ * @param sources ranks that halo data is received from.
+ * @param destinations ranks that halo data is sent to.
+ * @param send vertices sent to each process.
+ * @param recv vertices received from each process.
+ * @param vec data, block values per vertex.
+ */
+template <typename DATATYPE, int block>
+  void neighbour_halo_update(MPI_Comm comm,
+                             const std::vector<int> &sources,
+                             const std::vector<int> &destinations,
+                             const std::vector< std::vector<index_t> > &send,
+                             const std::vector< std::vector<index_t> > &recv,
+                             std::vector<DATATYPE> &vec){
+  PRAGMATIC_TIMER("halo_update");
+  PRAGMATIC_COUNT(PROFILE_HALO_UPDATES, 1);
+
+  std::vector<int> send_cnt(destinations.size());
+  std::vector<DATATYPE> send_buff;
+  for(size_t i=0;i<destinations.size();i++){
+    const std::vector<index_t> &halo = send[destinations[i]];
+    send_cnt[i] = halo.size()*block;
+    for(typename std::vector<index_t>::const_iterator it=halo.begin();it!=halo.end();++it)
+      for(int j=0;j<block;j++)
+        send_buff.push_back(vec[(*it)*block+j]);
+  }
+
+  std::vector<int> recv_cnt(sources.size());
+  for(size_t i=0;i<sources.size();i++)
+    recv_cnt[i] = recv[sources[i]].size()*block;
+
+  std::vector<DATATYPE> recv_buff;
+  neighbour_alltoallv(comm, sources, destinations, send_buff, send_cnt, recv_buff, recv_cnt);
+
+  int k=0;
+  for(size_t i=0;i<sources.size();i++){
+    const std::vector<index_t> &halo = recv[sources[i]];
+    for(typename std::vector<index_t>::const_iterator it=halo.begin();it!=halo.end();++it)
+      for(int j=0;j<block;j++)
+        vec[(*it)*block+j] = recv_buff[k++];
+  }
+}
+
+/// As above, but update two arrays in a single exchange.
+template <typename DATATYPE, int block0, int block1>
+  void neighbour_halo_update(MPI_Comm comm,
+                             const std::vector<int> &sources,
+                             const std::vector<int> &destinations,
+                             const std::vector< std::vector<index_t> > &send,
+                             const std::vector< std::vector<index_t> > &recv,
+                             std::vector<DATATYPE> &vec0, std::vector<DATATYPE> &vec1){
+  PRAGMATIC_TIMER("halo_update");
+  PRAGMATIC_COUNT(PROFILE_HALO_UPDATES, 1);
+
+  std::vector<int> send_cnt(destinations.size());
+  std::vector<DATATYPE> send_buff;
+  for(size_t i=0;i<destinations.size();i++){
+    const std::vector<index_t> &halo = send[destinations[i]];
+    send_cnt[i] = halo.size()*(block0+block1);
+    for(typename std::vector<index_t>::const_iterator it=halo.begin();it!=halo.end();++it){
+      for(int j=0;j<block0;j++)
+        send_buff.push_back(vec0[(*it)*block0+j]);
+      for(int j=0;j<block1;j++)
+        send_buff.push_back(vec1[(*it)*block1+j]);
+    }
+  }
+
+  std::vector<int> recv_cnt(sources.size());
+  for(size_t i=0;i<sources.size();i++)
+    recv_cnt[i] = recv[sources[i]].size()*(block0+block1);
+
+  std::vector<DATATYPE> recv_buff;
+  neighbour_alltoallv(comm, sources, destinations, send_buff, send_cnt, recv_buff, recv_cnt);
+
+  int k=0;
+  for(size_t i=0;i<sources.size();i++){
+    const std::vector<index_t> &halo = recv[sources[i]];
+    for(typename std::vector<index_t>::const_iterator it=halo.begin();it!=halo.end();++it){
+      for(int j=0;j<block0;j++)
+        vec0[(*it)*block0+j] = recv_buff[k++];
+      for(int j=0;j<block1;j++)
+        vec1[(*it)*block1+j] = recv_buff[k++];
+    }
+  }
+}
+
 template <typename DATATYPE, int block>
   void halo_update(MPI_Comm comm,
 		   const std::vector< std::vector<index_t> > &send,
@@ -52,10 +246,20 @@ template <typename DATATYPE, int block>
   MPI_Comm_size(comm, &num_processes);
   if(num_processes<2)
     return;
-  
+
   assert(num_processes==send.size());
   assert(num_processes==recv.size());
-  
+
+  // If comm knows the halo neighbourhood then only talk to the neighbours.
+  std::vector<int> sources, destinations;
+  if(halo_neighbours(comm, sources, destinations)){
+    neighbour_halo_update<DATATYPE, block>(comm, sources, destinations, send, recv, vec);
+    return;
+  }
+
+  PRAGMATIC_TIMER("halo_update");
+  PRAGMATIC_COUNT(PROFILE_HALO_UPDATES, 1);
+
   int rank;
   MPI_Comm_rank(comm, &rank);
   
@@ -112,10 +316,20 @@ template <typename DATATYPE, int block0, int block1>
   MPI_Comm_size(comm, &num_processes);
   if(num_processes<2)
     return;
- 
+
   assert(num_processes==send.size());
   assert(num_processes==recv.size());
- 
+
+  // If comm knows the halo neighbourhood then only talk to the neighbours.
+  std::vector<int> sources, destinations;
+  if(halo_neighbours(comm, sources, destinations)){
+    neighbour_halo_update<DATATYPE, block0, block1>(comm, sources, destinations, send, recv, vec0, vec1);
+    return;
+  }
+
+  PRAGMATIC_TIMER("halo_update");
+  PRAGMATIC_COUNT(PROFILE_HALO_UPDATES, 1);
+
   int rank;
   MPI_Comm_rank(comm, &rank);
   
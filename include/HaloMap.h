@@ -0,0 +1,138 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+#ifndef HALOMAP_H
+#define HALOMAP_H
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include "PragmaticTypes.h"
+
+/// Bits of the per-vertex halo flags, see Mesh::halo_flag.
+enum {HALO_SEND=1, HALO_RECV=2};
+
+/*! \brief Maps the global node numbers of the halo vertices shared with
+ * one process to local node numbers.
+ *
+ * Entries are kept in a flat array sorted by global node number, so
+ * look-ups are a binary search over contiguous memory. Global numbers
+ * handed out during adaptivity grow monotonically, so insert() usually
+ * appends at the end.
+ */
+class HaloMap{
+ public:
+  typedef std::pair<index_t, index_t> value_type;
+  typedef std::vector<value_type>::const_iterator const_iterator;
+
+  /// Add the mapping gnn -> lnn, replacing any existing entry for gnn.
+  void insert(index_t gnn, index_t lnn){
+    if(map.empty() || map.back().first<gnn){
+      map.push_back(value_type(gnn, lnn));
+      return;
+    }
+
+    std::vector<value_type>::iterator it = lower(gnn);
+    if(it!=map.end() && it->first==gnn)
+      it->second = lnn;
+    else
+      map.insert(it, value_type(gnn, lnn));
+  }
+
+  /// Return 1 if gnn is in the map, 0 otherwise.
+  size_t count(index_t gnn) const{
+    const_iterator it = lower(gnn);
+    return (it!=map.end() && it->first==gnn)?1:0;
+  }
+
+  /// Return the local node number of gnn, or -1 if it is not in the map.
+  index_t find(index_t gnn) const{
+    const_iterator it = lower(gnn);
+    if(it!=map.end() && it->first==gnn)
+      return it->second;
+    return -1;
+  }
+
+  /// Build the map from a list of local node numbers and their global numbers.
+  void assign(const std::vector<index_t> &lnn, const std::vector<index_t> &lnn2gnn){
+    map.resize(lnn.size());
+    for(size_t i=0;i<lnn.size();i++)
+      map[i] = value_type(lnn2gnn[lnn[i]], lnn[i]);
+    std::sort(map.begin(), map.end());
+  }
+
+  void clear(){
+    map.clear();
+  }
+
+  void swap(HaloMap &other){
+    map.swap(other.map);
+  }
+
+  size_t size() const{
+    return map.size();
+  }
+
+  size_t capacity() const{
+    return map.capacity();
+  }
+
+  const_iterator begin() const{
+    return map.begin();
+  }
+
+  const_iterator end() const{
+    return map.end();
+  }
+
+ private:
+  std::vector<value_type>::iterator lower(index_t gnn){
+    return std::lower_bound(map.begin(), map.end(), value_type(gnn, 0), compare);
+  }
+
+  const_iterator lower(index_t gnn) const{
+    return std::lower_bound(map.begin(), map.end(), value_type(gnn, 0), compare);
+  }
+
+  static bool compare(const value_type &a, const value_type &b){
+    return a.first<b.first;
+  }
+
+  std::vector<value_type> map;
+};
+
+#endif
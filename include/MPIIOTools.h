@@ -0,0 +1,418 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef MPIIO_TOOLS_H
+#define MPIIO_TOOLS_H
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "Mesh.h"
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#include "mpi_tools.h"
+
+/*! \brief Toolkit for reading and writing a mesh in parallel with MPI-IO.
+ *
+ * The mesh is stored in a single binary file (.pmesh): a fixed-size
+ * header followed by the global coordinates and metric, ordered by
+ * global node number, and the global element-node list. Unlike
+ * VTKTools::import_vtu, no process reads the whole file. Each process
+ * reads a contiguous slab of vertices and elements with collective
+ * reads, and the elements and halo vertices are then redistributed
+ * to the processes which need them. Memory and I/O therefore scale
+ * with the size of the local mesh.
+ *
+ * Vertices are partitioned into contiguous ranges of global node
+ * numbers, so the partitioning follows the vertex ordering of the
+ * file. export_pmesh() numbers the vertices of each process
+ * contiguously, so a file written on P processes and read back on P
+ * processes keeps its partitioning. Boundary labels are not stored.
+ * Call create_boundary() after import, as for import_vtu.
+ */
+template<typename real_t> class MPIIOTools{
+ public:
+  /*! Read a mesh written by export_pmesh(). This is collective over
+   * MPI_COMM_WORLD.
+   *
+   * @param filename name of the .pmesh file.
+   * @return the new mesh, or NULL if the file could not be read.
+   */
+  static Mesh<real_t>* import_pmesh(const char *filename){
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int rank, nprocs;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+
+    mpi_type_wrapper<index_t> mpi_index_t_wrapper;
+    MPI_Datatype MPI_INDEX_T = mpi_index_t_wrapper.mpi_type;
+    mpi_type_wrapper<real_t> mpi_real_t_wrapper;
+    MPI_Datatype MPI_REAL_T = mpi_real_t_wrapper.mpi_type;
+
+    MPI_File fh;
+    if(MPI_File_open(comm, (char *)filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh)!=MPI_SUCCESS){
+      if(rank==0)
+        std::cerr<<"ERROR: Cannot open "<<filename<<" for reading.\n";
+      return NULL;
+    }
+
+    Header header;
+    MPI_File_read_at_all(fh, 0, &header, sizeof(Header), MPI_BYTE, MPI_STATUS_IGNORE);
+    if(!validate(filename, header, rank)){
+      MPI_File_close(&fh);
+      return NULL;
+    }
+
+    size_t ndims = header.ndims;
+    size_t nloc = header.nloc;
+    size_t msize = header.msize;
+    bool has_metric = header.flags&HAS_METRIC;
+
+    // Vertex ownership: contiguous ranges of global node numbers.
+    std::vector<index_t> owner_range(nprocs+1);
+    for(int i=0;i<=nprocs;i++)
+      owner_range[i] = (index_t)((header.NNodes*i)/nprocs);
+
+    // Read the owned vertices.
+    index_t gnn0 = owner_range[rank];
+    size_t NPNodes = owner_range[rank+1]-gnn0;
+    std::vector<real_t> coords(NPNodes*ndims);
+    MPI_File_read_at_all(fh, header.coords_offset+(MPI_Offset)gnn0*ndims*sizeof(real_t),
+                         coords.empty()?NULL:&(coords[0]), NPNodes*ndims, MPI_REAL_T, MPI_STATUS_IGNORE);
+    std::vector<double> metric;
+    if(has_metric){
+      metric.resize(NPNodes*msize);
+      MPI_File_read_at_all(fh, header.metric_offset+(MPI_Offset)gnn0*msize*sizeof(double),
+                           metric.empty()?NULL:&(metric[0]), NPNodes*msize, MPI_DOUBLE, MPI_STATUS_IGNORE);
+    }
+
+    // Read a slab of elements.
+    uint64_t eid0 = (header.NElements*rank)/nprocs;
+    size_t NSElements = (header.NElements*(rank+1))/nprocs - eid0;
+    std::vector<index_t> slab(NSElements*nloc);
+    MPI_File_read_at_all(fh, header.ENList_offset+(MPI_Offset)eid0*nloc*sizeof(index_t),
+                         slab.empty()?NULL:&(slab[0]), NSElements*nloc, MPI_INDEX_T, MPI_STATUS_IGNORE);
+
+    MPI_File_close(&fh);
+
+    // Send each element to every process owning one of its vertices.
+    std::vector< std::vector<index_t> > send_elements(nprocs);
+    for(size_t i=0;i<NSElements;i++){
+      int owners[4];
+      for(size_t j=0;j<nloc;j++)
+        owners[j] = owner(owner_range, slab[i*nloc+j]);
+      std::sort(owners, owners+nloc);
+      for(size_t j=0;j<nloc;j++){
+        if(j>0 && owners[j]==owners[j-1])
+          continue;
+        send_elements[owners[j]].insert(send_elements[owners[j]].end(), slab.begin()+i*nloc, slab.begin()+(i+1)*nloc);
+      }
+    }
+    std::vector<index_t>().swap(slab);
+
+    std::vector<index_t> ENList;
+    alltoallv(comm, MPI_INDEX_T, send_elements, ENList);
+    size_t NElements = ENList.size()/nloc;
+
+    // Request the vertices of the halo from their owners.
+    std::set<index_t> halo_set;
+    for(typename std::vector<index_t>::const_iterator it=ENList.begin();it!=ENList.end();++it)
+      if(*it<owner_range[rank] || *it>=owner_range[rank+1])
+        halo_set.insert(*it);
+
+    std::vector< std::vector<index_t> > requests(nprocs);
+    for(typename std::set<index_t>::const_iterator it=halo_set.begin();it!=halo_set.end();++it)
+      requests[owner(owner_range, *it)].push_back(*it);
+    std::vector<index_t> halo(halo_set.begin(), halo_set.end());
+    std::set<index_t>().swap(halo_set);
+
+    std::vector<int> request_cnt;
+    std::vector<index_t> requested;
+    alltoallv(comm, MPI_INDEX_T, requests, requested, &request_cnt);
+
+    // Reply with coordinates and metric, in the order they were requested.
+    std::vector< std::vector<real_t> > reply_coords(nprocs);
+    std::vector< std::vector<double> > reply_metric(nprocs);
+    typename std::vector<index_t>::const_iterator rit=requested.begin();
+    for(int i=0;i<nprocs;i++){
+      for(int j=0;j<request_cnt[i];j++, ++rit){
+        size_t lnn = *rit-gnn0;
+        reply_coords[i].insert(reply_coords[i].end(), coords.begin()+lnn*ndims, coords.begin()+(lnn+1)*ndims);
+        if(has_metric)
+          reply_metric[i].insert(reply_metric[i].end(), metric.begin()+lnn*msize, metric.begin()+(lnn+1)*msize);
+      }
+    }
+
+    // Requests to each process were made in increasing order of gnn, and
+    // the replies arrive ordered by process, so they line up with halo.
+    std::vector<real_t> halo_coords;
+    alltoallv(comm, MPI_REAL_T, reply_coords, halo_coords);
+    coords.insert(coords.end(), halo_coords.begin(), halo_coords.end());
+    if(has_metric){
+      std::vector<double> halo_metric;
+      alltoallv(comm, MPI_DOUBLE, reply_metric, halo_metric);
+      metric.insert(metric.end(), halo_metric.begin(), halo_metric.end());
+    }
+
+    // Local numbering: owned vertices first, then the halo.
+    size_t NNodes = NPNodes+halo.size();
+    std::vector<index_t> lnn2gnn(NNodes);
+    for(size_t i=0;i<NPNodes;i++)
+      lnn2gnn[i] = gnn0+i;
+    std::copy(halo.begin(), halo.end(), lnn2gnn.begin()+NPNodes);
+
+    std::vector<real_t> x(NNodes), y(NNodes), z(ndims==3?NNodes:0);
+    for(size_t i=0;i<NNodes;i++){
+      x[i] = coords[i*ndims];
+      y[i] = coords[i*ndims+1];
+      if(ndims==3)
+        z[i] = coords[i*ndims+2];
+    }
+
+    Mesh<real_t> *mesh;
+    if(ndims==2)
+      mesh = new Mesh<real_t>(NNodes, NElements, &(ENList[0]), &(x[0]), &(y[0]), &(lnn2gnn[0]), &(owner_range[0]), comm);
+    else
+      mesh = new Mesh<real_t>(NNodes, NElements, &(ENList[0]), &(x[0]), &(y[0]), &(z[0]), &(lnn2gnn[0]), &(owner_range[0]), comm);
+
+    if(has_metric)
+      std::copy(metric.begin(), metric.end(), mesh->metric.begin());
+
+    return mesh;
+  }
+
+  /*! Write a mesh to a single .pmesh file. This is collective over the
+   * mesh's communicator. Deleted vertices and elements are skipped and
+   * the vertices are renumbered contiguously per process.
+   *
+   * @param filename name of the .pmesh file.
+   * @param mesh the mesh.
+   * @return true on success.
+   */
+  static bool export_pmesh(const char *filename, Mesh<real_t> *mesh){
+    MPI_Comm comm = mesh->get_mpi_comm();
+    int rank = mesh->rank;
+
+    size_t NNodes = mesh->get_number_nodes();
+    size_t NElements = mesh->get_number_elements();
+    size_t ndims = mesh->ndims;
+    size_t nloc = mesh->nloc;
+    size_t msize = mesh->msize;
+    bool has_metric = mesh->metric.size()>=NNodes*msize && NNodes>0;
+
+    // Number the active owned vertices contiguously.
+    std::vector<index_t> gnn(NNodes, -1);
+    index_t NPNodes=0;
+    for(size_t i=0;i<NNodes;i++)
+      if(mesh->is_owned_node(i) && !mesh->NNList[i].empty())
+        NPNodes++;
+    index_t gnn_offset=0;
+    MPI_Exscan(&NPNodes, &gnn_offset, 1, mesh->MPI_INDEX_T, MPI_SUM, comm);
+    if(rank==0)
+      gnn_offset = 0;
+
+    std::vector<real_t> coords;
+    std::vector<double> metric;
+    coords.reserve(NPNodes*ndims);
+    if(has_metric)
+      metric.reserve(NPNodes*msize);
+    for(size_t i=0, pos=gnn_offset;i<NNodes;i++){
+      if(mesh->is_owned_node(i) && !mesh->NNList[i].empty()){
+        gnn[i] = pos++;
+        coords.insert(coords.end(), mesh->_coords.begin()+i*ndims, mesh->_coords.begin()+(i+1)*ndims);
+        if(has_metric)
+          metric.insert(metric.end(), mesh->metric.begin()+i*msize, mesh->metric.begin()+(i+1)*msize);
+      }
+    }
+    mesh->template update_halo<index_t, 1>(gnn);
+
+    // Each element is written by the lowest-ranked owner of its vertices.
+    std::vector<index_t> ENList;
+    for(size_t i=0;i<NElements;i++){
+      const index_t *n=mesh->get_element(i);
+      if(n[0]<0)
+        continue;
+
+      int owner = mesh->node_owner[n[0]];
+      for(size_t j=1;j<nloc;j++)
+        owner = std::min(owner, mesh->node_owner[n[j]]);
+      if(owner!=rank)
+        continue;
+
+      for(size_t j=0;j<nloc;j++)
+        ENList.push_back(gnn[n[j]]);
+    }
+    index_t NPElements = ENList.size()/nloc;
+    index_t eid_offset=0;
+    MPI_Exscan(&NPElements, &eid_offset, 1, mesh->MPI_INDEX_T, MPI_SUM, comm);
+    if(rank==0)
+      eid_offset = 0;
+
+    // Header: sizes are needed for the section offsets.
+    int flag = has_metric?1:0;
+    MPI_Allreduce(MPI_IN_PLACE, &flag, 1, MPI_INT, MPI_MIN, comm);
+    has_metric = flag;
+
+    uint64_t totals[2] = {(uint64_t)NPNodes, (uint64_t)NPElements};
+    MPI_Allreduce(MPI_IN_PLACE, totals, 2, MPI_UINT64_T, MPI_SUM, comm);
+
+    Header header;
+    memset(&header, 0, sizeof(Header));
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.real_size = sizeof(real_t);
+    header.index_size = sizeof(index_t);
+    header.ndims = ndims;
+    header.nloc = nloc;
+    header.msize = msize;
+    header.flags = has_metric?HAS_METRIC:0;
+    header.NNodes = totals[0];
+    header.NElements = totals[1];
+    header.coords_offset = align(sizeof(Header));
+    header.metric_offset = align(header.coords_offset+header.NNodes*ndims*sizeof(real_t));
+    header.ENList_offset = align(header.metric_offset+(has_metric?header.NNodes*msize*sizeof(double):0));
+
+    MPI_File fh;
+    if(MPI_File_open(comm, (char *)filename, MPI_MODE_WRONLY|MPI_MODE_CREATE, MPI_INFO_NULL, &fh)!=MPI_SUCCESS){
+      if(rank==0)
+        std::cerr<<"ERROR: Cannot open "<<filename<<" for writing.\n";
+      return false;
+    }
+    MPI_File_set_size(fh, header.ENList_offset+header.NElements*nloc*sizeof(index_t));
+
+    MPI_File_write_at_all(fh, 0, &header, rank==0?sizeof(Header):0, MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(fh, header.coords_offset+(MPI_Offset)gnn_offset*ndims*sizeof(real_t),
+                          coords.empty()?NULL:&(coords[0]), coords.size(), mesh->MPI_REAL_T, MPI_STATUS_IGNORE);
+    if(has_metric)
+      MPI_File_write_at_all(fh, header.metric_offset+(MPI_Offset)gnn_offset*msize*sizeof(double),
+                            metric.empty()?NULL:&(metric[0]), metric.size(), MPI_DOUBLE, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(fh, header.ENList_offset+(MPI_Offset)eid_offset*nloc*sizeof(index_t),
+                          ENList.empty()?NULL:&(ENList[0]), ENList.size(), mesh->MPI_INDEX_T, MPI_STATUS_IGNORE);
+
+    return MPI_File_close(&fh)==MPI_SUCCESS;
+  }
+
+ private:
+  static const char MAGIC[8];
+  static const uint32_t VERSION = 1;
+  static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+  static const uint32_t HAS_METRIC = 1;
+  static const uint64_t ALIGNMENT = 64;
+
+  // Fixed-size file header. Offsets are in bytes.
+  struct Header{
+    char magic[8];
+    uint32_t version, byte_order, real_size, index_size;
+    uint32_t ndims, nloc, msize, flags;
+    uint64_t NNodes, NElements;
+    uint64_t coords_offset, metric_offset, ENList_offset;
+  };
+
+  static uint64_t align(uint64_t offset){
+    return ((offset+ALIGNMENT-1)/ALIGNMENT)*ALIGNMENT;
+  }
+
+  /// Return the process owning global node gnn.
+  static int owner(const std::vector<index_t> &owner_range, index_t gnn){
+    return std::upper_bound(owner_range.begin(), owner_range.end(), gnn)-owner_range.begin()-1;
+  }
+
+  /*! Exchange send[i] with process i. The received data is concatenated
+   * in order of process; recv_cnt optionally returns the number of items
+   * received from each process.
+   */
+  template<typename T>
+    static void alltoallv(MPI_Comm comm, MPI_Datatype type, const std::vector< std::vector<T> > &send,
+                          std::vector<T> &recv, std::vector<int> *recv_cnt=NULL){
+    int nprocs = send.size();
+    std::vector<int> send_cnt(nprocs), send_displ(nprocs+1, 0), cnt(nprocs), recv_displ(nprocs+1, 0);
+    for(int i=0;i<nprocs;i++){
+      send_cnt[i] = send[i].size();
+      send_displ[i+1] = send_displ[i]+send_cnt[i];
+    }
+    MPI_Alltoall(&(send_cnt[0]), 1, MPI_INT, &(cnt[0]), 1, MPI_INT, comm);
+    for(int i=0;i<nprocs;i++)
+      recv_displ[i+1] = recv_displ[i]+cnt[i];
+
+    std::vector<T> send_buff(send_displ[nprocs]);
+    for(int i=0;i<nprocs;i++)
+      std::copy(send[i].begin(), send[i].end(), send_buff.begin()+send_displ[i]);
+
+    recv.resize(recv_displ[nprocs]);
+    MPI_Alltoallv(send_buff.empty()?NULL:&(send_buff[0]), &(send_cnt[0]), &(send_displ[0]), type,
+                  recv.empty()?NULL:&(recv[0]), &(cnt[0]), &(recv_displ[0]), type, comm);
+
+    if(recv_cnt!=NULL)
+      recv_cnt->swap(cnt);
+  }
+
+  static bool validate(const char *filename, const Header &header, int rank){
+    bool ok = true;
+    if(memcmp(header.magic, MAGIC, sizeof(header.magic))!=0){
+      if(rank==0)
+        std::cerr<<"ERROR: "<<filename<<" is not a PRAgMaTIc mesh file.\n";
+      ok = false;
+    }else if(header.version!=VERSION){
+      if(rank==0)
+        std::cerr<<"ERROR: "<<filename<<" has version "<<header.version<<", expected "<<VERSION<<".\n";
+      ok = false;
+    }else if(header.byte_order!=BYTE_ORDER_MARK || header.real_size!=sizeof(real_t) || header.index_size!=sizeof(index_t)){
+      if(rank==0)
+        std::cerr<<"ERROR: "<<filename<<" was written on an incompatible platform.\n";
+      ok = false;
+    }else if(!((header.ndims==2 && header.nloc==3 && header.msize==3) ||
+               (header.ndims==3 && header.nloc==4 && header.msize==6))){
+      if(rank==0)
+        std::cerr<<"ERROR: "<<filename<<" is corrupt.\n";
+      ok = false;
+    }
+    return ok;
+  }
+};
+
+template<typename real_t> const char MPIIOTools<real_t>::MAGIC[8] = {'P', 'R', 'G', 'M', 'M', 'E', 'S', 'H'};
+
+#endif
+#endif
@@ -0,0 +1,178 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef MEMORYREPORT_H
+#define MEMORYREPORT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+/*! \brief Bytes held by the containers of a mesh and its operators.
+ *
+ * Every entry records the bytes in use, i.e. the part which holds live
+ * mesh data, and the bytes reserved, i.e. what is actually allocated.
+ * Their difference is over-allocation, such as the spare capacity
+ * MetricField::update_mesh() reserves for refinement, and the heap
+ * overhead of node-based containers. Heap blocks are estimated for a
+ * glibc-like allocator: a size header and 16 byte granularity.
+ */
+class MemoryReport{
+ public:
+  struct Entry{
+    std::string name;
+    size_t used;
+    size_t reserved;
+  };
+
+  /// Add bytes to the entry name, creating it if necessary.
+  void add(const std::string &name, size_t used, size_t reserved){
+    for(std::vector<Entry>::iterator it=entries.begin();it!=entries.end();++it){
+      if(it->name==name){
+        it->used += used;
+        it->reserved += reserved;
+        return;
+      }
+    }
+    Entry entry = {name, used, reserved};
+    entries.push_back(entry);
+  }
+
+  /// Add a vector of which the first nused items are live.
+  template<typename T>
+    void add(const std::string &name, const std::vector<T> &v, size_t nused){
+    add(name, nused*sizeof(T), heap_block(v.capacity()*sizeof(T)));
+  }
+
+  /// Add a vector of vectors of which the first nused are live.
+  template<typename T>
+    void add(const std::string &name, const std::vector< std::vector<T> > &v, size_t nused){
+    size_t used = nused*sizeof(std::vector<T>), reserved = heap_block(v.capacity()*sizeof(std::vector<T>));
+    for(size_t i=0;i<v.size();i++){
+      if(i<nused)
+        used += v[i].size()*sizeof(T);
+      reserved += heap_block(v[i].capacity()*sizeof(T));
+    }
+    add(name, used, reserved);
+  }
+
+  /// Add a vector of sets of which the first nused are live.
+  template<typename T>
+    void add(const std::string &name, const std::vector< std::set<T> > &v, size_t nused){
+    size_t used = nused*sizeof(std::set<T>), reserved = heap_block(v.capacity()*sizeof(std::set<T>));
+    for(size_t i=0;i<v.size();i++){
+      if(i<nused)
+        used += v[i].size()*sizeof(T);
+      reserved += v[i].size()*set_node<T>();
+    }
+    add(name, used, reserved);
+  }
+
+  /// Add an array allocated with new[].
+  template<typename T>
+    void add(const std::string &name, const T *array, size_t nused, size_t n){
+    add(name, nused*sizeof(T), array==NULL?0:heap_block(n*sizeof(T)));
+  }
+
+  /// Add the entries of another report, prefixing their names.
+  void add(const std::string &prefix, const MemoryReport &report){
+    for(std::vector<Entry>::const_iterator it=report.entries.begin();it!=report.entries.end();++it)
+      add(prefix+it->name, it->used, it->reserved);
+  }
+
+  const std::vector<Entry> &get_entries() const{
+    return entries;
+  }
+
+  size_t get_used() const{
+    size_t used=0;
+    for(std::vector<Entry>::const_iterator it=entries.begin();it!=entries.end();++it)
+      used += it->used;
+    return used;
+  }
+
+  size_t get_reserved() const{
+    size_t reserved=0;
+    for(std::vector<Entry>::const_iterator it=entries.begin();it!=entries.end();++it)
+      reserved += it->reserved;
+    return reserved;
+  }
+
+  void clear(){
+    entries.clear();
+  }
+
+  /// Print the entries in MB, largest reservation first.
+  void print(std::ostream &out) const{
+    std::multimap<size_t, const Entry *> sorted;
+    for(std::vector<Entry>::const_iterator it=entries.begin();it!=entries.end();++it)
+      sorted.insert(std::make_pair(it->reserved, &(*it)));
+
+    out<<std::left<<std::setw(32)<<"container"<<std::right<<std::setw(12)<<"used (MB)"
+       <<std::setw(14)<<"reserved (MB)"<<std::endl;
+    for(std::multimap<size_t, const Entry *>::const_reverse_iterator it=sorted.rbegin();it!=sorted.rend();++it)
+      out<<std::left<<std::setw(32)<<it->second->name<<std::right<<std::fixed<<std::setprecision(3)
+         <<std::setw(12)<<it->second->used/1048576.0<<std::setw(14)<<it->second->reserved/1048576.0<<std::endl;
+    out<<std::left<<std::setw(32)<<"total"<<std::right<<std::setw(12)<<get_used()/1048576.0
+       <<std::setw(14)<<get_reserved()/1048576.0<<std::endl;
+    out.unsetf(std::ios_base::floatfield);
+    out<<std::setprecision(6);
+  }
+
+  /// Estimated size of the heap block for a request of bytes.
+  static size_t heap_block(size_t bytes){
+    if(bytes==0)
+      return 0;
+    return std::max((size_t)32, (bytes+sizeof(size_t)+15)&~(size_t)15);
+  }
+
+  /// Estimated size of a node of std::set<T>: a colour, three links and the value.
+  template<typename T>
+    static size_t set_node(){
+    return heap_block(4*sizeof(void *)+sizeof(T));
+  }
+
+ private:
+  std::vector<Entry> entries;
+};
+
+#endif
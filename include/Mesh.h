@@ -57,10 +57,16 @@
 
 #include "PragmaticTypes.h"
 #include "PragmaticMinis.h"
+#include "Profiler.h"
+#include "MemoryReport.h"
 
 #include "ElementProperty.h"
 #include "MetricTensor.h"
 #include "HaloExchange.h"
+#include "HaloMap.h"
+#include "MeshStatistics.h"
+#include "SharedHaloExchange.h"
+#include "Provenance.h"
 
 /*! \brief Manages mesh data.
  *
@@ -143,9 +149,76 @@ template<typename real_t> class Mesh{
   }
 #endif
 
+  /*! Mesh constructor for interleaved coordinates (x0, y0[, z0], x1,
+   * ...). This is for use when there is no MPI. The data is copied in a
+   * single pass.
+   *
+   * @param NNodes number of nodes in the local mesh.
+   * @param NElements number of elements in the local mesh.
+   * @param dim number of dimensions, 2 or 3.
+   * @param ENList element-node list.
+   * @param coords interleaved coordinates.
+   */
+  Mesh(int NNodes, int NElements, int dim, const index_t *ENList, const real_t *coords){
+#ifdef HAVE_MPI
+    _mpi_comm = MPI_COMM_WORLD;
+#endif
+    _init(NNodes, NElements, ENList, coords, coords+1, dim==3?coords+2:NULL, NULL, NULL, dim);
+  }
+
+#ifdef HAVE_MPI
+  /*! Mesh constructor for interleaved coordinates on a given
+   * communicator. Use MPI_COMM_SELF for a mesh which is local to one
+   * process when MPI_COMM_WORLD has several processes.
+   *
+   * @param NNodes number of nodes in the local mesh.
+   * @param NElements number of elements in the local mesh.
+   * @param dim number of dimensions, 2 or 3.
+   * @param ENList element-node list.
+   * @param coords interleaved coordinates.
+   * @param mpi_comm the mpi communicator, which must have a single process.
+   */
+  Mesh(int NNodes, int NElements, int dim, const index_t *ENList, const real_t *coords, MPI_Comm mpi_comm){
+    _mpi_comm = mpi_comm;
+    _init(NNodes, NElements, ENList, coords, coords+1, dim==3?coords+2:NULL, NULL, NULL, dim);
+  }
+#endif
+
+  /*! Mesh constructor which adopts the element-node list and the
+   * interleaved coordinates without copying them. This is for use when
+   * there is no MPI. The vectors are swapped into the mesh, so ENList
+   * and coords are empty on return.
+   *
+   * @param dim number of dimensions, 2 or 3.
+   * @param ENList element-node list.
+   * @param coords interleaved coordinates.
+   */
+  Mesh(int dim, std::vector<index_t> &ENList, std::vector<real_t> &coords){
+#ifdef HAVE_MPI
+    _mpi_comm = MPI_COMM_WORLD;
+#endif
+    int NNodes = coords.size()/dim;
+    int NElements = ENList.size()/(dim+1);
+    _ENList.swap(ENList);
+    _coords.swap(coords);
+    _init(NNodes, NElements, &(_ENList[0]), &(_coords[0]), &(_coords[1]), dim==3?&(_coords[2]):NULL, NULL, NULL, dim);
+  }
+
   /// Default destructor.
   ~Mesh(){
     delete property;
+    delete provenance;
+
+#ifdef HAVE_MPI
+    delete shared_halo;
+
+    if(_mpi_halo_comm!=MPI_COMM_NULL){
+      int finalized;
+      MPI_Finalized(&finalized);
+      if(!finalized)
+        MPI_Comm_free(&_mpi_halo_comm);
+    }
+#endif
   }
 
   /// Add a new vertex
@@ -359,6 +432,17 @@ template<typename real_t> class Mesh{
     return &(_ENList[eid*nloc]);
   }
 
+  /// Return a pointer to the boundary IDs of the facets of an
+  /// element. Facet j is opposite vertex j. Interior facets are 0.
+  /// Returns NULL if the boundary has not been created.
+  const int *get_boundary(size_t eid) const{
+    if(boundary.empty())
+      return NULL;
+
+    assert(boundary.size()>=(eid+1)*nloc);
+    return &(boundary[eid*nloc]);
+  }
+
   /// Return copy of element-node list.
   void get_element(size_t eid, index_t *ele) const{
     for(size_t i=0;i<nloc;i++)
@@ -380,6 +464,15 @@ template<typename real_t> class Mesh{
     return ndims;
   }
 
+  /// Return the largest number of neighbours of a vertex.
+  int get_max_degree() const{
+    int degree=0;
+#pragma omp parallel for reduction(max:degree)
+    for(int i=0;i<(int)NNodes;i++)
+      degree = std::max(degree, (int)NNList[i].size());
+    return degree;
+  }
+
   /// Return positions vector.
   const real_t *get_coords(index_t nid) const{
     return &(_coords[nid*ndims]);
@@ -408,7 +501,7 @@ template<typename real_t> class Mesh{
 
   /// Returns true if the node is in any of the partitioned elements.
   bool is_halo_node(index_t nid) const{
-    return (node_owner[nid]!= rank || send_halo.count(nid)>0);
+    return (node_owner[nid]!= rank || (halo_flag[nid]&HALO_SEND));
   }
 
   /// Returns true if the node is assigned to the local partition.
@@ -797,16 +890,35 @@ template<typename real_t> class Mesh{
     return mean;
   }
 
-  /// Print out the qualities. Useful if you want to plot a histogram of element qualities.
-  void print_quality() const{
+  /*! Histogram of the element quality in metric space. Bin i counts
+   * the values in [edges[i], edges[i+1]); values outside the edges are
+   * counted in the first or last bin. Each element is counted once
+   * across all processes, so this is collective.
+   *
+   * @param nbins number of bins.
+   * @param edges nbins+1 increasing bin edges.
+   * @param counts global number of elements in each bin.
+   */
+  void get_quality_histogram(int nbins, const double *edges, long *counts) const{
+    std::fill(counts, counts+nbins, 0);
+
 #pragma omp parallel
     {
+      std::vector<long> local_counts(nbins, 0);
+
 #pragma omp for schedule(static)
       for(size_t i=0;i<NElements;i++){
         const index_t *n=get_element(i);
         if(n[0]<0)
           continue;
-        
+
+        // Count the element on the lowest-ranked owner of its vertices.
+        int owner = node_owner[n[0]];
+        for(size_t j=1;j<nloc;j++)
+          owner = std::min(owner, node_owner[n[j]]);
+        if(owner!=rank)
+          continue;
+
         double q;
         if(ndims==2){
           q = property->lipnikov(get_coords(n[0]), get_coords(n[1]), get_coords(n[2]),
@@ -815,9 +927,75 @@ template<typename real_t> class Mesh{
           q = property->lipnikov(get_coords(n[0]), get_coords(n[1]), get_coords(n[2]), get_coords(n[3]),
                                  get_metric(n[0]), get_metric(n[1]), get_metric(n[2]), get_metric(n[3]));
         }
+        local_counts[histogram_bin(nbins, edges, q)]++;
+      }
+
 #pragma omp critical
-        std::cout<<"Quality[ele="<<i<<"] = "<<q<<std::endl;
+      for(int i=0;i<nbins;i++)
+        counts[i] += local_counts[i];
+    }
+
+#ifdef HAVE_MPI
+    if(num_processes>1)
+      MPI_Allreduce(MPI_IN_PLACE, counts, nbins, MPI_LONG, MPI_SUM, _mpi_comm);
+#endif
+  }
+
+  /*! Histogram of the edge lengths in metric space, binned as in
+   * get_quality_histogram(). Edges shared between processes are
+   * counted once. This is collective.
+   *
+   * @param nbins number of bins.
+   * @param edges nbins+1 increasing bin edges.
+   * @param counts global number of mesh edges in each bin.
+   */
+  void get_edge_length_histogram(int nbins, const double *edges, long *counts) const{
+    std::fill(counts, counts+nbins, 0);
+
+#pragma omp parallel
+    {
+      std::vector<long> local_counts(nbins, 0);
+
+#pragma omp for schedule(static)
+      for(size_t i=0;i<NNodes;i++){
+        for(typename std::vector<index_t>::const_iterator it=NNList[i].begin();it!=NNList[i].end();++it){
+          if((index_t)i<*it && std::min(node_owner[i], node_owner[*it])==rank)
+            local_counts[histogram_bin(nbins, edges, calc_edge_length(i, *it))]++;
+        }
       }
+
+#pragma omp critical
+      for(int i=0;i<nbins;i++)
+        counts[i] += local_counts[i];
+    }
+
+#ifdef HAVE_MPI
+    if(num_processes>1)
+      MPI_Allreduce(MPI_IN_PLACE, counts, nbins, MPI_LONG, MPI_SUM, _mpi_comm);
+#endif
+  }
+
+  /// Print histograms of the element quality and the edge length. This is collective.
+  void print_quality() const{
+    const int nbins=10;
+    double quality_edges[nbins+1], length_edges[nbins+1];
+    for(int i=0;i<=nbins;i++){
+      quality_edges[i] = (double)i/nbins;
+      length_edges[i] = 0.25*i;
+    }
+    length_edges[nbins] = INFINITY;
+
+    long quality_counts[nbins], length_counts[nbins];
+    get_quality_histogram(nbins, quality_edges, quality_counts);
+    get_edge_length_histogram(nbins, length_edges, length_counts);
+
+    if(rank==0){
+      std::cout<<"Element quality:"<<std::endl;
+      for(int i=0;i<nbins;i++)
+        std::cout<<"  ["<<quality_edges[i]<<", "<<quality_edges[i+1]<<(i+1<nbins?")":"]")<<"\t"<<quality_counts[i]<<std::endl;
+      std::cout<<"Edge length:"<<std::endl;
+      for(int i=0;i<nbins;i++)
+        std::cout<<"  ["<<length_edges[i]<<", "<<length_edges[i+1]<<")\t"<<length_counts[i]<<std::endl;
     }
   }
 
@@ -870,6 +1048,52 @@ template<typename real_t> class Mesh{
   MPI_Comm get_mpi_comm() const{
     return _mpi_comm;
   }
+
+  /*! Return the graph-topology communicator linking this process to
+   * the processes it shares halo vertices with. Halo exchanges on this
+   * communicator go through neighbourhood collectives. Falls back to
+   * get_mpi_comm() if there is no halo.
+   */
+  MPI_Comm get_halo_comm() const{
+    if(_mpi_halo_comm==MPI_COMM_NULL)
+      return _mpi_comm;
+    return _mpi_halo_comm;
+  }
+
+  /*! Update the halo values of vec. Neighbours on the same node are
+   * updated through node-local shared memory (see SharedHaloExchange),
+   * all others through get_halo_comm().
+   */
+  template <typename DATATYPE, int block>
+    void update_halo(std::vector<DATATYPE> &vec){
+    if(num_processes<2)
+      return;
+
+    if(_mpi_halo_comm==MPI_COMM_NULL)
+      halo_update<DATATYPE, block>(_mpi_comm, send, recv, vec);
+    else if(shared_halo!=NULL && shared_halo->is_active())
+      shared_halo->update<DATATYPE, block, 0>(_mpi_halo_comm, halo_neighbours_list, halo_neighbours_list,
+                                              send, recv, vec, vec);
+    else
+      neighbour_halo_update<DATATYPE, block>(_mpi_halo_comm, halo_neighbours_list, halo_neighbours_list,
+                                             send, recv, vec);
+  }
+
+  /// As above, but update two arrays in a single exchange.
+  template <typename DATATYPE, int block0, int block1>
+    void update_halo(std::vector<DATATYPE> &vec0, std::vector<DATATYPE> &vec1){
+    if(num_processes<2)
+      return;
+
+    if(_mpi_halo_comm==MPI_COMM_NULL)
+      halo_update<DATATYPE, block0, block1>(_mpi_comm, send, recv, vec0, vec1);
+    else if(shared_halo!=NULL && shared_halo->is_active())
+      shared_halo->update<DATATYPE, block0, block1>(_mpi_halo_comm, halo_neighbours_list, halo_neighbours_list,
+                                                    send, recv, vec0, vec1);
+    else
+      neighbour_halo_update<DATATYPE, block0, block1>(_mpi_halo_comm, halo_neighbours_list, halo_neighbours_list,
+                                                      send, recv, vec0, vec1);
+  }
 #endif
 
   /// Return the node id's connected to the specified node_id
@@ -952,10 +1176,139 @@ template<typename real_t> class Mesh{
     return L_max;
   }
 
+  /*! Add the memory held by the mesh to report, per container. The
+   * used bytes only count the NNodes vertices and NElements elements,
+   * so the spare capacity reserved for adaptation shows as the
+   * difference to the reserved bytes. Not thread-safe; call outside
+   * of the adaptation operators.
+   */
+  void memory_report(MemoryReport &report) const{
+    report.add("ENList", _ENList, NElements*nloc);
+    report.add("boundary", boundary, NElements*nloc);
+    report.add("coords", _coords, NNodes*ndims);
+    report.add("metric", metric, NNodes*msize);
+    report.add("NEList", NEList, NNodes);
+    report.add("NNList", NNList, NNodes);
+    report.add("halo_flag", halo_flag, NNodes);
+    report.add("node_owner", node_owner, NNodes);
+    report.add("lnn2gnn", lnn2gnn, NNodes);
+    report.add("send", send, send.size());
+    report.add("recv", recv, recv.size());
+
+    size_t used=0, reserved=0;
+    for(int i=0;i<(int)send_map.size();i++){
+      used += (send_map[i].size()+recv_map[i].size())*sizeof(HaloMap::value_type);
+      reserved += MemoryReport::heap_block(send_map[i].capacity()*sizeof(HaloMap::value_type))+
+        MemoryReport::heap_block(recv_map[i].capacity()*sizeof(HaloMap::value_type));
+    }
+    report.add("halo_maps", used, reserved);
+
+    if(provenance!=NULL)
+      provenance->memory_report(report);
+  }
+
+  /// Total bytes reserved by the mesh, see memory_report().
+  size_t get_memory_reserved() const{
+    MemoryReport report;
+    memory_report(report);
+    return report.get_reserved();
+  }
+
+  /*! Compute the element quality, edge length, volume and entity count
+   * statistics in a single traversal of the mesh. In parallel, the local
+   * values are combined with one non-blocking reduction, which completes
+   * when stats is first queried (or on stats.wait()).
+   */
+  void compute_statistics(MeshStatistics &stats) const{
+    // Elements are counted by the lowest-ranked owner of their vertices,
+    // edges by the lowest-ranked owner of their two vertices.
+    double qmin=1, lmax=0, qsum=0, lsum=0, volume=0, nelements=0, nnodes=0, nedges=0;
+
+#pragma omp parallel reduction(+:qsum, lsum, volume, nelements, nnodes, nedges)
+    {
+      double qmin_local=1, lmax_local=0;
+
+#pragma omp for schedule(static) nowait
+      for(size_t i=0;i<NElements;i++){
+        const index_t *n=get_element(i);
+        if(n[0]<0)
+          continue;
+
+        double q, v;
+        if(ndims==2){
+          q = property->lipnikov(get_coords(n[0]), get_coords(n[1]), get_coords(n[2]),
+                                 get_metric(n[0]), get_metric(n[1]), get_metric(n[2]));
+          v = property->area(get_coords(n[0]), get_coords(n[1]), get_coords(n[2]));
+        }else{
+          q = property->lipnikov(get_coords(n[0]), get_coords(n[1]), get_coords(n[2]), get_coords(n[3]),
+                                 get_metric(n[0]), get_metric(n[1]), get_metric(n[2]), get_metric(n[3]));
+          v = property->volume(get_coords(n[0]), get_coords(n[1]), get_coords(n[2]), get_coords(n[3]));
+        }
+        qmin_local = std::min(qmin_local, q);
+
+        int owner = node_owner[n[0]];
+        for(size_t j=1;j<nloc;j++)
+          owner = std::min(owner, node_owner[n[j]]);
+        if(owner!=rank)
+          continue;
+
+        qsum += q;
+        volume += v;
+        nelements++;
+      }
+
+#pragma omp for schedule(static)
+      for(size_t i=0;i<NNodes;i++){
+        if(NNList[i].empty())
+          continue;
+
+        if(is_owned_node(i))
+          nnodes++;
+
+        for(typename std::vector<index_t>::const_iterator it=NNList[i].begin();it!=NNList[i].end();++it){
+          if((index_t)i<*it){ // Ensure that every edge length is only calculated once.
+            double length = calc_edge_length(i, *it);
+            lmax_local = std::max(lmax_local, length);
+
+            if(std::min(node_owner[i], node_owner[*it])==rank){
+              lsum += length;
+              nedges++;
+            }
+          }
+        }
+      }
+
+#pragma omp critical
+      {
+        qmin = std::min(qmin, qmin_local);
+        lmax = std::max(lmax, lmax_local);
+      }
+    }
+
+    stats.wait();
+    stats.data[MeshStatistics::QMIN] = qmin;
+    stats.data[MeshStatistics::LMAX] = lmax;
+    stats.data[MeshStatistics::QSUM] = qsum;
+    stats.data[MeshStatistics::LSUM] = lsum;
+    stats.data[MeshStatistics::VOLUME] = volume;
+    stats.data[MeshStatistics::NELEMENTS] = nelements;
+    stats.data[MeshStatistics::NNODES] = nnodes;
+    stats.data[MeshStatistics::NEDGES] = nedges;
+
+#ifdef HAVE_MPI
+    if(num_processes>1)
+      stats.start(_mpi_comm);
+#endif
+  }
+
   /*! Defragment mesh. This compresses the storage of internal data
     structures. This is useful if the mesh has been significantly
     coarsened. */
   void defragment(){
+    PRAGMATIC_MEMORY("defragment", this);
+    PRAGMATIC_TIMER("defragment");
+    PRAGMATIC_COUNT(PROFILE_DEFRAGMENTS, 1);
+
     // Discover which vertices and elements are active.
     std::vector<index_t> active_vertex_map(NNodes);
     
@@ -983,7 +1336,7 @@ template<typename real_t> class Mesh{
       bool local=false, halo_element=false;
       for(size_t j=0;j<nloc;j++){
         nid = _ENList[e*nloc+j];
-        if(recv_halo.count(nid)){
+        if(halo_flag[nid]&HALO_RECV){
           halo_element = true;
         }else{
           local = true;
@@ -1000,17 +1353,17 @@ template<typename real_t> class Mesh{
         nid = _ENList[e*nloc+j];
         active_vertex_map[nid]=0;
 
-        if(halo_element){
-          for(int k=0;k<num_processes;k++){
-            if(recv_map[k].count(lnn2gnn[nid])){
-              new_recv_set[k].insert(nid);
-              neigh.insert(k);
-            }
-          }
+        // A received vertex is only ever in the recv list of its owner.
+        if(halo_element && (halo_flag[nid]&HALO_RECV)){
+          int k = node_owner[nid];
+          new_recv_set[k].insert(nid);
+          neigh.insert(k);
         }
       }
       for(size_t j=0;j<nloc;j++){
         nid = _ENList[e*nloc+j];
+        if(!(halo_flag[nid]&HALO_SEND))
+          continue;
         for(std::set<int>::iterator kt=neigh.begin();kt!=neigh.end();++kt){
           if(send_map[*kt].count(lnn2gnn[nid]))
             new_send_set[*kt].insert(nid);
@@ -1106,6 +1459,9 @@ template<typename real_t> class Mesh{
     memcpy(&_coords[0], &defrag_coords[0], NNodes*ndims*sizeof(real_t));
     memcpy(&metric[0], &defrag_metric[0], NNodes*msize*sizeof(double));
 
+    if(provenance!=NULL)
+      provenance->record_renumber(active_vertex_map, NNodes);
+
     // Renumber halo, fix lnn2gnn and node_owner.
     if(num_processes>1){
       std::vector<index_t> defrag_lnn2gnn(NNodes);
@@ -1125,47 +1481,31 @@ template<typename real_t> class Mesh{
 
       for(int k=0;k<num_processes;k++){
         std::vector<int> new_halo;
-        send_map[k].clear();
         for(std::vector<int>::iterator jt=send[k].begin();jt!=send[k].end();++jt){
           if(new_send_set[k].count(*jt)){
             index_t new_lnn = active_vertex_map[*jt];
             new_halo.push_back(new_lnn);
-            send_map[k][lnn2gnn[new_lnn]] = new_lnn;
           }
         }
         send[k].swap(new_halo);
+        send_map[k].assign(send[k], lnn2gnn);
       }
 
       for(int k=0;k<num_processes;k++){
         std::vector<int> new_halo;
-        recv_map[k].clear();
         for(std::vector<int>::iterator jt=recv[k].begin();jt!=recv[k].end();++jt){
           if(new_recv_set[k].count(*jt)){
             index_t new_lnn = active_vertex_map[*jt];
             new_halo.push_back(new_lnn);
-            recv_map[k][lnn2gnn[new_lnn]] = new_lnn;
           }
         }
         recv[k].swap(new_halo);
+        recv_map[k].assign(recv[k], lnn2gnn);
       }
 
-      {
-        send_halo.clear();
-        for(int k=0;k<num_processes;k++){
-          for(std::vector<int>::iterator jt=send[k].begin();jt!=send[k].end();++jt){
-            send_halo.insert(*jt);
-          }
-        }
-      }
+      create_halo_flags();
 
-      {
-        recv_halo.clear();
-        for(int k=0;k<num_processes;k++){
-          for(std::vector<int>::iterator jt=recv[k].begin();jt!=recv[k].end();++jt){
-            recv_halo.insert(*jt);
-          }
-        }
-      }
+      update_halo_comm();
     }else{
       for(size_t i=0; i<NNodes; ++i){
         lnn2gnn[i] = i;
@@ -1177,6 +1517,79 @@ template<typename real_t> class Mesh{
     create_adjacency();
   }
 
+  /*! Attach a node field, stored node by node with ncomps values per
+   * node, to be carried through adaptation. While fields are attached
+   * the operators record a Provenance log, which transfer_fields()
+   * replays on the fields.
+   */
+  void attach_field(std::vector<real_t> &field, int ncomps=1){
+    assert(field.size()==NNodes*ncomps);
+
+    record_provenance();
+    attached_fields.push_back(std::pair<std::vector<real_t> *, int>(&field, ncomps));
+  }
+
+  /*! Start a new Provenance log from the current mesh, bringing the
+   * attached fields up to date with the old one. The operators record
+   * into it until detach_fields() is called. FieldTransfer uses it to
+   * find where the vertices of the adapted mesh come from. In parallel
+   * this is collective if a log is already being recorded.
+   */
+  void record_provenance(){
+    if(provenance==NULL){
+#ifdef HAVE_MPI
+      provenance = new Provenance<real_t>(NNodes, _mpi_comm);
+#else
+      provenance = new Provenance<real_t>(NNodes);
+#endif
+    }else
+      transfer_fields();
+  }
+
+  /// Detach all fields and stop recording provenance.
+  void detach_fields(){
+    delete provenance;
+    provenance = NULL;
+    attached_fields.clear();
+  }
+
+  /*! Bring the attached fields up to date with the mesh by replaying
+   * the provenance log, which is then cleared. In parallel this is
+   * collective: values of halo vertices are taken from their owners.
+   */
+  void transfer_fields(){
+    if(provenance==NULL)
+      return;
+
+    for(size_t i=0;i<attached_fields.size();i++){
+      std::vector<real_t> &field = *(attached_fields[i].first);
+      int ncomps = attached_fields[i].second;
+
+      provenance->replay(field, ncomps);
+      field.resize(NNodes*ncomps);
+
+#ifdef HAVE_MPI
+      if(num_processes>1){
+        std::vector<real_t> component(NNodes);
+        for(int k=0;k<ncomps;k++){
+          for(size_t j=0;j<NNodes;j++)
+            component[j] = field[j*ncomps+k];
+          update_halo<real_t, 1>(component);
+          for(size_t j=0;j<NNodes;j++)
+            field[j*ncomps+k] = component[j];
+        }
+      }
+#endif
+    }
+
+    provenance->clear(NNodes);
+  }
+
+  /// Return the provenance log, or NULL if none is being recorded.
+  const Provenance<real_t> *get_provenance() const{
+    return provenance;
+  }
+
   /// This is used to verify that the mesh and its metadata is correct.
   bool verify() const{
     bool state = true;
@@ -1238,11 +1651,11 @@ template<typename real_t> class Mesh{
                      <<get_coords(i)[0]<<", "
                      <<get_coords(i)[1]<<", ";
             if(ndims==3) std::cerr<<get_coords(i)[2]<<", ";
-            std::cerr<<send_halo.count(i)<<", "<<recv_halo.count(i)<<")] =       ";
+            std::cerr<<((halo_flag[i]&HALO_SEND)!=0)<<", "<<((halo_flag[i]&HALO_RECV)!=0)<<")] =       ";
             for(size_t j=0;j<NNList[i].size();j++)
               std::cerr<<NNList[i][j]<<"("<<NNList[NNList[i][j]].size()<<", "
-                       <<send_halo.count(NNList[i][j])<<", "
-                       <<recv_halo.count(NNList[i][j])<<") ";
+                       <<((halo_flag[NNList[i][j]]&HALO_SEND)!=0)<<", "
+                       <<((halo_flag[NNList[i][j]]&HALO_RECV)!=0)<<") ";
             std::cerr<<std::endl;
             std::cerr<<"local_NNList["<<i<<"] = ";
             for(typename std::set<index_t>::iterator kt=local_NNList[i].begin();kt!=local_NNList[i].end();++kt)
@@ -1389,33 +1802,34 @@ template<typename real_t> class Mesh{
     return state;
   }
 
+  /*! Exchange lists of indices with the halo neighbours. Only ranks
+   * in the halo neighbourhood (see get_halo_comm()) take part, so
+   * send_vec must be empty for all other ranks.
+   */
   void send_all_to_all(std::vector< std::vector<index_t> > send_vec,
                        std::vector< std::vector<index_t> > *recv_vec) {
-    int ierr, recv_size, tag = 123456;
-    std::vector<MPI_Status> status(num_processes);
-    std::vector<MPI_Request> send_req(num_processes);
-    std::vector<MPI_Request> recv_req(num_processes);
-
-    for (int proc=0; proc<num_processes; proc++) {
-      if (proc == rank) {send_req[proc] = MPI_REQUEST_NULL; continue;}
-
-      ierr = MPI_Isend(send_vec[proc].data(), send_vec[proc].size(), MPI_INDEX_T,
-                       proc, tag, _mpi_comm, &send_req[proc]); assert(ierr==0);
+    if(_mpi_halo_comm==MPI_COMM_NULL)
+      return;
+    const std::vector<int> &sources = halo_neighbours_list, &destinations = halo_neighbours_list;
+
+    std::vector<int> send_cnt(destinations.size());
+    std::vector<index_t> send_buff;
+    for(size_t i=0;i<destinations.size();i++){
+      send_cnt[i] = send_vec[destinations[i]].size();
+      send_buff.insert(send_buff.end(), send_vec[destinations[i]].begin(), send_vec[destinations[i]].end());
     }
 
-    /* Receive send list from remote proc */
-    for (int proc=0; proc<num_processes; proc++) {
-      if (proc == rank) {recv_req[proc] = MPI_REQUEST_NULL; continue;}
+    std::vector<int> recv_cnt(sources.size());
+    PRAGMATIC_TRACE_CALL("MPI_Neighbor_alltoall", MPI_Neighbor_alltoall(send_cnt.data(), 1, MPI_INT, recv_cnt.data(), 1, MPI_INT, _mpi_halo_comm));
 
-      ierr = MPI_Probe(proc, tag, _mpi_comm, &(status[proc])); assert(ierr==0);
-      ierr = MPI_Get_count(&(status[proc]), MPI_INT, &recv_size); assert(ierr==0);
-      (*recv_vec)[proc].resize(recv_size);
-      MPI_Irecv((*recv_vec)[proc].data(), recv_size, MPI_INT, proc,
-                tag, _mpi_comm, &recv_req[proc]); assert(ierr==0);
-    }
+    std::vector<index_t> recv_buff;
+    neighbour_alltoallv(_mpi_halo_comm, sources, destinations, send_buff, send_cnt, recv_buff, recv_cnt);
 
-    MPI_Waitall(num_processes, &(send_req[0]), &(status[0]));
-    MPI_Waitall(num_processes, &(recv_req[0]), &(status[0]));
+    typename std::vector<index_t>::const_iterator it=recv_buff.begin();
+    for(size_t i=0;i<sources.size();i++){
+      (*recv_vec)[sources[i]].assign(it, it+recv_cnt[i]);
+      it += recv_cnt[i];
+    }
   }
 
  private:
@@ -1427,17 +1841,46 @@ template<typename real_t> class Mesh{
   template<typename _real_t> friend class DeferredOperations;
   template<typename _real_t> friend class VTKTools;
   template<typename _real_t> friend class CUDATools;
+  template<typename _real_t> friend class MeshCheckpoint;
+  template<typename _real_t> friend class MeshGenerator;
+  template<typename _real_t> friend class MPIIOTools;
+  template<typename _real_t> friend class VTUWriter;
+  template<typename _real_t> friend class GmshTools;
+  template<typename _real_t, int _dim> friend class KernelBenchmark;
+
+  /// Bin of value in a histogram, see get_quality_histogram().
+  static int histogram_bin(int nbins, const double *edges, double value){
+    int bin = std::upper_bound(edges, edges+nbins+1, value)-edges-1;
+    return std::max(0, std::min(bin, nbins-1));
+  }
 
-  void _init(int _NNodes, int _NElements, const index_t *globalENList,
-             const real_t *x, const real_t *y, const real_t *z,
-             const index_t *lnn2gnn, const index_t *owner_range){
-    num_processes = 1;
-    rank=0;
+  /// Empty mesh, to be filled in by MeshCheckpoint::load() or MeshGenerator.
+  Mesh() : ndims(0), nloc(0), msize(0), NNodes(0), NElements(0), property(NULL), provenance(NULL),
+           rank(0), num_processes(1), nthreads(1)
+#ifdef HAVE_MPI
+         , _mpi_comm(MPI_COMM_NULL), gnn_offset(0), _mpi_halo_comm(MPI_COMM_NULL), shared_halo(NULL),
+           MPI_INDEX_T(MPI_DATATYPE_NULL), MPI_REAL_T(MPI_DATATYPE_NULL)
+#endif
+  {}
 
-    NElements = _NElements;
-    NNodes = _NNodes;
+  /// Set up the communicator, process layout and thread count. Every
+  /// way of building a mesh goes through here before filling in the
+  /// topology.
+  void _init_parallel(
+#ifdef HAVE_MPI
+                      MPI_Comm comm
+#endif
+                      ){
+    num_processes = 1;
+    rank = 0;
 
 #ifdef HAVE_MPI
+    _mpi_comm = comm;
+    _mpi_halo_comm = MPI_COMM_NULL;
+    halo_neighbours_list.clear();
+    shared_halo = NULL;
+    gnn_offset = 0;
+
     MPI_Comm_size(_mpi_comm, &num_processes);
     MPI_Comm_rank(_mpi_comm, &rank);
 
@@ -1449,6 +1892,22 @@ template<typename real_t> class Mesh{
 #endif
 
     nthreads = pragmatic_nthreads();
+  }
+
+  void _init(int _NNodes, int _NElements, const index_t *globalENList,
+             const real_t *x, const real_t *y, const real_t *z,
+             const index_t *lnn2gnn, const index_t *owner_range, int stride=1){
+#ifdef HAVE_MPI
+    _init_parallel(_mpi_comm);
+#else
+    _init_parallel();
+#endif
+
+    NElements = _NElements;
+    NNodes = _NNodes;
+
+    property = NULL;
+    provenance = NULL;
 
     if(z==NULL){
       nloc = 3;
@@ -1499,47 +1958,53 @@ template<typename real_t> class Mesh{
         recv_size[j] = recv[j].size();
       }
       std::vector<int> send_size(num_processes);
-      MPI_Alltoall(&(recv_size[0]), 1, MPI_INT,
-                   &(send_size[0]), 1, MPI_INT, _mpi_comm);
+      PRAGMATIC_TRACE_CALL("MPI_Alltoall", MPI_Alltoall(&(recv_size[0]), 1, MPI_INT,
+                                                        &(send_size[0]), 1, MPI_INT, _mpi_comm));
 
-      // Setup non-blocking receives
       send.resize(num_processes);
       send_map.resize(num_processes);
-      std::vector<MPI_Request> request(num_processes*2);
-      for(int i=0;i<num_processes;i++){
-        if((i==rank)||(send_size[i]==0)){
-          request[i] =  MPI_REQUEST_NULL;
-        }else{
-          send[i].resize(send_size[i]);
-          MPI_Irecv(&(send[i][0]), send_size[i], MPI_INDEX_T, i, 0, _mpi_comm, &(request[i]));
-        }
-      }
+      for(int i=0;i<num_processes;i++)
+        send[i].resize(send_size[i]);
 
-      // Non-blocking sends.
-      for(int i=0;i<num_processes;i++){
-        if((i==rank)||(recv_size[i]==0)){
-          request[num_processes+i] =  MPI_REQUEST_NULL;
-        }else{
-          MPI_Isend(&(recv[i][0]), recv_size[i], MPI_INDEX_T, i, 0, _mpi_comm, &(request[num_processes+i]));
-        }
+      // Now that the halo neighbourhood is known, the global numbers
+      // of the halo vertices are exchanged with the neighbours only.
+      update_halo_comm();
+      shared_halo = new SharedHaloExchange(_mpi_comm);
+
+      const std::vector<int> &sources = halo_neighbours_list, &destinations = halo_neighbours_list;
+
+      std::vector<int> sendcnt(destinations.size());
+      std::vector<index_t> send_buff;
+      for(size_t i=0;i<destinations.size();i++){
+        sendcnt[i] = recv_size[destinations[i]];
+        send_buff.insert(send_buff.end(), recv[destinations[i]].begin(), recv[destinations[i]].end());
       }
 
-      std::vector<MPI_Status> status(num_processes*2);
-      MPI_Waitall(num_processes, &(request[0]), &(status[0]));
-      MPI_Waitall(num_processes, &(request[num_processes]), &(status[num_processes]));
+      std::vector<int> recvcnt(sources.size());
+      for(size_t i=0;i<sources.size();i++)
+        recvcnt[i] = send_size[sources[i]];
+
+      std::vector<index_t> recv_buff;
+      neighbour_alltoallv(_mpi_halo_comm, sources, destinations, send_buff, sendcnt, recv_buff, recvcnt);
+
+      typename std::vector<index_t>::const_iterator rit=recv_buff.begin();
+      for(size_t i=0;i<sources.size();i++){
+        std::copy(rit, rit+recvcnt[i], send[sources[i]].begin());
+        rit += recvcnt[i];
+      }
 
       for(int j=0;j<num_processes;j++){
         for(int k=0;k<recv_size[j];k++){
           index_t gnn = recv[j][k];
           index_t lnn = gnn2lnn[gnn];
-          recv_map[j][gnn] = lnn;
+          recv_map[j].insert(gnn, lnn);
           recv[j][k] = lnn;
         }
 
         for(int k=0;k<send_size[j];k++){
           index_t gnn = send[j][k];
           index_t lnn = gnn2lnn[gnn];
-          send_map[j][gnn] = lnn;
+          send_map[j].insert(gnn, lnn);
           send[j][k] = lnn;
         }
       }
@@ -1554,46 +2019,43 @@ template<typename real_t> class Mesh{
     NNList.resize(NNodes);
     NEList.resize(NNodes);
     node_owner.resize(NNodes);
+    halo_flag.resize(NNodes, 0);
     this->lnn2gnn.resize(NNodes);
 
+    // Data adopted by the constructor is already in place.
+    bool adopted = x==&(_coords[0]);
+
     // TODO I don't know whether this method makes sense anymore.
     // Enforce first-touch policy
 #pragma omp parallel
     {
+      if(!adopted){
 #pragma omp for schedule(static)
-      for(int i=0;i<(int)NElements;i++){
-        for(size_t j=0;j<nloc;j++){
-          _ENList[i*nloc+j] = ENList[i*nloc+j];
+        for(int i=0;i<(int)NElements;i++){
+          for(size_t j=0;j<nloc;j++){
+            _ENList[i*nloc+j] = ENList[i*nloc+j];
+          }
         }
-      }
-      if(ndims==2){
+        if(ndims==2){
 #pragma omp for schedule(static)
-        for(int i=0;i<(int)NNodes;i++){
-          _coords[i*2  ] = x[i];
-          _coords[i*2+1] = y[i];
-        }
-      }else{
+          for(int i=0;i<(int)NNodes;i++){
+            _coords[i*2  ] = x[i*stride];
+            _coords[i*2+1] = y[i*stride];
+          }
+        }else{
 #pragma omp for schedule(static)
-        for(int i=0;i<(int)NNodes;i++){
-          _coords[i*3  ] = x[i];
-          _coords[i*3+1] = y[i];
-          _coords[i*3+2] = z[i];
+          for(int i=0;i<(int)NNodes;i++){
+            _coords[i*3  ] = x[i*stride];
+            _coords[i*3+1] = y[i*stride];
+            _coords[i*3+2] = z[i*stride];
+          }
         }
       }
 
 #pragma omp single nowait
       {
-        if(num_processes>1){
-          // Take into account renumbering for halo.
-          for(int j=0;j<num_processes;j++){
-            for(size_t k=0;k<recv[j].size();k++){
-              recv_halo.insert(recv[j][k]);
-            }
-            for(size_t k=0;k<send[j].size();k++){
-              send_halo.insert(send[j][k]);
-            }
-          }
-        }
+        if(num_processes>1)
+          create_halo_flags();
       }
 
       // Set the orientation of elements.
@@ -1659,13 +2121,16 @@ template<typename real_t> class Mesh{
       NEList[i].clear();
     }
 
+    // Use the size of the current team, which is smaller than
+    // nthreads when called from inside an outer parallel region.
+    int nteam = pragmatic_team_size();
     for(size_t i=0; i<NElements; i++){
       if(_ENList[i*nloc]<0)
         continue;
 
       for(size_t j=0;j<nloc;j++){
         index_t nid_j = _ENList[i*nloc+j];
-        if((nid_j%nthreads)==tid){
+        if((nid_j%nteam)==tid){
           NEList[nid_j].insert(NEList[nid_j].end(), i);
           for(size_t k=0;k<nloc;k++){
             if(j!=k){
@@ -1695,124 +2160,204 @@ template<typename real_t> class Mesh{
     }
   }
 
-  void trim_halo(){
-    std::set<index_t> recv_halo_temp, send_halo_temp;
+  /*! (Re)build the graph-topology communicator returned by
+   * get_halo_comm() from the ranks appearing in send and recv. This is
+   * collective over get_mpi_comm() and must be called whenever the set
+   * of halo neighbours may have grown. The communicator is only
+   * recreated if the neighbourhood changed on at least one process.
+   * The neighbour list is kept in halo_neighbours_list so that halo
+   * exchanges need not query the topology each time.
+   */
+  void update_halo_comm(){
+#ifdef HAVE_MPI
+    if(num_processes<2)
+      return;
 
-    // Traverse all vertices V in all recv[i] vectors. Vertices in send[i] belong by definition to *this* MPI process,
-    // so all elements adjacent to them either belong exclusively to *this* process or cross partitions.
+    // The halo is symmetric: if we send to a process then it receives
+    // from us, so the same list is used for sources and destinations.
+    std::vector<int> neighbours;
     for(int i=0;i<num_processes;i++){
-      if(recv[i].size()==0)
-        continue;
+      if((i!=rank) && (send[i].size()>0 || recv[i].size()>0))
+        neighbours.push_back(i);
+    }
 
-      std::vector<index_t> recv_temp;
-#ifdef HAVE_BOOST_UNORDERED_MAP_HPP
-      boost::unordered_map<index_t, index_t> recv_map_temp;
-#else
-      std::map<index_t, index_t> recv_map_temp;
+    int changed = (_mpi_halo_comm==MPI_COMM_NULL || neighbours!=halo_neighbours_list)?1:0;
+    PRAGMATIC_TRACE_CALL("MPI_Allreduce", MPI_Allreduce(MPI_IN_PLACE, &changed, 1, MPI_INT, MPI_MAX, _mpi_comm));
+    if(!changed)
+      return;
+
+    if(_mpi_halo_comm!=MPI_COMM_NULL)
+      MPI_Comm_free(&_mpi_halo_comm);
+
+    halo_neighbours_list.swap(neighbours);
+    int degree = halo_neighbours_list.size();
+    MPI_Dist_graph_create_adjacent(_mpi_comm,
+                                   degree, halo_neighbours_list.data(), MPI_UNWEIGHTED,
+                                   degree, halo_neighbours_list.data(), MPI_UNWEIGHTED,
+                                   MPI_INFO_NULL, 0, &_mpi_halo_comm);
 #endif
+  }
 
-      for(typename std::vector<index_t>::const_iterator vit = recv[i].begin(); vit != recv[i].end(); ++vit){
-        // For each vertex, traverse a copy of the vertex's NEList.
-        // We need a copy because erase_element modifies the original NEList.
-        std::set<index_t> NEList_copy = NEList[*vit];
-        for(typename std::set<index_t>::const_iterator eit = NEList_copy.begin(); eit != NEList_copy.end(); ++eit){
-          // Check whether all vertices comprising the element belong to another MPI process.
-          std::vector<index_t> n(nloc);
-          get_element(*eit, &n[0]);
+  /// Set halo_flag from the send and recv lists.
+  void create_halo_flags(){
+    std::fill(halo_flag.begin(), halo_flag.end(), 0);
+    for(int k=0;k<num_processes;k++){
+      for(typename std::vector<index_t>::const_iterator it=send[k].begin();it!=send[k].end();++it)
+        halo_flag[*it] |= HALO_SEND;
+      for(typename std::vector<index_t>::const_iterator it=recv[k].begin();it!=recv[k].end();++it)
+        halo_flag[*it] |= HALO_RECV;
+    }
+  }
+
+  /*! Remove halo elements which no longer contain a vertex owned by
+   * this process, along with the halo vertices and edges which are
+   * left orphaned, and trim the send and recv lists accordingly. Each
+   * pass is thread-parallel, so this must not be called from inside a
+   * parallel region.
+   */
+  void trim_halo(){
+    // Vertices in send[i] belong by definition to *this* MPI process, so all elements
+    // adjacent to them either belong exclusively to *this* process or cross partitions.
+    // Hence only the elements around recv vertices need to be considered.
+    std::vector<index_t> recv_vertices;
+    for(int i=0;i<num_processes;i++)
+      recv_vertices.insert(recv_vertices.end(), recv[i].begin(), recv[i].end());
+
+    std::vector< std::vector<index_t> > deleted_elements(nthreads), affected_vertices(nthreads);
+    std::vector<char> affected(NNodes, 0);
+
+#pragma omp parallel
+    {
+      int tid = pragmatic_thread_id();
+
+      // An element can be deleted if none of its vertices is owned by *this* process.
+      // It is claimed by the thread processing its recv vertex with the lowest id.
+#pragma omp for schedule(guided)
+      for(size_t i=0;i<recv_vertices.size();i++){
+        index_t v = recv_vertices[i];
+        for(typename std::set<index_t>::const_iterator eit=NEList[v].begin();eit!=NEList[v].end();++eit){
+          const index_t *n = get_element(*eit);
           if(n[0] < 0)
             continue;
 
-          // If one of the vertices belongs to *this* partition, the element should be retained.
           bool to_be_deleted = true;
-          for(size_t j=0; j<nloc; ++j)
+          index_t min_vertex = v;
+          for(size_t j=0; j<nloc; ++j){
             if(is_owned_node(n[j])){
               to_be_deleted = false;
               break;
             }
-
-          if(to_be_deleted){
-            erase_element(*eit);
-
-            // Now check whether one of the edges must be deleted
-            for(size_t j=0; j<nloc; ++j){
-              for(size_t k=j+1; k<nloc; ++k){
-                std::set<index_t> intersection;
-                std::set_intersection(NEList[n[j]].begin(), NEList[n[j]].end(), NEList[n[k]].begin(), NEList[n[k]].end(),
-                    std::inserter(intersection, intersection.begin()));
-
-                // If these two vertices have no element in common anymore,
-                // then the corresponding edge does not exist, so update NNList.
-                if(intersection.empty()){
-                  typename std::vector<index_t>::iterator it;
-                  it = std::find(NNList[n[j]].begin(), NNList[n[j]].end(), n[k]);
-                  NNList[n[j]].erase(it);
-                  it = std::find(NNList[n[k]].begin(), NNList[n[k]].end(), n[j]);
-                  NNList[n[k]].erase(it);
-                }
-              }
-            }
+            if(halo_flag[n[j]]&HALO_RECV)
+              min_vertex = std::min(min_vertex, n[j]);
           }
+
+          if(to_be_deleted && min_vertex==v)
+            deleted_elements[tid].push_back(*eit);
         }
+      }
 
-        // If this vertex is no longer part of any element, then it is safe to be removed.
-        if(NEList[*vit].empty()){
-          // Update NNList of all neighbours
-          for(typename std::vector<index_t>::const_iterator neigh_it = NNList[*vit].begin(); neigh_it != NNList[*vit].end(); ++neigh_it){
-            typename std::vector<index_t>::iterator it = std::find(NNList[*neigh_it].begin(), NNList[*neigh_it].end(), *vit);
-            NNList[*neigh_it].erase(it);
+      // Delete the elements and collect their vertices. Not all of these are
+      // in recv: new vertices which are not visible by *this* process are not.
+      // Each vertex is collected by the first thread to mark it.
+      for(typename std::vector<index_t>::const_iterator eit=deleted_elements[tid].begin();eit!=deleted_elements[tid].end();++eit){
+        for(size_t j=0; j<nloc; ++j){
+          index_t v = _ENList[(*eit)*nloc+j];
+          char marked;
+#pragma omp atomic capture
+          {
+            marked = affected[v];
+            affected[v] = 1;
           }
-
-          erase_vertex(*vit);
-        }else{
-          // We will keep this vertex, so put it into recv_halo_temp.
-          recv_temp.push_back(*vit);
-          recv_map_temp[lnn2gnn[*vit]] = *vit;
-          recv_halo_temp.insert(*vit);
+          if(!marked)
+            affected_vertices[tid].push_back(v);
         }
+        _ENList[(*eit)*nloc] = -1;
       }
+#pragma omp barrier
 
-      recv[i].swap(recv_temp);
-      recv_map[i].swap(recv_map_temp);
-    }
+      // Remove deleted elements from the NEList of affected vertices.
+      for(typename std::vector<index_t>::const_iterator vit=affected_vertices[tid].begin();vit!=affected_vertices[tid].end();++vit){
+        index_t v = *vit;
+        for(typename std::set<index_t>::iterator eit=NEList[v].begin();eit!=NEList[v].end();){
+          if(_ENList[(*eit)*nloc] < 0)
+            NEList[v].erase(eit++);
+          else
+            ++eit;
+        }
+      }
 
-    // Once all recv[i] have been traversed, update recv_halo.
-    recv_halo.swap(recv_halo_temp);
+#pragma omp barrier
 
-    // Traverse all vertices V in all send[i] vectors.
-    // If none of V's neighbours are owned by the i-th MPI process, it means that the i-th process
-    // has removed V from its recv_halo, so remove the vertex from send[i].
-    for(int i=0;i<num_processes;i++){
-      if(send[i].size()==0)
-        continue;
+      // If two affected vertices have no element in common anymore,
+      // then the corresponding edge does not exist, so update NNList.
+      // Only edges between affected vertices can have disappeared.
+      for(typename std::vector<index_t>::const_iterator vit=affected_vertices[tid].begin();vit!=affected_vertices[tid].end();++vit){
+        index_t v = *vit;
+        std::vector<index_t> new_NNList;
+        new_NNList.reserve(NNList[v].size());
+        for(typename std::vector<index_t>::const_iterator it=NNList[v].begin();it!=NNList[v].end();++it){
+          if(!affected[*it] || share_element(v, *it))
+            new_NNList.push_back(*it);
+        }
+        NNList[v].swap(new_NNList);
+      }
+#pragma omp barrier
 
-      std::vector<index_t> send_temp;
-#ifdef HAVE_BOOST_UNORDERED_MAP_HPP
-      boost::unordered_map<index_t, index_t> send_map_temp;
-#else
-      std::map<index_t, index_t> send_map_temp;
-#endif
+      // If a vertex is no longer part of any element, then it is safe to be removed.
+#pragma omp for schedule(guided)
+      for(size_t i=0;i<recv_vertices.size();i++){
+        index_t v = recv_vertices[i];
+        if(NEList[v].empty())
+          erase_vertex(v);
+      }
 
-      for(typename std::vector<index_t>::const_iterator vit = send[i].begin(); vit != send[i].end(); ++vit){
-        bool to_be_deleted = true;
-        for(typename std::vector<index_t>::const_iterator neigh_it = NNList[*vit].begin(); neigh_it != NNList[*vit].end(); ++neigh_it)
-          if(node_owner[*neigh_it] == i){
-            to_be_deleted = false;
-            break;
+      // Trim the send and recv lists, one process per iteration. If none of
+      // the neighbours of a vertex V in send[i] is owned by the i-th process,
+      // then the i-th process has removed V from its recv list.
+#pragma omp for schedule(dynamic)
+      for(int i=0;i<num_processes;i++){
+        if(recv[i].size()>0){
+          std::vector<index_t> recv_temp;
+          for(typename std::vector<index_t>::const_iterator vit=recv[i].begin(); vit!=recv[i].end(); ++vit){
+            if(!NEList[*vit].empty())
+              recv_temp.push_back(*vit);
           }
+          recv[i].swap(recv_temp);
+          recv_map[i].assign(recv[i], lnn2gnn);
+        }
 
-        if(!to_be_deleted){
-          send_temp.push_back(*vit);
-          send_map_temp[lnn2gnn[*vit]] = *vit;
-          send_halo_temp.insert(*vit);
+        if(send[i].size()>0){
+          std::vector<index_t> send_temp;
+          for(typename std::vector<index_t>::const_iterator vit=send[i].begin(); vit!=send[i].end(); ++vit){
+            for(typename std::vector<index_t>::const_iterator neigh_it=NNList[*vit].begin(); neigh_it!=NNList[*vit].end(); ++neigh_it){
+              if(node_owner[*neigh_it] == i){
+                send_temp.push_back(*vit);
+                break;
+              }
+            }
+          }
+          send[i].swap(send_temp);
+          send_map[i].assign(send[i], lnn2gnn);
         }
       }
-
-      send[i].swap(send_temp);
-      send_map[i].swap(send_map_temp);
     }
 
-    // Once all send[i] have been traversed, update send_halo.
-    send_halo.swap(send_halo_temp);
+    // Once all send[i] and recv[i] have been traversed, update the halo flags.
+    create_halo_flags();
+  }
+
+  /// Returns true if vertices nid0 and nid1 have an element in common.
+  bool share_element(index_t nid0, index_t nid1) const{
+    typename std::set<index_t>::const_iterator it0=NEList[nid0].begin(), it1=NEList[nid1].begin();
+    while(it0!=NEList[nid0].end() && it1!=NEList[nid1].end()){
+      if(*it0<*it1)
+        ++it0;
+      else if(*it1<*it0)
+        ++it1;
+      else
+        return true;
+    }
+    return false;
   }
 
   void create_global_node_numbering(){
@@ -1820,13 +2365,15 @@ template<typename real_t> class Mesh{
 #ifdef HAVE_MPI
       // Calculate the global numbering offset for this partition.
       int gnn_offset;
-      int NPNodes = NNodes - recv_halo.size();
-      MPI_Scan(&NPNodes, &gnn_offset, 1, MPI_INT, MPI_SUM, get_mpi_comm());
+      int NPNodes = NNodes;
+      for(int i=0;i<num_processes;i++)
+        NPNodes -= recv[i].size();
+      PRAGMATIC_TRACE_CALL("MPI_Scan", MPI_Scan(&NPNodes, &gnn_offset, 1, MPI_INT, MPI_SUM, get_mpi_comm()));
       gnn_offset-=NPNodes;
 
       // Write global node numbering and ownership for nodes assigned to local process.
       for(index_t i=0; i < (index_t) NNodes; i++){
-        if(recv_halo.count(i)){
+        if(halo_flag[i]&HALO_RECV){
           lnn2gnn[i] = 0;
         }else{
           lnn2gnn[i] = gnn_offset++;
@@ -1835,7 +2382,7 @@ template<typename real_t> class Mesh{
       }
 
       // Update GNN's for the halo nodes.
-      halo_update<int, 1>(_mpi_comm, send, recv, lnn2gnn);
+      halo_update<int, 1>(get_halo_comm(), send, recv, lnn2gnn);
 
       // Finish writing node ownerships.
       for(int i=0;i<num_processes;i++){
@@ -1856,7 +2403,7 @@ template<typename real_t> class Mesh{
     // We expect to have NElements_predict/2 nodes in the partition,
     // so let's reserve 10 times more space for global node numbers.
     index_t gnn_reserve = 5*pNElements;
-    MPI_Scan(&gnn_reserve, &gnn_offset, 1, MPI_INDEX_T, MPI_SUM, _mpi_comm);
+    PRAGMATIC_TRACE_CALL("MPI_Scan", MPI_Scan(&gnn_reserve, &gnn_offset, 1, MPI_INDEX_T, MPI_SUM, _mpi_comm));
     gnn_offset -= gnn_reserve;
 
     for(size_t i=0; i<NNodes; ++i){
@@ -1866,61 +2413,54 @@ template<typename real_t> class Mesh{
         lnn2gnn[i] = -1;
     }
 
-    halo_update<int, 1>(_mpi_comm, send, recv, lnn2gnn);
+    halo_update<int, 1>(get_halo_comm(), send, recv, lnn2gnn);
 
     for(int i=0;i<num_processes;i++){
-      send_map[i].clear();
       for(std::vector<int>::const_iterator it=send[i].begin();it!=send[i].end();++it){
         assert(node_owner[*it]==rank);
-        send_map[i][lnn2gnn[*it]] = *it;
       }
+      send_map[i].assign(send[i], lnn2gnn);
 
-      recv_map[i].clear();
       for(std::vector<int>::const_iterator it=recv[i].begin();it!=recv[i].end();++it){
         node_owner[*it] = i;
-        recv_map[i][lnn2gnn[*it]] = *it;
       }
+      recv_map[i].assign(recv[i], lnn2gnn);
     }
 #endif
   }
 
+  /*! Send the global numbers of the last send_cnt[i] vertices appended
+   * to send[i], and receive those of the last recv_cnt[i] vertices
+   * appended to recv[i]. The halo communicator must be up to date, see
+   * update_halo_comm().
+   */
   void update_gappy_global_numbering(std::vector<size_t>& recv_cnt, std::vector<size_t>& send_cnt){
 #ifdef HAVE_MPI
-    // MPI_Requests for all non-blocking communications.
-    std::vector<MPI_Request> request(num_processes*2);
-
-    // Setup non-blocking receives.
-    std::vector< std::vector<index_t> > recv_buff(num_processes);
-    for(int i=0;i<num_processes;i++){
-      if(recv_cnt[i]==0){
-        request[i] =  MPI_REQUEST_NULL;
-      }else{
-        recv_buff[i].resize(recv_cnt[i]);
-        MPI_Irecv(&(recv_buff[i][0]), recv_buff[i].size(), MPI_INDEX_T, i, 0, _mpi_comm, &(request[i]));
-      }
+    if(_mpi_halo_comm==MPI_COMM_NULL)
+      return;
+    const std::vector<int> &sources = halo_neighbours_list, &destinations = halo_neighbours_list;
+
+    std::vector<int> sendcnt(destinations.size());
+    std::vector<index_t> send_buff;
+    for(size_t i=0;i<destinations.size();i++){
+      int p = destinations[i];
+      sendcnt[i] = send_cnt[p];
+      for(typename std::vector<index_t>::const_iterator it=send[p].end()-send_cnt[p];it!=send[p].end();++it)
+        send_buff.push_back(lnn2gnn[*it]);
     }
 
-    // Non-blocking sends.
-    std::vector< std::vector<index_t> > send_buff(num_processes);
-    for(int i=0;i<num_processes;i++){
-      if(send_cnt[i]==0){
-        request[num_processes+i] = MPI_REQUEST_NULL;
-      }else{
-        for(typename std::vector<index_t>::const_iterator it=send[i].end()-send_cnt[i];it!=send[i].end();++it)
-          send_buff[i].push_back(lnn2gnn[*it]);
-
-        MPI_Isend(&(send_buff[i][0]), send_buff[i].size(), MPI_INDEX_T, i, 0, _mpi_comm, &(request[num_processes+i]));
-      }
-    }
+    std::vector<int> recvcnt(sources.size());
+    for(size_t i=0;i<sources.size();i++)
+      recvcnt[i] = recv_cnt[sources[i]];
 
-    std::vector<MPI_Status> status(num_processes*2);
-    MPI_Waitall(num_processes, &(request[0]), &(status[0]));
-    MPI_Waitall(num_processes, &(request[num_processes]), &(status[num_processes]));
+    std::vector<index_t> recv_buff;
+    neighbour_alltoallv(_mpi_halo_comm, sources, destinations, send_buff, sendcnt, recv_buff, recvcnt);
 
-    for(int i=0;i<num_processes;i++){
-      int k=0;
-      for(typename std::vector<index_t>::const_iterator it=recv[i].end()-recv_cnt[i];it!=recv[i].end();++it, ++k)
-        lnn2gnn[*it] = recv_buff[i][k];
+    int k=0;
+    for(size_t i=0;i<sources.size();i++){
+      int p = sources[i];
+      for(typename std::vector<index_t>::const_iterator it=recv[p].end()-recv_cnt[p];it!=recv[p].end();++it, ++k)
+        lnn2gnn[*it] = recv_buff[k];
     }
 #endif
   }
@@ -1943,15 +2483,16 @@ template<typename real_t> class Mesh{
   // Metric tensor field.
   std::vector<double> metric;
 
+  // Provenance log and the node fields it is replayed on.
+  Provenance<real_t> *provenance;
+  std::vector< std::pair<std::vector<real_t> *, int> > attached_fields;
+
   // Parallel support.
   int rank, num_processes, nthreads;
   std::vector< std::vector<index_t> > send, recv;
-#ifdef HAVE_BOOST_UNORDERED_MAP_HPP
-  std::vector< boost::unordered_map<index_t, index_t> > send_map, recv_map;
-#else
-  std::vector< std::map<index_t, index_t> > send_map, recv_map;
-#endif
-  std::set<index_t> send_halo, recv_halo;
+  std::vector<HaloMap> send_map, recv_map;
+  // HALO_SEND/HALO_RECV bits for each vertex.
+  std::vector<unsigned char> halo_flag;
   std::vector<int> node_owner;
   std::vector<index_t> lnn2gnn;
 
@@ -1959,6 +2500,14 @@ template<typename real_t> class Mesh{
   MPI_Comm _mpi_comm;
   index_t gnn_offset;
 
+  // Graph-topology communicator over the halo neighbours, which are
+  // both its sources and its destinations.
+  MPI_Comm _mpi_halo_comm;
+  std::vector<int> halo_neighbours_list;
+
+  // Halo exchange with neighbours on the same node.
+  SharedHaloExchange *shared_halo;
+
   // MPI data type for index_t and real_t
   MPI_Datatype MPI_INDEX_T;
   MPI_Datatype MPI_REAL_T;
@@ -0,0 +1,448 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef MESHCHECKPOINT_H
+#define MESHCHECKPOINT_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Mesh.h"
+
+/*! \brief Binary checkpoint/restart of a Mesh.
+ *
+ * Each MPI process writes the raw contents of its local mesh (elements,
+ * coordinates, metric, boundary labels, global numbering, ownership,
+ * halo lists and, optionally, the adjacency lists in CSR form) to its
+ * own file, basename_<rank>.pcp. On restart the file is mapped with
+ * mmap and copied straight into the Mesh: there is no parsing,
+ * renumbering or repartitioning, so restarting is limited by I/O
+ * bandwidth. A checkpoint can only be loaded with the same number of
+ * processes, and on a machine with the same byte order and type sizes.
+ */
+template<typename real_t> class MeshCheckpoint{
+ public:
+  /*! Write a checkpoint of mesh.
+   *
+   * @param basename prefix of the checkpoint files.
+   * @param mesh the mesh.
+   * @param adjacency also store NNList and NEList, so that they do not
+   *        have to be rebuilt on restart.
+   * @return true on success.
+   */
+  static bool save(const char *basename, const Mesh<real_t> *mesh, bool adjacency=true){
+    Header header;
+    memset(&header, 0, sizeof(Header));
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.real_size = sizeof(real_t);
+    header.index_size = sizeof(index_t);
+    header.ndims = mesh->ndims;
+    header.nloc = mesh->nloc;
+    header.msize = mesh->msize;
+    header.flags = adjacency?HAS_ADJACENCY:0;
+    header.rank = mesh->rank;
+    header.nprocs = mesh->num_processes;
+    header.NNodes = mesh->NNodes;
+    header.NElements = mesh->NElements;
+
+    size_t NNodes = mesh->NNodes;
+    size_t NElements = mesh->NElements;
+
+    // Flatten the halo and the adjacency lists.
+    std::vector<int64_t> send_ptr, recv_ptr, NNList_ptr, NEList_ptr;
+    std::vector<index_t> send_list, recv_list, NNList_list, NEList_list;
+    flatten(mesh->send, mesh->num_processes, send_ptr, send_list);
+    flatten(mesh->recv, mesh->num_processes, recv_ptr, recv_list);
+    if(adjacency){
+      flatten(mesh->NNList, NNodes, NNList_ptr, NNList_list);
+      flatten(mesh->NEList, NNodes, NEList_ptr, NEList_list);
+    }
+
+    const void *data[NSECTIONS];
+    set_section(header, data, ENLIST, &(mesh->_ENList[0]), NElements*mesh->nloc*sizeof(index_t));
+    set_section(header, data, COORDS, &(mesh->_coords[0]), NNodes*mesh->ndims*sizeof(real_t));
+    set_section(header, data, METRIC, mesh->metric.empty()?NULL:&(mesh->metric[0]),
+                mesh->metric.empty()?0:NNodes*mesh->msize*sizeof(double));
+    set_section(header, data, BOUNDARY, mesh->boundary.empty()?NULL:&(mesh->boundary[0]),
+                mesh->boundary.empty()?0:NElements*mesh->nloc*sizeof(int));
+    set_section(header, data, LNN2GNN, &(mesh->lnn2gnn[0]), NNodes*sizeof(index_t));
+    set_section(header, data, NODE_OWNER, &(mesh->node_owner[0]), NNodes*sizeof(int));
+    set_section(header, data, SEND_PTR, &(send_ptr[0]), send_ptr.size()*sizeof(int64_t));
+    set_section(header, data, SEND, send_list.empty()?NULL:&(send_list[0]), send_list.size()*sizeof(index_t));
+    set_section(header, data, RECV_PTR, &(recv_ptr[0]), recv_ptr.size()*sizeof(int64_t));
+    set_section(header, data, RECV, recv_list.empty()?NULL:&(recv_list[0]), recv_list.size()*sizeof(index_t));
+    set_section(header, data, NNLIST_PTR, NNList_ptr.empty()?NULL:&(NNList_ptr[0]), NNList_ptr.size()*sizeof(int64_t));
+    set_section(header, data, NNLIST, NNList_list.empty()?NULL:&(NNList_list[0]), NNList_list.size()*sizeof(index_t));
+    set_section(header, data, NELIST_PTR, NEList_ptr.empty()?NULL:&(NEList_ptr[0]), NEList_ptr.size()*sizeof(int64_t));
+    set_section(header, data, NELIST, NEList_list.empty()?NULL:&(NEList_list[0]), NEList_list.size()*sizeof(index_t));
+
+    // Lay the sections out one after the other, each aligned so that the
+    // mapped arrays are suitably aligned for any type.
+    uint64_t offset = align(sizeof(Header));
+    for(int i=0;i<NSECTIONS;i++){
+      header.section_offset[i] = offset;
+      offset = align(offset+header.section_size[i]);
+    }
+
+    std::string filename = get_filename(basename, mesh->rank);
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if(fp==NULL){
+      std::cerr<<"ERROR: Cannot open "<<filename<<" for writing.\n";
+      return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(Header), 1, fp)==1;
+    uint64_t pos = sizeof(Header);
+    const char zeros[ALIGNMENT] = {0};
+    for(int i=0;ok && i<NSECTIONS;i++){
+      ok = fwrite(zeros, 1, header.section_offset[i]-pos, fp)==header.section_offset[i]-pos;
+      if(ok && header.section_size[i]>0)
+        ok = fwrite(data[i], 1, header.section_size[i], fp)==header.section_size[i];
+      pos = header.section_offset[i]+header.section_size[i];
+    }
+    ok = (fclose(fp)==0) && ok;
+
+    if(!ok)
+      std::cerr<<"ERROR: Failed to write "<<filename<<".\n";
+
+    return ok;
+  }
+
+  /*! Restart from a checkpoint written by save(). This is collective
+   * over MPI_COMM_WORLD when MPI is enabled.
+   *
+   * @param basename prefix of the checkpoint files.
+   * @return the new mesh, or NULL if the checkpoint could not be loaded.
+   */
+  static Mesh<real_t>* load(const char *basename){
+    int rank=0, nprocs=1;
+#ifdef HAVE_MPI
+    MPI_Comm comm = MPI_COMM_WORLD;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+#endif
+
+    std::string filename = get_filename(basename, rank);
+
+    const char *base = NULL;
+    size_t length = 0;
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd<0){
+      std::cerr<<"ERROR: Cannot open "<<filename<<" for reading.\n";
+    }else{
+      struct stat st;
+      if(fstat(fd, &st)==0 && st.st_size>=(off_t)sizeof(Header)){
+        length = st.st_size;
+        void *addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr!=MAP_FAILED){
+          base = (const char *)addr;
+          madvise(addr, length, MADV_SEQUENTIAL);
+        }
+      }
+      close(fd);
+    }
+
+    const Header *header = (const Header *)base;
+    int ok = (base!=NULL && validate(filename, header, length, rank, nprocs))?1:0;
+
+    // All processes must agree before entering the collective part.
+#ifdef HAVE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+#endif
+    if(!ok){
+      if(base!=NULL)
+        munmap((void *)base, length);
+      return NULL;
+    }
+
+    Mesh<real_t> *mesh = new Mesh<real_t>();
+#ifdef HAVE_MPI
+    mesh->_init_parallel(comm);
+#else
+    mesh->_init_parallel();
+#endif
+
+    mesh->ndims = header->ndims;
+    mesh->nloc = header->nloc;
+    mesh->msize = header->msize;
+    mesh->NNodes = header->NNodes;
+    mesh->NElements = header->NElements;
+
+    size_t NNodes = mesh->NNodes;
+
+    mesh->_ENList.resize(mesh->NElements*mesh->nloc);
+    mesh->_coords.resize(NNodes*mesh->ndims);
+    mesh->metric.resize(NNodes*mesh->msize);
+    mesh->lnn2gnn.resize(NNodes);
+    mesh->node_owner.resize(NNodes);
+    mesh->halo_flag.resize(NNodes, 0);
+    mesh->NNList.resize(NNodes);
+    mesh->NEList.resize(NNodes);
+    if(header->section_size[BOUNDARY]>0)
+      mesh->boundary.resize(mesh->NElements*mesh->nloc);
+
+    const int64_t *send_ptr = (const int64_t *)(base+header->section_offset[SEND_PTR]);
+    const index_t *send_list = (const index_t *)(base+header->section_offset[SEND]);
+    const int64_t *recv_ptr = (const int64_t *)(base+header->section_offset[RECV_PTR]);
+    const index_t *recv_list = (const index_t *)(base+header->section_offset[RECV]);
+    if(nprocs>1){
+      mesh->send.resize(nprocs);
+      mesh->recv.resize(nprocs);
+      for(int i=0;i<nprocs;i++){
+        mesh->send[i].assign(send_list+send_ptr[i], send_list+send_ptr[i+1]);
+        mesh->recv[i].assign(recv_list+recv_ptr[i], recv_list+recv_ptr[i+1]);
+      }
+    }
+
+    bool adjacency = header->flags&HAS_ADJACENCY;
+#pragma omp parallel
+    {
+      // resize() above already zeroed the arrays serially, so their pages
+      // are placed by the master thread; copying in parallel only spreads
+      // the copy over the threads. The adjacency lists below are
+      // allocated by the threads which will work on them.
+      copy_section(base, header, ENLIST, mesh->_ENList);
+      copy_section(base, header, COORDS, mesh->_coords);
+      copy_section(base, header, METRIC, mesh->metric);
+      copy_section(base, header, BOUNDARY, mesh->boundary);
+      copy_section(base, header, LNN2GNN, mesh->lnn2gnn);
+      copy_section(base, header, NODE_OWNER, mesh->node_owner);
+
+      if(adjacency){
+        const int64_t *NNList_ptr = (const int64_t *)(base+header->section_offset[NNLIST_PTR]);
+        const index_t *NNList_list = (const index_t *)(base+header->section_offset[NNLIST]);
+        const int64_t *NEList_ptr = (const int64_t *)(base+header->section_offset[NELIST_PTR]);
+        const index_t *NEList_list = (const index_t *)(base+header->section_offset[NELIST]);
+#pragma omp for schedule(static)
+        for(size_t i=0;i<NNodes;i++){
+          mesh->NNList[i].assign(NNList_list+NNList_ptr[i], NNList_list+NNList_ptr[i+1]);
+          // NEList was written in order, so every insertion is at the end.
+          for(int64_t j=NEList_ptr[i];j<NEList_ptr[i+1];j++)
+            mesh->NEList[i].insert(mesh->NEList[i].end(), NEList_list[j]);
+        }
+      }else{
+        // create_adjacency is meant to be called from inside a parallel region
+        mesh->create_adjacency();
+      }
+    }
+
+    munmap((void *)base, length);
+
+    // Elements are stored with consistent orientation, so set the reference
+    // orientation from the first one which has not been deleted.
+    mesh->property = NULL;
+    for(size_t i=0;i<mesh->NElements;i++){
+      const index_t *n=mesh->get_element(i);
+      if(n[0]<0)
+        continue;
+
+      if(mesh->ndims==2)
+        mesh->property = new ElementProperty<real_t>(mesh->get_coords(n[0]),
+                                                     mesh->get_coords(n[1]),
+                                                     mesh->get_coords(n[2]));
+      else
+        mesh->property = new ElementProperty<real_t>(mesh->get_coords(n[0]),
+                                                     mesh->get_coords(n[1]),
+                                                     mesh->get_coords(n[2]),
+                                                     mesh->get_coords(n[3]));
+      break;
+    }
+
+#ifdef HAVE_MPI
+    if(nprocs>1){
+      mesh->send_map.resize(nprocs);
+      mesh->recv_map.resize(nprocs);
+      for(int i=0;i<nprocs;i++){
+        mesh->send_map[i].assign(mesh->send[i], mesh->lnn2gnn);
+        mesh->recv_map[i].assign(mesh->recv[i], mesh->lnn2gnn);
+      }
+      mesh->create_halo_flags();
+
+      mesh->update_halo_comm();
+      mesh->shared_halo = new SharedHaloExchange(comm);
+    }
+#endif
+
+    return mesh;
+  }
+
+ private:
+  static const char MAGIC[8];
+  static const uint32_t VERSION = 1;
+  static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+  static const uint32_t HAS_ADJACENCY = 1;
+  static const uint64_t ALIGNMENT = 64;
+
+  enum {ENLIST=0, COORDS, METRIC, BOUNDARY, LNN2GNN, NODE_OWNER,
+        SEND_PTR, SEND, RECV_PTR, RECV,
+        NNLIST_PTR, NNLIST, NELIST_PTR, NELIST, NSECTIONS};
+
+  // Fixed-size file header. Sizes and offsets are in bytes.
+  struct Header{
+    char magic[8];
+    uint32_t version, byte_order, real_size, index_size;
+    uint32_t ndims, nloc, msize, flags;
+    int32_t rank, nprocs;
+    uint64_t NNodes, NElements;
+    uint64_t section_offset[NSECTIONS], section_size[NSECTIONS];
+  };
+
+  static uint64_t align(uint64_t offset){
+    return ((offset+ALIGNMENT-1)/ALIGNMENT)*ALIGNMENT;
+  }
+
+  static std::string get_filename(const char *basename, int rank){
+    char filename[4096];
+    snprintf(filename, 4096, "%s_%d.pcp", basename, rank);
+    return std::string(filename);
+  }
+
+  static void set_section(Header &header, const void **data, int section, const void *ptr, uint64_t size){
+    data[section] = ptr;
+    header.section_size[section] = size;
+  }
+
+  /// Flatten the first n lists into CSR form. Missing lists are empty.
+  template<typename list_t>
+    static void flatten(const std::vector<list_t> &lists, size_t n,
+                        std::vector<int64_t> &ptr, std::vector<index_t> &flat){
+    size_t nlists = std::min(n, lists.size());
+
+    ptr.assign(n+1, 0);
+    for(size_t i=0;i<nlists;i++)
+      ptr[i+1] = ptr[i]+lists[i].size();
+    for(size_t i=nlists;i<n;i++)
+      ptr[i+1] = ptr[i];
+
+    flat.resize(ptr[n]);
+    for(size_t i=0;i<nlists;i++)
+      std::copy(lists[i].begin(), lists[i].end(), flat.begin()+ptr[i]);
+  }
+
+  /// Check that the CSR offsets in ptr_section stay inside list_section.
+  static bool valid_csr(const char *base, const Header *header, int ptr_section, int list_section){
+    size_t n = header->section_size[ptr_section]/sizeof(int64_t);
+    if(n==0)
+      return true;
+
+    const int64_t *ptr = (const int64_t *)(base+header->section_offset[ptr_section]);
+    if(ptr[0]!=0 || (uint64_t)ptr[n-1]*sizeof(index_t)!=header->section_size[list_section])
+      return false;
+    for(size_t i=1;i<n;i++)
+      if(ptr[i]<ptr[i-1])
+        return false;
+
+    return true;
+  }
+
+  /// Copy a section into vec. Must be called from inside a parallel region.
+  template<typename T>
+    static void copy_section(const char *base, const Header *header, int section, std::vector<T> &vec){
+    const T *src = (const T *)(base+header->section_offset[section]);
+    size_t n = header->section_size[section]/sizeof(T);
+    assert(n<=vec.size());
+#pragma omp for schedule(static) nowait
+    for(size_t i=0;i<n;i++)
+      vec[i] = src[i];
+  }
+
+  static bool validate(const std::string &filename, const Header *header, size_t length, int rank, int nprocs){
+    if(memcmp(header->magic, MAGIC, sizeof(header->magic))!=0){
+      std::cerr<<"ERROR: "<<filename<<" is not a PRAgMaTIc checkpoint.\n";
+      return false;
+    }
+    if(header->version!=VERSION){
+      std::cerr<<"ERROR: "<<filename<<" has checkpoint version "<<header->version
+               <<", expected "<<VERSION<<".\n";
+      return false;
+    }
+    if(header->byte_order!=BYTE_ORDER_MARK || header->real_size!=sizeof(real_t) || header->index_size!=sizeof(index_t)){
+      std::cerr<<"ERROR: "<<filename<<" was written on an incompatible platform.\n";
+      return false;
+    }
+    if(header->nprocs!=nprocs || header->rank!=rank){
+      std::cerr<<"ERROR: "<<filename<<" was written by rank "<<header->rank<<" of "<<header->nprocs
+               <<" processes, but it is being read by rank "<<rank<<" of "<<nprocs<<".\n";
+      return false;
+    }
+
+    size_t NNodes = header->NNodes;
+    size_t NElements = header->NElements;
+    uint64_t expected[NSECTIONS] = {NElements*header->nloc*sizeof(index_t), NNodes*header->ndims*sizeof(real_t),
+                                    NNodes*header->msize*sizeof(double), NElements*header->nloc*sizeof(int),
+                                    NNodes*sizeof(index_t), NNodes*sizeof(int),
+                                    (nprocs+1)*sizeof(int64_t), header->section_size[SEND],
+                                    (nprocs+1)*sizeof(int64_t), header->section_size[RECV],
+                                    (NNodes+1)*sizeof(int64_t), header->section_size[NNLIST],
+                                    (NNodes+1)*sizeof(int64_t), header->section_size[NELIST]};
+    // Metric and boundary are optional, as is the adjacency.
+    bool ok = (header->ndims==2 && header->nloc==3 && header->msize==3) ||
+      (header->ndims==3 && header->nloc==4 && header->msize==6);
+    for(int i=0;ok && i<NSECTIONS;i++){
+      bool optional = (i==METRIC || i==BOUNDARY || (i>=NNLIST_PTR && !(header->flags&HAS_ADJACENCY)));
+      if(header->section_size[i]!=expected[i] && !(optional && header->section_size[i]==0))
+        ok = false;
+      if(header->section_offset[i]+header->section_size[i]>length)
+        ok = false;
+    }
+    const char *base = (const char *)header;
+    ok = ok && valid_csr(base, header, SEND_PTR, SEND) && valid_csr(base, header, RECV_PTR, RECV) &&
+      valid_csr(base, header, NNLIST_PTR, NNLIST) && valid_csr(base, header, NELIST_PTR, NELIST);
+    if(!ok)
+      std::cerr<<"ERROR: "<<filename<<" is truncated or corrupt.\n";
+
+    return ok;
+  }
+};
+
+template<typename real_t> const char MeshCheckpoint<real_t>::MAGIC[8] = {'P', 'R', 'G', 'M', 'C', 'K', 'P', 'T'};
+
+#endif
@@ -0,0 +1,391 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef MESHGENERATOR_H
+#define MESHGENERATOR_H
+
+#include <iostream>
+#include <vector>
+
+#include <stdint.h>
+
+#include "Mesh.h"
+
+/*! \brief Generates structured triangle and tetrahedral meshes of a box.
+ *
+ * The box [0, extent[0]]x[0, extent[1]](x[0, extent[2]]) is divided
+ * into n[0]xn[1](xn[2]) cells. Each cell is split into two triangles,
+ * or into six tetrahedra along the paths from one corner to the
+ * opposite one. The element-node list, coordinates, global numbering,
+ * halo and boundary labels are written straight into the Mesh arrays
+ * by all threads, so there is no global element list and no
+ * renumbering: large meshes are generated in about the time it takes
+ * to touch the memory.
+ *
+ * With several processes the node planes normal to x are dealt out in
+ * slabs. Each process generates only its own planes and the halo plane
+ * either side, and owns a contiguous range of global node numbers.
+ *
+ * The boundary is labelled as by Mesh::set_boundary(). By default the
+ * faces x=0, x=extent[0], y=0, y=extent[1], z=0 and z=extent[2] get
+ * the IDs 1 to 6.
+ */
+template<typename real_t> class MeshGenerator{
+ public:
+  /*! Generate the whole box on this process.
+   *
+   * @param dim 2 for triangles or 3 for tetrahedra.
+   * @param n number of cells along each axis.
+   * @param extent length of the box along each axis, or NULL for the unit box.
+   * @param boundary_ids IDs of the faces x=0, x=extent[0], y=0, ..., or NULL for 1 to 2*dim.
+   * @param perturbation interior nodes are moved randomly by up to this
+   *        fraction of the cell size along each axis. Elements remain
+   *        valid for values up to about 0.25 in 2D and 0.2 in 3D.
+   * @param seed seed of the perturbation.
+   * @return the new mesh, or NULL if the arguments are invalid.
+   */
+  static Mesh<real_t> *generate_box(int dim, const int *n, const real_t *extent=NULL, const int *boundary_ids=NULL,
+                                    real_t perturbation=0.0, unsigned int seed=0){
+#ifdef HAVE_MPI
+    return generate(dim, n, extent, boundary_ids, perturbation, seed, MPI_COMM_SELF);
+#else
+    return generate(dim, n, extent, boundary_ids, perturbation, seed);
+#endif
+  }
+
+#ifdef HAVE_MPI
+  /*! Generate the box partitioned over comm, with halos. The
+   * perturbation is a function of the global node number, so the mesh
+   * does not depend on the number of processes or threads. This is
+   * collective over comm.
+   *
+   * @param dim 2 for triangles or 3 for tetrahedra.
+   * @param n number of cells along each axis. There must be at least
+   *        one node plane per process, n[0]+1>=size of comm.
+   * @param extent length of the box along each axis, or NULL for the unit box.
+   * @param boundary_ids IDs of the faces x=0, x=extent[0], y=0, ..., or NULL for 1 to 2*dim.
+   * @param perturbation maximum random displacement of interior nodes,
+   *        as a fraction of the cell size.
+   * @param seed seed of the perturbation.
+   * @param comm the communicator the mesh is partitioned over.
+   * @return the new mesh, or NULL if the arguments are invalid.
+   */
+  static Mesh<real_t> *generate_box(int dim, const int *n, const real_t *extent, const int *boundary_ids,
+                                    real_t perturbation, unsigned int seed, MPI_Comm comm){
+    return generate(dim, n, extent, boundary_ids, perturbation, seed, comm);
+  }
+#endif
+
+ private:
+  static Mesh<real_t> *generate(int dim, const int *n, const real_t *extent, const int *boundary_ids,
+                                real_t perturbation, unsigned int seed
+#ifdef HAVE_MPI
+                                , MPI_Comm comm
+#endif
+                                ){
+    int rank=0, nprocs=1;
+#ifdef HAVE_MPI
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nprocs);
+#endif
+
+    if(dim!=2 && dim!=3){
+      std::cerr<<"ERROR: MeshGenerator can only generate 2D or 3D meshes.\n";
+      return NULL;
+    }
+    for(int d=0;d<dim;d++){
+      if(n[d]<1){
+        std::cerr<<"ERROR: MeshGenerator needs at least one cell along each axis.\n";
+        return NULL;
+      }
+    }
+    if(n[0]+1<nprocs){
+      std::cerr<<"ERROR: MeshGenerator needs at least one node plane per process, but n[0]+1="
+               <<n[0]+1<<" and there are "<<nprocs<<" processes.\n";
+      return NULL;
+    }
+
+    const int nloc = dim+1;
+    const int epc = dim==2?2:6;
+    const int nj = n[1]+1, nk = dim==2?1:n[2]+1;
+    const size_t nplane = (size_t)nj*nk;
+    real_t length[3] = {1.0, 1.0, 1.0};
+    if(extent!=NULL){
+      for(int d=0;d<dim;d++)
+        length[d] = extent[d];
+    }
+    int ids[6] = {1, 2, 3, 4, 5, 6};
+    if(boundary_ids!=NULL){
+      for(int d=0;d<2*dim;d++)
+        ids[d] = boundary_ids[d];
+    }
+
+    // Owned node planes are [lo, hi), followed by the halo planes
+    // lo-1 and hi if they exist.
+    int lo = (long)(n[0]+1)*rank/nprocs;
+    int hi = (long)(n[0]+1)*(rank+1)/nprocs;
+    std::vector<int> planes;
+    for(int i=lo;i<hi;i++)
+      planes.push_back(i);
+    if(lo>0)
+      planes.push_back(lo-1);
+    if(hi<=n[0])
+      planes.push_back(hi);
+    PlaneMap local(lo, hi, nplane);
+
+    // Cells between planes i and i+1 for i in [c0, c1). Every element
+    // touches both planes, so these are the owned elements and one
+    // layer of halo elements.
+    int c0 = std::max(lo-1, 0), c1 = std::min(hi, n[0]);
+    size_t ncells = (size_t)(c1-c0)*n[1]*(dim==3?n[2]:1);
+
+    Mesh<real_t> *mesh = new Mesh<real_t>();
+#ifdef HAVE_MPI
+    mesh->_init_parallel(comm);
+    mesh->gnn_offset = lo*nplane;
+#else
+    mesh->_init_parallel();
+#endif
+
+    mesh->ndims = dim;
+    mesh->nloc = nloc;
+    mesh->msize = dim==2?3:6;
+    mesh->NNodes = planes.size()*nplane;
+    mesh->NElements = ncells*epc;
+
+    size_t NNodes = mesh->NNodes;
+    size_t NElements = mesh->NElements;
+
+    mesh->_ENList.resize(NElements*nloc);
+    mesh->_coords.resize(NNodes*dim);
+    mesh->metric.resize(NNodes*mesh->msize);
+    mesh->boundary.resize(NElements*nloc);
+    mesh->lnn2gnn.resize(NNodes);
+    mesh->node_owner.resize(NNodes);
+    mesh->halo_flag.resize(NNodes, 0);
+    mesh->NNList.resize(NNodes);
+    mesh->NEList.resize(NNodes);
+
+    // The halo planes are listed in the same order on both sides.
+    if(nprocs>1){
+      mesh->send.resize(nprocs);
+      mesh->recv.resize(nprocs);
+      if(lo>0){
+        mesh->send[rank-1].resize(nplane);
+        mesh->recv[rank-1].resize(nplane);
+        for(size_t l=0;l<nplane;l++){
+          mesh->send[rank-1][l] = local.lnn(lo, l);
+          mesh->recv[rank-1][l] = local.lnn(lo-1, l);
+        }
+      }
+      if(hi<=n[0]){
+        mesh->send[rank+1].resize(nplane);
+        mesh->recv[rank+1].resize(nplane);
+        for(size_t l=0;l<nplane;l++){
+          mesh->send[rank+1][l] = local.lnn(hi-1, l);
+          mesh->recv[rank+1][l] = local.lnn(hi, l);
+        }
+      }
+    }
+
+    // Corners of each cell: bit 0 steps in x, bit 1 in y and bit 2 in z.
+    // In 3D the tetrahedra follow the paths from corner 0 to corner 7.
+    const int triangles[2][3] = {{0, 1, 3}, {0, 3, 2}};
+    const int paths[6][3] = {{1, 2, 4}, {1, 4, 2}, {2, 1, 4}, {2, 4, 1}, {4, 1, 2}, {4, 2, 1}};
+    int corners[6][4];
+    for(int p=0;p<epc;p++){
+      if(dim==2){
+        for(int v=0;v<3;v++)
+          corners[p][v] = triangles[p][v];
+      }else{
+        int corner=0;
+        for(int v=0;v<4;v++){
+          corners[p][v] = corner;
+          if(v<3)
+            corner += paths[p][v];
+        }
+        // Odd permutations of the axes give the opposite orientation.
+        if(p==1 || p==2 || p==5)
+          std::swap(corners[p][0], corners[p][1]);
+      }
+    }
+
+#pragma omp parallel
+    {
+      // The arrays were zeroed serially by resize(), so this only
+      // shares the work; the adjacency that create_adjacency() builds
+      // below is allocated by the threads.
+#pragma omp for schedule(static)
+      for(size_t i=0;i<NNodes;i++){
+        int plane = planes[i/nplane];
+        size_t l = i%nplane;
+        int ijk[3] = {plane, (int)(l%nj), (int)(l/nj)};
+
+        mesh->lnn2gnn[i] = plane*nplane+l;
+        mesh->node_owner[i] = plane<lo?rank-1:(plane<hi?rank:rank+1);
+
+        bool interior = true;
+        for(int d=0;d<dim;d++)
+          interior = interior && ijk[d]>0 && ijk[d]<n[d];
+        for(int d=0;d<dim;d++){
+          // The sides of the box are exactly at 0 and length[d].
+          real_t x = length[d]*ijk[d]/n[d];
+          if(interior && perturbation>0)
+            x += perturbation*length[d]/n[d]*jitter(mesh->lnn2gnn[i], d, seed);
+          mesh->_coords[i*dim+d] = x;
+        }
+      }
+
+#pragma omp for schedule(static)
+      for(size_t c=0;c<ncells;c++){
+        int cell[3] = {(int)(c%n[1]), (int)(c/n[1]), 0};
+        if(dim==3){
+          cell[1] = (c/n[1])%n[2];
+          cell[2] = c/((size_t)n[1]*n[2]);
+        }
+        // cell holds (j, k, i) in 3D and (j, i) in 2D.
+        int i = c0+cell[dim-1], j = cell[0], k = dim==3?cell[1]:0;
+
+        for(int p=0;p<epc;p++){
+          size_t eid = c*epc+p;
+          int ijk[4][3];
+          for(int v=0;v<nloc;v++){
+            int corner = corners[p][v];
+            ijk[v][0] = i+(corner&1);
+            ijk[v][1] = j+((corner>>1)&1);
+            ijk[v][2] = k+((corner>>2)&1);
+            mesh->_ENList[eid*nloc+v] = local.lnn(ijk[v][0], ijk[v][2]*nj+ijk[v][1]);
+          }
+
+          // Label the facet opposite each vertex.
+          for(int v=0;v<nloc;v++){
+            bool owned = false;
+            int lower=(1<<dim)-1, upper=(1<<dim)-1;
+            for(int w=1;w<nloc;w++){
+              const int *x = ijk[(v+w)%nloc];
+              owned = owned || (x[0]>=lo && x[0]<hi);
+              for(int d=0;d<dim;d++){
+                if(x[d]!=0)
+                  lower &= ~(1<<d);
+                if(x[d]!=n[d])
+                  upper &= ~(1<<d);
+              }
+            }
+
+            int label = 0;
+            if(!owned){
+              label = -1;
+            }else{
+              for(int d=0;d<dim;d++){
+                if(lower&(1<<d))
+                  label = ids[2*d];
+                else if(upper&(1<<d))
+                  label = ids[2*d+1];
+              }
+            }
+            mesh->boundary[eid*nloc+v] = label;
+          }
+        }
+      }
+
+      // create_adjacency is meant to be called from inside a parallel region
+      mesh->create_adjacency();
+    }
+
+    // All elements have the orientation of the first one.
+    if(dim==2)
+      mesh->property = new ElementProperty<real_t>(mesh->get_coords(mesh->_ENList[0]),
+                                                   mesh->get_coords(mesh->_ENList[1]),
+                                                   mesh->get_coords(mesh->_ENList[2]));
+    else
+      mesh->property = new ElementProperty<real_t>(mesh->get_coords(mesh->_ENList[0]),
+                                                   mesh->get_coords(mesh->_ENList[1]),
+                                                   mesh->get_coords(mesh->_ENList[2]),
+                                                   mesh->get_coords(mesh->_ENList[3]));
+
+#ifdef HAVE_MPI
+    if(nprocs>1){
+      mesh->send_map.resize(nprocs);
+      mesh->recv_map.resize(nprocs);
+      for(int i=0;i<nprocs;i++){
+        mesh->send_map[i].assign(mesh->send[i], mesh->lnn2gnn);
+        mesh->recv_map[i].assign(mesh->recv[i], mesh->lnn2gnn);
+      }
+      mesh->create_halo_flags();
+
+      mesh->update_halo_comm();
+      mesh->shared_halo = new SharedHaloExchange(comm);
+    }
+#endif
+
+    return mesh;
+  }
+
+  /// Local node numbers of the owned planes followed by the halo planes.
+  class PlaneMap{
+   public:
+    PlaneMap(int lo, int hi, size_t nplane) : lo(lo), hi(hi), nplane(nplane){}
+
+    /// Local number of node l within plane i.
+    index_t lnn(int i, size_t l) const{
+      size_t p;
+      if(i>=lo && i<hi)
+        p = i-lo;
+      else if(i==lo-1)
+        p = hi-lo;
+      else
+        p = hi-lo+(lo>0);
+      return p*nplane+l;
+    }
+
+   private:
+    int lo, hi;
+    size_t nplane;
+  };
+
+  /// Deterministic pseudo-random number in [-1, 1) for each node and axis.
+  static real_t jitter(index_t gnn, int axis, unsigned int seed){
+    uint64_t x = ((uint64_t)gnn*3+axis)^((uint64_t)seed<<40);
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x^(x>>30))*0xbf58476d1ce4e5b9ULL;
+    x = (x^(x>>27))*0x94d049bb133111ebULL;
+    x ^= x>>31;
+    return (x>>11)*(2.0/9007199254740992.0)-1.0;
+  }
+};
+
+#endif
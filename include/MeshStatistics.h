@@ -0,0 +1,198 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+#ifndef MESHSTATISTICS_H
+#define MESHSTATISTICS_H
+
+#include <algorithm>
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+/*! \brief Global mesh statistics gathered in a single pass, see
+ * Mesh::compute_statistics().
+ *
+ * All quantities are packed into one buffer so that the global values
+ * are obtained with a single (non-blocking) reduction. The reduction is
+ * completed by wait(), which the accessors call implicitly. Work that
+ * does not modify the mesh can be done between
+ * Mesh::compute_statistics() and the first access to overlap it with
+ * the reduction.
+ */
+class MeshStatistics{
+ public:
+  MeshStatistics(){
+    for(int i=0;i<NFIELDS;i++)
+      data[i] = 0;
+#ifdef HAVE_MPI
+    request = MPI_REQUEST_NULL;
+    packed_type = MPI_DATATYPE_NULL;
+    reduce_op = MPI_OP_NULL;
+#endif
+  }
+
+  ~MeshStatistics(){
+#ifdef HAVE_MPI
+    int finalized;
+    MPI_Finalized(&finalized);
+    if(!finalized){
+      wait();
+      if(reduce_op!=MPI_OP_NULL)
+        MPI_Op_free(&reduce_op);
+      if(packed_type!=MPI_DATATYPE_NULL)
+        MPI_Type_free(&packed_type);
+    }
+#endif
+  }
+
+  /// Complete the global reduction if one is pending.
+  void wait(){
+#ifdef HAVE_MPI
+    if(request!=MPI_REQUEST_NULL)
+      MPI_Wait(&request, MPI_STATUS_IGNORE);
+#endif
+  }
+
+  /// Return true if the global reduction has completed.
+  bool test(){
+#ifdef HAVE_MPI
+    if(request!=MPI_REQUEST_NULL){
+      int flag;
+      MPI_Test(&request, &flag, MPI_STATUS_IGNORE);
+      return flag!=0;
+    }
+#endif
+    return true;
+  }
+
+  /// Minimum element quality.
+  double qmin(){
+    wait();
+    return data[QMIN];
+  }
+
+  /// Mean element quality.
+  double qmean(){
+    wait();
+    return data[QSUM]/data[NELEMENTS];
+  }
+
+  /// Maximum edge length in metric space.
+  double lmax(){
+    wait();
+    return data[LMAX];
+  }
+
+  /// Mean edge length in metric space.
+  double lmean(){
+    wait();
+    return data[LSUM]/data[NEDGES];
+  }
+
+  /// Area (2D) or volume (3D) of the mesh.
+  double volume(){
+    wait();
+    return data[VOLUME];
+  }
+
+  /// Number of elements, counting each halo element once.
+  long nelements(){
+    wait();
+    return (long)data[NELEMENTS];
+  }
+
+  /// Number of vertices, counting each halo vertex once.
+  long nnodes(){
+    wait();
+    return (long)data[NNODES];
+  }
+
+  /// Number of edges, counting each halo edge once.
+  long nedges(){
+    wait();
+    return (long)data[NEDGES];
+  }
+
+ private:
+  template<typename _real_t> friend class Mesh;
+
+  // Not copyable: an object owns its pending request.
+  MeshStatistics(const MeshStatistics&);
+  MeshStatistics& operator=(const MeshStatistics&);
+
+  // Layout of the packed buffer. Counts are stored as doubles, which is
+  // exact up to 2^53.
+  enum {QMIN=0, LMAX, QSUM, LSUM, VOLUME, NELEMENTS, NNODES, NEDGES, NFIELDS};
+
+  /// Combine two packed buffers: min, max and then sums.
+  static void combine(const double *in, double *inout){
+    inout[QMIN] = std::min(inout[QMIN], in[QMIN]);
+    inout[LMAX] = std::max(inout[LMAX], in[LMAX]);
+    for(int i=QSUM;i<NFIELDS;i++)
+      inout[i] += in[i];
+  }
+
+#ifdef HAVE_MPI
+  static void reduce(void *in, void *inout, int *len, MPI_Datatype *){
+    for(int i=0;i<*len;i++)
+      combine((const double *)in+i*NFIELDS, (double *)inout+i*NFIELDS);
+  }
+
+  /// Start the global reduction of the local values in data.
+  void start(MPI_Comm comm){
+    wait();
+
+    // The buffer is reduced as a single element of a derived type so
+    // that MPI cannot split it and apply the operation per field.
+    if(packed_type==MPI_DATATYPE_NULL){
+      MPI_Type_contiguous(NFIELDS, MPI_DOUBLE, &packed_type);
+      MPI_Type_commit(&packed_type);
+      MPI_Op_create(&MeshStatistics::reduce, 1, &reduce_op);
+    }
+
+    MPI_Iallreduce(MPI_IN_PLACE, data, 1, packed_type, reduce_op, comm, &request);
+  }
+
+  MPI_Request request;
+  MPI_Datatype packed_type;
+  MPI_Op reduce_op;
+#endif
+
+  double data[NFIELDS];
+};
+
+#endif
@@ -335,6 +335,8 @@ void fit_ellipsoid(int i, real_t *sm){
   /// Update the metric field on the mesh.
   void relax_mesh(double omega){
     assert(_metric!=NULL);
+    PRAGMATIC_MEMORY("relax_mesh", _mesh);
+    PRAGMATIC_TIMER("relax_mesh");
     
     size_t pNElements = (size_t)predict_nelements_part();
 
@@ -364,6 +366,7 @@ void fit_ellipsoid(int i, real_t *sm){
     _mesh->NNList.resize(pNNodes);
     _mesh->NEList.resize(pNNodes);
     _mesh->node_owner.resize(pNNodes, -1);
+    _mesh->halo_flag.resize(pNNodes, 0);
     _mesh->lnn2gnn.resize(pNNodes, -1);
 
 #ifdef HAVE_MPI
@@ -386,13 +389,15 @@ void fit_ellipsoid(int i, real_t *sm){
     }
     
     // Halo update if parallel
-    halo_update<double, (dim==2?3:6)>(_mesh->get_mpi_comm(), _mesh->send, _mesh->recv, _mesh->metric);
+    _mesh->template update_halo<double, (dim==2?3:6)>(_mesh->metric);
   }
 
 
   /// Update the metric field on the mesh.
   void update_mesh(){
     assert(_metric!=NULL);
+    PRAGMATIC_MEMORY("update_mesh", _mesh);
+    PRAGMATIC_TIMER("update_mesh");
     
     size_t pNElements = (size_t)predict_nelements_part();
 
@@ -422,6 +427,7 @@ void fit_ellipsoid(int i, real_t *sm){
     _mesh->NNList.resize(pNNodes);
     _mesh->NEList.resize(pNNodes);
     _mesh->node_owner.resize(pNNodes, -1);
+    _mesh->halo_flag.resize(pNNodes, 0);
     _mesh->lnn2gnn.resize(pNNodes, -1);
 
 #ifdef HAVE_MPI
@@ -440,7 +446,7 @@ void fit_ellipsoid(int i, real_t *sm){
     }
     
     // Halo update if parallel
-    halo_update<double, (dim==2?3:6)>(_mesh->get_mpi_comm(), _mesh->send, _mesh->recv, _mesh->metric);
+    _mesh->template update_halo<double, (dim==2?3:6)>(_mesh->metric);
   }
 
   /*! Add the contribution from the metric field from a new field with a target linear interpolation error. 
@@ -462,71 +468,42 @@ void fit_ellipsoid(int i, real_t *sm){
 #pragma omp parallel
     {
       // Calculate Hessian at each point.
-      double h[dim==2?3:6];
+      real_t h[dim==2?3:6];
 
-      if(p_norm>0){
-#pragma omp for schedule(static) nowait
-        for(int i=0; i<_NNodes; i++){
-          hessian_qls_kernel(psi, i, h);
-          
-          double m_det;
-          if(dim==2){
-            /*|h[0] h[1]|
-              |h[1] h[2]|*/
-            m_det = fabs(h[0]*h[2]-h[1]*h[1]);
-          }else if(dim==3){
-            /*|h[0] h[1] h[2]|
-              |h[1] h[3] h[4]|
-              |h[2] h[4] h[5]|
-	      
-              sympy
-              h0,h1,h2,h3,h4,h5 = symbols("h[0], h[1], h[2], h[3], h[4], h[5]")
-              M = Matrix([[h0, h1, h2],
-                          [h1, h3, h4],
-                          [h2, h4, h5]])
-              print_ccode(det(M))
-            */
-            m_det = fabs(h[0]*h[3]*h[5] - h[0]*pow(h[4], 2) - pow(h[1], 2)*h[5] + 2*h[1]*h[2]*h[4] - pow(h[2], 2)*h[3]);
-          }
+#pragma omp for schedule(static)
+      for(int i=0; i<_NNodes; i++){
+        hessian_qls_kernel(psi, i, h);
+        add_hessian_kernel(i, h, eta, p_norm, add_to);
+      }
+    }
+  }
 
-          double scaling_factor = eta * pow(m_det+DBL_EPSILON, -1.0 / (2.0 * p_norm + dim));
-
-	  if(std::isnormal(scaling_factor)){
-	    for(int j=0;j<(dim==2?3:6);j++)
-	      h[j] *= scaling_factor;
-	  }else{
-	    if(dim==2){
-	      h[0] = min_eigenvalue; h[1] = 0.0;
-	                             h[2] = min_eigenvalue;
-	    }else{
-	      h[0] = min_eigenvalue; h[1] = 0.0;            h[2] = 0.0;
-	                             h[3] = min_eigenvalue; h[4] = 0.0;
-				                            h[5] = min_eigenvalue;
-	    }
-	  }
+  /*! Add the contribution to the metric field of a field whose Hessian
+   * has been computed elsewhere, e.g. by a finite element library. The
+   * scaling is the same as in add_field().
+   * @param hessian is the Hessian at each node. It is assumed that only
+   * the top triangle of the tensors are stored.
+   * @param target_error is the user target error for a given norm.
+   * @param p_norm Set this optional argument to a positive integer to
+   * apply the p-norm scaling to the metric.
+   */
+  void add_hessian(const real_t* hessian, const real_t target_error, int p_norm=-1){
+    bool add_to=true;
+    if(_metric==NULL){
+      add_to = false;
+      _metric = new MetricTensor<real_t,dim>[_NNodes];
+    }
+
+    real_t eta = 1.0/target_error;
+#pragma omp parallel
+    {
+      real_t h[dim==2?3:6];
 
-          if(add_to){
-            // Merge this metric with the existing metric field.
-            _metric[i].constrain(h);
-          }else{
-            _metric[i].set_metric(h);
-          }
-        }
-      }else{
 #pragma omp for schedule(static)
-        for(int i=0; i<_NNodes; i++){
-          hessian_qls_kernel(psi, i, h);
-          
-          for(int j=0; j<(dim==2?3:6); j++)
-            h[j] *= eta;
-	  
-	  if(add_to){
-            // Merge this metric with the existing metric field.
-            _metric[i].constrain(h);
-          }else{
-            _metric[i].set_metric(h);
-          }
-        }
+      for(int i=0; i<_NNodes; i++){
+        for(int j=0; j<(dim==2?3:6); j++)
+          h[j] = hessian[i*(dim==2?3:6)+j];
+        add_hessian_kernel(i, h, eta, p_norm, add_to);
       }
     }
   }
@@ -628,6 +605,121 @@ void fit_ellipsoid(int i, real_t *sm){
     }
   }
 
+  /*! Limit the gradation of the metric field, i.e. how fast the edge
+   * lengths may grow away from small features, as in F. Alauzet, Size
+   * gradation control of anisotropic meshes, Finite Elements in
+   * Analysis and Design 46 (2010), pp. 181-202. The metric of each
+   * vertex is intersected with the metrics of its neighbours grown by
+   * (1+l*log(gradation))^-2, where l is the length of the edge in the
+   * neighbour's metric, until the field no longer changes.
+   * @param gradation maximum growth factor of the edge lengths per unit
+   * length in metric space, e.g. 1.5.
+   * @param max_iterations maximum number of sweeps over the vertices.
+   */
+  void apply_gradation(real_t gradation, int max_iterations=100){
+    assert(_metric!=NULL);
+    assert(gradation>1.0);
+
+    const int msize = dim==2?3:6;
+    const real_t log_gradation = log(gradation);
+
+    std::vector<real_t> metric(_NNodes*msize), next(_NNodes*msize);
+    get_metric(&(metric[0]));
+    next = metric;
+
+    // Only vertices next to a vertex whose metric changed in the
+    // previous sweep need to be visited again.
+    std::vector<char> modified(_NNodes, 1), was_modified(_NNodes);
+
+    for(int iter=0;iter<max_iterations;iter++){
+      int changed=0;
+      modified.swap(was_modified);
+
+#pragma omp parallel for schedule(guided) reduction(+:changed)
+      for(int i=0;i<_NNodes;i++){
+        modified[i] = 0;
+#ifdef HAVE_MPI
+        if(!_mesh->is_owned_node(i))
+          continue;
+#endif
+
+        bool visit=false;
+        for(typename std::vector<index_t>::const_iterator it=_mesh->NNList[i].begin();it!=_mesh->NNList[i].end();++it){
+          if(was_modified[*it]){
+            visit = true;
+            break;
+          }
+        }
+        if(!visit)
+          continue;
+
+        MetricTensor<real_t,dim> M(&(metric[i*msize]));
+        const real_t *xi = _mesh->get_coords(i);
+
+        for(typename std::vector<index_t>::const_iterator it=_mesh->NNList[i].begin();it!=_mesh->NNList[i].end();++it){
+          const real_t *mj = &(metric[(*it)*msize]);
+          const real_t *xj = _mesh->get_coords(*it);
+
+          real_t e[dim];
+          for(int d=0;d<dim;d++)
+            e[d] = xi[d]-xj[d];
+
+          real_t l2;
+          if(dim==2)
+            l2 = mj[0]*e[0]*e[0] + 2*mj[1]*e[0]*e[1] + mj[2]*e[1]*e[1];
+          else
+            l2 = mj[0]*e[0]*e[0] + 2*mj[1]*e[0]*e[1] + 2*mj[2]*e[0]*e[2] +
+              mj[3]*e[1]*e[1] + 2*mj[4]*e[1]*e[2] + mj[5]*e[2]*e[2];
+
+          real_t eta = 1.0/pow(1.0+sqrt(std::max(l2, (real_t)0.0))*log_gradation, 2);
+
+          real_t grown[dim==2?3:6];
+          for(int j=0;j<msize;j++)
+            grown[j] = eta*mj[j];
+
+          M.constrain(grown);
+        }
+
+        M.get_metric(&(next[i*msize]));
+
+        real_t diff=0, norm=0;
+        for(int j=0;j<msize;j++){
+          diff = std::max(diff, (real_t)fabs(next[i*msize+j]-metric[i*msize+j]));
+          norm = std::max(norm, (real_t)fabs(metric[i*msize+j]));
+        }
+        if(diff>1.0e-6*norm){
+          modified[i] = 1;
+          changed++;
+        }
+      }
+
+#pragma omp parallel for schedule(static)
+      for(int i=0;i<_NNodes;i++){
+        if(modified[i])
+          for(int j=0;j<msize;j++)
+            metric[i*msize+j] = next[i*msize+j];
+      }
+
+#ifdef HAVE_MPI
+      if(nprocs>1){
+        // Halo vertices are updated by their owners.
+        _mesh->template update_halo<real_t, (dim==2?3:6)>(metric);
+        for(int i=0;i<_NNodes;i++){
+          if(!_mesh->is_owned_node(i))
+            modified[i] = 1;
+        }
+        PRAGMATIC_TRACE_CALL("MPI_Allreduce", MPI_Allreduce(MPI_IN_PLACE, &changed, 1, MPI_INT, MPI_SUM, _mesh->get_mpi_comm()));
+      }
+#endif
+
+      if(changed==0)
+        break;
+    }
+
+    for(int i=0;i<_NNodes;i++)
+      _metric[i].set_metric(&(metric[i*msize]));
+  }
+
   /*! Apply maximum number of elements constraint.
    * @param nelements the maximum number of elements desired.
    */
@@ -758,6 +850,7 @@ void fit_ellipsoid(int i, real_t *sm){
 
 #ifdef HAVE_MPI
     if(nprocs>1){
+      PRAGMATIC_TRACE("MPI_Allreduce");
       MPI_Allreduce(MPI_IN_PLACE, &predicted, 1, _mesh->MPI_REAL_T, MPI_SUM, _mesh->get_mpi_comm());
     }
 #endif
@@ -766,7 +859,59 @@ void fit_ellipsoid(int i, real_t *sm){
   }
 
  private:
-  
+  template<typename _real_t, int _dim> friend class KernelBenchmark;
+
+  /// Scale the Hessian h of node i to a metric, and add it to the field.
+  void add_hessian_kernel(int i, real_t *h, real_t eta, int p_norm, bool add_to){
+    if(p_norm>0){
+      double m_det;
+      if(dim==2){
+        /*|h[0] h[1]|
+          |h[1] h[2]|*/
+        m_det = fabs(h[0]*h[2]-h[1]*h[1]);
+      }else if(dim==3){
+        /*|h[0] h[1] h[2]|
+          |h[1] h[3] h[4]|
+          |h[2] h[4] h[5]|
+
+          sympy
+          h0,h1,h2,h3,h4,h5 = symbols("h[0], h[1], h[2], h[3], h[4], h[5]")
+          M = Matrix([[h0, h1, h2],
+                      [h1, h3, h4],
+                      [h2, h4, h5]])
+          print_ccode(det(M))
+        */
+        m_det = fabs(h[0]*h[3]*h[5] - h[0]*pow(h[4], 2) - pow(h[1], 2)*h[5] + 2*h[1]*h[2]*h[4] - pow(h[2], 2)*h[3]);
+      }
+
+      double scaling_factor = eta * pow(m_det+DBL_EPSILON, -1.0 / (2.0 * p_norm + dim));
+
+      if(std::isnormal(scaling_factor)){
+        for(int j=0;j<(dim==2?3:6);j++)
+          h[j] *= scaling_factor;
+      }else{
+        if(dim==2){
+          h[0] = min_eigenvalue; h[1] = 0.0;
+                                 h[2] = min_eigenvalue;
+        }else{
+          h[0] = min_eigenvalue; h[1] = 0.0;            h[2] = 0.0;
+                                 h[3] = min_eigenvalue; h[4] = 0.0;
+                                                        h[5] = min_eigenvalue;
+        }
+      }
+    }else{
+      for(int j=0; j<(dim==2?3:6); j++)
+        h[j] *= eta;
+    }
+
+    if(add_to){
+      // Merge this metric with the existing metric field.
+      _metric[i].constrain(h);
+    }else{
+      _metric[i].set_metric(h);
+    }
+  }
+
   /// Least squared Hessian recovery.
   void hessian_qls_kernel(const real_t *psi, int i, real_t *Hessian){
     int min_patch_size = (dim==2?6:15); // In 3D, 10 is the minimum but can give crappy results.
@@ -482,6 +482,74 @@ public:
     }
   }
 
+  /*! Eigen decomposition of a symmetric tensor. Unlike eigen_decomp()
+   * this keeps the sign of the eigenvalues, so it can be used on
+   * Hessians and on the logarithm of a metric.
+   * @param metric points to the upper triangle of the tensor.
+   * @param eigenvalues returns the dim eigenvalues.
+   * @param eigenvectors returns the eigenvectors, one per row.
+   */
+  static void symmetric_eigen_decomp(const treal_t *metric, treal_t *eigenvalues, treal_t *eigenvectors){
+    Eigen::Matrix<treal_t, dim, dim> M;
+    if(dim==2)
+      M << metric[0], metric[1],
+           metric[1], metric[2];
+    else if(dim==3)
+      M << metric[0], metric[1], metric[2],
+           metric[1], metric[3], metric[4],
+           metric[2], metric[4], metric[5];
+
+    if(M.isZero()){
+      for(size_t i=0; i<dim; i++)
+        eigenvalues[i] = 0.0;
+
+      // Any orthonormal basis will do.
+      for(size_t i=0; i<dim; i++)
+        for(size_t j=0; j<dim; j++)
+          eigenvectors[i*dim+j] = (i==j)?1.0:0.0;
+      return;
+    }
+
+    // Unlike EigenSolver, the eigenvectors stay orthonormal when
+    // eigenvalues repeat, which V^T D V relies on.
+    Eigen::SelfAdjointEigenSolver< Eigen::Matrix<treal_t, dim, dim> > solver(M);
+
+    const Eigen::Matrix<treal_t, dim, 1> &evalues = solver.eigenvalues();
+    const Eigen::Matrix<treal_t, dim, dim> &evectors = solver.eigenvectors();
+
+    for(size_t i=0; i<dim; i++){
+      eigenvalues[i] = evalues[i];
+      for(size_t j=0; j<dim; j++)
+        eigenvectors[i*dim+j] = evectors(j, i);
+    }
+  }
+
+  /*! Apply a function to the eigenvalues of a symmetric tensor, keeping
+   * its eigenvectors, e.g. to take the logarithm or the inverse of a
+   * metric.
+   * @param metric points to the upper triangle of the tensor.
+   * @param f function applied to each eigenvalue.
+   * @param result returns the upper triangle of the new tensor. May be
+   * the same as metric.
+   */
+  static void map_eigenvalues(const treal_t *metric, treal_t (*f)(treal_t), treal_t *result){
+    treal_t D[dim], V[dim*dim];
+    symmetric_eigen_decomp(metric, D, V);
+
+    for(size_t i=0; i<dim; i++)
+      D[i] = f(D[i]);
+
+    int k=0;
+    for(size_t i=0; i<dim; i++){
+      for(size_t j=i; j<dim; j++){
+        treal_t m=0.0;
+        for(size_t l=0; l<dim; l++)
+          m += D[l]*V[l*dim+i]*V[l*dim+j];
+        result[k++] = m;
+      }
+    }
+  }
+
 private:
   treal_t _metric[dim==2?3:(dim==3?6:-1)];
 };
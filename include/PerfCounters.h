@@ -0,0 +1,186 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// Hardware counters sampled by PerfCounterGroup.
+enum PerfCounter{
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_LLC_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_NCOUNTERS
+};
+
+/*! \brief A group of hardware performance counters of the calling
+ * thread, read with perf_event_open(2).
+ *
+ * Counters which the kernel or the processor do not provide, e.g. in
+ * containers or with a restrictive perf_event_paranoid setting, read
+ * as -1. On other systems than Linux all counters read as -1. The
+ * counters exclude the kernel and are scaled if the kernel had to
+ * multiplex them.
+ */
+class PerfCounterGroup{
+ public:
+  PerfCounterGroup() : leader(-1), nopen(0){
+    for(int i=0;i<PERF_NCOUNTERS;i++){
+      fd[i] = -1;
+      order[i] = -1;
+    }
+
+#ifdef __linux__
+    for(int i=0;i<PERF_NCOUNTERS;i++){
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP|PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+      get_event(i, attr.type, attr.config);
+
+      fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+      if(fd[i]<0)
+        continue;
+
+      if(leader<0)
+        leader = fd[i];
+      order[nopen++] = i;
+    }
+#endif
+  }
+
+  ~PerfCounterGroup(){
+#ifdef __linux__
+    for(int i=0;i<PERF_NCOUNTERS;i++)
+      if(fd[i]>=0)
+        close(fd[i]);
+#endif
+  }
+
+  /// Number of counters that could be opened.
+  int get_number_counters() const{
+    return nopen;
+  }
+
+  /// Return true if counter is provided.
+  bool is_available(int counter) const{
+    return fd[counter]>=0;
+  }
+
+  /// Read the current value of each counter, or -1 if it is not provided or has not yet counted.
+  void read_values(long long *values) const{
+    for(int i=0;i<PERF_NCOUNTERS;i++)
+      values[i] = -1;
+
+#ifdef __linux__
+    if(leader<0)
+      return;
+
+    // nr, time_enabled, time_running, then one value per counter.
+    unsigned long long buffer[3+PERF_NCOUNTERS];
+    if(read(leader, buffer, sizeof(buffer))<(ssize_t)((3+nopen)*sizeof(unsigned long long)))
+      return;
+
+    // A group that was never scheduled on the processor counted nothing.
+    if(buffer[2]==0)
+      return;
+
+    double scale = 1.0;
+    if(buffer[2]<buffer[1])
+      scale = (double)buffer[1]/buffer[2];
+
+    for(int i=0;i<nopen;i++)
+      values[order[i]] = (long long)(buffer[3+i]*scale);
+#endif
+  }
+
+  /// Name of a counter, or NULL if counter is out of range.
+  static const char *get_counter_name(int counter){
+    static const char *names[] = {"cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses"};
+    if(counter<0 || counter>=PERF_NCOUNTERS)
+      return NULL;
+    return names[counter];
+  }
+
+ private:
+  PerfCounterGroup(const PerfCounterGroup &);
+  PerfCounterGroup &operator=(const PerfCounterGroup &);
+
+#ifdef __linux__
+  static void get_event(int counter, __u32 &type, __u64 &config){
+    const __u64 read_miss = (PERF_COUNT_HW_CACHE_OP_READ<<8)|(PERF_COUNT_HW_CACHE_RESULT_MISS<<16);
+    switch(counter){
+    case PERF_CYCLES:
+      type = PERF_TYPE_HARDWARE;
+      config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case PERF_INSTRUCTIONS:
+      type = PERF_TYPE_HARDWARE;
+      config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case PERF_LLC_MISSES:
+      type = PERF_TYPE_HW_CACHE;
+      config = PERF_COUNT_HW_CACHE_LL|read_miss;
+      break;
+    case PERF_DTLB_MISSES:
+      type = PERF_TYPE_HW_CACHE;
+      config = PERF_COUNT_HW_CACHE_DTLB|read_miss;
+      break;
+    default:
+      type = PERF_TYPE_HARDWARE;
+      config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+    }
+  }
+#endif
+
+  int fd[PERF_NCOUNTERS];
+  int order[PERF_NCOUNTERS]; // counter of each value read from the group
+  int leader, nopen;
+};
+
+#endif
@@ -55,6 +55,14 @@ int pragmatic_nthreads(){
 #endif
 }
 
+int pragmatic_team_size(){
+#ifdef _OPENMP
+  return omp_get_num_threads();
+#else
+  return 1;
+#endif
+}
+
 int pragmatic_thread_id(){
 #ifdef _OPENMP
   return omp_get_thread_num();
@@ -0,0 +1,570 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "MemoryReport.h"
+#include "PerfCounters.h"
+
+/// Operation counters maintained by the Profiler.
+enum ProfilerCounter{
+  PROFILE_COLLAPSES,
+  PROFILE_SPLITS,
+  PROFILE_FLIPS,
+  PROFILE_SMOOTH_MOVES,
+  PROFILE_COLOUR_ROUNDS,
+  PROFILE_COLOUR_CONFLICTS,
+  PROFILE_HALO_UPDATES,
+  PROFILE_DEFRAGMENTS,
+  PROFILE_NCOUNTERS
+};
+
+/*! \brief Phase timers and operation counters.
+ *
+ * The operators are instrumented with the PRAGMATIC_TIMER,
+ * PRAGMATIC_PHASE and PRAGMATIC_COUNT macros, which compile to nothing
+ * unless HAVE_PROFILING is defined. Timers are named by a path such as
+ * "coarsen/colour", which places them in the hierarchy printed by
+ * print(). Each thread accumulates into its own storage, so recording
+ * takes no locks once a thread has been seen. The statistics are those
+ * of the local process and should be queried or reset between calls
+ * to the operators.
+ *
+ * Between start_tracing() and stop_tracing() every timer, phase and
+ * PRAGMATIC_TRACE scope is also logged as an event of its thread, and
+ * PRAGMATIC_BARRIER logs the time each thread waits at a barrier. The
+ * events are written by write_trace() in the Chrome trace event format,
+ * which can be loaded in chrome://tracing or https://ui.perfetto.dev to
+ * see where threads sit idle.
+ *
+ * After enable_hardware_counters() every timer and phase also samples
+ * the PerfCounterGroup of its thread, e.g. to tell whether an operator
+ * is limited by memory bandwidth (many LLC misses per instruction) or
+ * by latency (low instructions per cycle with few misses).
+ *
+ * After enable_memory_tracking() the PRAGMATIC_MEMORY scopes of the
+ * operators record how much the memory reserved by the mesh and the
+ * operator's workspace grows over each call; see MemoryReport.
+ */
+class Profiler{
+ public:
+  /// Aggregate of a timer over all threads.
+  struct TimerStats{
+    std::string name;
+    long calls;
+    double time;     ///< summed over threads
+    double max_time; ///< slowest thread
+    int nthreads;    ///< number of threads which recorded the timer
+    long long hw[PERF_NCOUNTERS]; ///< summed over threads, -1 if not sampled
+    long long memory_growth; ///< largest growth over a call in bytes
+    long long memory_peak;   ///< largest footprint at the end of a call in bytes
+  };
+
+  ~Profiler(){
+    for(std::vector<ThreadData*>::iterator it=threads.begin();it!=threads.end();++it)
+      delete *it;
+  }
+
+  /// Monotonic wall clock time in seconds.
+  static double wtime(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /// The process wide profiler.
+  static Profiler &instance(){
+    static Profiler profiler;
+    return profiler;
+  }
+
+  /*! Add the time dt to timer name of the calling thread.
+   * @param hw optional change of the hardware counters over dt, see
+   * read_hardware_counters().
+   */
+  void add_time(const char *name, double dt, const long long *hw=NULL){
+    Timer &timer = local().timers[name];
+    timer.calls++;
+    timer.time += dt;
+    if(hw!=NULL){
+      for(int i=0;i<PERF_NCOUNTERS;i++)
+        timer.hw[i] += std::max(hw[i], 0LL);
+    }
+  }
+
+  /*! Start sampling hardware counters in the timers. This is a no-op
+   * if the counters cannot be opened.
+   * @return number of counters available.
+   */
+  int enable_hardware_counters(){
+    PerfCounterGroup probe;
+    for(int i=0;i<PERF_NCOUNTERS;i++)
+      hw_available[i] = probe.is_available(i);
+    hw_enabled = probe.get_number_counters()>0;
+    return probe.get_number_counters();
+  }
+
+  void disable_hardware_counters(){
+    hw_enabled = false;
+  }
+
+  /// Return true if the timers sample hardware counters.
+  bool is_sampling_hardware() const{
+    return hw_enabled.load(std::memory_order_relaxed);
+  }
+
+  /// Read the hardware counters of the calling thread.
+  void read_hardware_counters(long long *values){
+    ThreadData &data = local();
+    if(data.perf==NULL)
+      data.perf = new PerfCounterGroup();
+    data.perf->read_values(values);
+  }
+
+  /// Record the bytes reserved before and after a call of name.
+  void add_memory(const char *name, size_t before, size_t after){
+    Timer &timer = local().timers[name];
+    timer.memory_growth = std::max(timer.memory_growth, (long long)after-(long long)before);
+    timer.memory_peak = std::max(timer.memory_peak, (long long)after);
+  }
+
+  /*! Record the memory growth of the operators. This walks the mesh
+   * adjacency twice per operator call, so it is off by default.
+   */
+  void enable_memory_tracking(){
+    memory_enabled = true;
+  }
+
+  void disable_memory_tracking(){
+    memory_enabled = false;
+  }
+
+  bool is_tracking_memory() const{
+    return memory_enabled.load(std::memory_order_relaxed);
+  }
+
+  /// Log the event name of the calling thread if tracing.
+  void trace(const char *name, double start, double end){
+    if(tracing.load(std::memory_order_relaxed)){
+      TraceEvent event = {name, start, end};
+      local().events.push_back(event);
+    }
+  }
+
+  /// Return true between start_tracing() and stop_tracing().
+  bool is_tracing() const{
+    return tracing.load(std::memory_order_relaxed);
+  }
+
+  /// Discard previous events and start logging new ones.
+  void start_tracing(){
+    std::lock_guard<std::mutex> lock(mutex);
+    for(std::vector<ThreadData*>::iterator it=threads.begin();it!=threads.end();++it)
+      (*it)->events.clear();
+    trace_start = wtime();
+    tracing = true;
+  }
+
+  void stop_tracing(){
+    tracing = false;
+  }
+
+  /*! Write the logged events as Chrome trace event JSON.
+   * @param out stream to write to.
+   * @param pid process id of the events, e.g. the MPI rank.
+   */
+  void write_trace(std::ostream &out, int pid){
+    std::lock_guard<std::mutex> lock(mutex);
+
+    out<<"{\"displayTimeUnit\": \"ms\", \"traceEvents\": ["<<std::endl;
+    out<<"{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": "<<pid
+       <<", \"args\": {\"name\": \"rank "<<pid<<"\"}}";
+    std::streamsize precision = out.precision(3);
+    std::ios_base::fmtflags flags = out.setf(std::ios::fixed, std::ios::floatfield);
+    for(size_t t=0;t<threads.size();t++){
+      out<<","<<std::endl<<"{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": "<<pid<<", \"tid\": "<<t
+         <<", \"args\": {\"name\": \"thread "<<t<<"\"}}";
+      for(std::vector<TraceEvent>::const_iterator it=threads[t]->events.begin();it!=threads[t]->events.end();++it){
+        out<<","<<std::endl<<"{\"name\": \""<<it->name<<"\", \"ph\": \"X\", \"pid\": "<<pid<<", \"tid\": "<<t
+           <<", \"ts\": "<<(it->start-trace_start)*1e6<<", \"dur\": "<<(it->end-it->start)*1e6<<"}";
+      }
+    }
+    out.precision(precision);
+    out.flags(flags);
+    out<<std::endl<<"]}"<<std::endl;
+  }
+
+  /// Increment a counter of the calling thread.
+  void count(ProfilerCounter counter, long n){
+    local().counters[counter] += n;
+  }
+
+  /// Total of a counter over all threads.
+  long get_counter(ProfilerCounter counter){
+    std::lock_guard<std::mutex> lock(mutex);
+    long total=0;
+    for(std::vector<ThreadData*>::const_iterator it=threads.begin();it!=threads.end();++it)
+      total += (*it)->counters[counter];
+    return total;
+  }
+
+  /// Name of a counter, or NULL if counter is out of range.
+  static const char *get_counter_name(int counter){
+    static const char *names[] = {"collapses", "splits", "flips", "smooth_moves",
+                                  "colour_rounds", "colour_conflicts", "halo_updates", "defragments"};
+    if(counter<0 || counter>=PROFILE_NCOUNTERS)
+      return NULL;
+    return names[counter];
+  }
+
+  /// Timers aggregated over threads, sorted by name.
+  void get_timers(std::vector<TimerStats> &stats){
+    std::map<std::string, TimerStats> merged;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for(std::vector<ThreadData*>::const_iterator it=threads.begin();it!=threads.end();++it){
+        // The same name may appear under several addresses.
+        std::map<std::string, Timer> thread_timers;
+        for(std::map<const char*, Timer>::const_iterator jt=(*it)->timers.begin();jt!=(*it)->timers.end();++jt){
+          Timer &timer = thread_timers[jt->first];
+          timer.calls += jt->second.calls;
+          timer.time += jt->second.time;
+          for(int i=0;i<PERF_NCOUNTERS;i++)
+            timer.hw[i] += jt->second.hw[i];
+          timer.memory_growth = std::max(timer.memory_growth, jt->second.memory_growth);
+          timer.memory_peak = std::max(timer.memory_peak, jt->second.memory_peak);
+        }
+
+        for(std::map<std::string, Timer>::const_iterator jt=thread_timers.begin();jt!=thread_timers.end();++jt){
+          std::map<std::string, TimerStats>::iterator st = merged.find(jt->first);
+          if(st==merged.end()){
+            TimerStats s = {jt->first, 0, 0.0, 0.0, 0, {0}, 0, 0};
+            for(int i=0;i<PERF_NCOUNTERS;i++)
+              s.hw[i] = hw_available[i]?0:-1;
+            st = merged.insert(std::make_pair(jt->first, s)).first;
+          }
+          st->second.calls += jt->second.calls;
+          for(int i=0;i<PERF_NCOUNTERS;i++)
+            if(hw_available[i])
+              st->second.hw[i] += jt->second.hw[i];
+          st->second.time += jt->second.time;
+          st->second.max_time = std::max(st->second.max_time, jt->second.time);
+          st->second.memory_growth = std::max(st->second.memory_growth, jt->second.memory_growth);
+          st->second.memory_peak = std::max(st->second.memory_peak, jt->second.memory_peak);
+          st->second.nthreads++;
+        }
+      }
+    }
+
+    stats.clear();
+    for(std::map<std::string, TimerStats>::const_iterator it=merged.begin();it!=merged.end();++it)
+      stats.push_back(it->second);
+  }
+
+  /// Zero all timers and counters.
+  void reset(){
+    std::lock_guard<std::mutex> lock(mutex);
+    for(std::vector<ThreadData*>::iterator it=threads.begin();it!=threads.end();++it){
+      (*it)->timers.clear();
+      memset((*it)->counters, 0, sizeof((*it)->counters));
+    }
+  }
+
+  /*! Print the timer hierarchy and the counters. For each timer the
+   * mean and maximum time per thread are shown; a large ratio of the
+   * two points to load imbalance. If hardware counters were sampled,
+   * the instructions per cycle and the misses per 1000 instructions
+   * are shown as well, and if memory was tracked the peak growth.
+   */
+  void print(std::ostream &out){
+    std::vector<TimerStats> stats;
+    get_timers(stats);
+
+    bool hw = hw_available[PERF_CYCLES] && hw_available[PERF_INSTRUCTIONS];
+    bool memory=false;
+    for(std::vector<TimerStats>::const_iterator it=stats.begin();it!=stats.end();++it)
+      memory = memory || it->memory_peak>0;
+
+    out<<std::left<<std::setw(40)<<"timer"<<std::right<<std::setw(10)<<"calls"
+       <<std::setw(14)<<"mean (s)"<<std::setw(14)<<"max (s)";
+    if(hw)
+      out<<std::setw(8)<<"IPC"<<std::setw(12)<<"LLC/kinst"<<std::setw(12)<<"dTLB/kinst"<<std::setw(12)<<"br/kinst";
+    if(memory)
+      out<<std::setw(14)<<"growth (MB)"<<std::setw(12)<<"peak (MB)";
+    out<<std::endl;
+    for(std::vector<TimerStats>::const_iterator it=stats.begin();it!=stats.end();++it){
+      size_t depth = std::count(it->name.begin(), it->name.end(), '/');
+      size_t pos = it->name.rfind('/');
+      std::string label = std::string(2*depth, ' ')+(pos==std::string::npos?it->name:it->name.substr(pos+1));
+      out<<std::left<<std::setw(40)<<label<<std::right<<std::setw(10)<<it->calls
+         <<std::setw(14)<<it->time/it->nthreads<<std::setw(14)<<it->max_time;
+      if(hw){
+        double kinst = std::max(it->hw[PERF_INSTRUCTIONS], 1LL)*1e-3;
+        out<<std::setw(8)<<std::setprecision(3)<<(double)it->hw[PERF_INSTRUCTIONS]/std::max(it->hw[PERF_CYCLES], 1LL);
+        const int misses[] = {PERF_LLC_MISSES, PERF_DTLB_MISSES, PERF_BRANCH_MISSES};
+        for(int i=0;i<3;i++){
+          if(it->hw[misses[i]]<0)
+            out<<std::setw(12)<<"-";
+          else
+            out<<std::setw(12)<<it->hw[misses[i]]/kinst;
+        }
+        out<<std::setprecision(6);
+      }
+      if(memory){
+        if(it->memory_peak>0)
+          out<<std::setw(14)<<it->memory_growth/1048576.0<<std::setw(12)<<it->memory_peak/1048576.0;
+        else
+          out<<std::setw(14)<<"-"<<std::setw(12)<<"-";
+      }
+      out<<std::endl;
+    }
+
+    for(int i=0;i<PROFILE_NCOUNTERS;i++)
+      out<<std::left<<std::setw(40)<<get_counter_name(i)<<std::right<<std::setw(10)
+         <<get_counter((ProfilerCounter)i)<<std::endl;
+  }
+
+ private:
+  Profiler() : tracing(false), trace_start(0.0), hw_enabled(false), memory_enabled(false){
+    for(int i=0;i<PERF_NCOUNTERS;i++)
+      hw_available[i] = false;
+  }
+  Profiler(const Profiler &);
+  Profiler &operator=(const Profiler &);
+
+  struct Timer{
+    Timer() : calls(0), time(0.0), memory_growth(0), memory_peak(0){
+      for(int i=0;i<PERF_NCOUNTERS;i++)
+        hw[i] = 0;
+    }
+    long calls;
+    double time;
+    long long hw[PERF_NCOUNTERS];
+    long long memory_growth, memory_peak;
+  };
+
+  struct TraceEvent{
+    const char *name;
+    double start, end;
+  };
+
+  struct ThreadData{
+    ThreadData() : perf(NULL){
+      memset(counters, 0, sizeof(counters));
+    }
+    ~ThreadData(){
+      delete perf;
+    }
+    long counters[PROFILE_NCOUNTERS];
+    // Timer names are string literals, so the address is a cheap key.
+    std::map<const char*, Timer> timers;
+    std::vector<TraceEvent> events;
+    PerfCounterGroup *perf;
+  };
+
+  ThreadData &local(){
+    static thread_local ThreadData *data=NULL;
+    if(data==NULL){
+      std::lock_guard<std::mutex> lock(mutex);
+      threads.push_back(new ThreadData());
+      data = threads.back();
+    }
+    return *data;
+  }
+
+  std::mutex mutex;
+  std::vector<ThreadData*> threads;
+  std::atomic<bool> tracing;
+  double trace_start;
+  std::atomic<bool> hw_enabled;
+  bool hw_available[PERF_NCOUNTERS];
+  std::atomic<bool> memory_enabled;
+};
+
+/// Start and end of a timed interval. The hardware counters are only
+/// read if they are being sampled.
+class ProfilerSample{
+ public:
+  ProfilerSample(){
+    start();
+  }
+
+  void start(){
+    hw = Profiler::instance().is_sampling_hardware();
+    if(hw)
+      Profiler::instance().read_hardware_counters(hw_start);
+    time_start = Profiler::wtime();
+  }
+
+  /// Add the interval to timer name and return its end.
+  double stop(const char *name){
+    double now = Profiler::wtime();
+    long long delta[PERF_NCOUNTERS];
+    if(hw){
+      Profiler::instance().read_hardware_counters(delta);
+      for(int i=0;i<PERF_NCOUNTERS;i++)
+        delta[i] = (delta[i]<0 || hw_start[i]<0)?-1:delta[i]-hw_start[i];
+    }
+    Profiler::instance().add_time(name, now-time_start, hw?delta:NULL);
+    Profiler::instance().trace(name, time_start, now);
+    return now;
+  }
+
+ private:
+  double time_start;
+  bool hw;
+  long long hw_start[PERF_NCOUNTERS];
+};
+
+/// Times the enclosing scope.
+class ProfilerTimer{
+ public:
+  ProfilerTimer(const char *name) : name(name){}
+
+  ~ProfilerTimer(){
+    sample.stop(name);
+  }
+
+ private:
+  const char *name;
+  ProfilerSample sample;
+};
+
+/// Times consecutive phases of a parallel region, ending the current
+/// phase when the next one starts or the scope is left.
+class ProfilerPhase{
+ public:
+  ProfilerPhase(const char *name) : name(name){}
+
+  ~ProfilerPhase(){
+    sample.stop(name);
+  }
+
+  void next(const char *next_name){
+    sample.stop(name);
+    name = next_name;
+    sample.start();
+  }
+
+ private:
+  const char *name;
+  ProfilerSample sample;
+};
+
+/*! Records the memory growth of an operator over the enclosing scope
+ * while memory is tracked. The operator provides memory_report(). Use
+ * it outside of parallel regions, before the timer of the operator so
+ * the cost of measuring is not timed.
+ */
+class ProfilerMemory{
+ public:
+  template<class Operator>
+    ProfilerMemory(const char *name, const Operator *op) : name(name), op(op), reserved(&get_reserved<Operator>), before(0){
+    enabled = Profiler::instance().is_tracking_memory();
+    if(enabled)
+      before = reserved(op);
+  }
+
+  ~ProfilerMemory(){
+    if(enabled)
+      Profiler::instance().add_memory(name, before, reserved(op));
+  }
+
+ private:
+  template<class Operator>
+    static size_t get_reserved(const void *op){
+    MemoryReport report;
+    static_cast<const Operator *>(op)->memory_report(report);
+    return report.get_reserved();
+  }
+
+  const char *name;
+  const void *op;
+  size_t (*reserved)(const void *);
+  size_t before;
+  bool enabled;
+};
+
+/// Logs the enclosing scope as an event while tracing, without
+/// accumulating a timer.
+class ProfilerTrace{
+ public:
+  ProfilerTrace(const char *name) : name(name), start(Profiler::instance().is_tracing()?Profiler::wtime():-1.0){}
+
+  ~ProfilerTrace(){
+    if(start>=0.0)
+      Profiler::instance().trace(name, start, Profiler::wtime());
+  }
+
+ private:
+  const char *name;
+  double start;
+};
+
+#define PRAGMATIC_CONCAT_(a, b) a##b
+#define PRAGMATIC_CONCAT(a, b) PRAGMATIC_CONCAT_(a, b)
+
+#ifdef HAVE_PROFILING
+#define PRAGMATIC_TIMER(name) ProfilerTimer PRAGMATIC_CONCAT(pragmatic_timer_, __LINE__)(name)
+#define PRAGMATIC_PHASE_BEGIN(phase, name) ProfilerPhase phase(name)
+#define PRAGMATIC_PHASE(phase, name) phase.next(name)
+#define PRAGMATIC_COUNT(counter, n) Profiler::instance().count(counter, n)
+#define PRAGMATIC_TRACE(name) ProfilerTrace PRAGMATIC_CONCAT(pragmatic_trace_, __LINE__)(name)
+#define PRAGMATIC_BARRIER() do{ PRAGMATIC_TRACE("barrier"); _Pragma("omp barrier") }while(0)
+#define PRAGMATIC_TRACE_CALL(name, call) do{ PRAGMATIC_TRACE(name); call; }while(0)
+#define PRAGMATIC_MEMORY(name, op) ProfilerMemory PRAGMATIC_CONCAT(pragmatic_memory_, __LINE__)(name, op)
+#else
+#define PRAGMATIC_TIMER(name)
+#define PRAGMATIC_PHASE_BEGIN(phase, name)
+#define PRAGMATIC_PHASE(phase, name)
+#define PRAGMATIC_COUNT(counter, n)
+#define PRAGMATIC_TRACE(name)
+#define PRAGMATIC_BARRIER() _Pragma("omp barrier")
+#define PRAGMATIC_TRACE_CALL(name, call) call
+#define PRAGMATIC_MEMORY(name, op)
+#endif
+
+#endif
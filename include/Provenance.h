@@ -0,0 +1,346 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef PROVENANCE_H
+#define PROVENANCE_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "PragmaticTypes.h"
+#include "PragmaticMinis.h"
+#include "MemoryReport.h"
+
+#ifdef HAVE_MPI
+#include "HaloExchange.h"
+#endif
+
+/*! \brief Log of how the adaptivity operators derive vertices from
+ * other vertices, used to carry node fields through adaptation.
+ *
+ * The operators record where the vertices they create or move come
+ * from:
+ * \li Refine: the parent edge of each new vertex and the split weight,
+ * and the parent element of each centroidal vertex;
+ * \li Smooth: the element each relocated vertex was found in, and
+ * its barycentric coordinates there;
+ * \li Mesh::defragment: the renumbering of the vertices.
+ *
+ * Coarsening and swapping leave the surviving vertices where they are,
+ * so they need no records. The log is a sequence of batches. The
+ * records of one batch are independent of each other, so they can be
+ * replayed in parallel, and batches are replayed in order. The cost of
+ * replaying is proportional to the number of changes, not to the size
+ * of the mesh.
+ *
+ * In parallel, Smooth moves halo vertices on their owner only, and
+ * then updates the halo. These halo updates are logged too, and are
+ * repeated when replaying, which makes replaying collective.
+ *
+ * Records are added by each OpenMP thread to its own buffer, and
+ * commit() closes the current batch.
+ */
+template<typename real_t> class Provenance{
+ public:
+  /// A vertex derived from up to four parent vertices. Unused parents
+  /// are -1.
+  struct Record{
+    index_t vid;
+    index_t parent[4];
+    real_t weight[4];
+  };
+
+  /// A batch of independent records, a renumbering of the vertices or
+  /// a halo update.
+  struct Batch{
+    size_t begin, end;
+    // new_id[old_id], -1 for deleted vertices. Empty unless this is a
+    // renumbering.
+    std::vector<index_t> renumber;
+    // Index of the halo to update, or -1.
+    int halo;
+    // Number of vertices after this batch.
+    size_t NNodes;
+  };
+
+#ifdef HAVE_MPI
+  Provenance(size_t NNodes, MPI_Comm comm){
+    pending.resize(pragmatic_nthreads());
+    this->NNodes = NNodes;
+    _mpi_comm = comm;
+  }
+#else
+  Provenance(size_t NNodes){
+    pending.resize(pragmatic_nthreads());
+    this->NNodes = NNodes;
+  }
+#endif
+
+  /// Make room for records from nthreads threads. Must not be called
+  /// from inside a parallel region.
+  void set_nthreads(int nthreads){
+    if((int)pending.size()<nthreads)
+      pending.resize(nthreads);
+  }
+
+  /// Record that vertex vid splits the edge (n0, n1) at weight w from n0.
+  void record_split(int tid, index_t vid, index_t n0, index_t n1, real_t w){
+    Record r;
+    r.vid = vid;
+    r.parent[0] = n0; r.parent[1] = n1; r.parent[2] = -1; r.parent[3] = -1;
+    r.weight[0] = 1.0-w; r.weight[1] = w; r.weight[2] = 0.0; r.weight[3] = 0.0;
+    pending[tid].push_back(r);
+  }
+
+  /// Record that vertex vid is at barycentric coordinates l in the
+  /// element n of nloc vertices. n may include vid itself.
+  void record_location(int tid, index_t vid, const index_t *n, const real_t *l, size_t nloc){
+    Record r;
+    r.vid = vid;
+    for(size_t i=0;i<4;i++){
+      r.parent[i] = i<nloc?n[i]:-1;
+      r.weight[i] = i<nloc?l[i]:0.0;
+    }
+    pending[tid].push_back(r);
+  }
+
+  /// Close the current batch. Only one thread may call this, after all
+  /// threads have finished recording the batch.
+  void commit(){
+    Batch batch;
+    batch.begin = records.size();
+    for(size_t t=0;t<pending.size();t++){
+      for(typename std::vector<Record>::const_iterator it=pending[t].begin();it!=pending[t].end();++it)
+        NNodes = std::max(NNodes, (size_t)it->vid+1);
+      records.insert(records.end(), pending[t].begin(), pending[t].end());
+      pending[t].clear();
+    }
+    batch.end = records.size();
+    batch.halo = -1;
+    batch.NNodes = NNodes;
+
+    if(batch.end>batch.begin)
+      batches.push_back(batch);
+  }
+
+  /// Record a renumbering of the vertices: new_id[old_id], or -1 for
+  /// deleted vertices.
+  void record_renumber(const std::vector<index_t> &new_id, size_t new_NNodes){
+    commit();
+
+    Batch batch;
+    batch.begin = batch.end = records.size();
+    batch.renumber = new_id;
+    batch.halo = -1;
+    batch.NNodes = NNodes = new_NNodes;
+    batches.push_back(batch);
+  }
+
+  /// Store the halo of the mesh, for use by record_halo_update(), and
+  /// return its index.
+  int add_halo(const std::vector< std::vector<index_t> > &send, const std::vector< std::vector<index_t> > &recv){
+    halos.push_back(std::make_pair(send, recv));
+    return halos.size()-1;
+  }
+
+  /// Record an update of the halo stored as halo, on a mesh of NNodes
+  /// vertices. The log must contain the same sequence of halo updates
+  /// on all processes.
+  void record_halo_update(int halo, size_t NNodes){
+    commit();
+    this->NNodes = std::max(this->NNodes, NNodes);
+
+    Batch batch;
+    batch.begin = batch.end = records.size();
+    batch.halo = halo;
+    batch.NNodes = NNodes;
+    batches.push_back(batch);
+  }
+
+  /// Number of records, excluding renumberings.
+  size_t size() const{
+    return records.size();
+  }
+
+  const std::vector<Record> &get_records() const{
+    return records;
+  }
+
+  const std::vector<Batch> &get_batches() const{
+    return batches;
+  }
+
+  /// Add the memory held by the log to report.
+  void memory_report(MemoryReport &report) const{
+    report.add("provenance/records", records, records.size());
+    report.add("provenance/pending", pending, pending.size());
+    size_t used=0, reserved=0;
+    for(typename std::vector<Batch>::const_iterator it=batches.begin();it!=batches.end();++it){
+      used += sizeof(Batch)+it->renumber.size()*sizeof(index_t);
+      reserved += MemoryReport::heap_block(it->renumber.capacity()*sizeof(index_t));
+    }
+    report.add("provenance/batches", used, reserved+MemoryReport::heap_block(batches.capacity()*sizeof(Batch)));
+  }
+
+  /// Discard the log. NNodes is the current number of vertices.
+  void clear(size_t NNodes){
+    records.clear();
+    batches.clear();
+    halos.clear();
+    for(size_t t=0;t<pending.size();t++)
+      pending[t].clear();
+    this->NNodes = NNodes;
+  }
+
+  /*! Replay the log on a node field, stored node by node with ncomps
+   * values per node. The field is resized to the current number of
+   * vertices. In parallel this is collective.
+   */
+  void replay(std::vector<real_t> &field, int ncomps) const{
+    std::vector<real_t> renumbered;
+    for(typename std::vector<Batch>::const_iterator batch=batches.begin();batch!=batches.end();++batch){
+      if(field.size()<batch->NNodes*ncomps)
+        field.resize(batch->NNodes*ncomps, 0.0);
+
+      if(!batch->renumber.empty()){
+        renumbered.resize(batch->NNodes*ncomps);
+        int nold = batch->renumber.size();
+#pragma omp parallel for schedule(static)
+        for(int i=0;i<nold;i++){
+          index_t j = batch->renumber[i];
+          if(j<0)
+            continue;
+          for(int k=0;k<ncomps;k++)
+            renumbered[j*ncomps+k] = field[i*ncomps+k];
+        }
+        field.swap(renumbered);
+        continue;
+      }
+
+      if(batch->halo>=0){
+#ifdef HAVE_MPI
+        const std::vector< std::vector<index_t> > &send = halos[batch->halo].first;
+        const std::vector< std::vector<index_t> > &recv = halos[batch->halo].second;
+        std::vector<real_t> component(batch->NNodes);
+        for(int k=0;k<ncomps;k++){
+          for(size_t i=0;i<batch->NNodes;i++)
+            component[i] = field[i*ncomps+k];
+          halo_update<real_t, 1>(_mpi_comm, send, recv, component);
+          for(size_t i=0;i<batch->NNodes;i++)
+            field[i*ncomps+k] = component[i];
+        }
+#endif
+        continue;
+      }
+
+      int begin = batch->begin, end = batch->end;
+#pragma omp parallel for schedule(static)
+      for(int r=begin;r<end;r++){
+        const Record &rec = records[r];
+        real_t value[16];
+        for(int k0=0;k0<ncomps;k0+=16){
+          int kn = std::min(16, ncomps-k0);
+          for(int k=0;k<kn;k++)
+            value[k] = 0.0;
+          for(int i=0;i<4 && rec.parent[i]>=0;i++)
+            for(int k=0;k<kn;k++)
+              value[k] += rec.weight[i]*field[rec.parent[i]*ncomps+k0+k];
+          for(int k=0;k<kn;k++)
+            field[rec.vid*ncomps+k0+k] = value[k];
+        }
+      }
+    }
+  }
+
+  /*! Trace each vertex back to the vertex it derives from at the
+   * start of the log: the parent with the largest weight, or the vertex
+   * itself if it has not been moved. origin must hold a value for each
+   * vertex at the start of the log, e.g. its index, and is resized to
+   * the current number of vertices. Unlike replay() this is local to
+   * the process: halo updates are skipped, so halo vertices keep the
+   * origin they had locally. Vertices without an origin are -1.
+   */
+  void trace(std::vector<index_t> &origin) const{
+    std::vector<index_t> renumbered;
+    for(typename std::vector<Batch>::const_iterator batch=batches.begin();batch!=batches.end();++batch){
+      if(origin.size()<batch->NNodes)
+        origin.resize(batch->NNodes, -1);
+
+      if(!batch->renumber.empty()){
+        renumbered.assign(batch->NNodes, -1);
+        int nold = batch->renumber.size();
+#pragma omp parallel for schedule(static)
+        for(int i=0;i<nold;i++){
+          index_t j = batch->renumber[i];
+          if(j>=0)
+            renumbered[j] = origin[i];
+        }
+        origin.swap(renumbered);
+        continue;
+      }
+
+      if(batch->halo>=0)
+        continue;
+
+      int begin = batch->begin, end = batch->end;
+#pragma omp parallel for schedule(static)
+      for(int r=begin;r<end;r++){
+        const Record &rec = records[r];
+        int heaviest=0;
+        for(int i=1;i<4 && rec.parent[i]>=0;i++){
+          if(rec.weight[i]>rec.weight[heaviest])
+            heaviest = i;
+        }
+        origin[rec.vid] = rec.parent[heaviest]>=0?origin[rec.parent[heaviest]]:-1;
+      }
+    }
+  }
+
+ private:
+  std::vector<Record> records;
+  std::vector<Batch> batches;
+  std::vector< std::vector<Record> > pending;
+  std::vector< std::pair< std::vector< std::vector<index_t> >, std::vector< std::vector<index_t> > > > halos;
+  size_t NNodes;
+
+#ifdef HAVE_MPI
+  MPI_Comm _mpi_comm;
+#endif
+};
+
+#endif
@@ -45,6 +45,7 @@
 #include <string.h>
 #include <inttypes.h>
 
+#include "Autotuner.h"
 #include "DeferredOperations.h"
 #include "Edge.h"
 #include "ElementProperty.h"
@@ -90,6 +91,7 @@ template<typename real_t, int dim> class Refine{
     newBoundaries.resize(nthreads);
     newCoords.resize(nthreads);
     newMetric.resize(nthreads);
+    newWeights.resize(nthreads);
 
     // Pre-allocate the maximum size that might be required
     allNewVertices.resize(_mesh->_ENList.size());
@@ -97,10 +99,19 @@ template<typename real_t, int dim> class Refine{
     threadIdx.resize(nthreads);
     splitCnt.resize(nthreads);
 
+    defOp_scaling_factor = Autotuner::defaults(AUTOTUNE_REFINE, dim).defop_scaling_factor;
     def_ops = new DeferredOperations<real_t>(_mesh, nthreads, defOp_scaling_factor);
 
-    cidRecv_additional.resize(nprocs);
-    cidSend_additional.resize(nprocs);
+    recv_additional.resize(nthreads);
+    send_additional.resize(nthreads);
+    cidRecv_additional.resize(nthreads);
+    cidSend_additional.resize(nthreads);
+    for(int i=0;i<nthreads;i++){
+      recv_additional[i].resize(nprocs);
+      send_additional[i].resize(nprocs);
+      cidRecv_additional[i].resize(nprocs);
+      cidSend_additional[i].resize(nprocs);
+    }
 
     if(dim==2){
       refineMode2D[0] = &Refine<real_t,dim>::refine2D_1;
@@ -130,12 +141,26 @@ template<typename real_t, int dim> class Refine{
    * Mathematics, Volume 13, Issue 6, February 1994, Pages 437-452.
    */
   void refine(real_t L_max){
+    PRAGMATIC_MEMORY("refine", this);
+    PRAGMATIC_TIMER("refine");
     size_t origNElements = _mesh->get_number_elements();
     size_t origNNodes = _mesh->get_number_nodes();
     size_t edgeSplitCnt = 0;
 
+    AutotunerScope tuning(AUTOTUNE_REFINE, dim, 0);
+    defOp_scaling_factor = tuning.parameters().defop_scaling_factor;
+    def_ops->set_scaling_factor(defOp_scaling_factor);
+
+    // Number of vertices appended to recv[i] and send[i].
+    std::vector<size_t> recv_cnt(nprocs, 0), send_cnt(nprocs, 0);
+
+    Provenance<real_t> *provenance = _mesh->provenance;
+    if(provenance!=NULL)
+      provenance->set_nthreads(nthreads);
+
 #pragma omp parallel
     {
+      PRAGMATIC_PHASE_BEGIN(phase, "refine/split");
 #pragma omp single nowait
       {
         new_vertices_per_element.resize(nedge*origNElements);
@@ -154,10 +179,11 @@ template<typename real_t, int dim> class Refine{
       newVertices[tid].clear(); newVertices[tid].reserve(reserve_size);
       newCoords[tid].clear(); newCoords[tid].reserve(ndims*reserve_size);
       newMetric[tid].clear(); newMetric[tid].reserve(msize*reserve_size);
+      newWeights[tid].clear();
 
       /* Loop through all edges and select them for refinement if
          its length is greater than L_max in transformed space. */
-#pragma omp for schedule(guided) nowait
+#pragma omp for schedule(runtime) nowait
       for(size_t i=0;i<origNNodes;++i){
         for(size_t it=0;it<_mesh->NNList[i].size();++it){
           index_t otherVertex = _mesh->NNList[i][it];
@@ -179,11 +205,13 @@ template<typename real_t, int dim> class Refine{
 
       threadIdx[tid] = pragmatic_omp_atomic_capture(&_mesh->NNodes, splitCnt[tid]);
       assert(newVertices[tid].size()==splitCnt[tid]);
+      PRAGMATIC_COUNT(PROFILE_SPLITS, splitCnt[tid]);
 
-#pragma omp barrier
+      PRAGMATIC_BARRIER();
 
 #pragma omp single
       {
+        PRAGMATIC_TRACE("single");
         size_t reserve = 1.1*_mesh->NNodes; // extra space is required for centroidals
         if(_mesh->_coords.size()<reserve*ndims){
           _mesh->_coords.resize(reserve*ndims);
@@ -191,6 +219,7 @@ template<typename real_t, int dim> class Refine{
           _mesh->NNList.resize(reserve);
           _mesh->NEList.resize(reserve);
           _mesh->node_owner.resize(reserve);
+          _mesh->halo_flag.resize(reserve, 0);
           _mesh->lnn2gnn.resize(reserve);
         }
         edgeSplitCnt = _mesh->NNodes - origNNodes;
@@ -206,13 +235,27 @@ template<typename real_t, int dim> class Refine{
         newVertices[tid][i].id = threadIdx[tid]+i;
       }
 
+      if(provenance!=NULL){
+        for(size_t i=0;i<splitCnt[tid];i++)
+          provenance->record_split(tid, newVertices[tid][i].id, newVertices[tid][i].edge.first,
+                                   newVertices[tid][i].edge.second, newWeights[tid][i]);
+      }
+
       // Accumulate all newVertices in a contiguous array
       memcpy(&allNewVertices[threadIdx[tid]-origNNodes], &newVertices[tid][0], newVertices[tid].size()*sizeof(DirectedEdge<index_t>));
 
       // Mark each element with its new vertices,
       // update NNList for all split edges.
-#pragma omp barrier
-#pragma omp for schedule(guided)
+      PRAGMATIC_BARRIER();
+      PRAGMATIC_PHASE(phase, "refine/mark");
+      // New vertices of a centroid may be split vertices, so the
+      // splits are a batch of their own.
+      if(provenance!=NULL){
+#pragma omp single nowait
+        provenance->commit();
+      }
+
+#pragma omp for schedule(runtime)
       for(size_t i=0; i<edgeSplitCnt; ++i){
         index_t vid = allNewVertices[i].id;
         index_t firstid = allNewVertices[i].edge.first;
@@ -267,7 +310,8 @@ template<typename real_t, int dim> class Refine{
 
       if(dim==3){
         // If in 3D, we need to refine facets first.
-#pragma omp for schedule(guided)
+        PRAGMATIC_PHASE(phase, "refine/facets");
+#pragma omp for schedule(runtime)
         for(index_t eid=0; eid<origNElements; ++eid){
           // Find the 4 facets comprising the element
           const index_t *n = _mesh->get_element(eid);
@@ -304,7 +348,7 @@ template<typename real_t, int dim> class Refine{
           }
         }
 
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
         for(int vtid=0; vtid<defOp_scaling_factor*nthreads; ++vtid){
           for(int i=0; i<nthreads; ++i){
             def_ops->commit_remNN(i, vtid);
@@ -314,12 +358,13 @@ template<typename real_t, int dim> class Refine{
       }
 
       // Start element refinement.
+      PRAGMATIC_PHASE(phase, "refine/elements");
       splitCnt[tid] = 0;
       newElements[tid].clear(); newBoundaries[tid].clear();
       newElements[tid].reserve(dim*dim*origNElements/nthreads);
       newBoundaries[tid].reserve(dim*dim*origNElements/nthreads);
 
-#pragma omp for schedule(guided) nowait
+#pragma omp for schedule(runtime) nowait
       for(size_t eid=0; eid<origNElements; ++eid){
         //If the element has been deleted, continue.
         const index_t *n = _mesh->get_element(eid);
@@ -335,9 +380,10 @@ template<typename real_t, int dim> class Refine{
 
       threadIdx[tid] = pragmatic_omp_atomic_capture(&_mesh->NElements, splitCnt[tid]);
 
-#pragma omp barrier
+      PRAGMATIC_BARRIER();
 #pragma omp single
       {
+        PRAGMATIC_TRACE("single");
         if(_mesh->_ENList.size()<_mesh->NElements*nloc){
           _mesh->_ENList.resize(_mesh->NElements*nloc);
           _mesh->boundary.resize(_mesh->NElements*nloc);
@@ -349,7 +395,8 @@ template<typename real_t, int dim> class Refine{
       memcpy(&_mesh->boundary[nloc*threadIdx[tid]], &newBoundaries[tid][0], nloc*splitCnt[tid]*sizeof(int));
 
       // Commit deferred operations.
-#pragma omp for schedule(guided)
+      PRAGMATIC_PHASE(phase, "refine/commit");
+#pragma omp for schedule(runtime)
       for(int vtid=0; vtid<defOp_scaling_factor*nthreads; ++vtid){
         for(int i=0; i<nthreads; ++i){
           def_ops->commit_remNN(i, vtid);
@@ -363,116 +410,129 @@ template<typename real_t, int dim> class Refine{
       // Update halo.
 #ifdef HAVE_MPI
       if(nprocs>1){
-#pragma omp single
-        {
-          std::vector< std::set< DirectedEdge<index_t> > > recv_additional(nprocs), send_additional(nprocs);
-
-          for(size_t i=0; i<edgeSplitCnt; ++i){
-            DirectedEdge<index_t> *vert = &allNewVertices[i];
-
-            if(_mesh->node_owner[vert->id] != rank){
-              // Vertex is owned by another MPI process, so prepare to update recv and recv_halo.
-              // Only update them if the vertex is actually visible by *this* MPI process,
-              // i.e. if at least one of its neighbours is owned by *this* process.
-              bool visible = false;
-              for(typename std::vector<index_t>::const_iterator neigh=_mesh->NNList[vert->id].begin(); neigh!=_mesh->NNList[vert->id].end(); ++neigh){
-                if(_mesh->is_owned_node(*neigh)){
-                  visible = true;
-                  DirectedEdge<index_t> gnn_edge(_mesh->lnn2gnn[vert->edge.first], _mesh->lnn2gnn[vert->edge.second], vert->id);
-                  recv_additional[_mesh->node_owner[vert->id]].insert(gnn_edge);
-                  break;
-                }
+        PRAGMATIC_PHASE(phase, "refine/halo");
+        // Find the new vertices which lie on the halo. Each thread
+        // collects them in its own buffers, one per process.
+#pragma omp for schedule(runtime)
+        for(size_t i=0; i<edgeSplitCnt; ++i){
+          DirectedEdge<index_t> *vert = &allNewVertices[i];
+
+          if(_mesh->node_owner[vert->id] != rank){
+            // Vertex is owned by another MPI process, so prepare to update recv and the halo flags.
+            // Only update them if the vertex is actually visible by *this* MPI process,
+            // i.e. if at least one of its neighbours is owned by *this* process.
+            for(typename std::vector<index_t>::const_iterator neigh=_mesh->NNList[vert->id].begin(); neigh!=_mesh->NNList[vert->id].end(); ++neigh){
+              if(_mesh->is_owned_node(*neigh)){
+                DirectedEdge<index_t> gnn_edge(_mesh->lnn2gnn[vert->edge.first], _mesh->lnn2gnn[vert->edge.second], vert->id);
+                recv_additional[tid][_mesh->node_owner[vert->id]].push_back(gnn_edge);
+                break;
               }
-            }else{
-              // Vertex is owned by *this* MPI process, so check whether it is visible by other MPI processes.
-              // The latter is true only if both vertices of the original edge were halo vertices.
-              if(_mesh->is_halo_node(vert->edge.first) && _mesh->is_halo_node(vert->edge.second)){
-                // Find which processes see this vertex
-                std::set<int> processes;
-                for(typename std::vector<index_t>::const_iterator neigh=_mesh->NNList[vert->id].begin(); neigh!=_mesh->NNList[vert->id].end(); ++neigh)
-                  processes.insert(_mesh->node_owner[*neigh]);
-
-                processes.erase(rank);
-
-                for(typename std::set<int>::const_iterator proc=processes.begin(); proc!=processes.end(); ++proc){
-                  DirectedEdge<index_t> gnn_edge(_mesh->lnn2gnn[vert->edge.first], _mesh->lnn2gnn[vert->edge.second], vert->id);
-                  send_additional[*proc].insert(gnn_edge);
-                }
+            }
+          }else{
+            // Vertex is owned by *this* MPI process, so check whether it is visible by other MPI processes.
+            // The latter is true only if both vertices of the original edge were halo vertices.
+            if(_mesh->is_halo_node(vert->edge.first) && _mesh->is_halo_node(vert->edge.second)){
+              // Find which processes see this vertex
+              std::set<int> processes;
+              for(typename std::vector<index_t>::const_iterator neigh=_mesh->NNList[vert->id].begin(); neigh!=_mesh->NNList[vert->id].end(); ++neigh)
+                processes.insert(_mesh->node_owner[*neigh]);
+
+              processes.erase(rank);
+
+              for(typename std::set<int>::const_iterator proc=processes.begin(); proc!=processes.end(); ++proc){
+                DirectedEdge<index_t> gnn_edge(_mesh->lnn2gnn[vert->edge.first], _mesh->lnn2gnn[vert->edge.second], vert->id);
+                send_additional[tid][*proc].push_back(gnn_edge);
               }
             }
           }
+        }
 
-          // Append vertices in recv_additional and send_additional to recv and send.
-          // Mark how many vertices are added to each of these vectors.
-          std::vector<size_t> recv_cnt(nprocs, 0), send_cnt(nprocs, 0);
+        // Merge the per-thread buffers and append them to recv and send, one
+        // process per iteration. Vertices are sorted by the gnn's of the edge
+        // they split (by coordinates for centroidal vertices), so that both
+        // sides of the halo append them in the same order.
+#pragma omp for schedule(dynamic)
+        for(int p=0;p<nprocs;++p){
+          std::vector< DirectedEdge<index_t> > recv_p, send_p;
+          for(int t=0;t<nthreads;++t){
+            recv_p.insert(recv_p.end(), recv_additional[t][p].begin(), recv_additional[t][p].end());
+            recv_additional[t][p].clear();
+            send_p.insert(send_p.end(), send_additional[t][p].begin(), send_additional[t][p].end());
+            send_additional[t][p].clear();
+          }
+          std::sort(recv_p.begin(), recv_p.end());
+          std::sort(send_p.begin(), send_p.end());
 
-          for(int i=0;i<nprocs;++i){
-            recv_cnt[i] = recv_additional[i].size();
-            for(typename std::set< DirectedEdge<index_t> >::const_iterator it=recv_additional[i].begin();it!=recv_additional[i].end();++it){
-              _mesh->recv[i].push_back(it->id);
-              _mesh->recv_halo.insert(it->id);
-            }
+          recv_cnt[p] = recv_p.size();
+          for(typename std::vector< DirectedEdge<index_t> >::const_iterator it=recv_p.begin();it!=recv_p.end();++it){
+            _mesh->recv[p].push_back(it->id);
+            _mesh->halo_flag[it->id] |= HALO_RECV;
+          }
 
-            send_cnt[i] = send_additional[i].size();
-            for(typename std::set< DirectedEdge<index_t> >::const_iterator it=send_additional[i].begin();it!=send_additional[i].end();++it){
-              _mesh->send[i].push_back(it->id);
-              _mesh->send_halo.insert(it->id);
-            }
+          send_cnt[p] = send_p.size();
+          for(typename std::vector< DirectedEdge<index_t> >::const_iterator it=send_p.begin();it!=send_p.end();++it){
+            _mesh->send[p].push_back(it->id);
+            // The same vertex may be sent to several processes.
+#pragma omp atomic
+            _mesh->halo_flag[it->id] |= HALO_SEND;
           }
 
           // Additional code for centroidal vertices.
           if(dim==3){
-            for(int i=0;i<nprocs;++i){
-              recv_cnt[i] += cidRecv_additional[i].size();
-              for(typename std::set<Wedge>::const_iterator it=cidRecv_additional[i].begin();it!=cidRecv_additional[i].end();++it){
-                _mesh->recv[i].push_back(it->cid);
-                _mesh->recv_halo.insert(it->cid);
-              }
+            std::vector<Wedge> cidRecv_p, cidSend_p;
+            for(int t=0;t<nthreads;++t){
+              cidRecv_p.insert(cidRecv_p.end(), cidRecv_additional[t][p].begin(), cidRecv_additional[t][p].end());
+              cidRecv_additional[t][p].clear();
+              cidSend_p.insert(cidSend_p.end(), cidSend_additional[t][p].begin(), cidSend_additional[t][p].end());
+              cidSend_additional[t][p].clear();
+            }
+            std::sort(cidRecv_p.begin(), cidRecv_p.end());
+            std::sort(cidSend_p.begin(), cidSend_p.end());
 
-              send_cnt[i] += cidSend_additional[i].size();
-              for(typename std::set<Wedge>::const_iterator it=cidSend_additional[i].begin();it!=cidSend_additional[i].end();++it){
-                _mesh->send[i].push_back(it->cid);
-                _mesh->send_halo.insert(it->cid);
-              }
+            recv_cnt[p] += cidRecv_p.size();
+            for(typename std::vector<Wedge>::const_iterator it=cidRecv_p.begin();it!=cidRecv_p.end();++it){
+              _mesh->recv[p].push_back(it->cid);
+              _mesh->halo_flag[it->cid] |= HALO_RECV;
+            }
+
+            send_cnt[p] += cidSend_p.size();
+            for(typename std::vector<Wedge>::const_iterator it=cidSend_p.begin();it!=cidSend_p.end();++it){
+              _mesh->send[p].push_back(it->cid);
+#pragma omp atomic
+              _mesh->halo_flag[it->cid] |= HALO_SEND;
             }
           }
+        }
+
+#pragma omp single
+        {
+          PRAGMATIC_TRACE("single");
+          // New halo vertices may link us to new neighbours.
+          _mesh->update_halo_comm();
 
           // Update global numbering
           _mesh->update_gappy_global_numbering(recv_cnt, send_cnt);
+        }
 
-          // Now that the global numbering has been updated, update send_map and recv_map.
-          for(int i=0;i<nprocs;++i){
-            for(typename std::set< DirectedEdge<index_t> >::const_iterator it=recv_additional[i].begin();it!=recv_additional[i].end();++it)
-              _mesh->recv_map[i][_mesh->lnn2gnn[it->id]] = it->id;
-
-            for(typename std::set< DirectedEdge<index_t> >::const_iterator it=send_additional[i].begin();it!=send_additional[i].end();++it)
-              _mesh->send_map[i][_mesh->lnn2gnn[it->id]] = it->id;
-
-            // Additional code for centroidals.
-            if(dim==3){
-              for(typename std::set<Wedge>::const_iterator it=cidRecv_additional[i].begin();it!=cidRecv_additional[i].end();++it)
-                _mesh->recv_map[i][_mesh->lnn2gnn[it->cid]] = it->cid;
-
-              for(typename std::set<Wedge>::const_iterator it=cidSend_additional[i].begin();it!=cidSend_additional[i].end();++it)
-                _mesh->send_map[i][_mesh->lnn2gnn[it->cid]] = it->cid;
-
-              cidRecv_additional[i].clear();
-              cidSend_additional[i].clear();
-            }
-          }
+        // Now that the global numbering has been updated, update send_map and recv_map.
+#pragma omp for schedule(dynamic)
+        for(int p=0;p<nprocs;++p){
+          for(typename std::vector<index_t>::const_iterator it=_mesh->recv[p].end()-recv_cnt[p];it!=_mesh->recv[p].end();++it)
+            _mesh->recv_map[p].insert(_mesh->lnn2gnn[*it], *it);
 
-          _mesh->trim_halo();
+          for(typename std::vector<index_t>::const_iterator it=_mesh->send[p].end()-send_cnt[p];it!=_mesh->send[p].end();++it)
+            _mesh->send_map[p].insert(_mesh->lnn2gnn[*it], *it);
         }
       }
 #endif
 
 #if !defined NDEBUG
       if(dim==2){
-#pragma omp barrier
+        PRAGMATIC_BARRIER();
       // Fix orientations of new elements.
       size_t NElements = _mesh->get_number_elements();
 
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
         for(size_t i=0;i<NElements;i++){
           index_t n0 = _mesh->_ENList[i*nloc];
           if(n0<0)
@@ -497,9 +557,44 @@ template<typename real_t, int dim> class Refine{
       }
 #endif
     }
+
+    tuning.set_work(edgeSplitCnt);
+
+    if(provenance!=NULL)
+      provenance->commit();
+
+#ifdef HAVE_MPI
+    // Remove the parts of the halo which are no longer needed.
+    if(nprocs>1)
+      _mesh->trim_halo();
+#endif
+  }
+
+  /// Add the memory held by the mesh and the refinement workspace to report.
+  void memory_report(MemoryReport &report) const{
+    _mesh->memory_report(report);
+
+    MemoryReport workspace;
+    workspace.add("newVertices", newVertices, newVertices.size());
+    workspace.add("newCoords", newCoords, newCoords.size());
+    workspace.add("newMetric", newMetric, newMetric.size());
+    workspace.add("newWeights", newWeights, newWeights.size());
+    workspace.add("newElements", newElements, newElements.size());
+    workspace.add("newBoundaries", newBoundaries, newBoundaries.size());
+    workspace.add("new_vertices_per_element", new_vertices_per_element, new_vertices_per_element.size());
+    workspace.add("allNewVertices", allNewVertices, allNewVertices.size());
+    for(size_t t=0;t<recv_additional.size();t++){
+      workspace.add("halo_additional", recv_additional[t], recv_additional[t].size());
+      workspace.add("halo_additional", send_additional[t], send_additional[t].size());
+      workspace.add("halo_additional", cidRecv_additional[t], cidRecv_additional[t].size());
+      workspace.add("halo_additional", cidSend_additional[t], cidSend_additional[t].size());
+    }
+    def_ops->memory_report(workspace);
+    report.add("refine/", workspace);
   }
 
  private:
+  template<typename _real_t, int _dim> friend class KernelBenchmark;
 
   void refine_edge(index_t n0, index_t n1, int tid){
     if(_mesh->lnn2gnn[n0] > _mesh->lnn2gnn[n1]){
@@ -521,6 +616,8 @@ template<typename real_t, int dim> class Refine{
 
     real_t weight = 1.0/(1.0 + sqrt(property->template length<dim>(x0, x1, m0)/
         property->template length<dim>(x0, x1, m1)));
+    if(_mesh->provenance!=NULL)
+      newWeights[tid].push_back(weight);
 
     // Calculate position of new vertex and append it to OMP thread's temp storage
     for(size_t i=0;i<ndims;i++){
@@ -2692,6 +2789,25 @@ template<typename real_t, int dim> class Refine{
                                      l[2]*_mesh->metric[sorted_best_e[2]*msize+i]+
                                      l[3]*_mesh->metric[sorted_best_e[3]*msize+i];
 
+      // The elements above include the centroidal vertex itself, so
+      // record its location in the element being refined instead.
+      if(_mesh->provenance!=NULL){
+        const real_t *x0 = _mesh->get_coords(n[0]);
+        const real_t *x1 = _mesh->get_coords(n[1]);
+        const real_t *x2 = _mesh->get_coords(n[2]);
+        const real_t *x3 = _mesh->get_coords(n[3]);
+
+        real_t L = property->volume(x0, x1, x2, x3);
+
+        real_t lp[4];
+        lp[0] = property->volume(nc, x1, x2, x3)/L;
+        lp[1] = property->volume(x0, nc, x2, x3)/L;
+        lp[2] = property->volume(x0, x1, nc, x3)/L;
+        lp[3] = property->volume(x0, x1, x2, nc)/L;
+
+        _mesh->provenance->record_location(tid, cid, n, lp, nloc);
+      }
+
       append_element(ele1, ele1_boundary, tid);
       append_element(ele2, ele2_boundary, tid);
       append_element(ele3, ele3_boundary, tid);
@@ -2714,10 +2830,9 @@ template<typename real_t, int dim> class Refine{
         _mesh->node_owner[cid] = owner;
 
         if(_mesh->node_owner[cid] != rank){
-          // Vertex is owned by another MPI process, so prepare to update recv and recv_halo.
+          // Vertex is owned by another MPI process, so prepare to update recv and the halo flags.
           Wedge wedge(cid, _mesh->get_coords(cid));
-#pragma omp critical
-          cidRecv_additional[_mesh->node_owner[cid]].insert(wedge);
+          cidRecv_additional[tid][_mesh->node_owner[cid]].push_back(wedge);
         }else{
           // Vertex is owned by *this* MPI process, so check whether it is visible by other MPI processes.
           // The latter is true only if all vertices of the original element were halo vertices.
@@ -2730,10 +2845,8 @@ template<typename real_t, int dim> class Refine{
             processes.erase(rank);
 
             Wedge wedge(cid, _mesh->get_coords(cid));
-            for(typename std::set<int>::const_iterator proc=processes.begin(); proc!=processes.end(); ++proc){
-#pragma omp critical
-              cidSend_additional[*proc].insert(wedge);
-            }
+            for(typename std::set<int>::const_iterator proc=processes.begin(); proc!=processes.end(); ++proc)
+              cidSend_additional[tid][*proc].push_back(wedge);
           }
 
           // Finally, assign a gnn
@@ -2865,7 +2978,7 @@ template<typename real_t, int dim> class Refine{
 
     /// Less-than operator
     bool operator<(const Coords_t& in) const{
-      bool isLess;
+      bool isLess=false;
 
       for(int i=0; i<3; ++i){
         if(coords[i] < in.coords[i]){
@@ -2884,8 +2997,8 @@ template<typename real_t, int dim> class Refine{
   // Struct containing gnn's of the six vertices comprising a wedge. It is only
   // to be used for consistent sorting of centroidal vertices across MPI processes.
   struct Wedge{
-    const Coords_t coords;
-    const index_t cid;
+    Coords_t coords;
+    index_t cid;
 
     Wedge(const index_t id, const real_t *cid_coords) : coords(cid_coords), cid(id){}
 
@@ -2898,16 +3011,20 @@ template<typename real_t, int dim> class Refine{
   std::vector< std::vector< DirectedEdge<index_t> > > newVertices;
   std::vector< std::vector<real_t> > newCoords;
   std::vector< std::vector<double> > newMetric;
+  // Split weights of newVertices, only kept when recording provenance.
+  std::vector< std::vector<real_t> > newWeights;
   std::vector< std::vector<index_t> > newElements;
   std::vector< std::vector<int> > newBoundaries;
   std::vector<index_t> new_vertices_per_element;
 
   std::vector<size_t> threadIdx, splitCnt;
   std::vector< DirectedEdge<index_t> > allNewVertices;
-  std::vector< std::set<Wedge> > cidRecv_additional, cidSend_additional;
+  // Per-thread buffers of new halo vertices, indexed by [tid][process].
+  std::vector< std::vector< std::vector< DirectedEdge<index_t> > > > recv_additional, send_additional;
+  std::vector< std::vector< std::vector<Wedge> > > cidRecv_additional, cidSend_additional;
 
   DeferredOperations<real_t>* def_ops;
-  static const int defOp_scaling_factor = 32;
+  int defOp_scaling_factor;
 
   Mesh<real_t> *_mesh;
   ElementProperty<real_t> *property;
@@ -0,0 +1,264 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+#ifndef SHAREDHALOEXCHANGE_H
+#define SHAREDHALOEXCHANGE_H
+
+#include <vector>
+#include <cassert>
+#include <cstring>
+
+#include "PragmaticTypes.h"
+#include "mpi_tools.h"
+#include "HaloExchange.h"
+
+/*! \brief Halo exchange through node-local shared memory.
+ *
+ * Ranks which share a node (MPI_COMM_TYPE_SHARED) each expose a
+ * MPI_Win_allocate_shared window. A rank writes the values of its send
+ * halo straight into its window and co-located peers copy them from
+ * there into their own arrays, so no MPI message or intermediate
+ * buffer is involved on-node. Neighbours on other nodes still go
+ * through a neighbourhood collective on the halo communicator.
+ *
+ * Every rank in the communicator must take part in update(), as for
+ * halo_update().
+ */
+class SharedHaloExchange{
+ public:
+  /*! Constructor.
+   * @param comm communicator over which the halo is defined.
+   */
+  SharedHaloExchange(MPI_Comm comm){
+    int num_processes;
+    MPI_Comm_size(comm, &num_processes);
+
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_size(node_comm, &node_size);
+    MPI_Comm_rank(node_comm, &node_rank);
+
+    // Map ranks in comm to ranks within this node.
+    std::vector<int> ranks(num_processes);
+    for(int i=0;i<num_processes;i++)
+      ranks[i] = i;
+    node_rank_of.resize(num_processes);
+    MPI_Group group, node_group;
+    MPI_Comm_group(comm, &group);
+    MPI_Comm_group(node_comm, &node_group);
+    MPI_Group_translate_ranks(group, num_processes, &(ranks[0]), node_group, &(node_rank_of[0]));
+    MPI_Group_free(&group);
+    MPI_Group_free(&node_group);
+
+    window = MPI_WIN_NULL;
+    capacity = 0;
+  }
+
+  ~SharedHaloExchange(){
+    int finalized;
+    MPI_Finalized(&finalized);
+    if(finalized)
+      return;
+
+    free_window();
+    MPI_Comm_free(&node_comm);
+  }
+
+  /// Return true if there are other ranks on this node.
+  bool is_active() const{
+    return node_size>1;
+  }
+
+  /// Return true if process p is on the same node as this process.
+  bool is_local(int p) const{
+    return node_rank_of[p]!=MPI_UNDEFINED;
+  }
+
+  /*! Update halo values of vec0 (and vec1 if block1>0).
+   * @param comm halo communicator, see Mesh::get_halo_comm().
+   * @param sources ranks that halo data is received from.
+   * @param destinations ranks that halo data is sent to.
+   * @param send vertices sent to each process.
+   * @param recv vertices received from each process.
+   */
+  template <typename DATATYPE, int block0, int block1>
+    void update(MPI_Comm comm,
+                const std::vector<int> &sources,
+                const std::vector<int> &destinations,
+                const std::vector< std::vector<index_t> > &send,
+                const std::vector< std::vector<index_t> > &recv,
+                std::vector<DATATYPE> &vec0, std::vector<DATATYPE> &vec1){
+    const int block = block0+block1;
+
+    // Lay out the window: one offset per node rank, followed by the
+    // halo data destined for each co-located neighbour.
+    std::vector<size_t> offset(node_size, 0);
+    size_t bytes = node_size*sizeof(size_t);
+    for(size_t i=0;i<destinations.size();i++){
+      int p = destinations[i];
+      if(!is_local(p))
+        continue;
+      offset[node_rank_of[p]] = bytes;
+      bytes += send[p].size()*block*sizeof(DATATYPE);
+    }
+    reserve(bytes);
+
+    // Write the send halo into the window.
+    memcpy(local_base, &(offset[0]), node_size*sizeof(size_t));
+    for(size_t i=0;i<destinations.size();i++){
+      int p = destinations[i];
+      if(!is_local(p))
+        continue;
+      DATATYPE *buff = (DATATYPE *)(local_base+offset[node_rank_of[p]]);
+      for(typename std::vector<index_t>::const_iterator it=send[p].begin();it!=send[p].end();++it){
+        for(int j=0;j<block0;j++)
+          *(buff++) = vec0[(*it)*block0+j];
+        for(int j=0;j<block1;j++)
+          *(buff++) = vec1[(*it)*block1+j];
+      }
+    }
+    MPI_Win_sync(window);
+
+    // Start the exchange with off-node neighbours, which proceeds while
+    // co-located ranks are writing and while we copy from their windows.
+    std::vector<int> send_cnt(destinations.size(), 0);
+    std::vector<DATATYPE> send_buff;
+    for(size_t i=0;i<destinations.size();i++){
+      int p = destinations[i];
+      if(is_local(p))
+        continue;
+      send_cnt[i] = send[p].size()*block;
+      for(typename std::vector<index_t>::const_iterator it=send[p].begin();it!=send[p].end();++it){
+        for(int j=0;j<block0;j++)
+          send_buff.push_back(vec0[(*it)*block0+j]);
+        for(int j=0;j<block1;j++)
+          send_buff.push_back(vec1[(*it)*block1+j]);
+      }
+    }
+    std::vector<int> recv_cnt(sources.size(), 0);
+    for(size_t i=0;i<sources.size();i++){
+      if(!is_local(sources[i]))
+        recv_cnt[i] = recv[sources[i]].size()*block;
+    }
+    std::vector<DATATYPE> recv_buff;
+    std::vector<int> send_displ, recv_displ;
+    MPI_Request request;
+    neighbour_ialltoallv(comm, sources, destinations, send_buff, send_cnt, send_displ,
+                         recv_buff, recv_cnt, recv_displ, &request);
+
+    // Wait until all ranks on the node have written their halo.
+    MPI_Barrier(node_comm);
+    MPI_Win_sync(window);
+
+    for(size_t i=0;i<sources.size();i++){
+      int p = sources[i];
+      if(!is_local(p))
+        continue;
+      const char *peer = peer_base[node_rank_of[p]];
+      const DATATYPE *buff = (const DATATYPE *)(peer+((const size_t *)peer)[node_rank]);
+      for(typename std::vector<index_t>::const_iterator it=recv[p].begin();it!=recv[p].end();++it){
+        for(int j=0;j<block0;j++)
+          vec0[(*it)*block0+j] = *(buff++);
+        for(int j=0;j<block1;j++)
+          vec1[(*it)*block1+j] = *(buff++);
+      }
+    }
+
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    int k=0;
+    for(size_t i=0;i<sources.size();i++){
+      int p = sources[i];
+      if(is_local(p))
+        continue;
+      for(typename std::vector<index_t>::const_iterator it=recv[p].begin();it!=recv[p].end();++it){
+        for(int j=0;j<block0;j++)
+          vec0[(*it)*block0+j] = recv_buff[k++];
+        for(int j=0;j<block1;j++)
+          vec1[(*it)*block1+j] = recv_buff[k++];
+      }
+    }
+
+    // Peers must be done reading before anyone writes again.
+    MPI_Barrier(node_comm);
+  }
+
+ private:
+  /// Make sure the local window is at least bytes large. Collective over the node.
+  void reserve(size_t bytes){
+    int grow = (bytes>capacity)?1:0;
+    MPI_Allreduce(MPI_IN_PLACE, &grow, 1, MPI_INT, MPI_MAX, node_comm);
+    if(!grow)
+      return;
+
+    free_window();
+
+    // Leave some room as the halo tends to grow during adaptivity.
+    capacity = std::max(bytes+bytes/2, capacity);
+
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, (char *)"alloc_shared_noncontig", (char *)"true");
+    MPI_Win_allocate_shared(capacity, 1, info, node_comm, &local_base, &window);
+    MPI_Info_free(&info);
+
+    peer_base.resize(node_size);
+    for(int i=0;i<node_size;i++){
+      MPI_Aint size;
+      int disp_unit;
+      MPI_Win_shared_query(window, i, &size, &disp_unit, &(peer_base[i]));
+    }
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+  }
+
+  void free_window(){
+    if(window==MPI_WIN_NULL)
+      return;
+
+    MPI_Win_unlock_all(window);
+    MPI_Win_free(&window);
+  }
+
+  MPI_Comm node_comm;
+  int node_size, node_rank;
+  std::vector<int> node_rank_of;
+
+  MPI_Win window;
+  size_t capacity;
+  char *local_base;
+  std::vector<char *> peer_base;
+};
+
+#endif
@@ -46,6 +46,7 @@
 #include <limits>
 #include <random>
 
+#include "Autotuner.h"
 #include "Colour.h"
 
 #include <Eigen/Core>
@@ -78,6 +79,7 @@ template<typename real_t, int dim>
 #endif
 
     epsilon_q = DBL_EPSILON;
+    initial_colours = Autotuner::defaults(AUTOTUNE_SMART_LAPLACIAN, dim).initial_colours;
 
     // Set the orientation of elements.
     property = NULL;
@@ -109,6 +111,11 @@ template<typename real_t, int dim>
 
   // Smart laplacian mesh smoothing.
   void smart_laplacian(int max_iterations=10, double quality_tol=-1.0){
+    PRAGMATIC_MEMORY("smooth", this);
+    PRAGMATIC_TIMER("smooth");
+    AutotunerScope tuning(AUTOTUNE_SMART_LAPLACIAN, dim, _mesh->get_number_nodes());
+    initial_colours = tuning.parameters().initial_colours;
+
     // Calculate all element qualities
     int NElements = _mesh->get_number_elements();
     quality.resize(NElements);
@@ -116,7 +123,7 @@ template<typename real_t, int dim>
     double qsum=0;
 #pragma omp parallel
     {
-#pragma omp for schedule(guided) reduction(+:qsum)
+#pragma omp for schedule(runtime) reduction(+:qsum)
       for(int i=0;i<NElements;i++){
         const int *n=_mesh->get_element(i);
         if(n[0]<0){
@@ -161,6 +168,7 @@ template<typename real_t, int dim>
       max_colour = colour_sets.rbegin()->first;
 #ifdef HAVE_MPI
     if(mpi_nparts>1){
+      PRAGMATIC_TRACE("MPI_Allreduce");
       MPI_Allreduce(MPI_IN_PLACE, &max_colour, 1, MPI_INT, MPI_MAX, _mesh->get_mpi_comm());
     }
 #endif
@@ -172,7 +180,7 @@ template<typename real_t, int dim>
       for(int ic=0;ic<=max_colour;ic++){
         if(colour_sets.count(ic)){
           int node_set_size = colour_sets[ic].size();
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
           for(int cn=0;cn<node_set_size;cn++){
             index_t node = colour_sets[ic][cn];
 	    active_vertices[node] = 0;
@@ -187,10 +195,13 @@ template<typename real_t, int dim>
           }
         }
 	
+        commit_provenance();
+
         if(mpi_nparts>1){
 #pragma omp single
           {
-            halo_update<real_t, dim, dim==2?3:6>(_mesh->get_mpi_comm(), _mesh->send, _mesh->recv, _mesh->_coords, _mesh->metric);
+            PRAGMATIC_TRACE("single");
+            _mesh->template update_halo<real_t, dim, dim==2?3:6>(_mesh->_coords, _mesh->metric);
 
             for(std::vector<int>::const_iterator ie=halo_elements.begin();ie!=halo_elements.end();++ie)
               update_quality(*ie);
@@ -202,7 +213,7 @@ template<typename real_t, int dim>
         for(int ic=0;ic<=max_colour;ic++){
           if(colour_sets.count(ic)){
             int node_set_size = colour_sets[ic].size();
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
             for(int cn=0;cn<node_set_size;cn++){
               index_t node = colour_sets[ic][cn];
 
@@ -220,10 +231,13 @@ template<typename real_t, int dim>
               }
             }
           }
+          commit_provenance();
+
           if(mpi_nparts>1){
 #pragma omp single
             {
-              halo_update<real_t, dim, dim==2?3:6>(_mesh->get_mpi_comm(), _mesh->send, _mesh->recv, _mesh->_coords, _mesh->metric);
+              PRAGMATIC_TRACE("single");
+              _mesh->template update_halo<real_t, dim, dim==2?3:6>(_mesh->_coords, _mesh->metric);
 
               for(std::vector<int>::const_iterator ie=halo_elements.begin();ie!=halo_elements.end();++ie)
                 update_quality(*ie);
@@ -233,11 +247,18 @@ template<typename real_t, int dim>
       }
     }
 
+    count_moves();
+
     return;
   }
 
   // Linf optimisation based smoothing..
   void optimisation_linf(int max_iterations=10, double quality_tol=-1.0){
+    PRAGMATIC_MEMORY("smooth", this);
+    PRAGMATIC_TIMER("smooth");
+    AutotunerScope tuning(AUTOTUNE_OPTIMISATION_LINF, dim, _mesh->get_number_nodes());
+    initial_colours = tuning.parameters().initial_colours;
+
     // Calculate all element qualities
     int NElements = _mesh->get_number_elements();
     quality.resize(NElements);
@@ -245,7 +266,7 @@ template<typename real_t, int dim>
     double qsum=0;
 #pragma omp parallel
     {
-#pragma omp for schedule(guided) reduction(+:qsum)
+#pragma omp for schedule(runtime) reduction(+:qsum)
       for(int i=0;i<NElements;i++){
         const int *n=_mesh->get_element(i);
         if(n[0]<0){
@@ -291,6 +312,7 @@ template<typename real_t, int dim>
       max_colour = colour_sets.rbegin()->first;
 #ifdef HAVE_MPI
     if(mpi_nparts>1){
+      PRAGMATIC_TRACE("MPI_Allreduce");
       MPI_Allreduce(MPI_IN_PLACE, &max_colour, 1, MPI_INT, MPI_MAX, _mesh->get_mpi_comm());
     }
 #endif
@@ -300,7 +322,7 @@ template<typename real_t, int dim>
       for(int ic=1;ic<=max_colour;ic++){
         if(colour_sets.count(ic)){
           int node_set_size = colour_sets[ic].size();
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
           for(int cn=0;cn<node_set_size;cn++){
             index_t node = colour_sets[ic][cn];
 	    active_vertices[node] = 0;
@@ -315,10 +337,13 @@ template<typename real_t, int dim>
           }
         }
 	
+        commit_provenance();
+
         if(mpi_nparts>1){
 #pragma omp single
           {
-            halo_update<real_t, dim, dim==2?3:6>(_mesh->get_mpi_comm(), _mesh->send, _mesh->recv, _mesh->_coords, _mesh->metric);
+            PRAGMATIC_TRACE("single");
+            _mesh->template update_halo<real_t, dim, dim==2?3:6>(_mesh->_coords, _mesh->metric);
 
             for(std::vector<int>::const_iterator ie=halo_elements.begin();ie!=halo_elements.end();++ie)
               update_quality(*ie);
@@ -330,7 +355,7 @@ template<typename real_t, int dim>
         for(int ic=1;ic<=max_colour;ic++){
           if(colour_sets.count(ic)){
             int node_set_size = colour_sets[ic].size();
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
             for(int cn=0;cn<node_set_size;cn++){
               index_t node = colour_sets[ic][cn];
 
@@ -348,10 +373,13 @@ template<typename real_t, int dim>
               }
             }
           }
+          commit_provenance();
+
           if(mpi_nparts>1){
 #pragma omp single
             {
-              halo_update<real_t, dim, dim==2?3:6>(_mesh->get_mpi_comm(), _mesh->send, _mesh->recv, _mesh->_coords, _mesh->metric);
+              PRAGMATIC_TRACE("single");
+              _mesh->template update_halo<real_t, dim, dim==2?3:6>(_mesh->_coords, _mesh->metric);
 
               for(std::vector<int>::const_iterator ie=halo_elements.begin();ie!=halo_elements.end();++ie)
                 update_quality(*ie);
@@ -361,11 +389,18 @@ template<typename real_t, int dim>
       }
     }
 
+    count_moves();
+
     return;
   }
 
   // Laplacian smoothing
   void laplacian(int max_iterations=10){
+    PRAGMATIC_MEMORY("smooth", this);
+    PRAGMATIC_TIMER("smooth");
+    AutotunerScope tuning(AUTOTUNE_LAPLACIAN, dim, _mesh->get_number_nodes());
+    initial_colours = tuning.parameters().initial_colours;
+
     init_cache();
     
     std::vector<int> halo_elements;
@@ -391,6 +426,7 @@ template<typename real_t, int dim>
       max_colour = colour_sets.rbegin()->first;
 #ifdef HAVE_MPI
     if(mpi_nparts>1){
+      PRAGMATIC_TRACE("MPI_Allreduce");
       MPI_Allreduce(MPI_IN_PLACE, &max_colour, 1, MPI_INT, MPI_MAX, _mesh->get_mpi_comm());
     }
 #endif
@@ -401,26 +437,44 @@ template<typename real_t, int dim>
         for(int ic=1;ic<=max_colour;ic++){
           if(colour_sets.count(ic)){
             int node_set_size = colour_sets[ic].size();
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
             for(int cn=0;cn<node_set_size;cn++){
               index_t node = colour_sets[ic][cn];
 	      
 	      laplacian_kernel(node);
             }
           }
+          commit_provenance();
+
           if(mpi_nparts>1){
 #pragma omp single
             {
-              halo_update<real_t, dim, dim==2?3:6>(_mesh->get_mpi_comm(), _mesh->send, _mesh->recv, _mesh->_coords, _mesh->metric);
+              PRAGMATIC_TRACE("single");
+              _mesh->template update_halo<real_t, dim, dim==2?3:6>(_mesh->_coords, _mesh->metric);
             }
           }
         }
       }
     }
     
+    count_moves();
+
     return;
   }
 
+  /// Add the memory held by the mesh and the smoothing workspace to report.
+  void memory_report(MemoryReport &report) const{
+    _mesh->memory_report(report);
+
+    MemoryReport workspace;
+    workspace.add("quality", quality, quality.size());
+    for(typename std::map<int, std::vector<index_t> >::const_iterator it=colour_sets.begin();it!=colour_sets.end();++it)
+      workspace.add("colour_sets", sizeof(*it)+it->second.size()*sizeof(index_t),
+                    MemoryReport::set_node< std::pair<const int, std::vector<index_t> > >()+
+                    MemoryReport::heap_block(it->second.capacity()*sizeof(index_t)));
+    report.add("smooth/", workspace);
+  }
+
  private:
 
   // Laplacian smooth kernels
@@ -439,13 +493,14 @@ template<typename real_t, int dim>
     laplacian_2d_kernel(node, p);
     
     double mp[3];
-    bool valid = generate_location_2d(node, p, mp);
+    Location loc;
+    bool valid = generate_location_2d(node, p, mp, &loc);
     if(!valid){
       // Try the mid point.
       for(size_t j=0;j<2;j++)
 	p[j] = 0.5*(p[j] +  _mesh->_coords[node*2+j]);
       
-      valid = generate_location_2d(node, p, mp);
+      valid = generate_location_2d(node, p, mp, &loc);
     }
     
     // Give up
@@ -457,6 +512,8 @@ template<typename real_t, int dim>
     
     for(size_t j=0;j<3;j++)
       _mesh->metric[node*3+j] = mp[j];
+
+    record_move(node, loc);
     
     return true;
   }
@@ -466,13 +523,14 @@ template<typename real_t, int dim>
     laplacian_3d_kernel(node, p);
     
     double mp[6];
-    bool valid = generate_location_3d(node, p, mp);
+    Location loc;
+    bool valid = generate_location_3d(node, p, mp, &loc);
     if(!valid){
       // Try the mid point.
       for(size_t j=0;j<3;j++)
 	p[j] = 0.5*(p[j] +  _mesh->_coords[node*3+j]);
       
-      valid = generate_location_3d(node, p, mp);
+      valid = generate_location_3d(node, p, mp, &loc);
     }
     if(!valid)
       return false;
@@ -482,6 +540,8 @@ template<typename real_t, int dim>
     
     for(size_t j=0;j<6;j++)
       _mesh->metric[node*6+j] = mp[j];
+
+    record_move(node, loc);
     
     return true;
   }
@@ -587,13 +647,14 @@ template<typename real_t, int dim>
     laplacian_2d_kernel(node, p);
 
     double mp[3];
-    bool valid = generate_location_2d(node, p, mp);
+    Location loc;
+    bool valid = generate_location_2d(node, p, mp, &loc);
     if(!valid){
       // Try the mid point.
       for(size_t j=0;j<2;j++)
 	p[j] = 0.5*(p[j] +  _mesh->_coords[node*2+j]);
       
-      valid = generate_location_2d(node, p, mp);
+      valid = generate_location_2d(node, p, mp, &loc);
     }
     
     // Give up
@@ -611,6 +672,8 @@ template<typename real_t, int dim>
     
     for(size_t j=0;j<3;j++)
       _mesh->metric[node*3+j] = mp[j];
+
+    record_move(node, loc);
     
     return true;
   }
@@ -620,13 +683,14 @@ template<typename real_t, int dim>
     laplacian_3d_kernel(node, p);
     
     double mp[6];
-    bool valid = generate_location_3d(node, p, mp);
+    Location loc;
+    bool valid = generate_location_3d(node, p, mp, &loc);
     if(!valid){
       // Try the mid point.
       for(size_t j=0;j<3;j++)
 	p[j] = 0.5*(p[j] +  _mesh->_coords[node*2+j]);
       
-      valid = generate_location_3d(node, p, mp);
+      valid = generate_location_3d(node, p, mp, &loc);
     }
     
     // Give up
@@ -644,6 +708,8 @@ template<typename real_t, int dim>
     
     for(size_t j=0;j<6;j++)
       _mesh->metric[node*6+j] = mp[j];
+
+    record_move(node, loc);
     
     return true;
   }
@@ -761,7 +827,8 @@ template<typename real_t, int dim>
       }
 
       double new_m0[3];
-      bool valid = generate_location_2d(n0, new_x0, new_m0);
+      Location loc;
+      bool valid = generate_location_2d(n0, new_x0, new_m0, &loc);
       
       if(!valid)
         continue;
@@ -812,6 +879,8 @@ template<typename real_t, int dim>
       for(size_t i=0;i<msize;i++)
         _mesh->metric[n0*msize+i] = new_m0[i];
 
+      record_move(n0, loc);
+
       break;
     }
   
@@ -967,7 +1036,8 @@ template<typename real_t, int dim>
       }
 
       double new_m0[6];
-      bool valid = generate_location_3d(n0, new_x0, new_m0);
+      Location loc;
+      bool valid = generate_location_3d(n0, new_x0, new_m0, &loc);
       
       if(!valid)
         continue;
@@ -1044,6 +1114,8 @@ template<typename real_t, int dim>
       for(size_t i=0;i<msize;i++)
         _mesh->metric[n0*msize+i] = new_m0[i];
 
+      record_move(n0, loc);
+
       break;
     }
   
@@ -1052,11 +1124,25 @@ template<typename real_t, int dim>
 
   void init_cache(){
     colour_sets.clear();
+    moves.assign(pragmatic_nthreads()*moves_stride, 0);
+
+    if(_mesh->provenance!=NULL){
+      _mesh->provenance->set_nthreads(pragmatic_nthreads());
+      if(mpi_nparts>1)
+        provenance_halo = _mesh->provenance->add_halo(_mesh->send, _mesh->recv);
+    }
 
     int NNodes = _mesh->get_number_nodes();
     std::vector<char> colour(NNodes);
 
-    Colour::GebremedhinManne(MPI_COMM_WORLD, NNodes, _mesh->NNList, _mesh->send, _mesh->recv, _mesh->node_owner, colour);
+    // The colouring iterates in step on all processes, so they must start from the same guess.
+    int K = initial_colours;
+#ifdef HAVE_MPI
+    if(mpi_nparts>1)
+      MPI_Allreduce(MPI_IN_PLACE, &K, 1, MPI_INT, MPI_MAX, _mesh->get_mpi_comm());
+#endif
+
+    Colour::GebremedhinManne(_mesh->get_halo_comm(), NNodes, _mesh->NNList, _mesh->send, _mesh->recv, _mesh->node_owner, colour, K);
 
     int NElements = _mesh->get_number_elements();
     std::vector<bool> is_boundary(NNodes, false);
@@ -1197,7 +1283,45 @@ template<typename real_t, int dim>
     return functional;
   }
 
-  bool generate_location_2d(index_t node, const real_t *p, double *mp){
+  // Element in which a new location of a vertex was found, and the
+  // barycentric coordinates of the location in it.
+  struct Location{
+    index_t n[4];
+    real_t l[4];
+  };
+
+  // Record the relocation of node in the provenance log.
+  inline void record_move(index_t node, const Location &loc){
+    moves[pragmatic_thread_id()*moves_stride]++;
+    if(_mesh->provenance!=NULL)
+      _mesh->provenance->record_location(pragmatic_thread_id(), node, loc.n, loc.l, nloc);
+  }
+
+  // Add up the moves of all threads since init_cache().
+  size_t count_moves(){
+    size_t total=0;
+    for(size_t i=0;i<moves.size();i+=moves_stride)
+      total += moves[i];
+    PRAGMATIC_COUNT(PROFILE_SMOOTH_MOVES, total);
+    return total;
+  }
+
+  // Close the provenance batch of a colour. Must be called by all
+  // threads of the team.
+  inline void commit_provenance(){
+    if(_mesh->provenance!=NULL){
+#pragma omp single
+      {
+        PRAGMATIC_TRACE("single");
+        if(mpi_nparts>1)
+          _mesh->provenance->record_halo_update(provenance_halo, _mesh->NNodes);
+        else
+          _mesh->provenance->commit();
+      }
+    }
+  }
+
+  bool generate_location_2d(index_t node, const real_t *p, double *mp, Location *loc=NULL){
     // Interpolate metric at this new position.
     real_t l[]={-1, -1, -1};
     int best_e=-1;
@@ -1252,6 +1376,13 @@ template<typename real_t, int dim>
     const index_t *n=_mesh->get_element(best_e);
     assert(n[0]>=0);
 
+    if(loc!=NULL){
+      for(size_t i=0;i<nloc;i++){
+        loc->n[i] = n[i];
+        loc->l[i] = l[i];
+      }
+    }
+
     for(size_t i=0;i<msize;i++)
       mp[i] = 
 	l[0]*_mesh->metric[n[0]*msize+i]+
@@ -1261,7 +1392,7 @@ template<typename real_t, int dim>
     return true;
   }
 
-  bool generate_location_3d(index_t node, const real_t *p, double *mp){
+  bool generate_location_3d(index_t node, const real_t *p, double *mp, Location *loc=NULL){
     // Interpolate metric at this new position.
     real_t l[]={-1, -1, -1, -1};
     int best_e=-1;
@@ -1320,6 +1451,13 @@ template<typename real_t, int dim>
     const index_t *n=_mesh->get_element(best_e);
     assert(n[0]>=0);
 
+    if(loc!=NULL){
+      for(size_t i=0;i<nloc;i++){
+        loc->n[i] = n[i];
+        loc->l[i] = l[i];
+      }
+    }
+
     for(size_t i=0;i<msize;i++)
       mp[i] =
 	l[0]*_mesh->metric[n[0]*msize+i]+
@@ -1377,9 +1515,17 @@ template<typename real_t, int dim>
   const size_t nloc, msize;
 
   int mpi_nparts, rank;
+  int initial_colours;
   real_t good_q, epsilon_q;
   std::vector<real_t> quality;
   std::map<int, std::vector<index_t> > colour_sets;
+
+  // Moves counted by each thread, a cache line apart.
+  static const size_t moves_stride=64/sizeof(size_t);
+  std::vector<size_t> moves;
+
+  // Index of the halo stored in the provenance log by init_cache().
+  int provenance_halo;
 };
 
 #endif
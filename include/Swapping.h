@@ -44,6 +44,7 @@
 #include <set>
 #include <vector>
 
+#include "Autotuner.h"
 #include "Colour.h"
 #include "DeferredOperations.h"
 #include "Edge.h"
@@ -97,6 +98,10 @@ template<typename real_t, int dim> class Swapping{
     // We pre-allocate the maximum capacity that may be needed.
     node_colour = NULL;
 
+    TuningParameters tuning = Autotuner::defaults(AUTOTUNE_SWAP, dim);
+    max_colour = tuning.max_colour;
+    defOp_scaling_factor = tuning.defop_scaling_factor;
+
     for(int i=0; i<3; ++i)
       ind_set_size[i].resize(max_colour, 0);
     ind_sets.resize(nthreads, std::vector< std::vector<index_t> >(max_colour));
@@ -122,16 +127,47 @@ template<typename real_t, int dim> class Swapping{
   }
 
   void swap(real_t quality_tolerance){
+    PRAGMATIC_MEMORY("swap", this);
+    PRAGMATIC_TIMER("swap");
+    AutotunerScope tuning(AUTOTUNE_SWAP, dim, 0);
+    defOp_scaling_factor = tuning.parameters().defop_scaling_factor;
+    def_ops->set_scaling_factor(defOp_scaling_factor);
+    tune_independent_sets(tuning.parameters(), _mesh, nthreads, max_colour, ind_set_size, ind_sets, range_indexer);
+
     if(dim==2)
-      swap2d(quality_tolerance);
+      tuning.set_work(swap2d(quality_tolerance));
     else
-      swap3d(quality_tolerance);
+      tuning.set_work(swap3d(quality_tolerance));
   }
 
 
+  /// Add the memory held by the mesh and the swapping workspace to report.
+  void memory_report(MemoryReport &report) const{
+    _mesh->memory_report(report);
+
+    MemoryReport workspace;
+    workspace.add("node_colour", node_colour, nnodes_reserve, nnodes_reserve);
+    for(int i=0;i<3;i++){
+      workspace.add("worklist", worklist[i], nnodes_reserve, nnodes_reserve);
+      workspace.add("ind_set_size", ind_set_size[i], ind_set_size[i].size());
+    }
+    workspace.add("GlobalActiveSet", GlobalActiveSet, GlobalActiveSet.size());
+    for(size_t t=0;t<ind_sets.size();t++)
+      workspace.add("ind_sets", ind_sets[t], ind_sets[t].size());
+    workspace.add("range_indexer", range_indexer, range_indexer.size());
+    workspace.add("newElements", newElements, newElements.size());
+    workspace.add("newBoundaries", newBoundaries, newBoundaries.size());
+    workspace.add("marked_edges", marked_edges, marked_edges.size());
+    workspace.add("quality", quality, quality.size());
+    def_ops->memory_report(workspace);
+    report.add("swap/", workspace);
+  }
+
  private:
+  template<typename _real_t, int _dim> friend class KernelBenchmark;
 
-  void swap2d(real_t quality_tolerance){
+  /// Swap edges in 2D, returning the number of flips.
+  size_t swap2d(real_t quality_tolerance){
     size_t NNodes = _mesh->get_number_nodes();
     size_t NElements = _mesh->get_number_elements();
 
@@ -157,12 +193,15 @@ template<typename real_t, int dim> class Swapping{
       marked_edges.resize(NNodes);
     }
 
+    size_t nflips=0;
 #pragma omp parallel
     {
       const int tid = pragmatic_thread_id();
+      PRAGMATIC_PHASE_BEGIN(phase, "swap/quality");
 
       // Thread-private array of forbidden colours
       std::vector<index_t> forbiddenColours(max_colour, std::numeric_limits<index_t>::max());
+      size_t flips=0;
 
 #pragma omp single nowait
       memset(node_colour, 0, NNodes*sizeof(int));
@@ -176,7 +215,7 @@ template<typename real_t, int dim> class Swapping{
 
       // Cache the element quality's. Really need to make this
       // persistent within Mesh. Also, initialise marked_edges.
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
       for(size_t i=0; i<NElements; ++i){
         const int *n=_mesh->get_element(i);
         if(n[0]>=0){
@@ -202,7 +241,7 @@ template<typename real_t, int dim> class Swapping{
         }
       }
 
-#pragma omp for schedule(guided)
+#pragma omp for schedule(runtime)
       for(int vtid=0; vtid<defOp_scaling_factor*nthreads; ++vtid){
         for(int i=0; i<nthreads; ++i){
           def_ops->commit_swapping_propagation(marked_edges, i, vtid);
@@ -227,11 +266,14 @@ template<typename real_t, int dim> class Swapping{
           for(int i=0; i<max_colour; ++i)
             ind_set_size[next_rnd][i] = 0;
           GlobalActiveSet_size[next_rnd] = 0;
+
+          PRAGMATIC_COUNT(PROFILE_COLOUR_ROUNDS, 1);
         }
 
         // Colour the active sub-mesh
+        PRAGMATIC_PHASE(phase, "swap/colour");
         std::vector<index_t> local_coloured;
-#pragma omp for schedule(guided) nowait
+#pragma omp for schedule(runtime) nowait
         for(size_t i=0; i<NNodes; ++i){
           if(marked_edges[i].size()>0){
             /*
@@ -263,7 +305,7 @@ template<typename real_t, int dim> class Swapping{
           memcpy(&GlobalActiveSet[pos], &local_coloured[0], local_coloured.size() * sizeof(index_t));
         }
 
-#pragma omp barrier
+        PRAGMATIC_BARRIER();
         if(GlobalActiveSet_size[rnd]>0){
           // Continue colouring and swapping
           for(int set_no=0; set_no<max_colour; ++set_no){
@@ -274,7 +316,7 @@ template<typename real_t, int dim> class Swapping{
 
           std::vector<index_t> conflicts;
 
-#pragma omp for schedule(guided) nowait
+#pragma omp for schedule(runtime) nowait
           for(size_t i=0; i<GlobalActiveSet_size[rnd]; ++i){
             bool defective = false;
             index_t n = GlobalActiveSet[i];
@@ -312,18 +354,19 @@ template<typename real_t, int dim> class Swapping{
             }
           }
 
+          PRAGMATIC_COUNT(PROFILE_COLOUR_CONFLICTS, conflicts.size());
           size_t pos;
           pos = pragmatic_omp_atomic_capture(&worklist_size[0], conflicts.size());
 
           memcpy(&worklist[0][pos], &conflicts[0], conflicts.size() * sizeof(index_t));
 
           conflicts.clear();
-#pragma omp barrier
+          PRAGMATIC_BARRIER();
 
           int wl = 0;
 
           while(worklist_size[wl]){
-#pragma omp for schedule(guided) nowait
+#pragma omp for schedule(runtime) nowait
             for(size_t item=0; item<worklist_size[wl]; ++item){
               index_t n = worklist[wl][item];
               bool defective = false;
@@ -364,6 +407,7 @@ template<typename real_t, int dim> class Swapping{
             // Switch worklist
             wl = (wl+1)%3;
 
+            PRAGMATIC_COUNT(PROFILE_COLOUR_CONFLICTS, conflicts.size());
             size_t pos = pragmatic_omp_atomic_capture(&worklist_size[wl], conflicts.size());
 
             memcpy(&worklist[wl][pos], &conflicts[0], conflicts.size() * sizeof(index_t));
@@ -384,7 +428,7 @@ template<typename real_t, int dim> class Swapping{
             }
           }
 
-#pragma omp barrier
+          PRAGMATIC_BARRIER();
 
           for(int set_no=0; set_no<max_colour; ++set_no){
             if(ind_set_size[rnd][set_no] == 0)
@@ -398,7 +442,8 @@ template<typename real_t, int dim> class Swapping{
             }
             std::sort(range.begin(), range.end(), pragmatic_range_element_comparator);
 
-#pragma omp for schedule(guided)
+            PRAGMATIC_PHASE(phase, "swap/flip");
+#pragma omp for schedule(runtime) nowait
             for(size_t idx=0; idx<ind_set_size[rnd][set_no]; ++idx){
               // Find which vertex corresponds to idx.
               index_t i = -1;
@@ -438,6 +483,7 @@ template<typename real_t, int dim> class Swapping{
 
                 // If edge was swapped
                 if(edge.edge.first != i){
+                  flips++;
                   index_t k = edge.edge.first;
                   index_t l = edge.edge.second;
                   // Uncolour one of the lateral vertices if their colours clash.
@@ -455,9 +501,11 @@ template<typename real_t, int dim> class Swapping{
 
               marked_edges[i].swap(marked_edges_new);
             }
+            PRAGMATIC_BARRIER();
 
             // Commit deferred operations
-#pragma omp for schedule(guided)
+            PRAGMATIC_PHASE(phase, "swap/commit");
+#pragma omp for schedule(runtime) nowait
             for(int vtid=0; vtid<defOp_scaling_factor*nthreads; ++vtid){
               for(int i=0; i<nthreads; ++i){
                 def_ops->commit_remNN(i, vtid);
@@ -468,13 +516,21 @@ template<typename real_t, int dim> class Swapping{
                 def_ops->commit_colour_reset(node_colour, i, vtid);
               }
             }
+            PRAGMATIC_BARRIER();
           }
         }
       }while(GlobalActiveSet_size[rnd]>0);
+
+      PRAGMATIC_COUNT(PROFILE_FLIPS, flips);
+#pragma omp atomic
+      nflips += flips;
     }
+
+    return nflips;
   }
 
-  void swap3d(real_t Q_min){
+  /// Swap edges and faces in 3D, returning the number of flips.
+  size_t swap3d(real_t Q_min){
     // Cache the element quality's.
     size_t NElements = _mesh->get_number_elements();
     std::vector<real_t> quality(NElements, -1);
@@ -545,7 +601,9 @@ template<typename real_t, int dim> class Swapping{
     }
 
     if(partialEEList.empty())
-      return;
+      return 0;
+
+    size_t flips=0;
 
     // Colour the graph and choose the maximal independent set.
     std::map<int , std::set<int> > graph;
@@ -706,6 +764,7 @@ template<typename real_t, int dim> class Swapping{
 
               _mesh->erase_element(eid0);
               _mesh->erase_element(eid1);
+              flips++;
 
               int e0[] = {hull[0], hull[1], hull[4], hull[3]};
               int b0[] = {0, 0, eid0_b2, eid1_b2};
@@ -1380,6 +1439,7 @@ template<typename real_t, int dim> class Swapping{
                 }
               }
 
+              flips++;
               swapped = true;
               break;
             }
@@ -1388,7 +1448,9 @@ template<typename real_t, int dim> class Swapping{
       }
     }
 
-    return;
+    PRAGMATIC_COUNT(PROFILE_FLIPS, flips);
+
+    return flips;
   }
 
   void swap_kernel2d(Edge<index_t>& edge, std::set<index_t>& modified_elements, size_t tid){
@@ -1527,7 +1589,7 @@ template<typename real_t, int dim> class Swapping{
 
   // Colouring
   int *node_colour;
-  static const int max_colour = (dim==2?16:64);
+  int max_colour;
   std::vector<index_t> GlobalActiveSet;
   size_t GlobalActiveSet_size[3];
   std::vector<size_t> ind_set_size[3];
@@ -1543,7 +1605,7 @@ template<typename real_t, int dim> class Swapping{
   static const size_t msize=(dim==2?3:6);
 
   DeferredOperations<real_t>* def_ops;
-  static const int defOp_scaling_factor = 32;
+  int defOp_scaling_factor;
 
   std::vector< std::vector<index_t> > newElements;
   std::vector< std::vector<int> > newBoundaries;
@@ -0,0 +1,606 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef VTUWRITER_H
+#define VTUWRITER_H
+
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "Mesh.h"
+#include "MetricTensor.h"
+#include "ElementProperty.h"
+
+/*! \brief Writes VTK XML unstructured grid files (.vtu/.pvtu) without
+ * going through VTK.
+ *
+ * Unlike VTKTools::export_vtu, no copy of the mesh is built: each
+ * array is generated, encoded and written to the file in turn, so
+ * peak memory overhead is that of the largest single array. Data are
+ * written in VTK's binary formats, either raw in an appended section
+ * or base64-encoded inline, optionally zlib compressed in independent
+ * blocks. Encoding and compression run in parallel with OpenMP.
+ * Diagnostic fields are only written on request.
+ *
+ * In parallel, every process writes its own piece, basename_<rank>.vtu,
+ * and process 0 also writes basename.pvtu.
+ */
+template<typename real_t> class VTUWriter{
+ public:
+  /// Optional fields, combined as a bit mask.
+  enum {METRIC=1, QUALITY=2, EDGE_LENGTH=4, BOUNDARY=8, NUMBERING=16, ALL_FIELDS=31};
+
+  /// Encoding of the binary data.
+  enum Encoding {APPENDED_RAW, BASE64};
+
+  /*! Write mesh to a .vtu file, or to .vtu pieces and a .pvtu file in parallel.
+   *
+   * @param basename file name without extension.
+   * @param mesh the mesh.
+   * @param psi optional vertex field.
+   * @param fields bit mask of the optional fields to write.
+   * @param encoding how binary data is written.
+   * @param compress zlib-compress the data (requires HAVE_ZLIB).
+   * @return true on success.
+   */
+  static bool export_vtu(const char *basename, const Mesh<real_t> *mesh, const real_t *psi=NULL,
+                         int fields=0, Encoding encoding=APPENDED_RAW, bool compress=false){
+#ifndef HAVE_ZLIB
+    if(compress){
+      std::cerr<<"WARNING: PRAgMaTIc was built without zlib; writing uncompressed VTU.\n";
+      compress = false;
+    }
+#endif
+
+    Piece piece(mesh, psi, fields);
+
+    int rank = mesh->rank;
+    int nparts = mesh->num_processes;
+
+    std::string filename = std::string(basename);
+    if(nparts>1)
+      filename += "_"+to_string(rank);
+    filename += ".vtu";
+
+    bool ok = write_piece(filename, piece, encoding, compress);
+
+    if(nparts>1 && rank==0)
+      ok = write_pvtu(basename, piece, nparts, compress) && ok;
+
+    return ok;
+  }
+
+ private:
+  // Block size (bytes, before compression) of compressed data.
+  static const size_t BLOCK_SIZE = 32768;
+
+  // Sections of the piece an array belongs to.
+  enum {POINT_DATA=0, CELL_DATA, POINTS, CELLS, NSECTIONS};
+
+  // Arrays which may be written.
+  enum {PSI=0, NID, GLOBAL_ID, METRIC_TENSOR, MEAN_EDGE_LENGTH, MAX_DESIRED_LENGTH, MIN_DESIRED_LENGTH,
+        EID, ELEMENT_QUALITY, ELEMENT_BOUNDARY, GHOST_LEVELS,
+        COORDINATES, CONNECTIVITY, OFFSETS, TYPES};
+
+  struct DataArray{
+    int id, section, ncomps;
+    std::string name, type;
+
+    DataArray(int _id, int _section, const std::string &_name, const std::string &_type, int _ncomps) :
+      id(_id), section(_section), ncomps(_ncomps), name(_name), type(_type){}
+  };
+
+  /*! The arrays of one piece. The list of arrays is set up front; the
+   * contents of each array are only generated by get_data() when it is
+   * about to be written.
+   */
+  class Piece{
+   public:
+    Piece(const Mesh<real_t> *_mesh, const real_t *_psi, int fields) : mesh(_mesh), psi(_psi){
+      ndims = mesh->get_number_dimensions();
+      nloc = ndims+1;
+      NNodes = mesh->get_number_nodes();
+
+      // Only active elements are written.
+      size_t NElements = mesh->get_number_elements();
+      for(size_t i=0;i<NElements;i++)
+        if(mesh->get_element(i)[0]>=0)
+          elements.push_back(i);
+
+      const char *real_type = sizeof(real_t)==8?"Float64":"Float32";
+      const char *index_type = sizeof(index_t)==8?"Int64":"Int32";
+      bool parallel = mesh->num_processes>1;
+
+      if(psi!=NULL)
+        arrays.push_back(DataArray(PSI, POINT_DATA, "psi", real_type, 1));
+      if(fields&NUMBERING){
+        arrays.push_back(DataArray(NID, POINT_DATA, "nid", index_type, 1));
+        if(parallel)
+          arrays.push_back(DataArray(GLOBAL_ID, POINT_DATA, "GlobalId", "Int64", 1));
+      }
+      if(fields&METRIC)
+        arrays.push_back(DataArray(METRIC_TENSOR, POINT_DATA, "Metric", "Float64", ndims*ndims));
+      if(fields&EDGE_LENGTH){
+        arrays.push_back(DataArray(MEAN_EDGE_LENGTH, POINT_DATA, "mean_edge_length", "Float64", 1));
+        arrays.push_back(DataArray(MAX_DESIRED_LENGTH, POINT_DATA, "max_desired_edge_length", "Float64", 1));
+        arrays.push_back(DataArray(MIN_DESIRED_LENGTH, POINT_DATA, "min_desired_edge_length", "Float64", 1));
+      }
+
+      if(fields&NUMBERING)
+        arrays.push_back(DataArray(EID, CELL_DATA, "eid", index_type, 1));
+      if(fields&QUALITY)
+        arrays.push_back(DataArray(ELEMENT_QUALITY, CELL_DATA, "quality", "Float64", 1));
+      if((fields&BOUNDARY) && !mesh->boundary.empty())
+        arrays.push_back(DataArray(ELEMENT_BOUNDARY, CELL_DATA, "Boundary", "Int32", nloc));
+      if(parallel)
+        arrays.push_back(DataArray(GHOST_LEVELS, CELL_DATA, "vtkGhostLevels", "UInt8", 1));
+
+      arrays.push_back(DataArray(COORDINATES, POINTS, "Points", real_type, 3));
+
+      arrays.push_back(DataArray(CONNECTIVITY, CELLS, "connectivity", index_type, 1));
+      arrays.push_back(DataArray(OFFSETS, CELLS, "offsets", "Int64", 1));
+      arrays.push_back(DataArray(TYPES, CELLS, "types", "UInt8", 1));
+    }
+
+    /*! Generate the contents of an array. The first header_size bytes
+     * of the buffer are left free for the encoder.
+     */
+    void get_data(int id, size_t header_size, std::vector<char> &buffer) const{
+      buffer.clear();
+      switch(id){
+      case PSI:
+        fill<real_t>(buffer, header_size, NNodes);
+        copy(psi, NNodes, buffer, header_size);
+        break;
+      case NID:{
+        index_t *nid = fill<index_t>(buffer, header_size, NNodes);
+#pragma omp parallel for schedule(static)
+        for(size_t i=0;i<NNodes;i++)
+          nid[i] = i;
+        break;}
+      case GLOBAL_ID:{
+        int64_t *gnn = fill<int64_t>(buffer, header_size, NNodes);
+#pragma omp parallel for schedule(static)
+        for(size_t i=0;i<NNodes;i++)
+          gnn[i] = mesh->lnn2gnn[i];
+        break;}
+      case METRIC_TENSOR:{
+        double *M = fill<double>(buffer, header_size, NNodes*ndims*ndims);
+#pragma omp parallel for schedule(static)
+        for(size_t i=0;i<NNodes;i++){
+          const double *m = mesh->get_metric(i);
+          if(ndims==2){
+            double tensor[] = {m[0], m[1],
+                               m[1], m[2]};
+            memcpy(M+i*4, tensor, 4*sizeof(double));
+          }else{
+            double tensor[] = {m[0], m[1], m[2],
+                               m[1], m[3], m[4],
+                               m[2], m[4], m[5]};
+            memcpy(M+i*9, tensor, 9*sizeof(double));
+          }
+        }
+        break;}
+      case MEAN_EDGE_LENGTH:{
+        double *length = fill<double>(buffer, header_size, NNodes);
+#pragma omp parallel for schedule(static)
+        for(size_t i=0;i<NNodes;i++){
+          length[i] = 0;
+          for(typename std::vector<index_t>::const_iterator it=mesh->NNList[i].begin();it!=mesh->NNList[i].end();++it)
+            length[i] += mesh->calc_edge_length(i, *it);
+          if(!mesh->NNList[i].empty())
+            length[i] /= mesh->NNList[i].size();
+        }
+        break;}
+      case MAX_DESIRED_LENGTH:
+      case MIN_DESIRED_LENGTH:{
+        double *length = fill<double>(buffer, header_size, NNodes);
+#pragma omp parallel for schedule(static)
+        for(size_t i=0;i<NNodes;i++){
+          if(mesh->NNList[i].empty()){
+            length[i] = (id==MAX_DESIRED_LENGTH)?0:DBL_MAX;
+          }else if(ndims==2){
+            MetricTensor<double,2> M(mesh->get_metric(i));
+            length[i] = (id==MAX_DESIRED_LENGTH)?M.max_length():M.min_length();
+          }else{
+            MetricTensor<double,3> M(mesh->get_metric(i));
+            length[i] = (id==MAX_DESIRED_LENGTH)?M.max_length():M.min_length();
+          }
+        }
+        break;}
+      case EID:
+        fill<index_t>(buffer, header_size, elements.size());
+        copy(elements.data(), elements.size(), buffer, header_size);
+        break;
+      case ELEMENT_QUALITY:{
+        double *quality = fill<double>(buffer, header_size, elements.size());
+        ElementProperty<real_t> *property = mesh->property;
+#pragma omp parallel for schedule(static)
+        for(size_t i=0;i<elements.size();i++){
+          const index_t *n = mesh->get_element(elements[i]);
+          if(ndims==2)
+            quality[i] = property->lipnikov(mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2]),
+                                            mesh->get_metric(n[0]), mesh->get_metric(n[1]), mesh->get_metric(n[2]));
+          else
+            quality[i] = property->lipnikov(mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2]), mesh->get_coords(n[3]),
+                                            mesh->get_metric(n[0]), mesh->get_metric(n[1]), mesh->get_metric(n[2]), mesh->get_metric(n[3]));
+        }
+        break;}
+      case ELEMENT_BOUNDARY:{
+        int32_t *boundary = fill<int32_t>(buffer, header_size, elements.size()*nloc);
+#pragma omp parallel for schedule(static)
+        for(size_t i=0;i<elements.size();i++)
+          for(size_t j=0;j<nloc;j++)
+            boundary[i*nloc+j] = mesh->boundary[elements[i]*nloc+j];
+        break;}
+      case GHOST_LEVELS:{
+        uint8_t *ghost = fill<uint8_t>(buffer, header_size, elements.size());
+#pragma omp parallel for schedule(static)
+        for(size_t i=0;i<elements.size();i++){
+          const index_t *n = mesh->get_element(elements[i]);
+          int owner = mesh->node_owner[n[0]];
+          for(size_t j=1;j<nloc;j++)
+            owner = std::min(owner, mesh->node_owner[n[j]]);
+          ghost[i] = (owner==mesh->rank)?0:1;
+        }
+        break;}
+      case COORDINATES:{
+        real_t *x = fill<real_t>(buffer, header_size, NNodes*3);
+#pragma omp parallel for schedule(static)
+        for(size_t i=0;i<NNodes;i++){
+          const real_t *r = mesh->get_coords(i);
+          x[i*3  ] = r[0];
+          x[i*3+1] = r[1];
+          x[i*3+2] = (ndims==2)?0.0:r[2];
+        }
+        break;}
+      case CONNECTIVITY:{
+        index_t *ENList = fill<index_t>(buffer, header_size, elements.size()*nloc);
+#pragma omp parallel for schedule(static)
+        for(size_t i=0;i<elements.size();i++)
+          memcpy(ENList+i*nloc, mesh->get_element(elements[i]), nloc*sizeof(index_t));
+        break;}
+      case OFFSETS:{
+        int64_t *offsets = fill<int64_t>(buffer, header_size, elements.size());
+#pragma omp parallel for schedule(static)
+        for(size_t i=0;i<elements.size();i++)
+          offsets[i] = (i+1)*nloc;
+        break;}
+      case TYPES:{
+        uint8_t *types = fill<uint8_t>(buffer, header_size, elements.size());
+        // VTK_TRIANGLE=5, VTK_TETRA=10
+        memset(types, ndims==2?5:10, elements.size());
+        break;}
+      }
+    }
+
+    size_t get_number_nodes() const{
+      return NNodes;
+    }
+
+    size_t get_number_elements() const{
+      return elements.size();
+    }
+
+    /// Attribute marking the global node numbers, if they are written.
+    const char *global_ids() const{
+      for(size_t i=0;i<arrays.size();i++)
+        if(arrays[i].id==GLOBAL_ID)
+          return " GlobalIds=\"GlobalId\"";
+      return "";
+    }
+
+    std::vector<DataArray> arrays;
+
+   private:
+    template<typename T>
+      static T *fill(std::vector<char> &buffer, size_t header_size, size_t n){
+      buffer.resize(header_size+n*sizeof(T));
+      return (T *)(&(buffer[0])+header_size);
+    }
+
+    template<typename T>
+      static void copy(const T *src, size_t n, std::vector<char> &buffer, size_t header_size){
+      if(n>0)
+        memcpy(&(buffer[0])+header_size, src, n*sizeof(T));
+    }
+
+    const Mesh<real_t> *mesh;
+    const real_t *psi;
+    size_t ndims, nloc, NNodes;
+    std::vector<index_t> elements;
+  };
+
+  static std::string to_string(size_t i){
+    char buffer[32];
+    snprintf(buffer, 32, "%lu", (unsigned long)i);
+    return std::string(buffer);
+  }
+
+  static const char *byte_order(){
+    const uint16_t one = 1;
+    return (*(const char *)&one)?"LittleEndian":"BigEndian";
+  }
+
+  static std::string file_header(const char *type, bool compress){
+    std::string header = std::string("<?xml version=\"1.0\"?>\n<VTKFile type=\"")+type+
+      "\" version=\"1.0\" byte_order=\""+byte_order()+"\" header_type=\"UInt64\"";
+    if(compress)
+      header += " compressor=\"vtkZLibDataCompressor\"";
+    return header+">\n";
+  }
+
+  static std::string array_tag(const char *tag, const DataArray &array, const char *format){
+    std::string xml = std::string("<")+tag+" type=\""+array.type+"\" Name=\""+array.name+
+      "\" NumberOfComponents=\""+to_string(array.ncomps)+"\"";
+    if(format!=NULL)
+      xml += std::string(" format=\"")+format+"\"";
+    return xml;
+  }
+
+  /*! Encode the array in buffer (which starts with 8 free bytes) in VTK's
+   * binary layout: a UInt64 size header followed by the data, or, when
+   * compressed, a header of block sizes followed by the compressed blocks.
+   * The result is appended to out, base64-encoded if requested.
+   */
+  static void encode(std::vector<char> &buffer, bool base64, bool compress, std::string &out){
+    size_t nbytes = buffer.size()-sizeof(uint64_t);
+
+    if(!compress){
+      uint64_t header = nbytes;
+      memcpy(&(buffer[0]), &header, sizeof(uint64_t));
+      if(base64)
+        base64_encode(&(buffer[0]), buffer.size(), out);
+      else
+        out.append(&(buffer[0]), buffer.size());
+      return;
+    }
+
+#ifdef HAVE_ZLIB
+    const char *data = &(buffer[0])+sizeof(uint64_t);
+    size_t nblocks = (nbytes+BLOCK_SIZE-1)/BLOCK_SIZE;
+    std::vector<uint64_t> header(3+nblocks);
+    header[0] = nblocks;
+    header[1] = BLOCK_SIZE;
+    header[2] = (nblocks>0 && nbytes%BLOCK_SIZE)?nbytes%BLOCK_SIZE:BLOCK_SIZE;
+
+    // Blocks are compressed independently, so they can be compressed in parallel.
+    std::vector< std::vector<Bytef> > blocks(nblocks);
+#pragma omp parallel for schedule(dynamic)
+    for(size_t i=0;i<nblocks;i++){
+      size_t size = std::min(BLOCK_SIZE, nbytes-i*BLOCK_SIZE);
+      uLongf csize = compressBound(size);
+      blocks[i].resize(csize);
+      compress2(&(blocks[i][0]), &csize, (const Bytef *)data+i*BLOCK_SIZE, size, Z_DEFAULT_COMPRESSION);
+      blocks[i].resize(csize);
+      header[3+i] = csize;
+    }
+    std::vector<char>().swap(buffer);
+
+    std::string compressed;
+    for(size_t i=0;i<nblocks;i++)
+      compressed.append((const char *)&(blocks[i][0]), blocks[i].size());
+    std::vector< std::vector<Bytef> >().swap(blocks);
+
+    // The header and the data are base64-encoded separately.
+    if(base64){
+      base64_encode((const char *)&(header[0]), header.size()*sizeof(uint64_t), out);
+      base64_encode(compressed.data(), compressed.size(), out);
+    }else{
+      out.append((const char *)&(header[0]), header.size()*sizeof(uint64_t));
+      out.append(compressed);
+    }
+#endif
+  }
+
+  /// Append the base64 encoding of in to out. Chunks are encoded in parallel.
+  static void base64_encode(const char *in, size_t n, std::string &out){
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    size_t pos = out.size();
+    out.resize(pos+4*((n+2)/3));
+    char *o = &(out[0])+pos;
+    const unsigned char *u = (const unsigned char *)in;
+
+    // Every chunk but the last is a whole number of 3-byte groups.
+    const size_t chunk = 3*4096;
+    size_t nchunks = (n+chunk-1)/chunk;
+#pragma omp parallel for schedule(static)
+    for(size_t c=0;c<nchunks;c++){
+      size_t begin = c*chunk;
+      size_t end = std::min(n, begin+chunk);
+      char *dst = o+(begin/3)*4;
+      size_t i=begin;
+      for(;i+3<=end;i+=3){
+        uint32_t v = (u[i]<<16)|(u[i+1]<<8)|u[i+2];
+        *dst++ = table[(v>>18)&63];
+        *dst++ = table[(v>>12)&63];
+        *dst++ = table[(v>>6)&63];
+        *dst++ = table[v&63];
+      }
+      if(i<end){
+        uint32_t v = u[i]<<16;
+        if(i+1<end)
+          v |= u[i+1]<<8;
+        *dst++ = table[(v>>18)&63];
+        *dst++ = table[(v>>12)&63];
+        *dst++ = (i+1<end)?table[(v>>6)&63]:'=';
+        *dst++ = '=';
+      }
+    }
+  }
+
+  static bool write_piece(const std::string &filename, const Piece &piece, Encoding encoding, bool compress){
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if(fp==NULL){
+      std::cerr<<"ERROR: Cannot open "<<filename<<" for writing.\n";
+      return false;
+    }
+
+    static const char *section_tags[] = {"PointData", "CellData", "Points", "Cells"};
+    bool base64 = (encoding==BASE64);
+
+    std::string xml = file_header("UnstructuredGrid", compress)+"<UnstructuredGrid>\n<Piece NumberOfPoints=\""+
+      to_string(piece.get_number_nodes())+"\" NumberOfCells=\""+to_string(piece.get_number_elements())+"\">\n";
+    bool ok = fputs(xml.c_str(), fp)>=0;
+
+    // In appended mode, the offsets into the appended data are only known
+    // once the data are encoded. Fixed-width placeholders are written and
+    // patched at the end.
+    const int width = 20;
+    std::vector<long> placeholders;
+
+    std::vector<char> buffer;
+    std::string encoded;
+    for(int s=0;ok && s<NSECTIONS;s++){
+      bool open = false;
+      for(size_t i=0;ok && i<piece.arrays.size();i++){
+        const DataArray &array = piece.arrays[i];
+        if(array.section!=s)
+          continue;
+
+        if(!open){
+          fprintf(fp, "<%s%s>\n", section_tags[s], s==POINT_DATA?piece.global_ids():"");
+          open = true;
+        }
+
+        if(base64){
+          xml = array_tag("DataArray", array, "binary")+">\n";
+          ok = fputs(xml.c_str(), fp)>=0;
+
+          piece.get_data(array.id, sizeof(uint64_t), buffer);
+          encoded.clear();
+          encode(buffer, true, compress, encoded);
+          ok = ok && fwrite(encoded.data(), 1, encoded.size(), fp)==encoded.size();
+
+          ok = ok && fputs("\n</DataArray>\n", fp)>=0;
+        }else{
+          xml = array_tag("DataArray", array, "appended")+" offset=\"";
+          fputs(xml.c_str(), fp);
+          placeholders.push_back(ftell(fp));
+          fprintf(fp, "%0*d\"/>\n", width, 0);
+        }
+      }
+      if(open)
+        fprintf(fp, "</%s>\n", section_tags[s]);
+    }
+    fputs("</Piece>\n</UnstructuredGrid>\n", fp);
+
+    if(!base64 && ok){
+      fputs("<AppendedData encoding=\"raw\">\n_", fp);
+
+      std::vector<uint64_t> offsets;
+      uint64_t offset = 0;
+      for(int s=0;ok && s<NSECTIONS;s++){
+        for(size_t i=0;ok && i<piece.arrays.size();i++){
+          if(piece.arrays[i].section!=s)
+            continue;
+
+          piece.get_data(piece.arrays[i].id, sizeof(uint64_t), buffer);
+          encoded.clear();
+          encode(buffer, false, compress, encoded);
+          ok = fwrite(encoded.data(), 1, encoded.size(), fp)==encoded.size();
+
+          offsets.push_back(offset);
+          offset += encoded.size();
+        }
+      }
+      fputs("\n</AppendedData>\n", fp);
+
+      for(size_t i=0;ok && i<placeholders.size();i++){
+        ok = fseek(fp, placeholders[i], SEEK_SET)==0;
+        fprintf(fp, "%0*lu", width, (unsigned long)offsets[i]);
+      }
+      fseek(fp, 0, SEEK_END);
+    }
+    fputs("</VTKFile>\n", fp);
+
+    ok = (fclose(fp)==0) && ok;
+    if(!ok)
+      std::cerr<<"ERROR: Failed to write "<<filename<<".\n";
+
+    return ok;
+  }
+
+  static bool write_pvtu(const char *basename, const Piece &piece, int nparts, bool compress){
+    std::string filename = std::string(basename)+".pvtu";
+    FILE *fp = fopen(filename.c_str(), "w");
+    if(fp==NULL){
+      std::cerr<<"ERROR: Cannot open "<<filename<<" for writing.\n";
+      return false;
+    }
+
+    static const char *section_tags[] = {"PPointData", "PCellData", "PPoints", "PCells"};
+
+    std::string xml = file_header("PUnstructuredGrid", compress)+"<PUnstructuredGrid GhostLevel=\"1\">\n";
+    for(int s=0;s<CELLS;s++){
+      xml += std::string("<")+section_tags[s]+(s==POINT_DATA?piece.global_ids():"")+">\n";
+      for(size_t i=0;i<piece.arrays.size();i++)
+        if(piece.arrays[i].section==s)
+          xml += array_tag("PDataArray", piece.arrays[i], NULL)+"/>\n";
+      xml += std::string("</")+section_tags[s]+">\n";
+    }
+
+    // Pieces are referenced relative to the .pvtu file.
+    std::string name(basename);
+    size_t slash = name.find_last_of('/');
+    if(slash!=std::string::npos)
+      name = name.substr(slash+1);
+    for(int i=0;i<nparts;i++)
+      xml += "<Piece Source=\""+name+"_"+to_string(i)+".vtu\"/>\n";
+    xml += "</PUnstructuredGrid>\n</VTKFile>\n";
+
+    bool ok = fputs(xml.c_str(), fp)>=0;
+    ok = (fclose(fp)==0) && ok;
+    if(!ok)
+      std::cerr<<"ERROR: Failed to write "<<filename<<".\n";
+
+    return ok;
+  }
+};
+
+#endif
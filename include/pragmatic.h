@@ -35,6 +35,9 @@
  *  SUCH DAMAGE.
  */
 
+#ifndef PRAGMATIC_H
+#define PRAGMATIC_H
+
 /*! \mainpage Parallel anisotRopic Adaptive Mesh ToolkIt
  *
  * PRAgMaTIc provides 2D/3D anisotropic mesh adaptivity for meshes of
@@ -50,20 +53,100 @@
  * \li Bleeding edge developer site on <a href="https://launchpad.net/pragmatic">Launchpad</a>.
  */
 
+#ifdef __cplusplus
 extern "C" {
-  void pragmatic_2d_begin(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y);
-  void pragmatic_3d_begin(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y, const double *z);
-  void pragmatic_vtk_begin(const char *filename);
-  void pragmatic_add_field(const double *psi, const double *error);
-  void pragmatic_set_metric(const double *metric, const double *min_length, const double *max_length);
+#endif
+  /// Opaque handle to a mesh being adapted.
+  typedef struct pragmatic_mesh pragmatic_mesh_t;
+
+  pragmatic_mesh_t *pragmatic_mesh_create_2d(int NNodes, int NElements, const int *enlist, const double *x, const double *y);
+  pragmatic_mesh_t *pragmatic_mesh_create_3d(int NNodes, int NElements, const int *enlist, const double *x, const double *y, const double *z);
+  pragmatic_mesh_t *pragmatic_mesh_create_interleaved(int dim, int NNodes, int NElements, const int *enlist, const double *coords);
+  void pragmatic_mesh_destroy(pragmatic_mesh_t *handle);
+  void pragmatic_mesh_add_field(pragmatic_mesh_t *handle, const double *psi, double error, int pnorm);
+  void pragmatic_mesh_set_metric(pragmatic_mesh_t *handle, const double *metric);
+  void pragmatic_mesh_add_hessian(pragmatic_mesh_t *handle, const double *hessian, double error, int pnorm);
+  int pragmatic_mesh_constrain_metric(pragmatic_mesh_t *handle, double min_edge_length, double max_edge_length, double max_aspect_ratio);
+  int pragmatic_mesh_gradate_metric(pragmatic_mesh_t *handle, double gradation);
+  void pragmatic_mesh_set_boundary(pragmatic_mesh_t *handle, int nfacets, const int *facets, const int *ids);
+  void pragmatic_mesh_adapt(pragmatic_mesh_t *handle);
+  void pragmatic_mesh_adapt_batch(int n, pragmatic_mesh_t **handles);
+  void pragmatic_mesh_snapshot(pragmatic_mesh_t *handle);
+  int pragmatic_mesh_interpolate(pragmatic_mesh_t *handle, int nfields, const double *old_fields, double *new_fields);
+  void pragmatic_mesh_get_info(const pragmatic_mesh_t *handle, int *NNodes, int *NElements);
+  void pragmatic_mesh_get_coords_2d(const pragmatic_mesh_t *handle, double *x, double *y);
+  void pragmatic_mesh_get_coords_3d(const pragmatic_mesh_t *handle, double *x, double *y, double *z);
+  void pragmatic_mesh_get_elements(const pragmatic_mesh_t *handle, int *elements);
+  void pragmatic_mesh_get_metric(const pragmatic_mesh_t *handle, double *metric);
+  const double *pragmatic_mesh_get_coords_view(const pragmatic_mesh_t *handle, int *stride);
+  const int *pragmatic_mesh_get_elements_view(const pragmatic_mesh_t *handle, int *stride);
+  const int *pragmatic_mesh_get_boundary_view(const pragmatic_mesh_t *handle, int *stride);
+  const double *pragmatic_mesh_get_metric_view(const pragmatic_mesh_t *handle, int *stride);
+  int pragmatic_mesh_get_quality_histogram(const pragmatic_mesh_t *handle, int nbins, const double *edges, long *counts);
+  int pragmatic_mesh_get_edge_length_histogram(const pragmatic_mesh_t *handle, int nbins, const double *edges, long *counts);
+
+  void pragmatic_metric_eig(int dim, int n, const double *tensors, double *eigenvalues, double *eigenvectors);
+  int pragmatic_metric_map(int dim, int n, const double *tensors, const char *op, double *result);
+
+  /// Number of hardware counters in pragmatic_timer_stats_t, see pragmatic_get_hw_counter_name.
+#define PRAGMATIC_NHW_COUNTERS 5
+
+  /// Phase timer, see pragmatic_get_stats.
+  typedef struct pragmatic_timer_stats{
+    char name[64];
+    long calls;
+    double time;     ///< mean over threads
+    double max_time; ///< slowest thread
+    long long hw_counters[PRAGMATIC_NHW_COUNTERS]; ///< summed over threads, -1 if not sampled
+    long long memory_growth;  ///< largest growth over a call in bytes
+    long long memory_peak;    ///< largest footprint after a call in bytes
+  } pragmatic_timer_stats_t;
+
+  /// Memory held by one container, see pragmatic_mesh_memory_report.
+  typedef struct pragmatic_memory_stats{
+    char name[64];
+    long long used;
+    long long reserved;
+  } pragmatic_memory_stats_t;
+
+  int pragmatic_get_stats(pragmatic_timer_stats_t *timers, int ntimers, long *counters, int ncounters);
+  const char *pragmatic_get_counter_name(int counter);
+  void pragmatic_reset_stats();
+  int pragmatic_enable_hw_counters();
+  const char *pragmatic_get_hw_counter_name(int counter);
+  void pragmatic_enable_memory_tracking();
+  int pragmatic_mesh_memory_report(const pragmatic_mesh_t *handle, pragmatic_memory_stats_t *entries, int nentries);
+  void pragmatic_start_trace();
+  int pragmatic_write_trace(const char *basename);
+  int pragmatic_enable_autotuning(const char *cache_file);
+  void pragmatic_disable_autotuning();
+
+  // Single-mesh interface.
+  void pragmatic_2d_init(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y);
+  void pragmatic_3d_init(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y, const double *z);
+  void pragmatic_init_interleaved(const int *dim, const int *NNodes, const int *NElements, const int *enlist, const double *coords);
+  void pragmatic_vtk_init(const char *filename);
+  void pragmatic_add_field(const double *psi, const double *error, int *pnorm);
+  void pragmatic_set_metric(const double *metric);
+  void pragmatic_set_boundary(const int *nfacets, const int *facets, const int *ids);
   void pragmatic_adapt();
-  void pragmatic_get_info(int *NNodes, int *NElements, int *NSElements);
+  void pragmatic_snapshot();
+  int pragmatic_interpolate(const int *nfields, const double *old_fields, double *new_fields);
+  void pragmatic_get_info(int *NNodes, int *NElements);
   void pragmatic_get_coords_2d(double *x, double *y);
   void pragmatic_get_coords_3d(double *x, double *y, double *z);
   void pragmatic_get_elements(int *elements);
-  void pragmatic_get_facets(int *facets);
-  void pragmatic_get_lnn2gnn(int *nodes_per_partition, int *lnn2gnn);
   void pragmatic_get_metric(double *metric);
+  const double *pragmatic_get_coords_view(int *stride);
+  const int *pragmatic_get_elements_view(int *stride);
+  const int *pragmatic_get_boundary_view(int *stride);
+  const double *pragmatic_get_metric_view(int *stride);
+  int pragmatic_get_quality_histogram(const int *nbins, const double *edges, long *counts);
+  int pragmatic_get_edge_length_histogram(const int *nbins, const double *edges, long *counts);
   void pragmatic_dump(const char *filename);
-  void pragmatic_end();
+  void pragmatic_finalize();
+#ifdef __cplusplus
 }
+#endif
+
+#endif
@@ -0,0 +1,332 @@
+#!/usr/bin/env python
+
+# Copyright (C) 2010 Imperial College London and others.
+#
+# Please see the AUTHORS file in the main source directory for a
+# full list of copyright holders.
+#
+# Gerard Gorman
+# Applied Modelling and Computation Group
+# Department of Earth Science and Engineering
+# Imperial College London
+#
+# g.gorman@imperial.ac.uk
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+# notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above
+# copyright notice, this list of conditions and the following
+# disclaimer in the documentation and/or other materials provided
+# with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+# CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+# INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+# BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+# TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+# THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+"""@package pragmatic
+
+Native python interface to PRAgMaTIc. Unlike adaptivity.py this does
+not depend on dolfin: meshes are plain numpy arrays, which are passed
+to and returned from libpragmatic without being copied. The metric
+helpers run in the library, in parallel with OpenMP.
+
+Example:
+
+  import pragmatic
+  mesh = pragmatic.Mesh(coords, elements)
+  mesh.set_boundary(facets, ids)
+  mesh.add_hessian(H, 0.01, p=2)
+  mesh.constrain_metric(min_edge_length=1e-3, max_edge_length=0.2)
+  mesh.gradate(1.5)
+  mesh.snapshot()
+  mesh.adapt()
+  u = mesh.interpolate(u)
+
+When libpragmatic is built with MPI, MPI has to be initialised before
+a Mesh is created; importing mpi4py first does this.
+"""
+
+import os, ctypes, ctypes.util, numpy
+
+__all__ = ["LibraryException",
+           "Mesh",
+           "adapt_batch",
+           "metric_eig",
+           "metric_map",
+           "pack_metric",
+           "unpack_metric"]
+
+class LibraryException(SystemError):
+  pass
+
+def _load_library():
+  name = os.environ.get("PRAGMATIC_LIBRARY")
+  if name is None:
+    name = ctypes.util.find_library("pragmatic")
+  if name is None:
+    name = "libpragmatic.so"
+  try:
+    return ctypes.cdll.LoadLibrary(name)
+  except OSError:
+    raise LibraryException("Failed to load %s, set PRAGMATIC_LIBRARY" % name)
+
+try:
+  from mpi4py import MPI
+except ImportError:
+  pass
+
+_lib = _load_library()
+
+_double_p = numpy.ctypeslib.ndpointer(dtype=numpy.float64, flags="C_CONTIGUOUS")
+_int_p = numpy.ctypeslib.ndpointer(dtype=numpy.intc, flags="C_CONTIGUOUS")
+_handle_t = ctypes.c_void_p
+_c_int_p = ctypes.POINTER(ctypes.c_int)
+
+def _prototype(name, restype, argtypes):
+  f = getattr(_lib, name)
+  f.restype = restype
+  f.argtypes = argtypes
+
+_prototype("pragmatic_mesh_create_interleaved", _handle_t, [ctypes.c_int, ctypes.c_int, ctypes.c_int, _int_p, _double_p])
+_prototype("pragmatic_mesh_destroy", None, [_handle_t])
+_prototype("pragmatic_mesh_add_field", None, [_handle_t, _double_p, ctypes.c_double, ctypes.c_int])
+_prototype("pragmatic_mesh_set_metric", None, [_handle_t, _double_p])
+_prototype("pragmatic_mesh_add_hessian", None, [_handle_t, _double_p, ctypes.c_double, ctypes.c_int])
+_prototype("pragmatic_mesh_constrain_metric", ctypes.c_int, [_handle_t, ctypes.c_double, ctypes.c_double, ctypes.c_double])
+_prototype("pragmatic_mesh_gradate_metric", ctypes.c_int, [_handle_t, ctypes.c_double])
+_prototype("pragmatic_mesh_set_boundary", None, [_handle_t, ctypes.c_int, _int_p, _int_p])
+_prototype("pragmatic_mesh_adapt", None, [_handle_t])
+_prototype("pragmatic_mesh_adapt_batch", None, [ctypes.c_int, ctypes.POINTER(_handle_t)])
+_prototype("pragmatic_mesh_snapshot", None, [_handle_t])
+_prototype("pragmatic_mesh_interpolate", ctypes.c_int, [_handle_t, ctypes.c_int, _double_p, _double_p])
+_prototype("pragmatic_mesh_get_info", None, [_handle_t, _c_int_p, _c_int_p])
+_prototype("pragmatic_mesh_get_coords_view", ctypes.POINTER(ctypes.c_double), [_handle_t, _c_int_p])
+_prototype("pragmatic_mesh_get_elements_view", ctypes.POINTER(ctypes.c_int), [_handle_t, _c_int_p])
+_prototype("pragmatic_mesh_get_boundary_view", ctypes.POINTER(ctypes.c_int), [_handle_t, _c_int_p])
+_prototype("pragmatic_mesh_get_metric_view", ctypes.POINTER(ctypes.c_double), [_handle_t, _c_int_p])
+_prototype("pragmatic_metric_eig", None, [ctypes.c_int, ctypes.c_int, _double_p, _double_p, _double_p])
+_prototype("pragmatic_metric_map", ctypes.c_int, [ctypes.c_int, ctypes.c_int, _double_p, ctypes.c_char_p, _double_p])
+
+def _doubles(a):
+  return numpy.ascontiguousarray(a, dtype=numpy.float64)
+
+def _ints(a):
+  return numpy.ascontiguousarray(a, dtype=numpy.intc)
+
+def _view(ptr, shape, owner):
+  # Wrap library memory without copying it. The array is read-only
+  # since the mesh owns (and may reallocate) the memory. The buffer
+  # under the array holds a reference to the owning Mesh, so the mesh
+  # is not destroyed while the array is in use.
+  if not ptr or shape[0]==0:
+    return numpy.zeros(shape, dtype=ptr._type_)
+  buf = (ptr._type_*(shape[0]*shape[1])).from_address(ctypes.addressof(ptr.contents))
+  buf._owner = owner
+  a = numpy.ctypeslib.as_array(buf).reshape(shape)
+  a.flags.writeable = False
+  return a
+
+def pack_metric(M):
+  """Convert an (n, dim, dim) array of symmetric tensors into the
+  packed (n, 3) or (n, 6) upper triangle format used by libpragmatic."""
+  M = numpy.asarray(M)
+  dim = M.shape[-1]
+  rows, cols = numpy.triu_indices(dim)
+  return _doubles(M[:, rows, cols])
+
+def unpack_metric(m):
+  """Convert packed tensors, see pack_metric, into an (n, dim, dim) array."""
+  m = numpy.asarray(m)
+  dim = 2 if m.shape[-1]==3 else 3
+  rows, cols = numpy.triu_indices(dim)
+  M = numpy.empty((m.shape[0], dim, dim))
+  M[:, rows, cols] = m
+  M[:, cols, rows] = m
+  return M
+
+def _packed(tensors):
+  t = numpy.asarray(tensors)
+  if t.ndim==3:
+    return pack_metric(t)
+  return _doubles(t)
+
+def metric_eig(tensors):
+  """Eigen decomposition of symmetric tensors, e.g. Hessians or
+  metrics, in packed or (n, dim, dim) format. This replaces
+  adaptivity.analytic_eig.
+
+  @return (eigenvalues, eigenvectors) with shapes (n, dim) and (n, dim,
+  dim), where eigenvectors[i, k] is the k'th eigenvector of tensor i.
+  """
+  t = _packed(tensors)
+  n = t.shape[0]
+  dim = 2 if t.shape[1]==3 else 3
+  eigenvalues = numpy.empty((n, dim))
+  eigenvectors = numpy.empty((n, dim, dim))
+  _lib.pragmatic_metric_eig(dim, n, t, eigenvalues, eigenvectors)
+  return eigenvalues, eigenvectors
+
+def metric_map(tensors, op):
+  """Apply a function to the eigenvalues of symmetric positive definite
+  tensors. op is one of "log", "exp", "inv", "sqr", "sqrt", "sqrtinv"
+  and "sqrinv"; metric_map(M, "log") and metric_map(M, "exp") replace
+  adaptivity.logexpmetric.
+
+  @return tensors in packed format.
+  """
+  t = _packed(tensors)
+  dim = 2 if t.shape[1]==3 else 3
+  result = numpy.empty_like(t)
+  if _lib.pragmatic_metric_map(dim, t.shape[0], t, op.encode(), result)!=0:
+    raise ValueError("Unknown metric operation %s" % op)
+  return result
+
+class Mesh(object):
+  """A simplex mesh owned by libpragmatic.
+
+  The coords, elements, boundary and metric properties are read-only
+  views of the library's memory. They are invalidated by adapt(), so
+  fetch them again afterwards rather than holding on to them.
+  """
+
+  def __init__(self, coords, elements):
+    """@param coords (NNodes, dim) node coordinates
+    @param elements (NElements, dim+1) element-node list
+    """
+    coords = _doubles(coords)
+    elements = _ints(elements)
+    self.dim = coords.shape[1]
+    if self.dim not in (2, 3) or elements.shape[1]!=self.dim+1:
+      raise ValueError("Expected 2D triangles or 3D tetrahedra")
+    self._snapshot_nnodes = None
+    self._handle = _lib.pragmatic_mesh_create_interleaved(self.dim, coords.shape[0], elements.shape[0], elements, coords)
+    if not self._handle:
+      raise LibraryException("Failed to create mesh")
+
+  def __del__(self):
+    self.destroy()
+
+  def destroy(self):
+    if getattr(self, "_handle", None):
+      _lib.pragmatic_mesh_destroy(self._handle)
+      self._handle = None
+
+  def get_info(self):
+    """@return (NNodes, NElements)"""
+    NNodes = ctypes.c_int()
+    NElements = ctypes.c_int()
+    _lib.pragmatic_mesh_get_info(self._handle, ctypes.byref(NNodes), ctypes.byref(NElements))
+    return NNodes.value, NElements.value
+
+  @property
+  def coords(self):
+    stride = ctypes.c_int()
+    ptr = _lib.pragmatic_mesh_get_coords_view(self._handle, ctypes.byref(stride))
+    return _view(ptr, (self.get_info()[0], stride.value), self)
+
+  @property
+  def elements(self):
+    stride = ctypes.c_int()
+    ptr = _lib.pragmatic_mesh_get_elements_view(self._handle, ctypes.byref(stride))
+    return _view(ptr, (self.get_info()[1], stride.value), self)
+
+  @property
+  def boundary(self):
+    """Boundary id of each element facet; facet k is opposite node k."""
+    stride = ctypes.c_int()
+    ptr = _lib.pragmatic_mesh_get_boundary_view(self._handle, ctypes.byref(stride))
+    return _view(ptr, (self.get_info()[1], stride.value), self)
+
+  @property
+  def metric(self):
+    """Metric tensors in packed format, see pack_metric."""
+    stride = ctypes.c_int()
+    ptr = _lib.pragmatic_mesh_get_metric_view(self._handle, ctypes.byref(stride))
+    return _view(ptr, (self.get_info()[0], stride.value), self)
+
+  def set_boundary(self, facets, ids):
+    """@param facets (nfacets, dim) boundary facets
+    @param ids boundary id of each facet
+    """
+    facets = _ints(facets)
+    _lib.pragmatic_mesh_set_boundary(self._handle, facets.shape[0], facets, _ints(ids))
+
+  def set_metric(self, M):
+    """@param M metric tensors, packed or (NNodes, dim, dim)"""
+    M = unpack_metric(_packed(M))
+    _lib.pragmatic_mesh_set_metric(self._handle, _doubles(M))
+
+  def add_field(self, psi, error, p=-1):
+    """Add the metric of a node centred field, whose Hessian is
+    recovered by the library.
+
+    @param psi field value at each node
+    @param error target interpolation error
+    @param p p-norm scaling, or -1 for none
+    """
+    _lib.pragmatic_mesh_add_field(self._handle, _doubles(psi), error, p)
+
+  def add_hessian(self, H, error, p=-1):
+    """Add the metric of a field with a known Hessian. With p>0 this
+    replaces adaptivity.metric_pnorm.
+
+    @param H Hessians, packed or (NNodes, dim, dim)
+    @param error target interpolation error
+    @param p p-norm scaling, or -1 for none
+    """
+    H = unpack_metric(_packed(H))
+    _lib.pragmatic_mesh_add_hessian(self._handle, _doubles(H), error, p)
+
+  def constrain_metric(self, min_edge_length=None, max_edge_length=None, max_aspect_ratio=None):
+    """Bound the edge lengths and aspect ratio requested by the metric.
+    A bound which is None is not applied."""
+    bounds = [-1 if b is None else b for b in (min_edge_length, max_edge_length, max_aspect_ratio)]
+    if _lib.pragmatic_mesh_constrain_metric(self._handle, *bounds)!=0:
+      raise RuntimeError("No metric has been set")
+
+  def gradate(self, gradation):
+    """Limit the growth of edge lengths in the metric. This replaces
+    adaptivity.gradate."""
+    if _lib.pragmatic_mesh_gradate_metric(self._handle, gradation)!=0:
+      raise RuntimeError("No metric has been set")
+
+  def snapshot(self):
+    """Keep a copy of the mesh for interpolate(). Call before adapt()."""
+    _lib.pragmatic_mesh_snapshot(self._handle)
+    self._snapshot_nnodes = self.get_info()[0]
+
+  def interpolate(self, fields):
+    """Interpolate node centred fields from the snapshot.
+
+    @param fields (NNodes,) or (NNodes, nfields) values on the snapshot
+    @return values on the current mesh, in the same layout
+    """
+    old = _doubles(fields)
+    if self._snapshot_nnodes is not None and old.shape[0]!=self._snapshot_nnodes:
+      raise ValueError("fields has %d rows but the snapshot has %d nodes" % (old.shape[0], self._snapshot_nnodes))
+    nfields = 1 if old.ndim==1 else old.shape[1]
+    new = numpy.empty((self.get_info()[0],) + old.shape[1:])
+    if _lib.pragmatic_mesh_interpolate(self._handle, nfields, old, new)<0:
+      raise RuntimeError("No snapshot has been taken")
+    return new
+
+  def adapt(self):
+    _lib.pragmatic_mesh_adapt(self._handle)
+
+def adapt_batch(meshes):
+  """Adapt a list of independent meshes concurrently."""
+  handles = (_handle_t*len(meshes))(*[m._handle for m in meshes])
+  _lib.pragmatic_mesh_adapt_batch(len(meshes), handles)
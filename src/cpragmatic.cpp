@@ -36,6 +36,13 @@
  */
 
 #include <cassert>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "Mesh.h"
 #include "MetricField.h"
@@ -43,15 +50,817 @@
 #include "Refine.h"
 #include "Swapping.h"
 #include "Smooth.h"
+#include "FieldTransfer.h"
 
 #include "VTKTools.h"
 
-static void *_pragmatic_mesh=NULL;
-static void *_pragmatic_metric_field=NULL;
+#include "pragmatic.h"
+
+/*! A mesh, its metric field and optionally a snapshot of the mesh for
+ * field transfer. The operators are created for each adapt. Handles
+ * share no state, so distinct handles can be used concurrently from
+ * different threads.
+ */
+struct pragmatic_mesh{
+  Mesh<double> *mesh;
+  void *metric_field;
+  FieldTransfer<double> *snapshot;
+};
+
+// Handle used by the single-mesh interface.
+static pragmatic_mesh_t *_pragmatic_handle=NULL;
+
+static pragmatic_mesh_t *pragmatic_wrap(Mesh<double> *mesh){
+  pragmatic_mesh_t *handle = new pragmatic_mesh_t;
+  handle->mesh = mesh;
+  handle->metric_field = NULL;
+  handle->snapshot = NULL;
+  return handle;
+}
+
+/* Create the metric field of a handle if it does not exist yet.
+ * Returns true if it was created.
+ */
+static bool pragmatic_create_metric_field(pragmatic_mesh_t *handle){
+  if(handle->metric_field!=NULL)
+    return false;
+
+  if(handle->mesh->get_number_dimensions()==2)
+    handle->metric_field = new MetricField<double,2>(*(handle->mesh));
+  else
+    handle->metric_field = new MetricField<double,3>(*(handle->mesh));
+
+  return true;
+}
+
+static void pragmatic_adapt_mesh(Mesh<double> *mesh){
+  PRAGMATIC_TIMER("adapt");
+  const size_t ndims = mesh->get_number_dimensions();
+
+  // See Eqn 7; X Li et al, Comp Methods Appl Mech Engrg 194 (2005) 4915-4950
+  double L_up = sqrt(2.0);
+  double L_low = L_up*0.5;
+
+  if(ndims==2){
+    // The reduction overlaps setting up the operators, which only read
+    // the mesh.
+    MeshStatistics stats;
+    mesh->compute_statistics(stats);
+
+    Coarsen<double, 2> coarsen(*mesh);
+    Smooth<double, 2> smooth(*mesh);
+    Refine<double, 2> refine(*mesh);
+    Swapping<double, 2> swapping(*mesh);
+
+    double L_max = stats.lmax();
+
+    double alpha = sqrt(2.0)/2.0;
+    for(size_t i=0;i<20;i++){
+      double L_ref = std::max(alpha*L_max, L_up);
+
+      coarsen.coarsen(L_low, L_ref);
+      swapping.swap(0.7);
+      refine.refine(L_ref);
+
+      mesh->compute_statistics(stats);
+      L_max = stats.lmax();
+
+      if(L_max>1.0 && (L_max-L_up)<0.01)
+        break;
+    }
+
+    mesh->defragment();
+
+    smooth.smart_laplacian(20);
+    smooth.optimisation_linf(20);
+  }else{
+    Coarsen<double, 3> coarsen(*mesh);
+    coarsen.coarsen(L_low, L_up);
+
+    MeshStatistics stats;
+    mesh->compute_statistics(stats);
+
+    Smooth<double, 3> smooth(*mesh);
+    Refine<double, 3> refine(*mesh);
+    Swapping<double, 3> swapping(*mesh);
+
+    double L_max = stats.lmax();
+
+    double alpha = sqrt(2.0)/2.0;
+    for(size_t i=0;i<10;i++){
+      double L_ref = std::max(alpha*L_max, L_up);
+
+      refine.refine(L_ref);
+      coarsen.coarsen(L_low, L_ref);
+      swapping.swap(0.95);
+
+      mesh->compute_statistics(stats);
+      L_max = stats.lmax();
+
+      if((L_max-L_up)<0.01)
+        break;
+    }
+
+    mesh->defragment();
+
+    smooth.smart_laplacian(10);
+    smooth.optimisation_linf(10);
+  }
+}
+
+// Functions applied to metric eigenvalues by pragmatic_metric_map.
+static double pragmatic_log(double x){return log(x);}
+static double pragmatic_exp(double x){return exp(x);}
+static double pragmatic_inv(double x){return 1.0/x;}
+static double pragmatic_sqr(double x){return x*x;}
+static double pragmatic_sqrt(double x){return sqrt(x);}
+static double pragmatic_sqrtinv(double x){return 1.0/sqrt(x);}
+static double pragmatic_sqrinv(double x){return 1.0/(x*x);}
+
+/* Check the bins of a histogram. Returns false if they are invalid.
+ */
+static bool pragmatic_check_bins(int nbins, const double *edges){
+  if(nbins<1){
+    std::cerr<<"ERROR: a histogram needs at least one bin.\n";
+    return false;
+  }
+  for(int i=0;i<nbins;i++){
+    if(!(edges[i]<edges[i+1])){
+      std::cerr<<"ERROR: histogram bin edges must be increasing.\n";
+      return false;
+    }
+  }
+  return true;
+}
 
 extern "C" {
+  /** Handle-based interface. Each handle owns its mesh and metric
+      field, so several meshes can be adapted at the same time, and
+      distinct handles may be used concurrently from different
+      threads. Meshes are local to the calling process.
+  */
+
+  /** Create a handle for a 2D mesh.
+
+      @param [in] NNodes Number of nodes
+      @param [in] NElements Number of elements
+      @param [in] enlist Element-node list
+      @param [in] x x coordinate array
+      @param [in] y y coordinate array
+      @return New handle, to be freed with pragmatic_mesh_destroy
+   */
+  pragmatic_mesh_t *pragmatic_mesh_create_2d(int NNodes, int NElements, const int *enlist, const double *x, const double *y){
+#ifdef HAVE_MPI
+    return pragmatic_wrap(new Mesh<double>(NNodes, NElements, enlist, x, y, NULL, NULL, MPI_COMM_SELF));
+#else
+    return pragmatic_wrap(new Mesh<double>(NNodes, NElements, enlist, x, y));
+#endif
+  }
+
+  /** Create a handle for a 3D mesh.
+
+      @param [in] NNodes Number of nodes
+      @param [in] NElements Number of elements
+      @param [in] enlist Element-node list
+      @param [in] x x coordinate array
+      @param [in] y y coordinate array
+      @param [in] z z coordinate array
+      @return New handle, to be freed with pragmatic_mesh_destroy
+   */
+  pragmatic_mesh_t *pragmatic_mesh_create_3d(int NNodes, int NElements, const int *enlist, const double *x, const double *y, const double *z){
+#ifdef HAVE_MPI
+    return pragmatic_wrap(new Mesh<double>(NNodes, NElements, enlist, x, y, z, NULL, NULL, MPI_COMM_SELF));
+#else
+    return pragmatic_wrap(new Mesh<double>(NNodes, NElements, enlist, x, y, z));
+#endif
+  }
+
+  /** Create a handle for a mesh with interleaved coordinates
+      (x0, y0[, z0], x1, ...).
+
+      @param [in] dim Number of dimensions, 2 or 3
+      @param [in] NNodes Number of nodes
+      @param [in] NElements Number of elements
+      @param [in] enlist Element-node list
+      @param [in] coords Interleaved coordinates
+      @return New handle, to be freed with pragmatic_mesh_destroy
+   */
+  pragmatic_mesh_t *pragmatic_mesh_create_interleaved(int dim, int NNodes, int NElements, const int *enlist, const double *coords){
+#ifdef HAVE_MPI
+    return pragmatic_wrap(new Mesh<double>(NNodes, NElements, dim, enlist, coords, MPI_COMM_SELF));
+#else
+    return pragmatic_wrap(new Mesh<double>(NNodes, NElements, dim, enlist, coords));
+#endif
+  }
+
+  /** Free a handle, its mesh, its metric field and its snapshot.
+   */
+  void pragmatic_mesh_destroy(pragmatic_mesh_t *handle){
+    if(handle==NULL)
+      return;
+
+    if(handle->mesh->get_number_dimensions()==2)
+      delete (MetricField<double,2> *)handle->metric_field;
+    else
+      delete (MetricField<double,3> *)handle->metric_field;
+
+    delete handle->snapshot;
+    delete handle->mesh;
+    delete handle;
+  }
+
+  /** Add field which should be adapted to. See pragmatic_add_field.
+   */
+  void pragmatic_mesh_add_field(pragmatic_mesh_t *handle, const double *psi, double error, int pnorm){
+    if(pragmatic_create_metric_field(handle)){
+      if(handle->mesh->get_number_dimensions()==2){
+        MetricField<double,2> *metric_field = (MetricField<double,2> *)handle->metric_field;
+        metric_field->add_field(psi, error, pnorm);
+        metric_field->update_mesh();
+      }else{
+        MetricField<double,3> *metric_field = (MetricField<double,3> *)handle->metric_field;
+        metric_field->add_field(psi, error, pnorm);
+        metric_field->update_mesh();
+      }
+    }else{
+      std::cerr<<"WARNING: Fortran interface currently only supports adding a single field.\n";
+    }
+  }
+
+  /** Set the node centred metric field. See pragmatic_set_metric.
+   */
+  void pragmatic_mesh_set_metric(pragmatic_mesh_t *handle, const double *metric){
+    pragmatic_create_metric_field(handle);
+
+    if(handle->mesh->get_number_dimensions()==2){
+      ((MetricField<double,2> *)handle->metric_field)->set_metric_full(metric);
+      ((MetricField<double,2> *)handle->metric_field)->update_mesh();
+    }else{
+      ((MetricField<double,3> *)handle->metric_field)->set_metric_full(metric);
+      ((MetricField<double,3> *)handle->metric_field)->update_mesh();
+    }
+  }
+
+  /** Add the metric of a field whose Hessian was computed by the
+      caller, e.g. by a finite element library. The scaling is that of
+      pragmatic_mesh_add_field. If a metric is already set the two are
+      merged, preserving the smaller edge lengths.
+
+      @param [in] hessian Hessian at each node, in the full format of pragmatic_set_metric
+      @param [in] error Target error
+      @param [in] pnorm p-norm scaling, or -1 for none
+   */
+  void pragmatic_mesh_add_hessian(pragmatic_mesh_t *handle, const double *hessian, double error, int pnorm){
+    pragmatic_create_metric_field(handle);
+
+    const int dim = handle->mesh->get_number_dimensions();
+    const int NNodes = handle->mesh->get_number_nodes();
+    std::vector<double> packed(NNodes*(dim==2?3:6));
+    for(int i=0;i<NNodes;i++){
+      const double *h = hessian+i*dim*dim;
+      double *m = &(packed[i*(dim==2?3:6)]);
+      if(dim==2){
+        m[0] = h[0]; m[1] = h[1];
+                     m[2] = h[3];
+      }else{
+        m[0] = h[0]; m[1] = h[1]; m[2] = h[2];
+                     m[3] = h[4]; m[4] = h[5];
+                                  m[5] = h[8];
+      }
+    }
+
+    if(dim==2){
+      ((MetricField<double,2> *)handle->metric_field)->add_hessian(&(packed[0]), error, pnorm);
+      ((MetricField<double,2> *)handle->metric_field)->update_mesh();
+    }else{
+      ((MetricField<double,3> *)handle->metric_field)->add_hessian(&(packed[0]), error, pnorm);
+      ((MetricField<double,3> *)handle->metric_field)->update_mesh();
+    }
+  }
+
+  /** Bound the edge lengths and aspect ratio requested by the metric.
+      A non-positive bound is not applied.
+
+      @param [in] min_edge_length Minimum edge length
+      @param [in] max_edge_length Maximum edge length
+      @param [in] max_aspect_ratio Maximum aspect ratio
+      @return 0, or -1 if no metric has been set
+   */
+  int pragmatic_mesh_constrain_metric(pragmatic_mesh_t *handle, double min_edge_length, double max_edge_length, double max_aspect_ratio){
+    if(handle->metric_field==NULL){
+      std::cerr<<"ERROR: no metric has been set."<<std::endl;
+      return -1;
+    }
+
+    if(handle->mesh->get_number_dimensions()==2){
+      MetricField<double,2> *metric_field = (MetricField<double,2> *)handle->metric_field;
+      if(min_edge_length>0)
+        metric_field->apply_min_edge_length(min_edge_length);
+      if(max_edge_length>0)
+        metric_field->apply_max_edge_length(max_edge_length);
+      if(max_aspect_ratio>0)
+        metric_field->apply_max_aspect_ratio(max_aspect_ratio);
+      metric_field->update_mesh();
+    }else{
+      MetricField<double,3> *metric_field = (MetricField<double,3> *)handle->metric_field;
+      if(min_edge_length>0)
+        metric_field->apply_min_edge_length(min_edge_length);
+      if(max_edge_length>0)
+        metric_field->apply_max_edge_length(max_edge_length);
+      if(max_aspect_ratio>0)
+        metric_field->apply_max_aspect_ratio(max_aspect_ratio);
+      metric_field->update_mesh();
+    }
+
+    return 0;
+  }
+
+  /** Limit the gradation of the metric, see MetricField::apply_gradation.
+
+      @param [in] gradation Maximum growth factor of the edge lengths, greater than 1
+      @return 0, or -1 if no metric has been set
+   */
+  int pragmatic_mesh_gradate_metric(pragmatic_mesh_t *handle, double gradation){
+    if(handle->metric_field==NULL){
+      std::cerr<<"ERROR: no metric has been set."<<std::endl;
+      return -1;
+    }
+
+    if(handle->mesh->get_number_dimensions()==2){
+      ((MetricField<double,2> *)handle->metric_field)->apply_gradation(gradation);
+      ((MetricField<double,2> *)handle->metric_field)->update_mesh();
+    }else{
+      ((MetricField<double,3> *)handle->metric_field)->apply_gradation(gradation);
+      ((MetricField<double,3> *)handle->metric_field)->update_mesh();
+    }
+
+    return 0;
+  }
+
+  /** Set the domain boundary. See pragmatic_set_boundary.
+   */
+  void pragmatic_mesh_set_boundary(pragmatic_mesh_t *handle, int nfacets, const int *facets, const int *ids){
+    handle->mesh->set_boundary(nfacets, facets, ids);
+  }
+
+  /** Adapt the mesh of a handle.
+   */
+  void pragmatic_mesh_adapt(pragmatic_mesh_t *handle){
+    pragmatic_adapt_mesh(handle->mesh);
+  }
+
+  /** Adapt several meshes. The meshes are distributed over the
+      OpenMP threads, and each mesh is adapted by a single thread. With
+      MPI this requires MPI_THREAD_MULTIPLE; at a lower thread support
+      level the meshes are adapted one after another, each using all
+      threads.
+
+      @param [in] n Number of handles
+      @param [in] handles Array of n distinct handles
+   */
+  void pragmatic_mesh_adapt_batch(int n, pragmatic_mesh_t **handles){
+    bool concurrent = true;
+#ifdef HAVE_MPI
+    int provided;
+    MPI_Query_thread(&provided);
+    concurrent = provided==MPI_THREAD_MULTIPLE;
+#endif
+
+    if(!concurrent){
+      for(int i=0;i<n;i++)
+        pragmatic_adapt_mesh(handles[i]->mesh);
+      return;
+    }
+
+#pragma omp parallel for schedule(dynamic)
+    for(int i=0;i<n;i++){
+#ifdef _OPENMP
+      // pragmatic_nthreads() reads omp_get_max_threads(), so limit it
+      // to 1 while this thread adapts its mesh: the operators then size
+      // their per-thread data for, and open their parallel regions with,
+      // a single thread. Restore it so the pool thread does not keep it.
+      int max_threads = omp_get_max_threads();
+      omp_set_num_threads(1);
+#endif
+      pragmatic_adapt_mesh(handles[i]->mesh);
+#ifdef _OPENMP
+      omp_set_num_threads(max_threads);
+#endif
+    }
+  }
+
+  /** Take a snapshot of the mesh, replacing any previous one, so that
+      fields can be transferred to the adapted mesh with
+      pragmatic_mesh_interpolate. Call before pragmatic_mesh_adapt.
+   */
+  void pragmatic_mesh_snapshot(pragmatic_mesh_t *handle){
+    delete handle->snapshot;
+    handle->snapshot = new FieldTransfer<double>(*(handle->mesh));
+  }
+
+  /** Interpolate node centred fields from the snapshot onto the
+      current mesh. Field values are stored node by node, i.e. value k
+      of node n is at n*nfields+k.
+
+      @param [in] nfields Number of fields
+      @param [in] old_fields Fields on the nodes of the snapshot
+      @param [out] new_fields Fields on the nodes of the mesh
+      @return Number of nodes found outside the snapshot, whose values
+      were extrapolated, or -1 if there is no snapshot
+   */
+  int pragmatic_mesh_interpolate(pragmatic_mesh_t *handle, int nfields, const double *old_fields, double *new_fields){
+    if(handle->snapshot==NULL){
+      std::cerr<<"ERROR: pragmatic_mesh_interpolate called without a snapshot.\n";
+      return -1;
+    }
+
+    return handle->snapshot->transfer(*(handle->mesh), nfields, old_fields, new_fields);
+  }
+
+  /** Get size of mesh.
+
+      @param [out] NNodes
+      @param [out] NElements
+   */
+  void pragmatic_mesh_get_info(const pragmatic_mesh_t *handle, int *NNodes, int *NElements){
+    *NNodes = handle->mesh->get_number_nodes();
+    *NElements = handle->mesh->get_number_elements();
+  }
+
+  void pragmatic_mesh_get_coords_2d(const pragmatic_mesh_t *handle, double *x, double *y){
+    const int NNodes = handle->mesh->get_number_nodes();
+    const double *coords = handle->mesh->get_coords(0);
+
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<NNodes;i++){
+      x[i] = coords[i*2];
+      y[i] = coords[i*2+1];
+    }
+  }
+
+  void pragmatic_mesh_get_coords_3d(const pragmatic_mesh_t *handle, double *x, double *y, double *z){
+    const int NNodes = handle->mesh->get_number_nodes();
+    const double *coords = handle->mesh->get_coords(0);
+
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<NNodes;i++){
+      x[i] = coords[i*3];
+      y[i] = coords[i*3+1];
+      z[i] = coords[i*3+2];
+    }
+  }
+
+  void pragmatic_mesh_get_elements(const pragmatic_mesh_t *handle, int *elements){
+    const size_t nloc = handle->mesh->get_number_dimensions()+1;
+    const size_t NElements = handle->mesh->get_number_elements();
+
+    if(NElements>0)
+      memcpy(elements, handle->mesh->get_element(0), NElements*nloc*sizeof(int));
+  }
+
+  /** Zero-copy views of the mesh. These return pointers to the
+      internal arrays of the mesh, so no data is copied. The arrays are
+      contiguous after adapting or creating the mesh, and the pointers
+      remain valid until the mesh is next modified or destroyed. Entry
+      j of item i is at array[i*stride+j].
+   */
+
+  /** Get the interleaved coordinates.
+
+      @param [out] stride Number of dimensions
+      @return Pointer to NNodes*stride coordinates
+   */
+  const double *pragmatic_mesh_get_coords_view(const pragmatic_mesh_t *handle, int *stride){
+    const Mesh<double> *mesh = handle->mesh;
+    *stride = mesh->get_number_dimensions();
+    return mesh->get_number_nodes()>0?mesh->get_coords(0):NULL;
+  }
+
+  /** Get the element-node list.
+
+      @param [out] stride Number of nodes per element
+      @return Pointer to NElements*stride node numbers
+   */
+  const int *pragmatic_mesh_get_elements_view(const pragmatic_mesh_t *handle, int *stride){
+    const Mesh<double> *mesh = handle->mesh;
+    *stride = mesh->get_number_dimensions()+1;
+    return mesh->get_number_elements()>0?mesh->get_element(0):NULL;
+  }
+
+  /** Get the boundary IDs of the element facets. Facet j of an
+      element is opposite its node j, and interior facets are 0.
+
+      @param [out] stride Number of facets per element
+      @return Pointer to NElements*stride boundary IDs, or NULL if no
+      boundary has been set
+   */
+  const int *pragmatic_mesh_get_boundary_view(const pragmatic_mesh_t *handle, int *stride){
+    const Mesh<double> *mesh = handle->mesh;
+    *stride = mesh->get_number_dimensions()+1;
+    return mesh->get_number_elements()>0?mesh->get_boundary(0):NULL;
+  }
+
+  /** Get the metric tensor field. Only the upper triangle of each
+      symmetric tensor is stored, row by row: m00, m01, m11 in 2D and
+      m00, m01, m02, m11, m12, m22 in 3D.
+
+      @param [out] stride Number of stored tensor components
+      @return Pointer to NNodes*stride components
+   */
+  const double *pragmatic_mesh_get_metric_view(const pragmatic_mesh_t *handle, int *stride){
+    const Mesh<double> *mesh = handle->mesh;
+    *stride = mesh->get_number_dimensions()==2?3:6;
+    return mesh->get_number_nodes()>0?mesh->get_metric(0):NULL;
+  }
+
+  /** Get the metric tensor field of the adapted mesh, in the packed
+      format of pragmatic_mesh_get_metric_view.
+
+      @param [out] metric NNodes*3 (2D) or NNodes*6 (3D) components
+   */
+  void pragmatic_mesh_get_metric(const pragmatic_mesh_t *handle, double *metric){
+    int stride;
+    const double *view = pragmatic_mesh_get_metric_view(handle, &stride);
+    const size_t NNodes = handle->mesh->get_number_nodes();
+
+    if(view!=NULL)
+      memcpy(metric, view, NNodes*stride*sizeof(double));
+  }
+
+  /** Get the histogram of the element quality in metric space. Bin i
+      counts the elements with quality in [edges[i], edges[i+1]); the
+      first and last bins also count the values below and above the
+      edges. For a mesh distributed over several processes the counts
+      are global, and every process must call this.
+
+      @param [in] nbins Number of bins
+      @param [in] edges nbins+1 increasing bin edges
+      @param [out] counts Number of elements in each bin
+      @return 0, or -1 if the bins are invalid
+   */
+  int pragmatic_mesh_get_quality_histogram(const pragmatic_mesh_t *handle, int nbins, const double *edges, long *counts){
+    if(!pragmatic_check_bins(nbins, edges))
+      return -1;
+
+    handle->mesh->get_quality_histogram(nbins, edges, counts);
+    return 0;
+  }
+
+  /** Get the histogram of the edge lengths in metric space, binned
+      and reduced as in pragmatic_mesh_get_quality_histogram. Adapting
+      again is worthwhile while many edges lie outside
+      [1/sqrt(2), sqrt(2)].
+
+      @param [in] nbins Number of bins
+      @param [in] edges nbins+1 increasing bin edges
+      @param [out] counts Number of edges in each bin
+      @return 0, or -1 if the bins are invalid
+   */
+  int pragmatic_mesh_get_edge_length_histogram(const pragmatic_mesh_t *handle, int nbins, const double *edges, long *counts){
+    if(!pragmatic_check_bins(nbins, edges))
+      return -1;
+
+    handle->mesh->get_edge_length_histogram(nbins, edges, counts);
+    return 0;
+  }
+
+  /** Metric helpers. These work on arrays of n symmetric tensors in the
+      packed format of pragmatic_mesh_get_metric_view, and are
+      parallelised with OpenMP.
+  */
+
+  /** Eigen decomposition of tensors. Unlike metrics, the tensors need
+      not be positive definite, e.g. Hessians.
+
+      @param [in] dim Number of dimensions, 2 or 3
+      @param [in] n Number of tensors
+      @param [in] tensors n*3 (2D) or n*6 (3D) components
+      @param [out] eigenvalues n*dim eigenvalues
+      @param [out] eigenvectors n*dim*dim components, one eigenvector per row
+   */
+  void pragmatic_metric_eig(int dim, int n, const double *tensors, double *eigenvalues, double *eigenvectors){
+    const int msize = dim==2?3:6;
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<n;i++){
+      if(dim==2)
+        MetricTensor<double,2>::symmetric_eigen_decomp(tensors+i*msize, eigenvalues+i*dim, eigenvectors+i*dim*dim);
+      else
+        MetricTensor<double,3>::symmetric_eigen_decomp(tensors+i*msize, eigenvalues+i*dim, eigenvectors+i*dim*dim);
+    }
+  }
+
+  /** Apply a function to the eigenvalues of tensors, keeping their
+      eigenvectors.
+
+      @param [in] dim Number of dimensions, 2 or 3
+      @param [in] n Number of tensors
+      @param [in] tensors n*3 (2D) or n*6 (3D) components
+      @param [in] op One of "log", "exp", "inv", "sqr", "sqrt", "sqrtinv" or "sqrinv"
+      @param [out] result Transformed tensors. May be the same as tensors.
+      @return 0, or -1 if op is unknown
+   */
+  int pragmatic_metric_map(int dim, int n, const double *tensors, const char *op, double *result){
+    double (*f)(double);
+    if(strcmp(op, "log")==0)
+      f = pragmatic_log;
+    else if(strcmp(op, "exp")==0)
+      f = pragmatic_exp;
+    else if(strcmp(op, "inv")==0)
+      f = pragmatic_inv;
+    else if(strcmp(op, "sqr")==0)
+      f = pragmatic_sqr;
+    else if(strcmp(op, "sqrt")==0)
+      f = pragmatic_sqrt;
+    else if(strcmp(op, "sqrtinv")==0)
+      f = pragmatic_sqrtinv;
+    else if(strcmp(op, "sqrinv")==0)
+      f = pragmatic_sqrinv;
+    else{
+      std::cerr<<"ERROR: unknown metric operation "<<op<<std::endl;
+      return -1;
+    }
+
+    const int msize = dim==2?3:6;
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<n;i++){
+      if(dim==2)
+        MetricTensor<double,2>::map_eigenvalues(tensors+i*msize, f, result+i*msize);
+      else
+        MetricTensor<double,3>::map_eigenvalues(tensors+i*msize, f, result+i*msize);
+    }
+
+    return 0;
+  }
+
+  /** Get the phase timers and operation counters of this process,
+      accumulated since the start or the last pragmatic_reset_stats. The
+      timers are only recorded if the library was built with
+      HAVE_PROFILING. Do not call while a mesh is being adapted.
+
+      @param [out] timers Up to ntimers timers, sorted by name
+      @param [in] ntimers Size of timers
+      @param [out] counters Up to ncounters counters, see pragmatic_get_counter_name
+      @param [in] ncounters Size of counters
+      @return Number of timers available, which may exceed ntimers
+   */
+  int pragmatic_get_stats(pragmatic_timer_stats_t *timers, int ntimers, long *counters, int ncounters){
+    Profiler &profiler = Profiler::instance();
+
+    std::vector<Profiler::TimerStats> stats;
+    profiler.get_timers(stats);
+    for(int i=0;i<std::min(ntimers, (int)stats.size());i++){
+      strncpy(timers[i].name, stats[i].name.c_str(), sizeof(timers[i].name)-1);
+      timers[i].name[sizeof(timers[i].name)-1] = '\0';
+      timers[i].calls = stats[i].calls;
+      timers[i].time = stats[i].time/stats[i].nthreads;
+      timers[i].max_time = stats[i].max_time;
+      static_assert(PERF_NCOUNTERS==PRAGMATIC_NHW_COUNTERS, "pragmatic_timer_stats_t must hold every PerfCounter");
+      for(int j=0;j<PERF_NCOUNTERS;j++)
+        timers[i].hw_counters[j] = stats[i].hw[j];
+      timers[i].memory_growth = stats[i].memory_growth;
+      timers[i].memory_peak = stats[i].memory_peak;
+    }
+
+    for(int i=0;i<std::min(ncounters, (int)PROFILE_NCOUNTERS);i++)
+      counters[i] = profiler.get_counter((ProfilerCounter)i);
+
+    return stats.size();
+  }
+
+  /** Name of an operation counter.
+
+      @param [in] counter Index into the counters of pragmatic_get_stats
+      @return Name, or NULL if counter is out of range
+   */
+  const char *pragmatic_get_counter_name(int counter){
+    return Profiler::get_counter_name(counter);
+  }
+
+  /** Zero the phase timers and operation counters.
+   */
+  void pragmatic_reset_stats(){
+    Profiler::instance().reset();
+  }
+
+  /** Sample hardware counters (cycles, instructions, LLC, dTLB and
+      branch misses) in the phase timers from now on, see the
+      hw_counters of pragmatic_timer_stats_t. Uses perf_event_open on
+      Linux; where the counters are not available, e.g. because of
+      perf_event_paranoid, this does nothing.
+
+      @return Number of hardware counters available
+   */
+  int pragmatic_enable_hw_counters(){
+    return Profiler::instance().enable_hardware_counters();
+  }
+
+  /** Name of a hardware counter.
+
+      @param [in] counter Index into hw_counters of pragmatic_timer_stats_t
+      @return Name, or NULL if counter is out of range
+   */
+  const char *pragmatic_get_hw_counter_name(int counter){
+    return PerfCounterGroup::get_counter_name(counter);
+  }
+
+  /** Record how much the memory reserved by the mesh and the workspace
+      of each operator grows per call, see memory_growth and
+      memory_peak of pragmatic_timer_stats_t. This walks the adjacency
+      lists before and after every operator call, so it costs time.
+      Requires a library built with HAVE_PROFILING.
+   */
+  void pragmatic_enable_memory_tracking(){
+    Profiler::instance().enable_memory_tracking();
+  }
+
+  /** Get the memory held by each container of a mesh. The used bytes
+      hold the live nodes and elements; the reserved bytes include
+      spare capacity and the estimated heap overhead.
+
+      @param [out] entries Up to nentries containers
+      @param [in] nentries Size of entries
+      @return Number of containers, which may exceed nentries
+   */
+  int pragmatic_mesh_memory_report(const pragmatic_mesh_t *handle, pragmatic_memory_stats_t *entries, int nentries){
+    MemoryReport report;
+    handle->mesh->memory_report(report);
+
+    const std::vector<MemoryReport::Entry> &list = report.get_entries();
+    for(int i=0;i<std::min(nentries, (int)list.size());i++){
+      strncpy(entries[i].name, list[i].name.c_str(), sizeof(entries[i].name)-1);
+      entries[i].name[sizeof(entries[i].name)-1] = '\0';
+      entries[i].used = list[i].used;
+      entries[i].reserved = list[i].reserved;
+    }
+
+    return list.size();
+  }
+
+  /** Start recording a timeline of the phases of every thread,
+      discarding any previous one. Requires a library built with
+      HAVE_PROFILING.
+   */
+  void pragmatic_start_trace(){
+    Profiler::instance().start_tracing();
+  }
+
+  /** Stop recording the timeline and write it in the Chrome trace
+      event format, viewable in chrome://tracing or Perfetto. Each MPI
+      process writes its own file.
+
+      @param [in] basename The file written is basename_<rank>.json
+      @return 0 on success, -1 if the file cannot be written
+   */
+  int pragmatic_write_trace(const char *basename){
+    Profiler &profiler = Profiler::instance();
+    profiler.stop_tracing();
+
+    int rank=0;
+#ifdef HAVE_MPI
+    int initialized;
+    MPI_Initialized(&initialized);
+    if(initialized)
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+
+    std::ostringstream filename;
+    filename<<basename<<"_"<<rank<<".json";
+    std::ofstream file(filename.str().c_str());
+    if(!file.is_open()){
+      std::cerr<<"ERROR: cannot write "<<filename.str()<<std::endl;
+      return -1;
+    }
+    profiler.write_trace(file, rank);
+
+    return file.good()?0:-1;
+  }
+
+  /** Tune the scheduling parameters of the operators over the next
+      calls of pragmatic_mesh_adapt, see Autotuner. Operators already
+      tuned for the same dimension and number of threads in cache_file
+      start from the cached parameters; the others are added to it once
+      tuned.
+
+      @param [in] cache_file Read if it exists, and written by rank 0
+      @return 0 on success, -1 if cache_file cannot be parsed
+   */
+  int pragmatic_enable_autotuning(const char *cache_file){
+    return Autotuner::instance().enable(cache_file)?0:-1;
+  }
+
+  /** Return every operator to its default parameters.
+   */
+  void pragmatic_disable_autotuning(){
+    Autotuner::instance().disable();
+  }
+
+  /** Single-mesh interface. This adapts one mesh at a time, held in a
+      global handle, and is kept for existing Fortran and Python
+      callers.
+  */
+
   void pragmatic_dump(const char *filename){
-    VTKTools<double>::export_vtu(filename, (Mesh<double>*)_pragmatic_mesh);
+    VTKTools<double>::export_vtu(filename, _pragmatic_handle->mesh);
   }
 
   void pragmatic_dump_debug(){
@@ -69,13 +878,11 @@ extern "C" {
       @param [in] y y coordinate array
    */
   void pragmatic_2d_init(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y){
-    if(_pragmatic_mesh!=NULL){
+    if(_pragmatic_handle!=NULL){
       throw new std::string("PRAgMaTIc: only one mesh can be adapted at a time");
     }
 
-    Mesh<double> *mesh = new Mesh<double>(*NNodes, *NElements, enlist, x, y);
-
-    _pragmatic_mesh = mesh;
+    _pragmatic_handle = pragmatic_mesh_create_2d(*NNodes, *NElements, enlist, x, y);
   }
 
   /** Initialise pragmatic with mesh to be adapted. pragmatic_finalize must
@@ -90,24 +897,38 @@ extern "C" {
       @param [in] z z coordinate array
    */
   void pragmatic_3d_init(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y, const double *z){
-    assert(_pragmatic_mesh==NULL);
-    assert(_pragmatic_metric_field==NULL);
+    assert(_pragmatic_handle==NULL);
 
-    Mesh<double> *mesh = new Mesh<double>(*NNodes, *NElements, enlist, x, y, z);
+    _pragmatic_handle = pragmatic_mesh_create_3d(*NNodes, *NElements, enlist, x, y, z);
+  }
+
+  /** Initialise pragmatic with mesh to be adapted, given as
+      interleaved coordinates (x0, y0[, z0], x1, ...). This avoids
+      splitting the coordinates into separate arrays; they are copied
+      into the mesh in a single pass. pragmatic_finalize must be
+      called before this can be called again.
 
-    _pragmatic_mesh = mesh;
+      @param [in] dim Number of dimensions, 2 or 3
+      @param [in] NNodes Number of nodes
+      @param [in] NElements Number of elements
+      @param [in] enlist Element-node list
+      @param [in] coords Interleaved coordinates
+   */
+  void pragmatic_init_interleaved(const int *dim, const int *NNodes, const int *NElements, const int *enlist, const double *coords){
+    assert(_pragmatic_handle==NULL);
+
+    _pragmatic_handle = pragmatic_mesh_create_interleaved(*dim, *NNodes, *NElements, enlist, coords);
   }
 
   /** Initialise pragmatic with name of VTK file to be adapted.
   */
   void pragmatic_vtk_init(const char *filename){
-    assert(_pragmatic_mesh==NULL);
-    assert(_pragmatic_metric_field==NULL);
+    assert(_pragmatic_handle==NULL);
 
     Mesh<double> *mesh=VTKTools<double>::import_vtu(filename);
     mesh->create_boundary();
 
-    _pragmatic_mesh = mesh;
+    _pragmatic_handle = pragmatic_wrap(mesh);
   }
 
   /** Add field which should be adapted to.
@@ -120,27 +941,9 @@ extern "C" {
       2007. Set to -1 to default to absolute error measure.
    */
   void pragmatic_add_field(const double *psi, const double *error, int *pnorm){
-    assert(_pragmatic_mesh!=NULL);
-
-    Mesh<double> *mesh = (Mesh<double> *)_pragmatic_mesh;
-
-    if(_pragmatic_metric_field==NULL){
-      if(((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions()==2){
-        MetricField<double,2> *metric_field = new MetricField<double,2>(*mesh);
-	metric_field->add_field(psi, *error, *pnorm);
-	metric_field->update_mesh();
-	
-        _pragmatic_metric_field = metric_field;
-      }else{
-        MetricField<double,3> *metric_field = new MetricField<double,3>(*mesh);
-	metric_field->add_field(psi, *error, *pnorm);
-	metric_field->update_mesh();
+    assert(_pragmatic_handle!=NULL);
 
-        _pragmatic_metric_field = metric_field;
-      }
-    }else{
-      std::cerr<<"WARNING: Fortran interface currently only supports adding a single field.\n";
-    }
+    pragmatic_mesh_add_field(_pragmatic_handle, psi, *error, *pnorm);
   }
 
   /** Set the node centred metric field
@@ -148,28 +951,10 @@ extern "C" {
       @param [in] metric Metric tensor field.
    */
   void pragmatic_set_metric(const double *metric){
-    assert(_pragmatic_mesh!=NULL);
-    assert(_pragmatic_metric_field==NULL);
-
-    Mesh<double> *mesh = (Mesh<double> *)_pragmatic_mesh;
+    assert(_pragmatic_handle!=NULL);
+    assert(_pragmatic_handle->metric_field==NULL);
 
-    if(_pragmatic_metric_field==NULL){
-      if(((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions()==2){
-        MetricField<double,2> *metric_field = new MetricField<double,2>(*mesh);
-        _pragmatic_metric_field = metric_field;
-      }else{
-        MetricField<double,3> *metric_field = new MetricField<double,3>(*mesh);
-        _pragmatic_metric_field = metric_field;
-      }
-    }
-
-    if(((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions()==2){
-      ((MetricField<double,2> *)_pragmatic_metric_field)->set_metric_full(metric);
-      ((MetricField<double,2> *)_pragmatic_metric_field)->update_mesh();
-    }else{
-      ((MetricField<double,3> *)_pragmatic_metric_field)->set_metric_full(metric);
-      ((MetricField<double,3> *)_pragmatic_metric_field)->update_mesh();
-    }
+    pragmatic_mesh_set_metric(_pragmatic_handle, metric);
   }
 
   /** Set the domain boundary.
@@ -179,78 +964,37 @@ extern "C" {
       @param [in] ids Boundary ids
    */
   void pragmatic_set_boundary(const int *nfacets, const int *facets, const int *ids){
-    assert(_pragmatic_mesh!=NULL);
+    assert(_pragmatic_handle!=NULL);
 
-    Mesh<double> *mesh = (Mesh<double> *)_pragmatic_mesh;
-    mesh->set_boundary(*nfacets, facets, ids);
+    pragmatic_mesh_set_boundary(_pragmatic_handle, *nfacets, facets, ids);
   }
-  
+
   /** Adapt the mesh.
    */
   void pragmatic_adapt(){
-    Mesh<double> *mesh = (Mesh<double> *)_pragmatic_mesh;
-
-    const size_t ndims = mesh->get_number_dimensions();
-
-    // See Eqn 7; X Li et al, Comp Methods Appl Mech Engrg 194 (2005) 4915-4950
-    double L_up = sqrt(2.0);
-    double L_low = L_up*0.5;
-
-    if(ndims==2){
-      Coarsen<double, 2> coarsen(*mesh);
-      Smooth<double, 2> smooth(*mesh);
-      Refine<double, 2> refine(*mesh);
-      Swapping<double, 2> swapping(*mesh);
-
-      double L_max = mesh->maximal_edge_length();
-
-      double alpha = sqrt(2.0)/2.0;
-      for(size_t i=0;i<20;i++){
-        double L_ref = std::max(alpha*L_max, L_up);
-
-        coarsen.coarsen(L_low, L_ref);
-        swapping.swap(0.7);
-        refine.refine(L_ref);
-
-        L_max = mesh->maximal_edge_length();
-
-        if(L_max>1.0 && (L_max-L_up)<0.01)
-          break;
-      }
-
-      mesh->defragment();
-
-      smooth.smart_laplacian(20);
-      smooth.optimisation_linf(20);
-    }else{
-      Coarsen<double, 3> coarsen(*mesh);
-      Smooth<double, 3> smooth(*mesh);
-      Refine<double, 3> refine(*mesh);
-      Swapping<double, 3> swapping(*mesh);
-
-      coarsen.coarsen(L_low, L_up);
-
-      double L_max = mesh->maximal_edge_length();
-
-      double alpha = sqrt(2.0)/2.0;
-      for(size_t i=0;i<10;i++){
-        double L_ref = std::max(alpha*L_max, L_up);
+    pragmatic_mesh_adapt(_pragmatic_handle);
+  }
 
-        refine.refine(L_ref);
-        coarsen.coarsen(L_low, L_ref);
-        swapping.swap(0.95);
+  /** Take a snapshot of the mesh before adapting it. See
+      pragmatic_mesh_snapshot.
+   */
+  void pragmatic_snapshot(){
+    assert(_pragmatic_handle!=NULL);
 
-        L_max = mesh->maximal_edge_length();
+    pragmatic_mesh_snapshot(_pragmatic_handle);
+  }
 
-        if((L_max-L_up)<0.01)
-          break;
-      }
+  /** Interpolate node centred fields from the snapshot onto the
+      adapted mesh. See pragmatic_mesh_interpolate.
 
-      mesh->defragment();
+      @param [in] nfields Number of fields
+      @param [in] old_fields Fields on the nodes of the snapshot
+      @param [out] new_fields Fields on the nodes of the adapted mesh
+   */
+  int pragmatic_interpolate(const int *nfields, const double *old_fields, double *new_fields){
+    assert(_pragmatic_handle!=NULL);
 
-      smooth.smart_laplacian(10);
-      smooth.optimisation_linf(10);
-    }
+    return pragmatic_mesh_interpolate(_pragmatic_handle, *nfields, old_fields, new_fields);
   }
 
   /** Get size of mesh.
@@ -259,47 +1003,40 @@ extern "C" {
       @param [out] NElements
    */
   void pragmatic_get_info(int *NNodes, int *NElements){
-    Mesh<double> *mesh = (Mesh<double> *)_pragmatic_mesh;
-
-    *NNodes = mesh->get_number_nodes();
-    *NElements = mesh->get_number_elements();
+    pragmatic_mesh_get_info(_pragmatic_handle, NNodes, NElements);
   }
 
   void pragmatic_get_coords_2d(double *x, double *y){
-    size_t NNodes = ((Mesh<double> *)_pragmatic_mesh)->get_number_nodes();
-    for(size_t i=0;i<NNodes;i++){
-      x[i] = ((Mesh<double> *)_pragmatic_mesh)->get_coords(i)[0];
-      y[i] = ((Mesh<double> *)_pragmatic_mesh)->get_coords(i)[1];
-    }
+    pragmatic_mesh_get_coords_2d(_pragmatic_handle, x, y);
   }
 
   void pragmatic_get_coords_3d(double *x, double *y, double *z){
-    size_t NNodes = ((Mesh<double> *)_pragmatic_mesh)->get_number_nodes();
-    for(size_t i=0;i<NNodes;i++){
-      x[i] = ((Mesh<double> *)_pragmatic_mesh)->get_coords(i)[0];
-      y[i] = ((Mesh<double> *)_pragmatic_mesh)->get_coords(i)[1];
-      z[i] = ((Mesh<double> *)_pragmatic_mesh)->get_coords(i)[2];
-    }
+    pragmatic_mesh_get_coords_3d(_pragmatic_handle, x, y, z);
   }
 
   void pragmatic_get_elements(int *elements){
-    const size_t ndims = ((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions();
-    const size_t NElements = ((Mesh<double> *)_pragmatic_mesh)->get_number_elements();
-    const size_t nloc = (ndims==2)?3:4;
+    pragmatic_mesh_get_elements(_pragmatic_handle, elements);
+  }
 
-    for(size_t i=0;i<NElements;i++){
-      const int *n=((Mesh<double> *)_pragmatic_mesh)->get_element(i);
+  const double *pragmatic_get_coords_view(int *stride){
+    return pragmatic_mesh_get_coords_view(_pragmatic_handle, stride);
+  }
 
-      for(size_t j=0;j<nloc;j++){
-        assert(n[j]>=0);
-        elements[i*nloc+j] = n[j];
-      }
-    }
+  const int *pragmatic_get_elements_view(int *stride){
+    return pragmatic_mesh_get_elements_view(_pragmatic_handle, stride);
+  }
+
+  const int *pragmatic_get_boundary_view(int *stride){
+    return pragmatic_mesh_get_boundary_view(_pragmatic_handle, stride);
+  }
+
+  const double *pragmatic_get_metric_view(int *stride){
+    return pragmatic_mesh_get_metric_view(_pragmatic_handle, stride);
   }
 /*
   void pragmatic_get_lnn2gnn(int *nodes_per_partition, int *lnn2gnn){
     std::vector<int> _NPNodes, _lnn2gnn;
-    ((Mesh<double> *)_pragmatic_mesh)->get_global_node_numbering(_NPNodes, _lnn2gnn);
+    _pragmatic_handle->mesh->get_global_node_numbering(_NPNodes, _lnn2gnn);
     size_t len0 = _NPNodes.size();
     for(size_t i=0;i<len0;i++)
       nodes_per_partition[i] = _NPNodes[i];
@@ -309,25 +1046,25 @@ extern "C" {
       lnn2gnn[i] = _lnn2gnn[i];
   }
 */
+  /** Get the metric tensor field of the adapted mesh, in the packed
+      format of pragmatic_get_metric_view.
+
+      @param [out] metric NNodes*3 (2D) or NNodes*6 (3D) components
+   */
   void pragmatic_get_metric(double *metric){
-    if(((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions()==2){
-      ((MetricField<double,2> *)_pragmatic_metric_field)->get_metric(metric);
-    }else{
-      ((MetricField<double,3> *)_pragmatic_metric_field)->get_metric(metric);
-    }
+    pragmatic_mesh_get_metric(_pragmatic_handle, metric);
   }
 
-  void pragmatic_finalize(){
-    if(((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions()==2){
-      if(_pragmatic_metric_field!=NULL)
-        delete (MetricField<double,2> *)_pragmatic_metric_field;
-    }else{
-      if(_pragmatic_metric_field!=NULL)
-        delete (MetricField<double,3> *)_pragmatic_metric_field;
-    }
-    _pragmatic_metric_field=NULL;
+  int pragmatic_get_quality_histogram(const int *nbins, const double *edges, long *counts){
+    return pragmatic_mesh_get_quality_histogram(_pragmatic_handle, *nbins, edges, counts);
+  }
 
-    delete (Mesh<double> *)_pragmatic_mesh;
-    _pragmatic_mesh=NULL;
+  int pragmatic_get_edge_length_histogram(const int *nbins, const double *edges, long *counts){
+    return pragmatic_mesh_get_edge_length_histogram(_pragmatic_handle, *nbins, edges, counts);
+  }
+
+  void pragmatic_finalize(){
+    pragmatic_mesh_destroy(_pragmatic_handle);
+    _pragmatic_handle=NULL;
   }
 }
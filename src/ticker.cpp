@@ -27,21 +27,16 @@
  *    USA
  */
 
-#include <sys/time.h>
+#include <time.h>
 #include <stdio.h>
 #include <unistd.h>
 
+// Monotonic, so intervals are not upset by adjustments of the system clock.
 double get_wtime(){
-    struct timeval tic;
+    struct timespec tic;
 
-    long seconds, useconds;
+    clock_gettime(CLOCK_MONOTONIC, &tic);
 
-    gettimeofday(&tic, NULL);
-
-    seconds  = tic.tv_sec;
-    useconds = tic.tv_usec;
-
-    return seconds + useconds*1e-06;
+    return tic.tv_sec + tic.tv_nsec*1e-09;
 }
 
-
@@ -0,0 +1,190 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef BENCHMARK_ADAPT_H
+#define BENCHMARK_ADAPT_H
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <omp.h>
+
+#include "Coarsen.h"
+#include "Mesh.h"
+#include "Profiler.h"
+#include "Refine.h"
+#include "Smooth.h"
+#include "Swapping.h"
+#include "ticker.h"
+
+#include <mpi.h>
+
+/// Operators timed by the adaptation benchmarks, in the order of their times.
+enum BenchmarkTime{
+  BENCHMARK_COARSEN,
+  BENCHMARK_REFINE,
+  BENCHMARK_SWAP,
+  BENCHMARK_SMOOTH,
+  BENCHMARK_ADAPT,
+  BENCHMARK_NTIMES
+};
+
+/*! Adapt the mesh to the metric already set on it, then defragment
+ * it. Refinement relies on the global numbering set up by the metric
+ * field, which defragment() compacts, so it is only called once the
+ * mesh is adapted.
+ * @param times if not NULL, the time of each operator is added to it.
+ */
+template<int dim>
+void benchmark_adapt(Mesh<double> *mesh, double *times, bool verbose){
+  // See Eqn 7; X Li et al, Comp Methods Appl Mech Engrg 194 (2005) 4915-4950
+  double L_up = sqrt(2.0);
+  double L_low = L_up/2;
+
+  // The reduction overlaps setting up the operators, which only read
+  // the mesh.
+  MeshStatistics stats;
+  mesh->compute_statistics(stats);
+
+  Coarsen<double,dim> coarsen(*mesh);
+  Smooth<double,dim> smooth(*mesh);
+  Refine<double,dim> refine(*mesh);
+  Swapping<double,dim> swapping(*mesh);
+
+  double elapsed[BENCHMARK_NTIMES] = {0, 0, 0, 0, 0};
+  double tic, toc;
+
+  double L_max = stats.lmax();
+  double alpha = sqrt(2.0)/2;
+
+  for(size_t I=0;I<5;I++){
+    double T1 = get_wtime();
+    for(size_t i=0;i<10;i++){
+      double L_ref = std::max(alpha*L_max, L_up);
+
+      tic = get_wtime();
+      coarsen.coarsen(L_low, L_ref);
+      toc = get_wtime();
+      elapsed[BENCHMARK_COARSEN] += (toc-tic);
+
+      tic = get_wtime();
+      swapping.swap(0.7);
+      toc = get_wtime();
+      elapsed[BENCHMARK_SWAP] += (toc-tic);
+
+      tic = get_wtime();
+      refine.refine(L_ref);
+      toc = get_wtime();
+      elapsed[BENCHMARK_REFINE] += (toc-tic);
+
+      mesh->compute_statistics(stats);
+      L_max = stats.lmax();
+
+      if((L_max-L_up)<0.01)
+        break;
+    }
+
+    double T2 = get_wtime();
+    elapsed[BENCHMARK_ADAPT] += (T2-T1);
+
+    tic = get_wtime();
+    smooth.smart_laplacian(10);
+    toc = get_wtime();
+    elapsed[BENCHMARK_SMOOTH] += (toc-tic);
+    elapsed[BENCHMARK_ADAPT] += (toc-tic);
+
+    mesh->compute_statistics(stats);
+    if(stats.qmin()>0.4)
+      break;
+    if(verbose)
+      std::cerr<<I<<" :: meatgrinder "<<stats.qmin()<<std::endl;
+  }
+
+  mesh->defragment();
+
+  if(times!=NULL)
+    for(int i=0;i<BENCHMARK_NTIMES;i++)
+      times[i] += elapsed[i];
+}
+
+/// Print the mean time per timestep of each operator over t timesteps, and the mesh size.
+inline void print_benchmark_times(const Mesh<double> *mesh, const double *times, int t){
+  std::cout<<"BENCHMARK: "
+           <<std::setw(12)<<times[BENCHMARK_COARSEN]/t<<" "
+           <<std::setw(11)<<times[BENCHMARK_REFINE]/t<<" "
+           <<std::setw(9)<<times[BENCHMARK_SWAP]/t<<" "
+           <<std::setw(11)<<times[BENCHMARK_SMOOTH]/t<<" "
+           <<std::setw(10)<<times[BENCHMARK_ADAPT]/t<<std::endl
+           <<"NNodes, NElements = "<<mesh->get_number_nodes()<<", "<<mesh->get_number_elements()<<std::endl;
+}
+
+/*! Write the mean time per timestep of each operator, and of the
+ * phase timers if built with HAVE_PROFILING, as JSON.
+ */
+inline void write_json(std::ostream &out, const char *benchmark, int n, int ntimesteps,
+                       long nnodes, long nelements, const double *times){
+  int nprocs;
+  MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+  const char *operators[] = {"coarsen", "refine", "swap", "smooth", "adapt"};
+  out<<"{"<<std::endl
+     <<"  \"benchmark\": \""<<benchmark<<"\","<<std::endl
+     <<"  \"processes\": "<<nprocs<<","<<std::endl
+     <<"  \"threads\": "<<omp_get_max_threads()<<","<<std::endl
+     <<"  \"intervals\": "<<n<<","<<std::endl
+     <<"  \"timesteps\": "<<ntimesteps<<","<<std::endl
+     <<"  \"nnodes\": "<<nnodes<<","<<std::endl
+     <<"  \"nelements\": "<<nelements<<","<<std::endl
+     <<"  \"operators\": {";
+  for(int i=0;i<BENCHMARK_NTIMES;i++)
+    out<<(i?", ":"")<<"\""<<operators[i]<<"\": "<<times[i]/ntimesteps;
+  out<<"},"<<std::endl;
+
+  std::vector<Profiler::TimerStats> stats;
+  Profiler::instance().get_timers(stats);
+  out<<"  \"timers\": [";
+  for(size_t i=0;i<stats.size();i++)
+    out<<(i?",":"")<<std::endl<<"    {\"name\": \""<<stats[i].name<<"\", \"calls\": "<<stats[i].calls
+       <<", \"mean\": "<<stats[i].time/stats[i].nthreads<<", \"max\": "<<stats[i].max_time<<"}";
+  out<<(stats.empty()?"":"\n  ")<<"]"<<std::endl
+     <<"}"<<std::endl;
+}
+
+#endif
@@ -0,0 +1,95 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef UNIT_SQUARE_H
+#define UNIT_SQUARE_H
+
+#include <cmath>
+#include <vector>
+
+#include "pragmatic.h"
+
+/*! Create an n x n mesh of the unit square with boundary IDs 1 to 4
+ * (x=0, x=1, y=0, y=1), and add a field with a sharp feature through
+ * (c, c) that is adapted to within the interpolation error eta.
+ */
+inline pragmatic_mesh_t *create_unit_square(int n, double c=0.5, double eta=0.01){
+  std::vector<double> coords;
+  for(int j=0;j<=n;j++){
+    for(int i=0;i<=n;i++){
+      coords.push_back((double)i/n);
+      coords.push_back((double)j/n);
+    }
+  }
+
+  std::vector<int> enlist;
+  for(int j=0;j<n;j++){
+    for(int i=0;i<n;i++){
+      int v0 = j*(n+1)+i, v1 = v0+1, v2 = v0+n+1, v3 = v2+1;
+      int tri[] = {v0, v1, v3, v0, v3, v2};
+      enlist.insert(enlist.end(), tri, tri+6);
+    }
+  }
+
+  std::vector<int> facets, ids;
+  for(int i=0;i<n;i++){
+    int sides[4][2] = {{i*(n+1), (i+1)*(n+1)},               // x=0
+                       {i*(n+1)+n, (i+1)*(n+1)+n},           // x=1
+                       {i, i+1},                             // y=0
+                       {n*(n+1)+i, n*(n+1)+i+1}};            // y=1
+    for(int k=0;k<4;k++){
+      facets.push_back(sides[k][0]);
+      facets.push_back(sides[k][1]);
+      ids.push_back(k+1);
+    }
+  }
+
+  int NNodes = coords.size()/2;
+  pragmatic_mesh_t *mesh = pragmatic_mesh_create_interleaved(2, NNodes, enlist.size()/3, &(enlist[0]), &(coords[0]));
+  pragmatic_mesh_set_boundary(mesh, ids.size(), &(facets[0]), &(ids[0]));
+
+  std::vector<double> psi(NNodes);
+  for(int i=0;i<NNodes;i++){
+    double x = coords[i*2]-c, y = coords[i*2+1]-c;
+    psi[i] = 0.1*sin(50*x*y)+atan2(-0.1, 2*x-sin(5*y));
+  }
+  pragmatic_mesh_add_field(mesh, &(psi[0]), eta, -1);
+
+  return mesh;
+}
+
+#endif
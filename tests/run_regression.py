@@ -0,0 +1,336 @@
+#!/usr/bin/env python
+
+"""Performance regression checks against a stored baseline.
+
+The benchmark suite (the 2D and 3D adaptation benchmarks and the kernel
+microbenchmarks) is run and the timings are stored in
+
+  <store>/<machine>/<commit>-p<processes>t<threads>.json
+
+and, when they become the baseline, also in baseline-p<processes>t<threads>.json.
+Every benchmark is run several times, in separate processes, so that
+the samples include the variation between runs. Each run gives one
+sample of the time per timestep of each operator, or of the median time
+per item of each kernel.
+
+Each timing is compared with the same timing in the baseline using a
+one-sided Mann-Whitney U test, which makes no assumption about the
+distribution of the times. A timing has regressed if its median is more
+than the threshold slower than in the baseline, and the slowdown is
+significant. The exit status is 1 if anything regressed, 2 if a
+benchmark failed, and 0 otherwise, so the script can gate an upgrade:
+
+  run_regression.py --set-baseline          # on the version in use
+  run_regression.py                         # after upgrading
+
+The first run on a machine becomes its baseline. Use -c to compare with
+the results of a particular commit instead, and -i to compare stored
+results without running anything.
+"""
+
+from __future__ import print_function
+
+import getopt
+import json
+import math
+import os
+import platform
+import subprocess
+import sys
+import tempfile
+import time
+
+# Command line of each benchmark in the suite.
+SUITE = {"adapt_2d": ["benchmark_adapt_2d", "-n", "50", "-t", "6"],
+         "adapt_3d": ["benchmark_adapt_3d", "-n", "8", "-t", "3"],
+         "kernels": ["benchmark_kernels", "-r", "10", "-w", "2", "-n2", "100", "-n3", "15"]}
+
+OPERATORS = ("coarsen", "refine", "swap", "smooth", "adapt")
+
+OK, REGRESSION, FAILURE = 0, 1, 2
+
+
+def usage():
+    print("usage: %s [-b benchmarks] [-d directory] [-s store] [-c commit] [-i commit]"
+          " [-p processes] [-t threads] [-r repeats] [-T threshold] [-a alpha]"
+          " [--mpirun command] [--set-baseline]" % sys.argv[0])
+    sys.exit(FAILURE)
+
+
+def git_commit(path):
+    """Abbreviated hash of HEAD, marked dirty if there are local changes."""
+    try:
+        with open(os.devnull, "w") as devnull:
+            commit = subprocess.check_output(["git", "-C", path, "rev-parse", "--short=12", "HEAD"],
+                                             stderr=devnull).decode().strip()
+            status = subprocess.check_output(["git", "-C", path, "status", "--porcelain", "-uno"],
+                                             stderr=devnull).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+    return commit+"-dirty" if status else commit
+
+
+def cpu_model():
+    try:
+        with open("/proc/cpuinfo") as f:
+            for line in f:
+                if line.startswith("model name"):
+                    return line.split(":", 1)[1].strip()
+    except IOError:
+        pass
+    return platform.processor()
+
+
+def machine_key():
+    """Results are only comparable on the same machine."""
+    return "%s-%s" % (platform.node().split(".")[0], platform.machine())
+
+
+def run(name, directory, nprocs, nthreads, mpirun):
+    """Run one benchmark of the suite and return its JSON results."""
+    fd, output = tempfile.mkstemp(suffix=".json")
+    os.close(fd)
+
+    command = [os.path.join(directory, SUITE[name][0])] + SUITE[name][1:] + ["-o", output]
+    # The kernel benchmark only times rank 0 on the synthetic meshes.
+    if nprocs > 1 and name != "kernels":
+        command = mpirun.split() + ["-np", str(nprocs)] + command
+
+    env = dict(os.environ)
+    env["OMP_NUM_THREADS"] = str(nthreads)
+    env.setdefault("OMP_PROC_BIND", "true")
+
+    try:
+        with open(os.devnull, "w") as devnull:
+            status = subprocess.call(command, env=env, stdout=devnull)
+        if status != 0:
+            print("ERROR: %s exited with %d" % (" ".join(command), status))
+            return None
+        with open(output) as f:
+            return json.load(f)
+    except OSError as e:
+        print("ERROR: cannot run %s: %s" % (command[0], e.strerror))
+        return None
+    finally:
+        os.remove(output)
+
+
+def measure(benchmarks, directory, nprocs, nthreads, repeats, mpirun):
+    """Samples of every timing, keyed by benchmark/operator or kernels/kernel/mesh."""
+    samples = {}
+    for name in benchmarks:
+        for r in range(repeats):
+            result = run(name, directory, nprocs, nthreads, mpirun)
+            if result is None:
+                return None
+            if name == "kernels":
+                for kernel in result["results"]:
+                    samples.setdefault("kernels/%s/%s" % (kernel["kernel"], kernel["mesh"]), []).append(kernel["median_ns"])
+            else:
+                for op in OPERATORS:
+                    samples.setdefault("%s/%s" % (name, op), []).append(result["operators"][op])
+        print("Ran %s" % name)
+    return samples
+
+
+def median(x):
+    x = sorted(x)
+    n = len(x)
+    return x[n//2] if n % 2 else 0.5*(x[n//2-1]+x[n//2])
+
+
+def u_distribution(m, n, cache={}):
+    """Number of orderings of m and n samples giving each value of U."""
+    if (m, n) not in cache:
+        if m == 0 or n == 0:
+            cache[(m, n)] = [1]
+        else:
+            # The largest sample is either one of the m, which then beats all n others, or one of the n.
+            a, b = u_distribution(m-1, n), u_distribution(m, n-1)
+            counts = [0]*(m*n+1)
+            for u, c in enumerate(a):
+                counts[u+n] += c
+            for u, c in enumerate(b):
+                counts[u] += c
+            cache[(m, n)] = counts
+    return cache[(m, n)]
+
+
+def mann_whitney(x, y):
+    """One-sided p-value of the hypothesis that x tends to be larger than y."""
+    m, n = len(x), len(y)
+    u = sum(1.0 if a > b else 0.5 if a == b else 0.0 for a in x for b in y)
+    ties = len(set(x+y)) < m+n
+    if not ties and m*n <= 400:
+        counts = u_distribution(m, n)
+        return float(sum(counts[int(math.ceil(u)):]))/sum(counts)
+
+    # Normal approximation with tie and continuity corrections.
+    pooled = sorted(x+y)
+    tie_term = 0.0
+    i = 0
+    while i < len(pooled):
+        j = i
+        while j < len(pooled) and pooled[j] == pooled[i]:
+            j += 1
+        tie_term += (j-i)**3-(j-i)
+        i = j
+    N = m+n
+    sigma = math.sqrt(m*n/12.0*((N+1)-tie_term/(N*(N-1))))
+    if sigma == 0:
+        return 1.0
+    z = (u-0.5-m*n/2.0)/sigma
+    return 0.5*math.erfc(z/math.sqrt(2))
+
+
+def compare(baseline, current, threshold, alpha):
+    """Print a table of changes and return the names of the timings which regressed."""
+    regressions = []
+    names = sorted(set(baseline["samples"]) & set(current["samples"]))
+    print("%-44s %12s %12s %8s %8s" % ("timing", "baseline", "current", "change", "p"))
+    for name in names:
+        x, y = current["samples"][name], baseline["samples"][name]
+        base, now = median(y), median(x)
+        if base <= 0:
+            continue
+        change = now/base-1
+        status = ""
+        if change > threshold:
+            p = mann_whitney(x, y)
+            if p < alpha:
+                status = "REGRESSION"
+                regressions.append(name)
+        elif change < -threshold:
+            p = mann_whitney(y, x)
+            if p < alpha:
+                status = "faster"
+        else:
+            p = min(mann_whitney(x, y), mann_whitney(y, x))
+        print("%-44s %12.4g %12.4g %+7.1f%% %8.3g %s" % (name, base, now, 100*change, p, status))
+
+    missing = sorted(set(baseline["samples"]) - set(current["samples"]))
+    if missing:
+        print("Not in the current results: %s" % ", ".join(missing))
+    return regressions
+
+
+def load(store, machine, commit, config):
+    """Stored results of a commit, which may be abbreviated."""
+    directory = os.path.join(store, machine)
+    if os.path.isdir(directory):
+        for filename in sorted(os.listdir(directory)):
+            if filename.startswith(commit) and filename.endswith("-%s.json" % config) \
+                    and not filename.startswith("baseline-"):
+                with open(os.path.join(directory, filename)) as f:
+                    return json.load(f)
+    return None
+
+
+def main():
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "b:d:s:c:i:p:t:r:T:a:h", ["mpirun=", "set-baseline"])
+    except getopt.GetoptError:
+        usage()
+
+    tests = os.path.dirname(os.path.abspath(__file__))
+    benchmarks = sorted(SUITE)
+    directory = os.path.join(tests, "benchmarks")
+    store = os.path.join(tests, "perf_results")
+    baseline_commit = None
+    input_commit = None
+    nprocs = 1
+    nthreads = 1
+    repeats = 5
+    threshold = 0.05
+    alpha = 0.05
+    mpirun = "mpirun"
+    set_baseline = False
+    for o, a in opts:
+        if o == "-b":
+            benchmarks = a.split(",")
+        elif o == "-d":
+            directory = os.path.abspath(a)
+        elif o == "-s":
+            store = os.path.abspath(a)
+        elif o == "-c":
+            baseline_commit = a
+        elif o == "-i":
+            input_commit = a
+        elif o == "-p":
+            nprocs = int(a)
+        elif o == "-t":
+            nthreads = int(a)
+        elif o == "-r":
+            repeats = max(int(a), 1)
+        elif o == "-T":
+            threshold = float(a)/100
+        elif o == "-a":
+            alpha = float(a)
+        elif o == "--mpirun":
+            mpirun = a
+        elif o == "--set-baseline":
+            set_baseline = True
+        else:
+            usage()
+    for name in benchmarks:
+        if name not in SUITE:
+            print("ERROR: unknown benchmark %s, expected one of %s" % (name, ", ".join(sorted(SUITE))))
+            return FAILURE
+
+    machine = machine_key()
+    config = "p%dt%d" % (nprocs, nthreads)
+    if not os.path.isdir(os.path.join(store, machine)):
+        os.makedirs(os.path.join(store, machine))
+    # A copy of the baseline results, which are kept even if the
+    # same commit is measured again.
+    baseline_file = os.path.join(store, machine, "baseline-%s.json" % config)
+
+    if input_commit is not None:
+        current = load(store, machine, input_commit, config)
+        if current is None:
+            print("ERROR: no results for %s on %s with %s" % (input_commit, machine, config))
+            return FAILURE
+    else:
+        commit = git_commit(os.path.dirname(tests))
+        samples = measure(benchmarks, directory, nprocs, nthreads, repeats, mpirun)
+        if samples is None:
+            return FAILURE
+        current = {"commit": commit,
+                   "machine": machine,
+                   "cpu": cpu_model(),
+                   "cpus": os.sysconf("SC_NPROCESSORS_ONLN"),
+                   "date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+                   "processes": nprocs,
+                   "threads": nthreads,
+                   "repeats": repeats,
+                   "samples": samples}
+        filename = os.path.join(store, machine, "%s-%s.json" % (commit, config))
+        with open(filename, "w") as f:
+            json.dump(current, f, indent=2, sort_keys=True)
+        print("Results written to %s" % filename)
+
+    if set_baseline or (baseline_commit is None and not os.path.exists(baseline_file)):
+        with open(baseline_file, "w") as f:
+            json.dump(current, f, indent=2, sort_keys=True)
+        print("%s is now the baseline on %s with %s" % (current["commit"], machine, config))
+        return OK
+
+    if baseline_commit is None:
+        with open(baseline_file) as f:
+            baseline = json.load(f)
+    else:
+        baseline = load(store, machine, baseline_commit, config)
+        if baseline is None:
+            print("ERROR: no results for %s on %s with %s" % (baseline_commit, machine, config))
+            return FAILURE
+
+    print("Comparing %s with baseline %s on %s with %s" % (current["commit"], baseline["commit"], machine, config))
+    regressions = compare(baseline, current, threshold, alpha)
+    if regressions:
+        print("%d timings regressed by more than %g%%" % (len(regressions), 100*threshold))
+        return REGRESSION
+    return OK
+
+
+if __name__ == "__main__":
+    sys.exit(main())
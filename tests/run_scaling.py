@@ -0,0 +1,161 @@
+#!/usr/bin/env python
+
+"""Strong and weak scaling sweeps of the end-to-end adaptation benchmarks
+on a single Linux machine.
+
+Every combination of MPI processes and OpenMP threads given is run. For
+strong scaling the mesh size stays fixed; for weak scaling the number of
+intervals per side grows with the number of workers (processes times
+threads), so that the number of elements per worker stays roughly
+constant. The per-operator times reported by the benchmark, with the
+speedup and parallel efficiency relative to the first run, are written
+as JSON.
+
+  run_scaling.py -b benchmarks/benchmark_adapt_3d -p 1,2 -t 1,2,4 -n 10 -o scaling.json
+"""
+
+from __future__ import print_function
+
+import getopt
+import json
+import os
+import platform
+import subprocess
+import sys
+import tempfile
+
+OPERATORS = ("coarsen", "refine", "swap", "smooth", "adapt")
+
+
+def usage():
+    print("usage: %s [-b benchmark] [-m strong|weak|both] [-p processes] [-t threads]"
+          " [-n intervals] [-s timesteps] [-r repeats] [--mpirun command] [-o output.json]" % sys.argv[0])
+    sys.exit(1)
+
+
+def run(benchmark, nprocs, nthreads, n, timesteps, mpirun):
+    """Run the benchmark once and return its JSON results."""
+    fd, output = tempfile.mkstemp(suffix=".json")
+    os.close(fd)
+
+    command = [benchmark, "-n", str(n), "-t", str(timesteps), "-o", output]
+    if nprocs > 1:
+        command = mpirun.split() + ["-np", str(nprocs)] + command
+
+    env = dict(os.environ)
+    env["OMP_NUM_THREADS"] = str(nthreads)
+    env.setdefault("OMP_PROC_BIND", "true")
+
+    with open(os.devnull, "w") as devnull:
+        status = subprocess.call(command, env=env, stdout=devnull)
+    try:
+        if status != 0:
+            print("ERROR: %s exited with %d" % (" ".join(command), status))
+            return None
+        with open(output) as f:
+            return json.load(f)
+    finally:
+        os.remove(output)
+
+
+def sweep(mode, benchmark, dim, procs, threads, size, timesteps, repeats, mpirun):
+    runs = []
+    for nprocs in procs:
+        for nthreads in threads:
+            workers = nprocs*nthreads
+            n = size
+            if mode == "weak":
+                n = int(round(size*workers**(1.0/dim)))
+
+            # Keep the fastest of the repeats, which is the least disturbed.
+            best = None
+            for r in range(repeats):
+                result = run(benchmark, nprocs, nthreads, n, timesteps, mpirun)
+                if result is not None and (best is None or result["operators"]["adapt"] < best["operators"]["adapt"]):
+                    best = result
+            if best is None:
+                continue
+
+            best["mode"] = mode
+            best["workers"] = workers
+            runs.append(best)
+            print("%-6s %4d x %-4d n=%-6d elements=%-10d %s" % (mode, nprocs, nthreads, n, best["nelements"],
+                  " ".join("%s=%.4g" % (op, best["operators"][op]) for op in OPERATORS)))
+
+    # Speedup and efficiency per operator, relative to the first run.
+    if runs:
+        base = runs[0]
+        for result in runs:
+            ratio = float(result["workers"])/base["workers"]
+            result["speedup"] = {}
+            result["efficiency"] = {}
+            for op in OPERATORS:
+                t0, t = base["operators"][op], result["operators"][op]
+                if t <= 0:
+                    continue
+                if mode == "strong":
+                    result["speedup"][op] = t0/t
+                    result["efficiency"][op] = t0/t/ratio
+                else:
+                    result["speedup"][op] = ratio*t0/t
+                    result["efficiency"][op] = t0/t
+    return runs
+
+
+def main():
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "b:m:p:t:n:s:r:o:h", ["mpirun="])
+    except getopt.GetoptError:
+        usage()
+
+    benchmark = os.path.join(os.path.dirname(os.path.abspath(__file__)), "benchmarks", "benchmark_adapt_2d")
+    modes = ("strong", "weak")
+    procs = [1]
+    threads = [1, 2, 4]
+    size = None
+    timesteps = 3
+    repeats = 1
+    mpirun = "mpirun"
+    output = "scaling.json"
+    for o, a in opts:
+        if o == "-b":
+            benchmark = os.path.abspath(a)
+        elif o == "-m":
+            modes = ("strong", "weak") if a == "both" else (a,)
+        elif o == "-p":
+            procs = [int(p) for p in a.split(",")]
+        elif o == "-t":
+            threads = [int(t) for t in a.split(",")]
+        elif o == "-n":
+            size = int(a)
+        elif o == "-s":
+            timesteps = int(a)
+        elif o == "-r":
+            repeats = int(a)
+        elif o == "--mpirun":
+            mpirun = a
+        elif o == "-o":
+            output = a
+        else:
+            usage()
+
+    dim = 3 if benchmark.endswith("3d") else 2
+    if size is None:
+        size = 10 if dim == 3 else 50
+
+    results = {"benchmark": os.path.basename(benchmark),
+               "host": platform.node(),
+               "machine": platform.machine(),
+               "cpus": os.sysconf("SC_NPROCESSORS_ONLN"),
+               "intervals": size,
+               "timesteps": timesteps}
+    for mode in modes:
+        results[mode] = sweep(mode, benchmark, dim, procs, threads, size, timesteps, repeats, mpirun)
+
+    with open(output, "w") as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+    print("Results written to %s" % output)
+
+
+if __name__ == "__main__":
+    main()
@@ -36,20 +36,22 @@
  */
 
 #include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #include <omp.h>
 
 #include "Mesh.h"
+#include "MeshGenerator.h"
 #include "VTKTools.h"
 #include "MetricField.h"
 
-#include "Coarsen.h"
-#include "Refine.h"
-#include "Smooth.h"
-#include "Swapping.h"
-#include "ticker.h"
+#include "Autotuner.h"
+#include "Profiler.h"
+#include "benchmark_adapt.h"
 
 #include <mpi.h>
 
@@ -62,26 +64,60 @@ int main(int argc, char **argv){
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
+  // benchmark_adapt_2d [-v] [-n intervals] [-t timesteps] [-o results.json] [-a tuning.cache]
   bool verbose = false;
-  if(argc>1){
-    verbose = std::string(argv[1])=="-v";
+  int n=200, ntimesteps=51;
+  std::string output, tuning_cache;
+  for(int i=1;i<argc;i++){
+    std::string arg(argv[i]);
+    if(arg=="-v")
+      verbose = true;
+    else if(arg=="-n" && i+1<argc)
+      n = atoi(argv[++i]);
+    else if(arg=="-t" && i+1<argc)
+      ntimesteps = std::max(atoi(argv[++i]), 2);
+    else if(arg=="-o" && i+1<argc)
+      output = argv[++i];
+    else if(arg=="-a" && i+1<argc)
+      tuning_cache = argv[++i];
+  }
+
+  // Tune the operators over the first timesteps, or start from the
+  // parameters already in the cache.
+  if(!tuning_cache.empty() && !Autotuner::instance().enable(tuning_cache)){
+    MPI_Finalize();
+    return -1;
   }
 
   const double pi = 3.141592653589793;
   const double period = 100.0;
 
-  // Benchmark times.
-  double time_coarsen=0, time_refine=0, time_swap=0, time_smooth=0, time_adapt=0;
+  // Benchmark times, in the order of BenchmarkTime.
+  double times[BENCHMARK_NTIMES] = {0, 0, 0, 0, 0};
+
+  // Label the whole boundary 1, as create_boundary() does for
+  // imported meshes.
+  const int cells[] = {n, n};
+  const int boundary_ids[] = {1, 1, 1, 1};
+  Mesh<double> *mesh=MeshGenerator<double>::generate_box(2, cells, NULL, boundary_ids, 0.0, 0, MPI_COMM_WORLD);
+  if(mesh==NULL){
+    MPI_Finalize();
+    return -1;
+  }
 
-  Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box200x200.vtu");
-  mesh->create_boundary();
+  // Sample hardware counters in the phase timers where permitted.
+  int nhw = Profiler::instance().enable_hardware_counters();
+  if(rank==0 && nhw==0)
+    std::cout<<"Hardware counters are not available"<<std::endl;
 
-  double eta=0.00005;
+  // The target error scales with the resolution, so the adapted mesh
+  // grows with n; n=200 gives the target error of the box200x200 runs.
+  double eta=2.0/(n*n);
   char filename[4096];
 
   if(rank==0)
     std::cout<<"BENCHMARK: time_coarsen time_refine time_swap time_smooth time_adapt\n";  
-  for(int t=0;t<51;t++){
+  for(int t=0;t<ntimesteps;t++){
     size_t NNodes = mesh->get_number_nodes();
 
     MetricField<double,2> metric_field(*mesh);
@@ -104,63 +140,8 @@ int main(int argc, char **argv){
       sprintf(filename, "../data/benchmark_adapt_2d-init-%d", t);
       VTKTools<double>::export_vtu(&(filename[0]), mesh, &(psi[0]));
     }
-    double T1 = get_wtime();
-
-    // See Eqn 7; X Li et al, Comp Methods Appl Mech Engrg 194 (2005) 4915-4950
-    double L_up = sqrt(2.0);
-    double L_low = L_up/2;
-
-    Coarsen<double,2> coarsen(*mesh);
-    Smooth<double,2> smooth(*mesh);
-    Refine<double,2> refine(*mesh);
-    Swapping<double,2> swapping(*mesh);
-
-    double tic, toc;
-
-    double L_max = mesh->maximal_edge_length();
-    double alpha = sqrt(2.0)/2;
-    
-    for(size_t I=0;I<5;I++){
-      for(size_t i=0;i<10;i++){
-        double L_ref = std::max(alpha*L_max, L_up);
-        
-        tic = get_wtime();
-        coarsen.coarsen(L_low, L_ref);
-        toc = get_wtime();
-        if(t>0) time_coarsen += (toc-tic);
-        
-        tic = get_wtime();
-        swapping.swap(0.7);
-        toc = get_wtime();
-        if(t>0) time_swap += (toc-tic);
-        
-        tic = get_wtime();
-        refine.refine(L_ref);
-        toc = get_wtime();
-        if(t>0) time_refine += (toc-tic);
-        
-        L_max = mesh->maximal_edge_length();
-        
-        if((L_max-L_up)<0.01)
-          break;
-      }
-      
-      double T2 = get_wtime();
-      if(t>0) time_adapt += (T2-T1);
-      
-      mesh->defragment();
-      
-      tic = get_wtime();
-      smooth.smooth(10);
-      toc = get_wtime();
-      if(t>0) time_smooth += (toc-tic);
-      if(t>0) time_adapt += (toc-tic);
-      
-      if(mesh->get_qmin()>0.4)
-        break;
-      if(verbose)
-        std::cerr<<I<<" :: meatgrinder "<<mesh->get_qmin()<<std::endl;
-    }
+    // The first timestep adapts the initial mesh, so it is not timed.
+    benchmark_adapt<2>(mesh, t>0?times:NULL, verbose);
 
     NNodes = mesh->get_number_nodes();
     psi.resize(NNodes);
@@ -172,13 +153,7 @@ int main(int argc, char **argv){
     }
 
     if((t>0)&&(rank==0))
-      std::cout<<"BENCHMARK: "
-               <<std::setw(12)<<time_coarsen/t<<" "
-               <<std::setw(11)<<time_refine/t<<" "
-               <<std::setw(9)<<time_swap/t<<" "
-               <<std::setw(11)<<time_smooth/t<<" "
-               <<std::setw(10)<<time_adapt/t<<std::endl
-               <<"NNodes, NElements = "<<mesh->get_number_nodes()<<", "<<mesh->get_number_elements()<<std::endl;
+      print_benchmark_times(mesh, times, t);
 
     if(verbose){
       mesh->print_quality();
@@ -187,6 +162,29 @@ int main(int argc, char **argv){
     }
   }
 
+  MeshStatistics stats;
+  mesh->compute_statistics(stats);
+
+  // The slowest process sets the pace.
+  MPI_Allreduce(MPI_IN_PLACE, times, BENCHMARK_NTIMES, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+  long nnodes = stats.nnodes(), nelements = stats.nelements();
+
+  if(rank==0 && !output.empty()){
+    std::ofstream file(output.c_str());
+    write_json(file, "adapt_2d", n, ntimesteps-1, nnodes, nelements, times);
+  }
+
+  // Per-operator breakdown; the counters are empty unless built with
+  // HAVE_PROFILING.
+  if(rank==0){
+    Profiler::instance().print(std::cout);
+
+    MemoryReport memory;
+    mesh->memory_report(memory);
+    memory.print(std::cout);
+  }
+
   delete mesh;
 
   MPI_Finalize();
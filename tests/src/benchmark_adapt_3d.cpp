@@ -0,0 +1,186 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "MeshGenerator.h"
+#include "VTKTools.h"
+#include "MetricField.h"
+
+#include "Autotuner.h"
+#include "Profiler.h"
+#include "benchmark_adapt.h"
+
+#include <mpi.h>
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  // benchmark_adapt_3d [-v] [-n intervals] [-t timesteps] [-o results.json] [-a tuning.cache]
+  bool verbose = false;
+  int n=20, ntimesteps=6;
+  std::string output, tuning_cache;
+  for(int i=1;i<argc;i++){
+    std::string arg(argv[i]);
+    if(arg=="-v")
+      verbose = true;
+    else if(arg=="-n" && i+1<argc)
+      n = atoi(argv[++i]);
+    else if(arg=="-t" && i+1<argc)
+      ntimesteps = std::max(atoi(argv[++i]), 2);
+    else if(arg=="-o" && i+1<argc)
+      output = argv[++i];
+    else if(arg=="-a" && i+1<argc)
+      tuning_cache = argv[++i];
+  }
+
+  // Tune the operators over the first timesteps, or start from the
+  // parameters already in the cache.
+  if(!tuning_cache.empty() && !Autotuner::instance().enable(tuning_cache)){
+    MPI_Finalize();
+    return -1;
+  }
+
+  const double pi = 3.141592653589793;
+  const double period = 100.0;
+
+  // Benchmark times, in the order of BenchmarkTime.
+  double times[BENCHMARK_NTIMES] = {0, 0, 0, 0, 0};
+
+  // One boundary ID for all six faces, which is what create_boundary()
+  // would have given.
+  const int cells[] = {n, n, n};
+  const int boundary_ids[] = {1, 1, 1, 1, 1, 1};
+  Mesh<double> *mesh=MeshGenerator<double>::generate_box(3, cells, NULL, boundary_ids, 0.0, 0, MPI_COMM_WORLD);
+  if(mesh==NULL){
+    MPI_Finalize();
+    return -1;
+  }
+
+  // Sample hardware counters in the phase timers where permitted.
+  int nhw = Profiler::instance().enable_hardware_counters();
+  if(rank==0 && nhw==0)
+    std::cout<<"Hardware counters are not available"<<std::endl;
+
+  // Target edge length away from the front; the adapted mesh grows as
+  // n^3, with a few times as many vertices as the initial one.
+  double h0=1.0/n;
+  char filename[4096];
+
+  if(rank==0)
+    std::cout<<"BENCHMARK: time_coarsen time_refine time_swap time_smooth time_adapt\n";  
+  for(int t=0;t<ntimesteps;t++){
+    size_t NNodes = mesh->get_number_nodes();
+
+    // A Hessian based metric of a field which varies mostly in two
+    // directions is singular in 3D, so the metric is prescribed instead:
+    // edges across a moving, wavy front are five times shorter.
+    MetricField<double,3> metric_field(*mesh);
+    std::vector<double> psi(NNodes), metric(NNodes*6);
+    for(size_t i=0;i<NNodes;i++){
+      const double *x = mesh->get_coords(i);
+      psi[i] = x[0] - 0.5 - 0.1*sin(2*pi*(x[1]+x[2]) + 2*pi*t/period);
+
+      double hn = h0*(0.2 + 0.8*std::min(fabs(psi[i])/0.1, 1.0));
+      double m[] = {1.0/(hn*hn), 0.0, 0.0, 1.0/(h0*h0), 0.0, 1.0/(h0*h0)};
+      std::copy(m, m+6, metric.begin()+i*6);
+    }
+
+    metric_field.set_metric(&(metric[0]));
+
+    if(t==0)
+      metric_field.update_mesh();
+    else
+      metric_field.relax_mesh(0.5);
+
+    if(verbose){
+      sprintf(filename, "../data/benchmark_adapt_3d-init-%d", t);
+      VTKTools<double>::export_vtu(&(filename[0]), mesh, &(psi[0]));
+    }
+    // The first timestep adapts the initial mesh, so it is not timed.
+    benchmark_adapt<3>(mesh, t>0?times:NULL, verbose);
+
+    if((t>0)&&(rank==0))
+      print_benchmark_times(mesh, times, t);
+
+    if(verbose)
+      mesh->print_quality();
+  }
+
+  MeshStatistics stats;
+  mesh->compute_statistics(stats);
+
+  // The slowest process sets the pace.
+  MPI_Allreduce(MPI_IN_PLACE, times, BENCHMARK_NTIMES, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+  long nnodes = stats.nnodes(), nelements = stats.nelements();
+
+  if(rank==0 && !output.empty()){
+    std::ofstream file(output.c_str());
+    write_json(file, "adapt_3d", n, ntimesteps-1, nnodes, nelements, times);
+  }
+
+  // Per-operator breakdown; the counters are empty unless built with
+  // HAVE_PROFILING.
+  if(rank==0){
+    Profiler::instance().print(std::cout);
+
+    MemoryReport memory;
+    mesh->memory_report(memory);
+    memory.print(std::cout);
+  }
+
+  delete mesh;
+
+  MPI_Finalize();
+
+  return 0;
+}
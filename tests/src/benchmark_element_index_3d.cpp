@@ -0,0 +1,156 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "VTKTools.h"
+#include "MetricField.h"
+#include "ElementIndex.h"
+
+#include "Coarsen.h"
+#include "Refine.h"
+#include "Smooth.h"
+#include "Swapping.h"
+#include "ticker.h"
+
+#include <mpi.h>
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  // Mesh size and number of query points.
+  double h = 0.02;
+  int npoints = 1000000;
+  if(argc>1)
+    h = atof(argv[1]);
+  if(argc>2)
+    npoints = atoi(argv[2]);
+
+  Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box20x20x20.vtu");
+  mesh->create_boundary();
+
+  // Adapt to a uniform mesh of size h.
+  MetricField<double,3> metric_field(*mesh);
+  size_t NNodes = mesh->get_number_nodes();
+  double m[] = {1.0/pow(h, 2), 0, 0, 1.0/pow(h, 2), 0, 1.0/pow(h, 2)};
+  for(size_t i=0;i<NNodes;i++)
+    metric_field.set_metric(m, i);
+  metric_field.update_mesh();
+
+  Coarsen<double,3> coarsen(*mesh);
+  Refine<double,3> refine(*mesh);
+  Swapping<double,3> swapping(*mesh);
+  Smooth<double,3> smooth(*mesh);
+
+  double L_up = sqrt(2.0);
+  double L_low = L_up*0.5;
+  double L_max = mesh->maximal_edge_length();
+  for(size_t i=0;i<20;i++){
+    double L_ref = std::max(sqrt(2.0)/2*L_max, L_up);
+    coarsen.coarsen(L_low, L_ref);
+    swapping.swap(0.7);
+    refine.refine(L_ref);
+    L_max = mesh->maximal_edge_length();
+    if((L_max-L_up)<0.01)
+      break;
+  }
+  mesh->defragment();
+
+  // Random points, and the same points sorted along x, which is
+  // closer to the access pattern of probes and particles.
+  std::vector<double> x(npoints*3), x_sorted(npoints*3), bary(npoints*4);
+  std::vector<int> eid(npoints);
+  for(int i=0;i<npoints*3;i++)
+    x[i] = (double)rand()/RAND_MAX;
+  {
+    std::vector< std::pair<double, int> > order(npoints);
+    for(int i=0;i<npoints;i++)
+      order[i] = std::pair<double, int>(x[i*3]+x[i*3+1]/1000, i);
+    std::sort(order.begin(), order.end());
+    for(int i=0;i<npoints;i++)
+      for(int d=0;d<3;d++)
+        x_sorted[i*3+d] = x[order[i].second*3+d];
+  }
+
+  double tic = get_wtime();
+  ElementIndex<double> index(*mesh);
+  double time_build = get_wtime()-tic;
+
+  tic = get_wtime();
+  size_t found = index.locate(npoints, &(x[0]), &(eid[0]), &(bary[0]));
+  double time_random = get_wtime()-tic;
+
+  tic = get_wtime();
+  found += index.locate(npoints, &(x_sorted[0]), &(eid[0]), &(bary[0]));
+  double time_sorted = get_wtime()-tic;
+
+  smooth.smart_laplacian(10);
+  tic = get_wtime();
+  index.refit();
+  double time_refit = get_wtime()-tic;
+
+  tic = get_wtime();
+  found += index.locate(npoints, &(x[0]), &(eid[0]), &(bary[0]));
+  double time_refitted = get_wtime()-tic;
+
+  std::cout<<"NElements, npoints, threads = "<<index.get_number_elements()<<", "<<npoints<<", "<<omp_get_max_threads()<<std::endl
+           <<"Located "<<found<<" of "<<3*npoints<<std::endl
+           <<"BENCHMARK: time_build time_refit queries/s(random) queries/s(sorted) queries/s(refitted)\n"
+           <<"BENCHMARK: "
+           <<std::setw(10)<<time_build<<" "
+           <<std::setw(10)<<time_refit<<" "
+           <<std::setw(17)<<npoints/time_random<<" "
+           <<std::setw(17)<<npoints/time_sorted<<" "
+           <<std::setw(19)<<npoints/time_refitted<<std::endl;
+
+  delete mesh;
+
+  MPI_Finalize();
+
+  return 0;
+}
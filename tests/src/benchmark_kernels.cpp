@@ -0,0 +1,633 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "MeshGenerator.h"
+#include "VTKTools.h"
+#include "MetricField.h"
+#include "MetricTensor.h"
+#include "ElementProperty.h"
+#include "Colour.h"
+
+#include "Coarsen.h"
+#include "Refine.h"
+#include "Swapping.h"
+#include "ticker.h"
+
+#include <mpi.h>
+
+/*
+ * Microbenchmarks of the kernels the mesh operators spend their time
+ * in. Each kernel is run over all items of a mesh (elements, nodes,
+ * edges or swap candidates) for a number of warm-up and timed
+ * repetitions, and the time per item is reported as JSON:
+ *
+ *   benchmark_kernels [-r repetitions] [-w warmup] [-n2 n] [-n3 n]
+ *                     [-m mesh.vtu]... [-k filter] [-o results.json]
+ *
+ * The synthetic meshes are structured n x n squares and n x n x n cubes,
+ * run on rank 0 only. Meshes given with -m are partitioned over all
+ * processes, which also times halo_update; the times are those of rank 0.
+ * Kernels which modify the mesh run on state that is restored, untimed,
+ * before every repetition.
+ */
+
+/// Time per item of one kernel, in seconds, for each timed repetition.
+struct KernelResult{
+  std::string kernel, mesh;
+  int dim;
+  size_t items;
+  std::vector<double> times;
+};
+
+/// Options shared by all benchmarks.
+struct KernelOptions{
+  int repetitions, warmup;
+  std::string filter;
+};
+
+template<typename real_t, int dim>
+class KernelBenchmark{
+ public:
+  KernelBenchmark(Mesh<real_t> &mesh, const std::string &name, const KernelOptions &options, std::vector<KernelResult> &results) :
+    mesh(&mesh), mesh_name(name), options(options), results(results), sink(0.0){
+    NNodes = mesh.get_number_nodes();
+    NElements = mesh.get_number_elements();
+
+    MPI_Comm comm = mesh.get_mpi_comm();
+    MPI_Comm_size(comm, &nprocs);
+
+    // A field with a sharp front, whose metric is normalised so that
+    // the mean edge length is 1, as it is during adaptation.
+    psi.resize(NNodes);
+    for(size_t i=0;i<NNodes;i++){
+      const real_t *x = mesh.get_coords(i);
+      double z = dim==3?x[2]:0.0;
+      psi[i] = 0.1*sin(50*(x[0]-0.5)*(x[1]-0.5+z))+atan2(-0.1, 2*(x[0]-0.5)-sin(5*(x[1]-0.5)));
+    }
+    metric_field = new MetricField<real_t,dim>(mesh);
+    metric_field->add_field(&(psi[0]), 0.01, -1);
+    metric_field->update_mesh();
+
+    double sum[] = {0.0, 0.0};
+    for(size_t i=0;i<NNodes;i++)
+      for(typename std::vector<index_t>::const_iterator it=mesh.NNList[i].begin();it!=mesh.NNList[i].end();++it)
+        if((index_t)i<*it){
+          sum[0] += mesh.calc_edge_length(i, *it);
+          sum[1] += 1;
+        }
+    MPI_Allreduce(MPI_IN_PLACE, sum, 2, MPI_DOUBLE, MPI_SUM, comm);
+    double scale = sum[0]/sum[1];
+    for(size_t i=0;i<NNodes*msize;i++)
+      mesh.metric[i] *= scale*scale;
+
+    coarsen = new Coarsen<real_t,dim>(mesh);
+    coarsen->delete_slivers = false;
+    property = coarsen->property;
+  }
+
+  ~KernelBenchmark(){
+    delete coarsen;
+    delete metric_field;
+  }
+
+  /// Run all kernels; refinement comes last as it leaves new vertices behind.
+  void run(){
+    if(dim==2){
+      measure("lipnikov", NElements, &KernelBenchmark::lipnikov_2d);
+      measure("lipnikov_grad", NElements, &KernelBenchmark::lipnikov_grad_2d);
+    }else{
+      measure("lipnikov", NElements, &KernelBenchmark::lipnikov_3d);
+      measure("lipnikov_grad", NElements, &KernelBenchmark::lipnikov_grad_3d);
+    }
+
+    size_t NEdges=0;
+    for(size_t i=0;i<NNodes;i++)
+      NEdges += mesh->NNList[i].size();
+    measure("calc_edge_length", NEdges/2, &KernelBenchmark::calc_edge_length);
+    measure("coarsen_identify_kernel", NNodes, &KernelBenchmark::coarsen_identify);
+    measure("hessian_qls_kernel", NNodes, &KernelBenchmark::hessian_qls);
+    measure("MetricTensor::constrain", NNodes, &KernelBenchmark::constrain);
+    measure("MetricTensor::eigen_decomp", NNodes, &KernelBenchmark::eigen_decomp);
+    measure("Colour::GebremedhinManne", NNodes, &KernelBenchmark::colour);
+
+    if(nprocs>1){
+      halo_field.assign(NNodes, 1.0);
+      measure("halo_update", 1, &KernelBenchmark::halo_update);
+    }
+
+    if(dim==2 && selected("swap_kernel2d")){
+      prepare_swap();
+      measure("swap_kernel2d", swap_edges.size(), &KernelBenchmark::swap_kernel2d, &KernelBenchmark::reset_swap);
+      delete swapping;
+    }
+
+    if(dim==3 && nprocs==1 && selected("refine3D_")){
+      prepare_refine();
+      for(refine_cnt=1;refine_cnt<=6;refine_cnt++){
+        std::ostringstream name;
+        name<<"refine3D_"<<refine_cnt;
+        measure(name.str(), refine_elements[refine_cnt-1].size(), &KernelBenchmark::refine3D, &KernelBenchmark::reset_refine);
+      }
+      delete refine;
+    }
+  }
+
+ private:
+  bool selected(const std::string &kernel) const{
+    return options.filter.empty() || kernel.find(options.filter)!=std::string::npos ||
+      options.filter.find(kernel)!=std::string::npos;
+  }
+
+  /// Time kernel, which processes items items, after calling reset.
+  void measure(const std::string &kernel, size_t items, void (KernelBenchmark::*body)(), void (KernelBenchmark::*reset)()=NULL){
+    if(!selected(kernel) || items==0)
+      return;
+
+    KernelResult result;
+    result.kernel = kernel;
+    result.mesh = mesh_name;
+    result.dim = dim;
+    result.items = items;
+    for(int r=0;r<options.warmup+options.repetitions;r++){
+      if(reset!=NULL)
+        (this->*reset)();
+      double tic = get_wtime();
+      (this->*body)();
+      double toc = get_wtime();
+      if(r>=options.warmup)
+        result.times.push_back((toc-tic)/items);
+    }
+    results.push_back(result);
+  }
+
+  void lipnikov_2d(){
+    double sum=0;
+    for(size_t i=0;i<NElements;i++){
+      const index_t *n=mesh->get_element(i);
+      sum += property->lipnikov(mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2]),
+                                mesh->get_metric(n[0]), mesh->get_metric(n[1]), mesh->get_metric(n[2]));
+    }
+    sink += sum;
+  }
+
+  void lipnikov_3d(){
+    double sum=0;
+    for(size_t i=0;i<NElements;i++){
+      const index_t *n=mesh->get_element(i);
+      sum += property->lipnikov(mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2]), mesh->get_coords(n[3]),
+                                mesh->get_metric(n[0]), mesh->get_metric(n[1]), mesh->get_metric(n[2]), mesh->get_metric(n[3]));
+    }
+    sink += sum;
+  }
+
+  void lipnikov_grad_2d(){
+    double sum=0, grad[2];
+    for(size_t i=0;i<NElements;i++){
+      const index_t *n=mesh->get_element(i);
+      property->lipnikov_grad(0, mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2]),
+                              mesh->get_metric(n[0]), grad);
+      sum += grad[0];
+    }
+    sink += sum;
+  }
+
+  void lipnikov_grad_3d(){
+    double sum=0, grad[3];
+    for(size_t i=0;i<NElements;i++){
+      const index_t *n=mesh->get_element(i);
+      property->lipnikov_grad(0, mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2]), mesh->get_coords(n[3]),
+                              mesh->get_metric(n[0]), grad);
+      sum += grad[0];
+    }
+    sink += sum;
+  }
+
+  void calc_edge_length(){
+    double sum=0;
+    for(size_t i=0;i<NNodes;i++)
+      for(typename std::vector<index_t>::const_iterator it=mesh->NNList[i].begin();it!=mesh->NNList[i].end();++it)
+        if((index_t)i<*it)
+          sum += mesh->calc_edge_length(i, *it);
+    sink += sum;
+  }
+
+  void coarsen_identify(){
+    double L_low = sqrt(2.0)/2, L_max = sqrt(2.0);
+    long sum=0;
+    for(size_t i=0;i<NNodes;i++)
+      sum += coarsen->coarsen_identify_kernel(i, L_low, L_max);
+    sink += sum;
+  }
+
+  void hessian_qls(){
+    real_t H[msize];
+    double sum=0;
+    for(size_t i=0;i<NNodes;i++){
+      metric_field->hessian_qls_kernel(&(psi[0]), i, H);
+      sum += H[0];
+    }
+    sink += sum;
+  }
+
+  void constrain(){
+    real_t M[msize];
+    double sum=0;
+    for(size_t i=0;i<NNodes;i++){
+      MetricTensor<real_t,dim> metric(mesh->get_metric(i));
+      metric.constrain(mesh->get_metric(mesh->NNList[i][0]));
+      metric.get_metric(M);
+      sum += M[0];
+    }
+    sink += sum;
+  }
+
+  void eigen_decomp(){
+    real_t D[dim], V[dim*dim];
+    double sum=0;
+    for(size_t i=0;i<NNodes;i++){
+      MetricTensor<real_t,dim> metric(mesh->get_metric(i));
+      metric.eigen_decomp(D, V);
+      sum += D[0];
+    }
+    sink += sum;
+  }
+
+  void colour(){
+    std::vector<char> colours(NNodes);
+    Colour::GebremedhinManne(NNodes, mesh->NNList, colours);
+    sink += colours[0];
+  }
+
+  void halo_update(){
+    mesh->template update_halo<real_t, 1>(halo_field);
+  }
+
+  /*! Pick the interior edges of which no two share an element, so each
+   * swap sees the mesh as it was before the repetition. */
+  void prepare_swap(){
+    swapping = new Swapping<real_t,dim>(*mesh);
+    swapping->quality.resize(NElements);
+    for(size_t i=0;i<NElements;i++){
+      const index_t *n=mesh->get_element(i);
+      swapping->quality[i] = property->lipnikov(mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2]),
+                                                mesh->get_metric(n[0]), mesh->get_metric(n[1]), mesh->get_metric(n[2]));
+    }
+
+    std::vector<bool> used(NElements, false);
+    for(size_t i=0;i<NNodes;i++){
+      for(typename std::vector<index_t>::const_iterator it=mesh->NNList[i].begin();it!=mesh->NNList[i].end();++it){
+        if(*it<(index_t)i)
+          continue;
+        std::vector<index_t> shared;
+        std::set_intersection(mesh->NEList[i].begin(), mesh->NEList[i].end(),
+                              mesh->NEList[*it].begin(), mesh->NEList[*it].end(), std::back_inserter(shared));
+        if(shared.size()==2 && !used[shared[0]] && !used[shared[1]]){
+          used[shared[0]] = used[shared[1]] = true;
+          swap_edges.push_back(Edge<index_t>(i, *it));
+        }
+      }
+    }
+
+    saved_ENList = mesh->_ENList;
+    saved_boundary = mesh->boundary;
+    saved_NNList = mesh->NNList;
+    saved_quality = swapping->quality;
+  }
+
+  void reset_swap(){
+    std::copy(saved_ENList.begin(), saved_ENList.end(), mesh->_ENList.begin());
+    std::copy(saved_boundary.begin(), saved_boundary.end(), mesh->boundary.begin());
+    for(size_t i=0;i<NNodes;i++)
+      mesh->NNList[i] = saved_NNList[i];
+    swapping->quality = saved_quality;
+    swapping->def_ops->clear();
+  }
+
+  void swap_kernel2d(){
+    std::set<index_t> modified_elements;
+    for(size_t i=0;i<swap_edges.size();i++){
+      Edge<index_t> edge(swap_edges[i]);
+      swapping->swap_kernel2d(edge, modified_elements, 0);
+      modified_elements.clear();
+    }
+  }
+
+  /*! Split every other edge, chosen by a hash of its vertices, and take
+   * the mesh through the split, mark and facet phases of Refine::refine
+   * on one thread. The elements are then grouped by their number of
+   * split edges, i.e. by the refine3D_N kernel that refines them. */
+  void prepare_refine(){
+    refine = new Refine<real_t,dim>(*mesh);
+    const size_t nedge = Refine<real_t,dim>::nedge;
+
+    refine->new_vertices_per_element.assign(nedge*NElements, -1);
+    refine->splitCnt[0] = 0;
+    refine->newVertices[0].clear();
+    refine->newCoords[0].clear();
+    refine->newMetric[0].clear();
+    for(size_t i=0;i<NNodes;i++){
+      for(typename std::vector<index_t>::const_iterator it=mesh->NNList[i].begin();it!=mesh->NNList[i].end();++it){
+        unsigned int hash = (unsigned int)(i*73856093)^(unsigned int)(*it*19349663);
+        if((index_t)i<*it && (hash>>4)%2==0){
+          refine->splitCnt[0]++;
+          refine->refine_edge(i, *it, 0);
+        }
+      }
+    }
+
+    // Room for the split vertices and a centroid per element.
+    size_t nsplit = refine->splitCnt[0];
+    size_t reserve = NNodes+nsplit+NElements;
+    if(mesh->NNList.size()<reserve){
+      mesh->_coords.resize(reserve*dim);
+      mesh->metric.resize(reserve*msize);
+      mesh->NNList.resize(reserve);
+      mesh->NEList.resize(reserve);
+      mesh->node_owner.resize(reserve);
+      mesh->halo_flag.resize(reserve, 0);
+      mesh->lnn2gnn.resize(reserve);
+    }
+    std::copy(refine->newCoords[0].begin(), refine->newCoords[0].end(), mesh->_coords.begin()+NNodes*dim);
+    std::copy(refine->newMetric[0].begin(), refine->newMetric[0].end(), mesh->metric.begin()+NNodes*msize);
+    mesh->NNodes = NNodes+nsplit;
+
+    for(size_t i=0;i<nsplit;i++){
+      DirectedEdge<index_t> &split = refine->newVertices[0][i];
+      split.id = NNodes+i;
+
+      std::vector<index_t> shared;
+      std::set_intersection(mesh->NEList[split.edge.first].begin(), mesh->NEList[split.edge.first].end(),
+                            mesh->NEList[split.edge.second].begin(), mesh->NEList[split.edge.second].end(),
+                            std::back_inserter(shared));
+      for(size_t j=0;j<shared.size();j++)
+        refine->new_vertices_per_element[nedge*shared[j]+refine->edgeNumber(shared[j], split.edge.first, split.edge.second)] = split.id;
+
+      mesh->NNList[split.id].push_back(split.edge.first);
+      mesh->NNList[split.id].push_back(split.edge.second);
+      refine->def_ops->remNN(split.edge.first, split.edge.second, 0);
+      refine->def_ops->addNN(split.edge.first, split.id, 0);
+      refine->def_ops->remNN(split.edge.second, split.edge.first, 0);
+      refine->def_ops->addNN(split.edge.second, split.id, 0);
+      mesh->node_owner[split.id] = 0;
+      mesh->lnn2gnn[split.id] = split.id;
+    }
+
+    for(size_t eid=0;eid<NElements;eid++){
+      const index_t *n = mesh->get_element(eid);
+      const index_t facets[4][3] = {{n[0], n[1], n[2]}, {n[0], n[1], n[3]}, {n[0], n[2], n[3]}, {n[1], n[2], n[3]}};
+      for(int j=0;j<4;j++){
+        const index_t *facet = facets[j];
+        std::vector<index_t> shared01, shared;
+        std::set_intersection(mesh->NEList[facet[0]].begin(), mesh->NEList[facet[0]].end(),
+                              mesh->NEList[facet[1]].begin(), mesh->NEList[facet[1]].end(), std::back_inserter(shared01));
+        std::set_intersection(mesh->NEList[facet[2]].begin(), mesh->NEList[facet[2]].end(),
+                              shared01.begin(), shared01.end(), std::back_inserter(shared));
+        if((index_t)eid==shared.back())
+          for(int k=0;k<3;k++)
+            if(refine->new_vertices_per_element[nedge*eid+refine->edgeNumber(eid, facet[k], facet[(k+1)%3])]!=-1){
+              refine->refine_facet(eid, facet, 0);
+              break;
+            }
+      }
+    }
+
+    for(int vtid=0;vtid<refine->defOp_scaling_factor*refine->nthreads;vtid++){
+      for(int i=0;i<refine->nthreads;i++){
+        refine->def_ops->commit_remNN(i, vtid);
+        refine->def_ops->commit_addNN(i, vtid);
+      }
+    }
+    refine->def_ops->clear();
+
+    // The split edges of each element, as in Refine::refine_element.
+    for(size_t eid=0;eid<NElements;eid++){
+      const index_t *n = mesh->get_element(eid);
+      std::vector< DirectedEdge<index_t> > splitEdges;
+      for(int j=0, pos=0;j<4;j++)
+        for(int k=j+1;k<4;k++, pos++){
+          index_t vid = refine->new_vertices_per_element[nedge*eid+pos];
+          if(vid>=0)
+            splitEdges.push_back(DirectedEdge<index_t>(n[j], n[k], vid));
+        }
+      if(!splitEdges.empty()){
+        refine_elements[splitEdges.size()-1].push_back(eid);
+        refine_edges[splitEdges.size()-1].push_back(splitEdges);
+      }
+    }
+
+    saved_ENList = mesh->_ENList;
+    saved_boundary = mesh->boundary;
+    refine_NNodes = mesh->NNodes;
+  }
+
+  void reset_refine(){
+    std::copy(saved_ENList.begin(), saved_ENList.end(), mesh->_ENList.begin());
+    std::copy(saved_boundary.begin(), saved_boundary.end(), mesh->boundary.begin());
+    for(size_t i=refine_NNodes;i<mesh->NNodes;i++)
+      mesh->NNList[i].clear();
+    mesh->NNodes = refine_NNodes;
+    refine->newElements[0].clear();
+    refine->newBoundaries[0].clear();
+    refine->splitCnt[0] = 0;
+    refine->def_ops->clear();
+    work_edges = refine_edges[refine_cnt-1];
+  }
+
+  void refine3D(){
+    const std::vector<index_t> &elements = refine_elements[refine_cnt-1];
+    for(size_t i=0;i<elements.size();i++)
+      (refine->*(refine->refineMode3D[refine_cnt-1]))(work_edges[i], elements[i], 0);
+  }
+
+  static const size_t msize=(dim==2?3:6);
+
+  Mesh<real_t> *mesh;
+  std::string mesh_name;
+  KernelOptions options;
+  std::vector<KernelResult> &results;
+  size_t NNodes, NElements;
+  int nprocs;
+
+  std::vector<real_t> psi, halo_field;
+  MetricField<real_t,dim> *metric_field;
+  Coarsen<real_t,dim> *coarsen;
+  ElementProperty<real_t> *property;
+
+  Swapping<real_t,dim> *swapping;
+  std::vector< Edge<index_t> > swap_edges;
+  std::vector< std::vector<index_t> > saved_NNList;
+  std::vector<real_t> saved_quality;
+
+  Refine<real_t,dim> *refine;
+  int refine_cnt;
+  size_t refine_NNodes;
+  std::vector<index_t> refine_elements[6];
+  std::vector< std::vector< DirectedEdge<index_t> > > refine_edges[6], work_edges;
+
+  std::vector<index_t> saved_ENList;
+  std::vector<int> saved_boundary;
+
+  // Results of the kernels, so they are not optimised away.
+  volatile double sink;
+};
+
+void write_json(std::ostream &out, const std::vector<KernelResult> &results, const KernelOptions &options, int nprocs){
+  out<<"{"<<std::endl
+     <<"  \"benchmark\": \"kernels\","<<std::endl
+     <<"  \"processes\": "<<nprocs<<","<<std::endl
+     <<"  \"threads\": "<<omp_get_max_threads()<<","<<std::endl
+     <<"  \"repetitions\": "<<options.repetitions<<","<<std::endl
+     <<"  \"warmup\": "<<options.warmup<<","<<std::endl
+     <<"  \"results\": ["<<std::endl;
+  out<<std::fixed<<std::setprecision(3);
+  for(size_t i=0;i<results.size();i++){
+    std::vector<double> times = results[i].times;
+    std::sort(times.begin(), times.end());
+    size_t n = times.size();
+    double mean=0, var=0;
+    for(size_t j=0;j<n;j++)
+      mean += times[j]/n;
+    for(size_t j=0;j<n;j++)
+      var += (times[j]-mean)*(times[j]-mean)/std::max(n-1, (size_t)1);
+    double median = n%2?times[n/2]:0.5*(times[n/2-1]+times[n/2]);
+
+    out<<"    {\"kernel\": \""<<results[i].kernel<<"\", \"dim\": "<<results[i].dim
+       <<", \"mesh\": \""<<results[i].mesh<<"\", \"items\": "<<results[i].items
+       <<", \"min_ns\": "<<times[0]*1e9<<", \"median_ns\": "<<median*1e9
+       <<", \"mean_ns\": "<<mean*1e9<<", \"stddev_ns\": "<<sqrt(var)*1e9
+       <<", \"max_ns\": "<<times[n-1]*1e9<<"}"<<(i+1<results.size()?",":"")<<std::endl;
+  }
+  out<<"  ]"<<std::endl<<"}"<<std::endl;
+}
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  int rank, nprocs;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+  KernelOptions options;
+  options.repetitions = 10;
+  options.warmup = 2;
+  int n2=200, n3=20;
+  std::vector<std::string> filenames;
+  std::string output;
+  for(int i=1;i+1<argc;i+=2){
+    std::string arg(argv[i]);
+    if(arg=="-r")
+      options.repetitions = std::max(atoi(argv[i+1]), 1);
+    else if(arg=="-w")
+      options.warmup = atoi(argv[i+1]);
+    else if(arg=="-n2")
+      n2 = atoi(argv[i+1]);
+    else if(arg=="-n3")
+      n3 = atoi(argv[i+1]);
+    else if(arg=="-m")
+      filenames.push_back(argv[i+1]);
+    else if(arg=="-k")
+      options.filter = argv[i+1];
+    else if(arg=="-o")
+      output = argv[i+1];
+    else if(rank==0)
+      std::cerr<<"WARNING: unknown option "<<arg<<std::endl;
+  }
+
+  std::vector<KernelResult> results;
+
+  if(rank==0){
+    std::ostringstream name2, name3;
+    name2<<"square_"<<n2;
+    name3<<"cube_"<<n3;
+    // The same single boundary ID that create_boundary() gives the
+    // imported meshes below.
+    const int boundary_ids[] = {1, 1, 1, 1, 1, 1};
+    if(n2>0){
+      const int cells[] = {n2, n2};
+      Mesh<double> *mesh = MeshGenerator<double>::generate_box(2, cells, NULL, boundary_ids);
+      KernelBenchmark<double,2>(*mesh, name2.str(), options, results).run();
+      delete mesh;
+    }
+    if(n3>0){
+      const int cells[] = {n3, n3, n3};
+      Mesh<double> *mesh = MeshGenerator<double>::generate_box(3, cells, NULL, boundary_ids);
+      KernelBenchmark<double,3>(*mesh, name3.str(), options, results).run();
+      delete mesh;
+    }
+  }
+
+  for(size_t i=0;i<filenames.size();i++){
+    Mesh<double> *mesh = VTKTools<double>::import_vtu(filenames[i].c_str());
+    mesh->create_boundary();
+    std::string name = filenames[i].substr(filenames[i].find_last_of('/')+1);
+    if(mesh->get_number_dimensions()==2)
+      KernelBenchmark<double,2>(*mesh, name, options, results).run();
+    else
+      KernelBenchmark<double,3>(*mesh, name, options, results).run();
+    delete mesh;
+  }
+
+  if(rank==0){
+    if(output.empty()){
+      write_json(std::cout, results, options, nprocs);
+    }else{
+      std::ofstream file(output.c_str());
+      write_json(file, results, options, nprocs);
+    }
+  }
+
+  MPI_Finalize();
+
+  return 0;
+}
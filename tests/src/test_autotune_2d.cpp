@@ -0,0 +1,199 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "MeshGenerator.h"
+#include "MetricField.h"
+
+#include "Autotuner.h"
+#include "Coarsen.h"
+#include "Refine.h"
+#include "Smooth.h"
+#include "Swapping.h"
+
+#include <mpi.h>
+
+// Adapt a fresh mesh to the same metric, as in one timestep.
+bool adapt(bool verbose){
+  const int n[] = {30, 30};
+  Mesh<double> *mesh=MeshGenerator<double>::generate_box(2, n);
+
+  MetricField<double,2> metric_field(*mesh);
+
+  size_t NNodes = mesh->get_number_nodes();
+  std::vector<double> psi(NNodes);
+  for(size_t i=0;i<NNodes;i++){
+    double x = 2*mesh->get_coords(i)[0]-1;
+    double y = 2*mesh->get_coords(i)[1]-1;
+
+    psi[i] = 0.1*sin(20*x) + atan2(-0.1, (double)(2*x - sin(5*y)));
+  }
+
+  metric_field.add_field(&(psi[0]), 0.01, 2);
+  metric_field.update_mesh();
+
+  double L_up = sqrt(2.0);
+  double L_low = L_up/2;
+
+  Coarsen<double, 2> coarsen(*mesh);
+  Smooth<double, 2> smooth(*mesh);
+  Refine<double, 2> refine(*mesh);
+  Swapping<double, 2> swapping(*mesh);
+
+  double L_max = mesh->maximal_edge_length();
+  double alpha = sqrt(2.0)/2;
+  for(size_t i=0;i<20;i++){
+    double L_ref = std::max(alpha*L_max, L_up);
+
+    coarsen.coarsen(L_low, L_ref);
+    swapping.swap(0.7);
+    refine.refine(L_ref);
+
+    L_max = mesh->maximal_edge_length();
+    if((L_max-L_up)<0.01)
+      break;
+  }
+
+  mesh->defragment();
+
+  smooth.smart_laplacian(10);
+  smooth.optimisation_linf(10);
+
+  bool valid = mesh->verify() && fabs(mesh->calculate_area()-1.0)<1e-12 && mesh->get_qmin()>0.1;
+  if(verbose)
+    std::cout<<"Adapted "<<mesh->get_number_elements()<<" elements, qmin "<<mesh->get_qmin()<<std::endl;
+
+  delete mesh;
+
+  return valid;
+}
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  const char *cache = "../data/test_autotune_2d.cache";
+  std::remove(cache);
+
+  const AutotunerOperator ops[] = {AUTOTUNE_COARSEN, AUTOTUNE_REFINE, AUTOTUNE_SWAP,
+                                   AUTOTUNE_SMART_LAPLACIAN, AUTOTUNE_OPTIMISATION_LINF};
+  const int nops = 5;
+  const int nthreads = pragmatic_nthreads();
+
+  Autotuner &autotuner = Autotuner::instance();
+  bool pass = autotuner.enable(cache);
+
+  // Every candidate has to be timed before an operator is tuned; the
+  // mesh must stay valid whatever parameters are tried.
+  int timesteps=0;
+  for(;timesteps<20;timesteps++){
+    pass = adapt(verbose) && pass;
+
+    int ntuned=0;
+    TuningParameters parameters;
+    for(int i=0;i<nops;i++)
+      ntuned += autotuner.get_tuned(ops[i], 2, nthreads, parameters);
+    if(ntuned==nops)
+      break;
+  }
+
+  std::vector<TuningParameters> tuned(nops);
+  for(int i=0;i<nops;i++){
+    pass = autotuner.get_tuned(ops[i], 2, nthreads, tuned[i]) && pass;
+    if(verbose)
+      std::cout<<Autotuner::get_operator_name(ops[i])<<": defop_scaling_factor "<<tuned[i].defop_scaling_factor
+               <<", schedule "<<Autotuner::get_schedule_name(tuned[i].schedule)<<","<<tuned[i].chunk
+               <<", max_colour "<<tuned[i].max_colour<<", initial_colours "<<tuned[i].initial_colours<<std::endl;
+  }
+  if(verbose)
+    std::cout<<"Tuned in "<<timesteps+1<<" timesteps"<<std::endl;
+
+  // A later run starts from the cache and tunes nothing.
+  autotuner.disable();
+  pass = autotuner.enable(cache) && pass;
+  for(int i=0;i<nops;i++){
+    TuningParameters parameters;
+    pass = autotuner.get_tuned(ops[i], 2, nthreads, parameters) && parameters==tuned[i] && pass;
+  }
+  pass = adapt(verbose) && pass;
+
+  // Operators tuned for another number of threads are not reused.
+  TuningParameters parameters;
+  pass = !autotuner.get_tuned(AUTOTUNE_COARSEN, 2, nthreads+1, parameters) && pass;
+  autotuner.disable();
+
+  // A corrupt cache is rejected, leaving tuning off and the file as it was.
+  const std::string corrupt = "coarsen 2 1 4 sometimes 0 16 15";
+  {
+    std::ofstream out(cache);
+    out<<corrupt<<std::endl;
+  }
+  pass = !autotuner.enable(cache) && !autotuner.is_enabled() && pass;
+  for(int i=0;i<8;i++)
+    pass = adapt(false) && pass;
+  {
+    std::ifstream in(cache);
+    std::string line;
+    pass = std::getline(in, line) && line==corrupt && pass;
+  }
+  std::remove(cache);
+
+  if(pass)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  MPI_Finalize();
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "pragmatic.h"
+#include "ticker.h"
+#include "unit_square.h"
+
+#include <mpi.h>
+
+// Sum of element areas, which must stay 1.
+double area(const pragmatic_mesh_t *mesh){
+  int NNodes, NElements, stride;
+  pragmatic_mesh_get_info(mesh, &NNodes, &NElements);
+  const double *x = pragmatic_mesh_get_coords_view(mesh, &stride);
+  const int *n = pragmatic_mesh_get_elements_view(mesh, &stride);
+
+  double total = 0;
+  for(int i=0;i<NElements;i++){
+    const double *x0 = x+n[i*3]*2, *x1 = x+n[i*3+1]*2, *x2 = x+n[i*3+2]*2;
+    total += 0.5*((x1[0]-x0[0])*(x2[1]-x0[1])-(x2[0]-x0[0])*(x1[1]-x0[1]));
+  }
+  return total;
+}
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_MULTIPLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  const int nmeshes = 16;
+  std::vector<pragmatic_mesh_t *> batch(nmeshes), reference(nmeshes);
+  for(int i=0;i<nmeshes;i++){
+    batch[i] = create_unit_square(20, 0.1+0.05*i, 0.05);
+    reference[i] = create_unit_square(20, 0.1+0.05*i, 0.05);
+  }
+
+  double tic = get_wtime();
+  pragmatic_mesh_adapt_batch(nmeshes, &(batch[0]));
+  double batch_time = get_wtime()-tic;
+
+  // Adapt the same meshes one after another on a single thread.
+  int nthreads = omp_get_max_threads();
+  omp_set_num_threads(1);
+  tic = get_wtime();
+  for(int i=0;i<nmeshes;i++)
+    pragmatic_mesh_adapt(reference[i]);
+  double serial_time = get_wtime()-tic;
+  omp_set_num_threads(nthreads);
+
+  bool valid = true;
+  for(int i=0;i<nmeshes;i++){
+    int NNodes0, NElements0, NNodes1, NElements1;
+    pragmatic_mesh_get_info(batch[i], &NNodes0, &NElements0);
+    pragmatic_mesh_get_info(reference[i], &NNodes1, &NElements1);
+
+    valid = valid && NNodes0==NNodes1 && NElements0==NElements1 &&
+      fabs(area(batch[i])-1.0)<1e-12;
+
+    pragmatic_mesh_destroy(batch[i]);
+    pragmatic_mesh_destroy(reference[i]);
+  }
+
+  if(verbose)
+    std::cout<<"Batch time:  "<<batch_time<<std::endl
+             <<"Serial time: "<<serial_time<<std::endl;
+
+  if(valid)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  MPI_Finalize();
+
+  return 0;
+}
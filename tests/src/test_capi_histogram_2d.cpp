@@ -0,0 +1,115 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "pragmatic.h"
+#include "unit_square.h"
+
+#include <mpi.h>
+
+// Fraction of the edges whose length is within [1/sqrt(2), sqrt(2)],
+// from a histogram with those bin edges.
+double unit_fraction(pragmatic_mesh_t *mesh, long *nedges){
+  const double edges[] = {0.0, 1.0/sqrt(2.0), sqrt(2.0), 1.0e100};
+  long counts[3];
+  if(pragmatic_mesh_get_edge_length_histogram(mesh, 3, edges, counts)!=0)
+    return -1;
+
+  *nedges = counts[0]+counts[1]+counts[2];
+  return (double)counts[1]/(*nedges);
+}
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  pragmatic_mesh_t *mesh = create_unit_square(20);
+
+  long nedges_before, nedges_after;
+  double before = unit_fraction(mesh, &nedges_before);
+  pragmatic_mesh_adapt(mesh);
+  double after = unit_fraction(mesh, &nedges_after);
+
+  int NNodes, NElements;
+  pragmatic_mesh_get_info(mesh, &NNodes, &NElements);
+
+  const int nbins=10;
+  double edges[nbins+1];
+  for(int i=0;i<=nbins;i++)
+    edges[i] = (double)i/nbins;
+  long counts[nbins];
+  bool valid = pragmatic_mesh_get_quality_histogram(mesh, nbins, edges, counts)==0;
+  long nelements=0;
+  for(int i=0;i<nbins;i++)
+    nelements += counts[i];
+
+  // Invalid bins are rejected.
+  const double decreasing[] = {1.0, 0.0};
+  valid = valid && pragmatic_mesh_get_quality_histogram(mesh, 1, decreasing, counts)==-1 &&
+    pragmatic_mesh_get_edge_length_histogram(mesh, 0, edges, counts)==-1;
+
+  if(verbose){
+    std::cout<<"Edges within [1/sqrt(2), sqrt(2)] before and after adapt: "<<before<<", "<<after<<std::endl
+             <<"Quality:";
+    for(int i=0;i<nbins;i++)
+      std::cout<<" "<<counts[i];
+    std::cout<<std::endl;
+  }
+
+  pragmatic_mesh_destroy(mesh);
+
+  // Adaptation brings edges to unit length. The mesh covers a disc, so
+  // by Euler's formula it has NNodes+NElements-1 edges.
+  if(valid && nelements==NElements && nedges_after==NNodes+NElements-1 && after>0.5 && after>before)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  MPI_Finalize();
+
+  return 0;
+}
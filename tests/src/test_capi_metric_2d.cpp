@@ -0,0 +1,226 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "pragmatic.h"
+#include "ticker.h"
+
+#include <mpi.h>
+
+// Count the edges (i, j) where the metric of j is smaller than the
+// metric of i grown by the gradation, in any of a few directions.
+int count_gradation_violations(pragmatic_mesh_t *handle, double gradation){
+  int NNodes, NElements, stride;
+  pragmatic_mesh_get_info(handle, &NNodes, &NElements);
+  const double *coords = pragmatic_mesh_get_coords_view(handle, &stride);
+  const int *enlist = pragmatic_mesh_get_elements_view(handle, &stride);
+  const double *metric = pragmatic_mesh_get_metric_view(handle, &stride);
+
+  int violations=0;
+  for(int e=0;e<NElements;e++){
+    for(int k=0;k<3;k++){
+      int i = enlist[e*3+k], j = enlist[e*3+(k+1)%3];
+      const double *mi = metric+i*3, *mj = metric+j*3;
+      double dx = coords[j*2]-coords[i*2], dy = coords[j*2+1]-coords[i*2+1];
+      double l = sqrt(mi[0]*dx*dx+2*mi[1]*dx*dy+mi[2]*dy*dy);
+      double eta = 1.0/pow(1.0+l*log(gradation), 2);
+      for(int a=0;a<16;a++){
+        double vx = cos(a*M_PI/16), vy = sin(a*M_PI/16);
+        double qi = mi[0]*vx*vx+2*mi[1]*vx*vy+mi[2]*vy*vy;
+        double qj = mj[0]*vx*vx+2*mj[1]*vx*vy+mj[2]*vy*vy;
+        if(qj<(1.0-1.0e-3)*eta*qi){
+          violations++;
+          break;
+        }
+      }
+    }
+  }
+
+  return violations;
+}
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  // Take a copy of the mesh and its boundary.
+  pragmatic_vtk_init("../data/box200x200.vtu");
+
+  int NNodes, NElements, stride;
+  pragmatic_get_info(&NNodes, &NElements);
+  std::vector<double> coords(pragmatic_get_coords_view(&stride), pragmatic_get_coords_view(&stride)+NNodes*2);
+  std::vector<int> enlist(pragmatic_get_elements_view(&stride), pragmatic_get_elements_view(&stride)+NElements*3);
+
+  std::vector<int> facets, ids;
+  const int *boundary = pragmatic_get_boundary_view(&stride);
+  for(int i=0;i<NElements;i++){
+    for(int j=0;j<3;j++){
+      if(boundary[i*3+j]>0){
+        facets.push_back(enlist[i*3+(j+1)%3]);
+        facets.push_back(enlist[i*3+(j+2)%3]);
+        ids.push_back(boundary[i*3+j]);
+      }
+    }
+  }
+  pragmatic_finalize();
+
+  pragmatic_mesh_t *handle = pragmatic_mesh_create_interleaved(2, NNodes, NElements, &(enlist[0]), &(coords[0]));
+  pragmatic_mesh_set_boundary(handle, ids.size(), &(facets[0]), &(ids[0]));
+
+  bool valid = true;
+
+  // The metric helpers need a metric.
+  valid = valid && pragmatic_mesh_gradate_metric(handle, 1.5)==-1;
+
+  // Hessian of psi = tanh(50*(x-0.5)), a sharp front across x=0.5.
+  std::vector<double> hessian(NNodes*4, 0.0);
+  for(int i=0;i<NNodes;i++){
+    double t = tanh(50*(coords[i*2]-0.5));
+    hessian[i*4] = -2*50*50*t*(1-t*t);
+  }
+  pragmatic_mesh_add_hessian(handle, &(hessian[0]), 0.05, 2);
+  valid = valid && pragmatic_mesh_constrain_metric(handle, 0.005, 0.2, 10.0)==0;
+
+  // Bounds on the eigenvalues.
+  const double *metric = pragmatic_mesh_get_metric_view(handle, &stride);
+  std::vector<double> D(NNodes*2), V(NNodes*4);
+  pragmatic_metric_eig(2, NNodes, metric, &(D[0]), &(V[0]));
+  double max_err=0;
+  for(int i=0;i<NNodes;i++){
+    double dmin = std::min(D[i*2], D[i*2+1]), dmax = std::max(D[i*2], D[i*2+1]);
+    valid = valid && dmin>=(1-1e-6)/(0.2*0.2) && dmax<=(1+1e-6)/(0.005*0.005) && dmax<=(1+1e-6)*100*dmin;
+
+    // V^T D V must give back the metric.
+    const double *v = &(V[i*4]), *d = &(D[i*2]);
+    double m[] = {d[0]*v[0]*v[0]+d[1]*v[2]*v[2],
+                  d[0]*v[0]*v[1]+d[1]*v[2]*v[3],
+                  d[0]*v[1]*v[1]+d[1]*v[3]*v[3]};
+    for(int j=0;j<3;j++)
+      max_err = std::max(max_err, fabs(m[j]-metric[i*3+j])/dmax);
+  }
+  valid = valid && max_err<1e-10;
+
+  // log followed by exp is the identity.
+  std::vector<double> logm(NNodes*3), expm(NNodes*3);
+  double tic = get_wtime();
+  valid = valid && pragmatic_metric_map(2, NNodes, metric, "log", &(logm[0]))==0;
+  double map_time = get_wtime()-tic;
+  valid = valid && pragmatic_metric_map(2, NNodes, &(logm[0]), "exp", &(expm[0]))==0;
+  valid = valid && pragmatic_metric_map(2, NNodes, metric, "cube", &(expm[0]))==-1;
+  double max_map_err=0;
+  for(int i=0;i<NNodes*3;i++)
+    max_map_err = std::max(max_map_err, fabs(expm[i]-metric[i])/fabs(metric[(i/3)*3]));
+  valid = valid && max_map_err<1e-8;
+
+  // Repeated eigenvalues, where the eigenvectors must still be
+  // orthonormal: an isotropic 2D metric, diag(1, 1, 4) rotated, and a
+  // metric within rounding of 2I.
+  double iso[] = {3.0, 0.0, 3.0}, iso_D[2], iso_V[4];
+  pragmatic_metric_eig(2, 1, iso, iso_D, iso_V);
+  double repeated_err = std::max(fabs(iso_D[0]-3.0), fabs(iso_D[1]-3.0));
+  repeated_err = std::max(repeated_err, fabs(iso_V[0]*iso_V[2]+iso_V[1]*iso_V[3]));
+  for(int k=0;k<2;k++)
+    repeated_err = std::max(repeated_err, fabs(iso_V[k*2]*iso_V[k*2]+iso_V[k*2+1]*iso_V[k*2+1]-1.0));
+
+  double c = cos(0.3), s = sin(0.3), ct = cos(0.7), st = sin(0.7);
+  double R[3][3] = {{c, -s*ct, s*st}, {s, c*ct, -c*st}, {0, st, ct}};
+  double d[] = {1.0, 1.0, 4.0};
+  double rotated[6], rotated_log[6], rotated_exp[6];
+  for(int i=0, k=0;i<3;i++)
+    for(int j=i;j<3;j++, k++){
+      rotated[k] = 0.0;
+      for(int l=0;l<3;l++)
+        rotated[k] += R[i][l]*d[l]*R[j][l];
+    }
+  valid = valid && pragmatic_metric_map(3, 1, rotated, "log", rotated_log)==0;
+  valid = valid && pragmatic_metric_map(3, 1, rotated_log, "exp", rotated_exp)==0;
+  for(int k=0;k<6;k++)
+    repeated_err = std::max(repeated_err, fabs(rotated_exp[k]-rotated[k]));
+
+  double near[] = {2.0, 1.0e-17, 0.0, 2.0, 0.0, 2.0}, near_log[6];
+  valid = valid && pragmatic_metric_map(3, 1, near, "log", near_log)==0;
+  const int offdiag[] = {1, 2, 4}, diag[] = {0, 3, 5};
+  for(int k=0;k<3;k++)
+    repeated_err = std::max(repeated_err, std::max(fabs(near_log[offdiag[k]]), fabs(near_log[diag[k]]-log(2.0))));
+  valid = valid && repeated_err<1e-12;
+
+  // Gradation.
+  int violations_before = count_gradation_violations(handle, 1.5);
+  tic = get_wtime();
+  valid = valid && pragmatic_mesh_gradate_metric(handle, 1.5)==0;
+  double gradation_time = get_wtime()-tic;
+  int violations_after = count_gradation_violations(handle, 1.5);
+  valid = valid && violations_before>0 && violations_after==0;
+
+  pragmatic_mesh_adapt(handle);
+  pragmatic_mesh_get_info(handle, &NNodes, &NElements);
+  valid = valid && NElements>0;
+
+  pragmatic_mesh_destroy(handle);
+
+  if(verbose)
+    std::cout<<"Eigen decomposition error:  "<<max_err<<std::endl
+             <<"log/exp error:              "<<max_map_err<<std::endl
+             <<"Repeated eigenvalue error:  "<<repeated_err<<std::endl
+             <<"log time:                   "<<map_time<<std::endl
+             <<"Gradation violations:       "<<violations_before<<" -> "<<violations_after<<std::endl
+             <<"Gradation time:             "<<gradation_time<<std::endl
+             <<"Adapted NNodes, NElements:  "<<NNodes<<", "<<NElements<<std::endl;
+
+  if(valid)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  MPI_Finalize();
+
+  return 0;
+}
@@ -0,0 +1,199 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "pragmatic.h"
+#include "unit_square.h"
+
+#include <mpi.h>
+
+const pragmatic_timer_stats_t *find_timer(const std::vector<pragmatic_timer_stats_t> &timers, const char *name){
+  for(size_t i=0;i<timers.size();i++)
+    if(strcmp(timers[i].name, name)==0)
+      return &(timers[i]);
+  return NULL;
+}
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  pragmatic_reset_stats();
+  pragmatic_start_trace();
+
+  // Hardware counters are often not permitted, in which case there
+  // are none.
+  int nhw = pragmatic_enable_hw_counters();
+  pragmatic_enable_memory_tracking();
+
+  pragmatic_mesh_t *mesh = create_unit_square(40);
+  pragmatic_mesh_adapt(mesh);
+
+  // The adjacency lists hold more than their payload.
+  int nentries = pragmatic_mesh_memory_report(mesh, NULL, 0);
+  std::vector<pragmatic_memory_stats_t> entries(nentries);
+  bool valid = nentries>0 && pragmatic_mesh_memory_report(mesh, &(entries[0]), nentries)==nentries;
+  long long used=0, reserved=0;
+  for(int i=0;i<nentries;i++){
+    if(verbose)
+      std::cout<<entries[i].name<<": "<<entries[i].used<<" used, "<<entries[i].reserved<<" reserved"<<std::endl;
+    if(strcmp(entries[i].name, "NEList")==0 || strcmp(entries[i].name, "ENList")==0)
+      valid = valid && entries[i].used>0 && entries[i].reserved>entries[i].used;
+    used += entries[i].used;
+    reserved += entries[i].reserved;
+  }
+  valid = valid && reserved>=used;
+
+  pragmatic_mesh_destroy(mesh);
+
+  valid = valid && pragmatic_write_trace("test_capi_stats_2d")==0;
+
+  int ncounters=0;
+  while(pragmatic_get_counter_name(ncounters)!=NULL)
+    ncounters++;
+
+  int ntimers = pragmatic_get_stats(NULL, 0, NULL, 0);
+  std::vector<pragmatic_timer_stats_t> timers(ntimers);
+  std::vector<long> counters(ncounters);
+  valid = valid && pragmatic_get_stats(&(timers[0]), ntimers, &(counters[0]), ncounters)==ntimers;
+
+  if(verbose){
+    for(int i=0;i<ntimers;i++)
+      std::cout<<timers[i].name<<": "<<timers[i].calls<<" calls, "<<timers[i].time<<" s (max "<<timers[i].max_time<<" s)"<<std::endl;
+    for(int i=0;i<ncounters;i++)
+      std::cout<<pragmatic_get_counter_name(i)<<": "<<counters[i]<<std::endl;
+    std::cout<<"Hardware counters available: "<<nhw<<std::endl;
+  }
+
+#ifdef HAVE_PROFILING
+  // Every operator was timed.
+  const char *operators[] = {"adapt", "coarsen", "refine", "swap", "smooth", "defragment"};
+  for(int i=0;i<6;i++){
+    const pragmatic_timer_stats_t *timer = find_timer(timers, operators[i]);
+    valid = valid && timer!=NULL && timer->calls>0 && timer->time>=0;
+  }
+
+  // The phases of coarsening lie within it.
+  const pragmatic_timer_stats_t *coarsen = find_timer(timers, "coarsen");
+  double phases=0;
+  for(int i=0;i<ntimers;i++)
+    if(strncmp(timers[i].name, "coarsen/", 8)==0)
+      phases += timers[i].time;
+  valid = valid && coarsen!=NULL && phases>0 && phases<=coarsen->time*1.01+1e-4;
+
+  // Each timer sampled at most the available hardware counters; those
+  // that the kernel never scheduled on the processor read as -1.
+  for(int i=0;i<ntimers;i++){
+    int nsampled=0;
+    for(int j=0;j<PRAGMATIC_NHW_COUNTERS;j++)
+      if(timers[i].hw_counters[j]>=0)
+        nsampled++;
+    valid = valid && nsampled<=nhw;
+  }
+
+  // Refinement grows the mesh, and every operator saw at least the mesh.
+  const pragmatic_timer_stats_t *refine = find_timer(timers, "refine");
+  valid = valid && refine!=NULL && refine->memory_growth>0;
+  for(int i=1;i<6;i++){
+    const pragmatic_timer_stats_t *timer = find_timer(timers, operators[i]);
+    valid = valid && timer!=NULL && timer->memory_peak>=used;
+    if(verbose && timer!=NULL)
+      std::cout<<operators[i]<<" memory: growth "<<timer->memory_growth<<", peak "<<timer->memory_peak<<std::endl;
+  }
+
+  const pragmatic_timer_stats_t *adapt = find_timer(timers, "adapt");
+  for(int j=0;j<PRAGMATIC_NHW_COUNTERS;j++){
+    if(verbose && adapt!=NULL)
+      std::cout<<"adapt "<<pragmatic_get_hw_counter_name(j)<<": "<<adapt->hw_counters[j]<<std::endl;
+    if(strcmp(pragmatic_get_hw_counter_name(j), "instructions")==0)
+      valid = valid && adapt!=NULL && (adapt->hw_counters[j]<0 || adapt->hw_counters[j]>0);
+  }
+
+  // Every mesh operation happened at least once.
+  const char *operations[] = {"collapses", "splits", "flips", "smooth_moves", "colour_rounds"};
+  for(int i=0;i<5;i++)
+    for(int j=0;j<ncounters;j++)
+      if(strcmp(pragmatic_get_counter_name(j), operations[i])==0)
+        valid = valid && counters[j]>0;
+
+  // The trace holds the phases and barriers of each thread.
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  std::ostringstream filename;
+  filename<<"test_capi_stats_2d_"<<rank<<".json";
+  std::ifstream trace(filename.str().c_str());
+  std::string json((std::istreambuf_iterator<char>(trace)), std::istreambuf_iterator<char>());
+  int nevents=0;
+  for(size_t pos=json.find("\"ph\": \"X\""); pos!=std::string::npos; pos=json.find("\"ph\": \"X\"", pos+1))
+    nevents++;
+  valid = valid && json.find("\"traceEvents\"")!=std::string::npos && json.find("\"coarsen/collapse\"")!=std::string::npos &&
+    json.find("\"barrier\"")!=std::string::npos && json.rfind("]}")!=std::string::npos;
+
+  if(verbose)
+    std::cout<<"Trace events: "<<nevents<<std::endl;
+#else
+  valid = valid && ntimers==0;
+#endif
+
+  // Resetting clears everything.
+  pragmatic_reset_stats();
+  valid = valid && pragmatic_get_stats(NULL, 0, &(counters[0]), ncounters)==0;
+  for(int i=0;i<ncounters;i++)
+    valid = valid && counters[i]==0;
+
+  if(valid)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  MPI_Finalize();
+
+  return 0;
+}
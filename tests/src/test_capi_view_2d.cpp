@@ -0,0 +1,165 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "pragmatic.h"
+#include "ticker.h"
+
+#include <mpi.h>
+
+// Check that the views agree with the copy-out functions.
+bool check_views(){
+  int NNodes, NElements;
+  pragmatic_get_info(&NNodes, &NElements);
+
+  int cstride, estride, bstride, mstride;
+  const double *coords = pragmatic_get_coords_view(&cstride);
+  const int *elements = pragmatic_get_elements_view(&estride);
+  const int *boundary = pragmatic_get_boundary_view(&bstride);
+  const double *metric = pragmatic_get_metric_view(&mstride);
+  if(cstride!=2 || estride!=3 || bstride!=3 || mstride!=3 || boundary==NULL)
+    return false;
+
+  std::vector<double> x(NNodes), y(NNodes), m(NNodes*3);
+  std::vector<int> enlist(NElements*3);
+  pragmatic_get_coords_2d(&(x[0]), &(y[0]));
+  pragmatic_get_elements(&(enlist[0]));
+  pragmatic_get_metric(&(m[0]));
+
+  bool valid = memcmp(&(enlist[0]), elements, NElements*3*sizeof(int))==0;
+  for(int i=0;i<NNodes;i++)
+    valid = valid &&
+      x[i]==coords[i*2] && y[i]==coords[i*2+1] &&
+      m[i*3]==metric[i*3] && m[i*3+1]==metric[i*3+1] && m[i*3+2]==metric[i*3+2];
+
+  return valid;
+}
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  pragmatic_vtk_init("../data/box200x200.vtu");
+
+  // Take a copy of the mesh through the views.
+  int NNodes, NElements, stride;
+  pragmatic_get_info(&NNodes, &NElements);
+  std::vector<double> coords(pragmatic_get_coords_view(&stride), pragmatic_get_coords_view(&stride)+NNodes*2);
+  std::vector<int> enlist(pragmatic_get_elements_view(&stride), pragmatic_get_elements_view(&stride)+NElements*3);
+
+  std::vector<int> facets, ids;
+  const int *boundary = pragmatic_get_boundary_view(&stride);
+  for(int i=0;i<NElements;i++){
+    for(int j=0;j<3;j++){
+      if(boundary[i*3+j]>0){
+        facets.push_back(enlist[i*3+(j+1)%3]);
+        facets.push_back(enlist[i*3+(j+2)%3]);
+        ids.push_back(boundary[i*3+j]);
+      }
+    }
+  }
+  pragmatic_finalize();
+
+  // Re-initialise from the interleaved copy and adapt.
+  int dim = 2;
+  pragmatic_init_interleaved(&dim, &NNodes, &NElements, &(enlist[0]), &(coords[0]));
+  int nfacets = ids.size();
+  pragmatic_set_boundary(&nfacets, &(facets[0]), &(ids[0]));
+
+  std::vector<double> psi(NNodes);
+  for(int i=0;i<NNodes;i++)
+    psi[i] = pow(coords[i*2], 3)+pow(coords[i*2+1], 3);
+  double error = 0.001;
+  int pnorm = -1;
+  pragmatic_add_field(&(psi[0]), &error, &pnorm);
+
+  pragmatic_adapt();
+
+  bool valid = check_views();
+
+  // Compare the cost of copying the mesh out with taking views.
+  int nreps = 100;
+  pragmatic_get_info(&NNodes, &NElements);
+  std::vector<double> x(NNodes), y(NNodes);
+  std::vector<int> elements(NElements*3);
+  double tic = get_wtime();
+  for(int i=0;i<nreps;i++){
+    pragmatic_get_coords_2d(&(x[0]), &(y[0]));
+    pragmatic_get_elements(&(elements[0]));
+  }
+  double copy_time = (get_wtime()-tic)/nreps;
+
+  tic = get_wtime();
+  const double *xy=NULL;
+  const int *en=NULL;
+  for(int i=0;i<nreps;i++){
+    xy = pragmatic_get_coords_view(&stride);
+    en = pragmatic_get_elements_view(&stride);
+  }
+  double view_time = (get_wtime()-tic)/nreps;
+  valid = valid && xy!=NULL && en!=NULL;
+
+  pragmatic_finalize();
+
+  if(verbose)
+    std::cout<<"Copy-out time: "<<copy_time<<std::endl
+             <<"View time:     "<<view_time<<std::endl;
+
+  if(valid)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  MPI_Finalize();
+
+  return 0;
+}
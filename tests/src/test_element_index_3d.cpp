@@ -0,0 +1,163 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "VTKTools.h"
+#include "MetricField.h"
+#include "ElementIndex.h"
+
+#include "Refine.h"
+#include "Smooth.h"
+#include "ticker.h"
+
+#include <mpi.h>
+
+// Locate npoints random points in the unit cube and check that each is
+// found, and that the barycentric coordinates reproduce it.
+bool check_index(const Mesh<double> *mesh, const ElementIndex<double> &index, int npoints, bool verbose){
+  std::vector<double> x(npoints*3), bary(npoints*4);
+  std::vector<int> eid(npoints);
+  for(int i=0;i<npoints*3;i++)
+    x[i] = (double)rand()/RAND_MAX;
+
+  double tic = get_wtime();
+  size_t found = index.locate(npoints, &(x[0]), &(eid[0]), &(bary[0]));
+  double toc = get_wtime();
+
+  double max_err=0;
+  for(int i=0;i<npoints;i++){
+    if(eid[i]<0)
+      continue;
+    const index_t *n = mesh->get_element(eid[i]);
+    for(int d=0;d<3;d++){
+      double xi=0;
+      for(int m=0;m<4;m++)
+        xi += bary[i*4+m]*mesh->get_coords(n[m])[d];
+      max_err = std::max(max_err, fabs(xi-x[i*3+d]));
+    }
+  }
+
+  // A point outside the mesh, whose closest element is on the x=1 face.
+  double outside[] = {1.5, 0.5, 0.5}, l[4], lmin;
+  int eid_outside = index.locate(outside, l);
+  int eid_closest = index.closest(outside, l, lmin);
+  double x_closest=0;
+  if(eid_closest>=0){
+    const index_t *n = mesh->get_element(eid_closest);
+    for(int m=0;m<4;m++)
+      x_closest += l[m]*mesh->get_coords(n[m])[0];
+  }
+
+  if(verbose)
+    std::cout<<"Located "<<found<<" of "<<npoints<<" points in "<<toc-tic
+             <<"s, max error "<<max_err<<", outside point in "<<eid_outside
+             <<", closest to it at x="<<x_closest<<std::endl;
+
+  return found==(size_t)npoints && max_err<1e-10 && eid_outside==-1 &&
+    eid_closest>=0 && lmin<0 && fabs(x_closest-1.0)<1e-10;
+}
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box20x20x20.vtu");
+  mesh->create_boundary();
+
+  MetricField<double,3> metric_field(*mesh);
+
+  size_t NNodes = mesh->get_number_nodes();
+  for(size_t i=0;i<NNodes;i++){
+    double x = 2*mesh->get_coords(i)[0] - 1;
+    double h = 0.02+0.1*fabs(x);
+    double m[] = {1.0/pow(h, 2), 0,            0,
+                                 1.0/pow(h, 2), 0,
+                                                1.0/pow(h, 2)};
+    metric_field.set_metric(m, i);
+  }
+  metric_field.update_mesh();
+
+  const int npoints = 100000;
+  bool pass = true;
+
+  ElementIndex<double> index(*mesh);
+  pass = check_index(mesh, index, npoints, verbose) && pass;
+
+  // Moving the vertices only requires the boxes to be refitted.
+  Smooth<double, 3> smooth(*mesh);
+  smooth.smart_laplacian(10);
+  index.refit();
+  pass = check_index(mesh, index, npoints, verbose) && pass;
+
+  // Changing the elements requires a rebuild.
+  Refine<double, 3> refine(*mesh);
+  refine.refine(sqrt(2.0));
+  index.rebuild();
+  size_t NElements=0;
+  for(size_t i=0;i<mesh->get_number_elements();i++)
+    if(mesh->get_element(i)[0]>=0)
+      NElements++;
+  pass = pass && index.get_number_elements()==NElements;
+  pass = check_index(mesh, index, npoints, verbose) && pass;
+
+  std::cout<<"Element index 3D: ";
+  if(pass)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  delete mesh;
+
+  MPI_Finalize();
+
+  return 0;
+}
@@ -0,0 +1,156 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "VTKTools.h"
+#include "MetricField.h"
+#include "FieldTransfer.h"
+
+#include "Coarsen.h"
+#include "Refine.h"
+#include "Smooth.h"
+#include "Swapping.h"
+#include "ticker.h"
+
+#include <mpi.h>
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box200x200.vtu");
+  mesh->create_boundary();
+
+  MetricField<double,2> metric_field(*mesh);
+
+  // Two fields: psi, which the mesh is adapted to, and a linear
+  // field, which must be transferred exactly.
+  size_t NNodes = mesh->get_number_nodes();
+  std::vector<double> fields(NNodes*2);
+  std::vector<double> psi(NNodes);
+  for(size_t i=0;i<NNodes;i++){
+    double x = 2*mesh->get_coords(i)[0]-1;
+    double y = 2*mesh->get_coords(i)[1]-1;
+
+    psi[i] = 0.1*sin(50*x) + atan2(-0.1, (double)(2*x - sin(5*y)));
+    fields[i*2] = psi[i];
+    fields[i*2+1] = 1.0+2.0*x-3.0*y;
+  }
+
+  metric_field.add_field(&(psi[0]), 0.01, 2);
+  metric_field.update_mesh();
+
+  double tic = get_wtime();
+  FieldTransfer<double> transfer(*mesh);
+  double snapshot_time = get_wtime()-tic;
+
+  double L_up = sqrt(2.0);
+  double L_low = L_up/2;
+
+  Coarsen<double, 2> coarsen(*mesh);
+  Smooth<double, 2> smooth(*mesh);
+  Refine<double, 2> refine(*mesh);
+  Swapping<double, 2> swapping(*mesh);
+
+  double L_max = mesh->maximal_edge_length();
+  double alpha = sqrt(2.0)/2;
+  for(size_t i=0;i<10;i++){
+    double L_ref = std::max(alpha*L_max, L_up);
+
+    coarsen.coarsen(L_low, L_ref);
+    swapping.swap(0.7);
+    refine.refine(L_ref);
+
+    L_max = mesh->maximal_edge_length();
+
+    if((L_max-L_up)<0.01)
+      break;
+  }
+
+  mesh->defragment();
+
+  smooth.smart_laplacian(10);
+
+  NNodes = mesh->get_number_nodes();
+  std::vector<double> new_fields(NNodes*2);
+
+  tic = get_wtime();
+  size_t outside = transfer.transfer(*mesh, 2, &(fields[0]), &(new_fields[0]));
+  double transfer_time = get_wtime()-tic;
+
+  double max_error=0, max_psi_error=0;
+  for(size_t i=0;i<NNodes;i++){
+    double x = 2*mesh->get_coords(i)[0]-1;
+    double y = 2*mesh->get_coords(i)[1]-1;
+
+    max_error = std::max(max_error, fabs(new_fields[i*2+1]-(1.0+2.0*x-3.0*y)));
+    max_psi_error = std::max(max_psi_error,
+                             fabs(new_fields[i*2]-(0.1*sin(50*x) + atan2(-0.1, (double)(2*x - sin(5*y))))));
+  }
+
+  if(verbose)
+    std::cout<<"Snapshot time:  "<<snapshot_time<<std::endl
+             <<"Transfer time:  "<<transfer_time<<std::endl
+             <<"Outside:        "<<outside<<std::endl
+             <<"Linear error:   "<<max_error<<std::endl
+             <<"Psi error:      "<<max_psi_error<<std::endl;
+
+  delete mesh;
+
+  if(outside==0 && max_error<1.0e-10)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  MPI_Finalize();
+
+  return 0;
+}
@@ -0,0 +1,126 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "MeshGenerator.h"
+#include "ticker.h"
+
+#include <mpi.h>
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  const int n[] = {40, 30};
+  const double extent[] = {2.0, 1.0};
+  const int ids[] = {7, 8, 9, 10};
+
+  double tic = get_wtime();
+  Mesh<double> *mesh=MeshGenerator<double>::generate_box(2, n, extent, ids, 0.2, 1);
+  double generate_time = get_wtime()-tic;
+
+  bool valid = mesh!=NULL && mesh->verify() &&
+    mesh->get_number_nodes()==(size_t)(n[0]+1)*(n[1]+1) &&
+    mesh->get_number_elements()==(size_t)2*n[0]*n[1];
+
+  // All elements must have the orientation of the first one.
+  size_t NElements = valid?mesh->get_number_elements():0;
+  int inverted=0;
+  if(valid){
+    const int *n0=mesh->get_element(0);
+    ElementProperty<double> property(mesh->get_coords(n0[0]), mesh->get_coords(n0[1]), mesh->get_coords(n0[2]));
+    for(size_t i=0;i<NElements;i++){
+      const int *e=mesh->get_element(i);
+      if(property.area(mesh->get_coords(e[0]), mesh->get_coords(e[1]), mesh->get_coords(e[2]))<=0)
+        inverted++;
+    }
+  }
+
+  // Boundary nodes are not perturbed, so a facet lies on a side of the
+  // box if both of its vertices do.
+  int mislabelled=0;
+  for(size_t i=0;i<NElements;i++){
+    const int *e=mesh->get_element(i);
+    const int *b=mesh->get_boundary(i);
+    for(int j=0;j<3;j++){
+      const double *x0=mesh->get_coords(e[(j+1)%3]);
+      const double *x1=mesh->get_coords(e[(j+2)%3]);
+      int label=0;
+      for(int d=0;d<2;d++){
+        if(x0[d]==0.0 && x1[d]==0.0)
+          label = ids[2*d];
+        else if(x0[d]==extent[d] && x1[d]==extent[d])
+          label = ids[2*d+1];
+      }
+      if(b[j]!=label)
+        mislabelled++;
+    }
+  }
+
+  double area = valid?mesh->calculate_area():0.0;
+
+  if(verbose)
+    std::cout<<"Generate time:     "<<generate_time<<std::endl
+             <<"Area:              "<<area<<std::endl
+             <<"Inverted elements: "<<inverted<<std::endl
+             <<"Mislabelled facets: "<<mislabelled<<std::endl;
+
+  delete mesh;
+
+  if(valid && inverted==0 && mislabelled==0 && fabs(area-extent[0]*extent[1])<1e-12)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  MPI_Finalize();
+
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "VTKTools.h"
+#include "GmshTools.h"
+
+#include "ticker.h"
+
+#include <mpi.h>
+
+// Boundary ID of the edge (n0, n1) of the unit square: 1 to 4 for the
+// sides x=0, x=1, y=0 and y=1, or 0 for an interior edge.
+int side(const Mesh<double> *mesh, index_t n0, index_t n1){
+  const double *x0 = mesh->get_coords(n0);
+  const double *x1 = mesh->get_coords(n1);
+  for(int d=0;d<2;d++){
+    if(fabs(x0[d])<1e-12 && fabs(x1[d])<1e-12)
+      return 2*d+1;
+    if(fabs(x0[d]-1.0)<1e-12 && fabs(x1[d]-1.0)<1e-12)
+      return 2*d+2;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box200x200.vtu");
+
+  // Label each side of the square with its own boundary ID.
+  size_t NElements = mesh->get_number_elements();
+  std::vector<int> facets, ids;
+  for(size_t i=0;i<NElements;i++){
+    const index_t *n = mesh->get_element(i);
+    for(int j=0;j<3;j++){
+      int id = side(mesh, n[(j+1)%3], n[(j+2)%3]);
+      if(id>0){
+        facets.push_back(n[(j+1)%3]);
+        facets.push_back(n[(j+2)%3]);
+        ids.push_back(id);
+      }
+    }
+  }
+  mesh->set_boundary(ids.size(), &(facets[0]), &(ids[0]));
+
+  double tic = get_wtime();
+  bool written = GmshTools<double>::export_gmsh("../data/test_gmsh_2d", mesh);
+  double write_time = get_wtime()-tic;
+
+  tic = get_wtime();
+  Mesh<double> *copy=GmshTools<double>::import_gmsh("../data/test_gmsh_2d.msh");
+  double read_time = get_wtime()-tic;
+
+  bool valid = written && copy!=NULL;
+  if(valid){
+    valid = copy->get_number_nodes()==mesh->get_number_nodes() &&
+      copy->get_number_elements()==NElements &&
+      fabs(copy->calculate_area()-mesh->calculate_area())<1e-12;
+
+    // Every facet must have kept its boundary ID.
+    for(size_t i=0;valid && i<NElements;i++){
+      const index_t *n = copy->get_element(i);
+      for(int j=0;j<3;j++)
+        valid = valid && copy->get_boundary(i)[j]==side(copy, n[(j+1)%3], n[(j+2)%3]);
+    }
+  }
+
+  // A node tag outside the range in the $Nodes header is rejected.
+  std::ifstream in("../data/test_gmsh_2d.msh", std::ios::binary);
+  std::string msh((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  size_t pos = msh.find("$Nodes\n");
+  valid = valid && pos!=std::string::npos;
+  if(valid){
+    size_t header[4];
+    memcpy(header, &(msh[pos+7]), sizeof(header));
+    header[3] = header[2];
+    memcpy(&(msh[pos+7]), header, sizeof(header));
+    std::ofstream out("../data/test_gmsh_2d_bad.msh", std::ios::binary);
+    out.write(msh.data(), msh.size());
+    out.close();
+
+    Mesh<double> *bad=GmshTools<double>::import_gmsh("../data/test_gmsh_2d_bad.msh");
+    valid = bad==NULL;
+    delete bad;
+  }
+
+  if(verbose)
+    std::cout<<"Write time: "<<write_time<<std::endl
+             <<"Read time:  "<<read_time<<std::endl;
+
+  delete mesh;
+  delete copy;
+
+  if(valid)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  MPI_Finalize();
+
+  return 0;
+}
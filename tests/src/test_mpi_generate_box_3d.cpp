@@ -0,0 +1,153 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "MeshGenerator.h"
+#include "ticker.h"
+
+#include <mpi.h>
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  const int n[] = {12, 10, 8};
+  const double extent[] = {1.0, 2.0, 3.0};
+
+  double tic = get_wtime();
+  Mesh<double> *mesh=MeshGenerator<double>::generate_box(3, n, extent, NULL, 0.15, 1, MPI_COMM_WORLD);
+  double generate_time = get_wtime()-tic;
+
+  int valid = mesh!=NULL && mesh->verify();
+
+  // All elements must have the orientation of the first one.
+  size_t NElements = valid?mesh->get_number_elements():0;
+  int inverted=0;
+  if(valid){
+    const int *n0=mesh->get_element(0);
+    ElementProperty<double> property(mesh->get_coords(n0[0]), mesh->get_coords(n0[1]),
+                                     mesh->get_coords(n0[2]), mesh->get_coords(n0[3]));
+    for(size_t i=0;i<NElements;i++){
+      const int *e=mesh->get_element(i);
+      if(property.volume(mesh->get_coords(e[0]), mesh->get_coords(e[1]),
+                         mesh->get_coords(e[2]), mesh->get_coords(e[3]))<=0)
+        inverted++;
+    }
+  }
+
+  // Boundary nodes are not perturbed, so a facet lies on a side of the
+  // box if all of its vertices do. Facets without an owned vertex are
+  // halo facets.
+  int mislabelled=0;
+  for(size_t i=0;i<NElements;i++){
+    const int *e=mesh->get_element(i);
+    const int *b=mesh->get_boundary(i);
+    for(int j=0;j<4;j++){
+      int label=0;
+      bool owned=false;
+      for(int d=0;d<3;d++){
+        bool lower=true, upper=true;
+        for(int k=1;k<4;k++){
+          const double *x=mesh->get_coords(e[(j+k)%4]);
+          lower = lower && x[d]==0.0;
+          upper = upper && x[d]==extent[d];
+          owned = owned || mesh->is_owned_node(e[(j+k)%4]);
+        }
+        if(lower)
+          label = 2*d+1;
+        else if(upper)
+          label = 2*d+2;
+      }
+      if(!owned)
+        label = -1;
+      if(b[j]!=label)
+        mislabelled++;
+    }
+  }
+
+  MeshStatistics stats;
+  if(valid)
+    mesh->compute_statistics(stats);
+
+  MPI_Allreduce(MPI_IN_PLACE, &valid, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, &inverted, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, &mislabelled, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, &generate_time, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+  long nnodes = (long)(n[0]+1)*(n[1]+1)*(n[2]+1);
+  long nelements = 6L*n[0]*n[1]*n[2];
+  double volume = extent[0]*extent[1]*extent[2];
+
+  if(verbose && rank==0)
+    std::cout<<"Generate time:      "<<generate_time<<std::endl
+             <<"Number elements:    "<<stats.nelements()<<std::endl
+             <<"Number vertices:    "<<stats.nnodes()<<std::endl
+             <<"Volume:             "<<stats.volume()<<std::endl
+             <<"Inverted elements:  "<<inverted<<std::endl
+             <<"Mislabelled facets: "<<mislabelled<<std::endl;
+
+  delete mesh;
+
+  if(rank==0){
+    if(valid && inverted==0 && mislabelled==0 && stats.nnodes()==nnodes && stats.nelements()==nelements &&
+       fabs(stats.volume()-volume)<1e-12)
+      std::cout<<"pass"<<std::endl;
+    else
+      std::cout<<"fail"<<std::endl;
+  }
+
+  MPI_Finalize();
+
+  return 0;
+}
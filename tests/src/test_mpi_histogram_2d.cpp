@@ -0,0 +1,142 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "MeshGenerator.h"
+#include "MetricField.h"
+
+#include "Refine.h"
+#include "ticker.h"
+
+#include <mpi.h>
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  const int n[] = {20, 20};
+  Mesh<double> *mesh=MeshGenerator<double>::generate_box(2, n, NULL, NULL, 0.0, 0, MPI_COMM_WORLD);
+
+  MetricField<double, 2> metric_field(*mesh);
+
+  size_t NNodes = mesh->get_number_nodes();
+  std::vector<double> psi(NNodes);
+  for(size_t i=0;i<NNodes;i++)
+    psi[i] = pow(mesh->get_coords(i)[0], 4) + pow(mesh->get_coords(i)[1], 4);
+
+  metric_field.add_field(&(psi[0]), 0.001);
+  metric_field.update_mesh();
+
+  Refine<double, 2> adapt(*mesh);
+  adapt.refine(sqrt(2.0));
+
+  const int nbins=20;
+  std::vector<double> quality_edges(nbins+1), length_edges(nbins+1);
+  for(int i=0;i<=nbins;i++){
+    quality_edges[i] = (double)i/nbins;
+    length_edges[i] = 0.1*i;
+  }
+
+  double tic = get_wtime();
+  std::vector<long> quality_counts(nbins), length_counts(nbins);
+  mesh->get_quality_histogram(nbins, &(quality_edges[0]), &(quality_counts[0]));
+  mesh->get_edge_length_histogram(nbins, &(length_edges[0]), &(length_counts[0]));
+  double toc = get_wtime();
+
+  MeshStatistics stats;
+  mesh->compute_statistics(stats);
+
+  // A single bin catches everything.
+  const double narrow[] = {0.5, 0.6};
+  long all_elements, all_edges;
+  mesh->get_quality_histogram(1, narrow, &all_elements);
+  mesh->get_edge_length_histogram(1, narrow, &all_edges);
+
+  // Every element and edge is counted once, and the extreme values
+  // fall in the outermost occupied bins.
+  long nelements=0, nedges=0;
+  int qbin=-1, lbin=-1;
+  for(int i=0;i<nbins;i++){
+    nelements += quality_counts[i];
+    nedges += length_counts[i];
+    if(qbin<0 && quality_counts[i]>0)
+      qbin = i;
+    if(length_counts[i]>0)
+      lbin = i;
+  }
+
+  bool valid = nelements==stats.nelements() && nedges==stats.nedges() &&
+    all_elements==nelements && all_edges==nedges &&
+    qbin>=0 && quality_edges[qbin]<=stats.qmin() && stats.qmin()<quality_edges[qbin+1] &&
+    lbin>=0 && length_edges[lbin]<=stats.lmax() && (lbin==nbins-1 || stats.lmax()<length_edges[lbin+1]);
+
+  if(verbose){
+    if(rank==0)
+      std::cout<<"Histogram time: "<<toc-tic<<std::endl;
+    mesh->print_quality();
+  }
+
+  delete mesh;
+
+  if(rank==0){
+    if(valid)
+      std::cout<<"pass"<<std::endl;
+    else
+      std::cout<<"fail"<<std::endl;
+  }
+
+  MPI_Finalize();
+
+  return 0;
+}
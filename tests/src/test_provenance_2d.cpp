@@ -0,0 +1,155 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "VTKTools.h"
+#include "MetricField.h"
+
+#include "Coarsen.h"
+#include "Refine.h"
+#include "Smooth.h"
+#include "Swapping.h"
+#include "ticker.h"
+
+#include <mpi.h>
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box200x200.vtu");
+  mesh->create_boundary();
+
+  MetricField<double,2> metric_field(*mesh);
+
+  // A linear field, which must be carried through exactly, and a
+  // vector field.
+  size_t NNodes = mesh->get_number_nodes();
+  std::vector<double> psi(NNodes), linear(NNodes), vec(NNodes*2);
+  for(size_t i=0;i<NNodes;i++){
+    double x = 2*mesh->get_coords(i)[0]-1;
+    double y = 2*mesh->get_coords(i)[1]-1;
+
+    psi[i] = 0.1*sin(50*x) + atan2(-0.1, (double)(2*x - sin(5*y)));
+    linear[i] = 1.0+2.0*x-3.0*y;
+    vec[i*2] = x;
+    vec[i*2+1] = y;
+  }
+
+  metric_field.add_field(&(psi[0]), 0.01, 2);
+  metric_field.update_mesh();
+
+  mesh->attach_field(linear);
+  mesh->attach_field(vec, 2);
+
+  double L_up = sqrt(2.0);
+  double L_low = L_up/2;
+
+  Coarsen<double, 2> coarsen(*mesh);
+  Smooth<double, 2> smooth(*mesh);
+  Refine<double, 2> refine(*mesh);
+  Swapping<double, 2> swapping(*mesh);
+
+  double L_max = mesh->maximal_edge_length();
+  double alpha = sqrt(2.0)/2;
+  for(size_t i=0;i<10;i++){
+    double L_ref = std::max(alpha*L_max, L_up);
+
+    coarsen.coarsen(L_low, L_ref);
+    swapping.swap(0.7);
+    refine.refine(L_ref);
+
+    L_max = mesh->maximal_edge_length();
+
+    if((L_max-L_up)<0.01)
+      break;
+  }
+
+  mesh->defragment();
+
+  smooth.smart_laplacian(10);
+  smooth.optimisation_linf(10);
+
+  size_t nrecords = mesh->get_provenance()->size();
+
+  double tic = get_wtime();
+  mesh->transfer_fields();
+  double transfer_time = get_wtime()-tic;
+
+  NNodes = mesh->get_number_nodes();
+  double max_error=0;
+  for(size_t i=0;i<NNodes;i++){
+    double x = 2*mesh->get_coords(i)[0]-1;
+    double y = 2*mesh->get_coords(i)[1]-1;
+
+    max_error = std::max(max_error, fabs(linear[i]-(1.0+2.0*x-3.0*y)));
+    max_error = std::max(max_error, std::max(fabs(vec[i*2]-x), fabs(vec[i*2+1]-y)));
+  }
+
+  if(verbose)
+    std::cout<<"Records:        "<<nrecords<<std::endl
+             <<"Transfer time:  "<<transfer_time<<std::endl
+             <<"Error:          "<<max_error<<std::endl;
+
+  bool valid = linear.size()==NNodes && vec.size()==NNodes*2 &&
+    mesh->get_provenance()->size()==0 && max_error<1.0e-10;
+
+  delete mesh;
+
+  if(valid)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  MPI_Finalize();
+
+  return 0;
+}
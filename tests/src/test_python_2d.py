@@ -0,0 +1,128 @@
+#!/usr/bin/env python
+
+# Copyright (C) 2010 Imperial College London and others.
+#
+# Please see the AUTHORS file in the main source directory for a
+# full list of copyright holders.
+#
+# Gerard Gorman
+# Applied Modelling and Computation Group
+# Department of Earth Science and Engineering
+# Imperial College London
+#
+# g.gorman@imperial.ac.uk
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+# notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above
+# copyright notice, this list of conditions and the following
+# disclaimer in the documentation and/or other materials provided
+# with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+# CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+# INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+# BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+# TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+# THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+"""Smoke test of the ctypes interface in python/pragmatic.py: create a
+mesh of the unit square, add the metric of a field, adapt, and read the
+mesh back through the views. The library is found via PRAGMATIC_LIBRARY
+and the module via PYTHONPATH, which the test target sets."""
+
+from __future__ import print_function
+
+import ctypes
+import numpy
+
+import pragmatic
+
+def report(name, ok, detail=""):
+  print("%s: %s %s" % (name, "pass" if ok else "fail", detail))
+
+def unit_square(n):
+  x, y = numpy.meshgrid(numpy.linspace(0.0, 1.0, n+1), numpy.linspace(0.0, 1.0, n+1))
+  coords = numpy.column_stack((x.ravel(), y.ravel()))
+  elements = []
+  for j in range(n):
+    for i in range(n):
+      v = j*(n+1)+i
+      elements.append((v, v+1, v+n+2))
+      elements.append((v, v+n+2, v+n+1))
+  facets = []
+  ids = []
+  for i in range(n):
+    facets += [(i, i+1), (n*(n+1)+i, n*(n+1)+i+1), (i*(n+1), (i+1)*(n+1)), (i*(n+1)+n, (i+1)*(n+1)+n)]
+    ids += [1, 2, 3, 4]
+  return coords, numpy.array(elements), numpy.array(facets), numpy.array(ids)
+
+def field(coords):
+  return 0.1*numpy.sin(50*coords[:, 0]) + numpy.arctan2(-0.1, 2*coords[:, 0]-numpy.sin(5*coords[:, 1]))
+
+def main():
+  # With an MPI build the library needs MPI to be initialised. Without
+  # mpi4py, call MPI_Init through the library's own MPI.
+  finalize = None
+  if not hasattr(pragmatic, "MPI") and hasattr(pragmatic._lib, "MPI_Initialized"):
+    initialized = ctypes.c_int()
+    pragmatic._lib.MPI_Initialized(ctypes.byref(initialized))
+    if not initialized.value:
+      pragmatic._lib.MPI_Init(None, None)
+      finalize = pragmatic._lib.MPI_Finalize
+
+  coords, elements, facets, ids = unit_square(20)
+  mesh = pragmatic.Mesh(coords, elements)
+  mesh.set_boundary(facets, ids)
+
+  NNodes, NElements = mesh.get_info()
+  report("Create mesh", NNodes==len(coords) and NElements==len(elements) and numpy.array_equal(mesh.coords, coords),
+         "(NNodes=%d, NElements=%d)" % (NNodes, NElements))
+
+  psi = field(coords)
+  mesh.add_field(psi, 0.01)
+  mesh.constrain_metric(min_edge_length=0.002, max_edge_length=0.5)
+  metric = mesh.metric
+  report("Add field", metric.shape==(NNodes, 3) and numpy.all(numpy.isfinite(metric)) and numpy.all(metric[:, 0]>0))
+
+  mesh.snapshot()
+  mesh.adapt()
+  NNodes, NElements = mesh.get_info()
+  coords = mesh.coords
+  elements = mesh.elements
+  boundary = mesh.boundary
+  report("Adapt", NNodes>0 and NElements>0 and coords.shape==(NNodes, 2) and elements.shape==(NElements, 3),
+         "(NNodes=%d, NElements=%d)" % (NNodes, NElements))
+
+  # Every element is live and references a live node, and the four
+  # sides of the square are still tagged.
+  report("Elements view", elements.min()>=0 and elements.max()<NNodes)
+  report("Boundary view", boundary.shape==(NElements, 3) and set(ids).issubset(set(boundary.ravel())))
+
+  x = coords[:, 0]
+  y = coords[:, 1]
+  area = 0.5*numpy.abs((x[elements[:, 1]]-x[elements[:, 0]])*(y[elements[:, 2]]-y[elements[:, 0]]) -
+                       (x[elements[:, 2]]-x[elements[:, 0]])*(y[elements[:, 1]]-y[elements[:, 0]]))
+  report("Area", abs(area.sum()-1.0)<1e-10, "(area=%g)" % area.sum())
+
+  # Linear interpolation from the snapshot reproduces a linear field.
+  old = unit_square(20)[0]
+  err = numpy.abs(mesh.interpolate(1+2*old[:, 0]-3*old[:, 1])-(1+2*x-3*y)).max()
+  report("Interpolate", err<1e-10, "(max error=%g)" % err)
+
+  mesh.destroy()
+  if finalize is not None:
+    finalize()
+
+if __name__=="__main__":
+  main()
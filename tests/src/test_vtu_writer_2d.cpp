@@ -0,0 +1,131 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "VTKTools.h"
+#include "VTUWriter.h"
+#include "MetricField.h"
+
+#include "ticker.h"
+
+#include <mpi.h>
+
+int main(int argc, char **argv){
+  int required_thread_support=MPI_THREAD_SINGLE;
+  int provided_thread_support;
+  MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+  assert(required_thread_support==provided_thread_support);
+
+  bool verbose = false;
+  if(argc>1){
+    verbose = std::string(argv[1])=="-v";
+  }
+
+  Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box200x200.vtu");
+  mesh->create_boundary();
+
+  MetricField<double, 2> metric_field(*mesh);
+
+  size_t NNodes = mesh->get_number_nodes();
+  std::vector<double> psi(NNodes);
+  for(size_t i=0;i<NNodes;i++){
+    double x = mesh->get_coords(i)[0];
+    double y = mesh->get_coords(i)[1];
+    psi[i] = x*x*x+y*y*y;
+  }
+  metric_field.add_field(&(psi[0]), 0.001);
+  metric_field.update_mesh();
+
+  size_t NElements = mesh->get_number_elements();
+
+  // Write the mesh in every encoding and read it back with VTK.
+  const char *names[] = {"raw", "base64", "raw_zlib", "base64_zlib"};
+  bool valid = true;
+  for(int i=0;i<4;i++){
+    VTUWriter<double>::Encoding encoding = (i%2==0)?VTUWriter<double>::APPENDED_RAW:VTUWriter<double>::BASE64;
+    bool compress = i>=2;
+#ifndef HAVE_ZLIB
+    if(compress)
+      continue;
+#endif
+
+    std::string basename = std::string("../data/test_vtu_writer_2d_")+names[i];
+    double tic = get_wtime();
+    valid = VTUWriter<double>::export_vtu(basename.c_str(), mesh, &(psi[0]), VTUWriter<double>::ALL_FIELDS, encoding, compress) && valid;
+    double toc = get_wtime();
+
+    vtkSmartPointer<vtkXMLUnstructuredGridReader> reader = vtkSmartPointer<vtkXMLUnstructuredGridReader>::New();
+    reader->SetFileName((basename+".vtu").c_str());
+    reader->Update();
+    vtkUnstructuredGrid *ug = reader->GetOutput();
+
+    valid = valid && ug->GetNumberOfPoints()==(vtkIdType)NNodes && ug->GetNumberOfCells()==(vtkIdType)NElements;
+    for(size_t j=0;valid && j<NNodes;j++){
+      double *r = ug->GetPoint(j);
+      valid = r[0]==mesh->get_coords(j)[0] && r[1]==mesh->get_coords(j)[1] &&
+        ug->GetPointData()->GetArray("psi")->GetTuple1(j)==psi[j];
+    }
+    for(size_t j=0;valid && j<NElements;j++){
+      vtkCell *cell = ug->GetCell(j);
+      const index_t *n = mesh->get_element(j);
+      valid = cell->GetCellType()==VTK_TRIANGLE;
+      for(int k=0;valid && k<3;k++)
+        valid = cell->GetPointId(k)==n[k];
+    }
+    valid = valid && ug->GetCellData()->GetArray("quality")!=NULL && ug->GetPointData()->GetArray("Metric")!=NULL;
+
+    if(verbose)
+      std::cout<<"VTU write time ("<<names[i]<<"): "<<toc-tic<<std::endl;
+  }
+
+  delete mesh;
+
+  if(valid)
+    std::cout<<"pass"<<std::endl;
+  else
+    std::cout<<"fail"<<std::endl;
+
+  MPI_Finalize();
+
+  return 0;
+}